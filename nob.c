@@ -1,37 +1,311 @@
 #define NOB_IMPLEMENTATION
+// Optional parts, kept when nob rebuilds itself:
+//   cc -DFAROL_GCCJIT nob.c -o nob -lgccjit   native interpreter tier
+//   cc -DFAROL_LUA nob.c -o nob -llua         Lua search strategies
+//   cc -DFAROL_Z3 nob.c -o nob -lz3 -lpthread SMT path conditions, BMC
+#ifdef FAROL_GCCJIT
+#define FAROL_GCCJIT_FLAGS "-DFAROL_GCCJIT",
+#define FAROL_GCCJIT_LIBS "-lgccjit",
+#else
+#define FAROL_GCCJIT_FLAGS
+#define FAROL_GCCJIT_LIBS
+#endif
+#ifdef FAROL_LUA
+#define FAROL_LUA_FLAGS "-DFAROL_LUA",
+#define FAROL_LUA_LIBS "-llua", "-lm",
+#else
+#define FAROL_LUA_FLAGS
+#define FAROL_LUA_LIBS
+#endif
+#ifdef FAROL_Z3
+#define FAROL_Z3_FLAGS "-DFAROL_Z3",
+#define FAROL_Z3_LIBS "-lz3", "-lpthread",
+#else
+#define FAROL_Z3_FLAGS
+#define FAROL_Z3_LIBS
+#endif
+#define NOB_REBUILD_URSELF(binary_path, source_path)                         \
+  "cc", FAROL_GCCJIT_FLAGS FAROL_LUA_FLAGS FAROL_Z3_FLAGS "-o", binary_path, \
+      source_path, FAROL_GCCJIT_LIBS FAROL_LUA_LIBS FAROL_Z3_LIBS
 #include "nob.h"
 
 #define BUILD_FOLDER "build/"
 #define SRC_FOLDER "src/"
 
+#define BENCH_IMPL
+#include "src/bench.h"
+#define STATS_IMPL
+#include "src/stats.h"
 #define STRING_INTERNER_IMPL
 #include "src/string_interner.h"
+#define SHARED_INTERNER_IMPL
+#include "src/shared_interner.h"
+#define IREP_IMPL
+#include "src/irep.h"
+#define GOTO_BINARY_IMPL
+#include "src/goto_binary.h"
+#define GOTO_LINK_IMPL
+#include "src/goto_link.h"
+#define U64_MAP_IMPL
+#include "src/u64_map.h"
+#define GOTO_WRITER_IMPL
+#include "src/goto_writer.h"
+#define BYTECODE_IMPL
+#include "src/bytecode.h"
+#define SIMPLIFIER_IMPL
+#include "src/simplifier.h"
+#define SLICER_IMPL
+#include "src/slicer.h"
+#define ABSINT_IMPL
+#include "src/absint.h"
+#define SSA_EQUATION_IMPL
+#include "src/ssa_equation.h"
+#define CODE_CACHE_IMPL
+#include "src/code_cache.h"
+#define HAMT_IMPL
+#include "src/hamt.h"
+#define MEMORY_IMPL
+#include "src/memory.h"
+#define SYMEX_STATE_IMPL
+#include "src/symex_state.h"
+#define SYMEX_SCHEDULER_IMPL
+#include "src/symex_scheduler.h"
+#define WITNESS_IMPL
+#include "src/witness.h"
+#ifdef FAROL_LUA
+#define SYMEX_LUA_IMPL
+#include "src/symex_lua.h"
+#endif
+#ifdef FAROL_Z3
+#define SMT_IMPL
+#include "src/smt.h"
+#define SMT_PORTFOLIO_IMPL
+#include "src/smt_portfolio.h"
+#define SMT_CACHE_IMPL
+#include "src/smt_cache.h"
+#define BMC_IMPL
+#include "src/bmc.h"
+#endif
+#ifdef FAROL_GCCJIT
+#define BYTECODE_JIT_IMPL
+#include "src/bytecode_jit.h"
+#endif
 
 
 uint64_t run_tests() {
   uint64_t errors = 0;
+  errors += stats_tests();
   errors += string_interner_tests();
+  errors += shared_interner_tests();
+  errors += irep_tests();
+  errors += goto_binary_tests();
+  errors += goto_link_tests();
+  errors += u64_map_tests();
+  errors += goto_writer_tests();
+  errors += bytecode_tests();
+  errors += simplifier_tests();
+  errors += slicer_tests();
+  errors += absint_tests();
+  errors += ssa_equation_tests();
+  errors += code_cache_tests();
+  errors += hamt_tests();
+  errors += memory_tests();
+  errors += symex_state_tests();
+  errors += symex_scheduler_tests();
+  errors += witness_tests();
+#ifdef FAROL_LUA
+  errors += symex_lua_tests();
+#endif
+#ifdef FAROL_Z3
+  errors += smt_tests();
+  errors += smt_cache_tests();
+  errors += smt_portfolio_tests();
+  errors += bmc_tests();
+#endif
+#ifdef FAROL_GCCJIT
+  errors += bytecode_jit_tests();
+#endif
   return errors;
 }
 
+// How farol is built, ./nob [debug | release | pgo [TRAINING_FILE...]]
+typedef enum {
+  PROFILE_DEFAULT,      // warnings, no optimization
+  PROFILE_DEBUG,        // -g, address and undefined behaviour sanitizers
+  PROFILE_RELEASE,      // -O3 -march=native and LTO
+  PROFILE_PGO_GENERATE, // release, instrumented to write a profile
+  PROFILE_PGO_USE,      // release, optimized by that profile
+  PROFILE_BENCH,        // release, counting allocations for ./nob bench
+} build_profile;
+
+#define PGO_FOLDER BUILD_FOLDER "pgo/"
+#define PGO_PROFILE_FOLDER PGO_FOLDER "profile"
+#define BENCH_FOLDER BUILD_FOLDER "bench/"
+
+static void profile_flags(Nob_Cmd *cmd, build_profile profile) {
+  switch (profile) {
+  case PROFILE_DEFAULT:
+    break;
+  case PROFILE_DEBUG:
+    nob_cmd_append(cmd, "-O0", "-g", "-fno-omit-frame-pointer",
+                   "-fsanitize=address,undefined");
+    break;
+  case PROFILE_RELEASE:
+  case PROFILE_PGO_GENERATE:
+  case PROFILE_PGO_USE:
+  case PROFILE_BENCH:
+    // Flags go to the link too, that is where LTO compiles
+    nob_cmd_append(cmd, "-O3", "-march=native", "-flto=auto");
+    break;
+  }
+  if (profile == PROFILE_BENCH)
+    nob_cmd_append(cmd, "-DBENCH_COUNT_ALLOCATIONS");
+  // Counters are shared by the interner's and the linker's threads. The
+  // training does not reach everything, what it did not run is optimized
+  // as without a profile rather than for size.
+  if (profile == PROFILE_PGO_GENERATE)
+    nob_cmd_append(cmd, "-fprofile-generate=" PGO_PROFILE_FOLDER,
+                   "-fprofile-update=atomic");
+  if (profile == PROFILE_PGO_USE)
+    nob_cmd_append(cmd, "-fprofile-use=" PGO_PROFILE_FOLDER,
+                   "-fprofile-partial-training");
+}
+
+// farol is one unit, src/main.c including every header with its
+// implementation. Its object goes to folder, farol to output. It is only
+// compiled again when it, a header, this file or nob changed, or always for
+// force. The optional parts nob was built with that farol uses are built
+// into it too.
+static bool build_farol(build_profile profile, const char *folder,
+                        const char *output, bool force) {
+  if (!nob_mkdir_if_not_exists(folder))
+    return false;
+
+  // It includes every header, any of them may have changed
+  Nob_File_Paths inputs = {0};
+  Nob_File_Paths children = {0};
+  if (!nob_read_entire_dir(SRC_FOLDER, &children))
+    return false;
+  nob_da_append(&inputs, SRC_FOLDER "main.c");
+  nob_da_append(&inputs, "nob.c");
+  nob_da_append(&inputs, "nob");
+  for (size_t i = 0; i < children.count; i++)
+    if (nob_sv_end_with(nob_sv_from_cstr(children.items[i]), ".h"))
+      nob_da_append(&inputs, nob_temp_sprintf(SRC_FOLDER "%s", children.items[i]));
+
+  bool result = true;
+  Nob_Cmd cmd = {0};
+  const char *object = nob_temp_sprintf("%smain.o", folder);
+  int rebuild = force ? 1 : nob_needs_rebuild(object, inputs.items,
+                                              inputs.count);
+  if (rebuild < 0)
+    nob_return_defer(false);
+  if (rebuild) {
+    nob_cc(&cmd);
+    nob_cc_flags(&cmd);
+    profile_flags(&cmd, profile);
+    nob_cmd_append(&cmd, FAROL_Z3_FLAGS "-c");
+    nob_cc_output(&cmd, object);
+    nob_cc_inputs(&cmd, inputs.items[0]);
+    if (!nob_cmd_run(&cmd))
+      nob_return_defer(false);
+  } else if (nob_file_exists(output)) {
+    nob_return_defer(true);
+  }
+
+  nob_cc(&cmd);
+  nob_cc_flags(&cmd);
+  profile_flags(&cmd, profile);
+  nob_cc_output(&cmd, output);
+  nob_cc_inputs(&cmd, object);
+#ifdef FAROL_Z3
+  nob_cmd_append(&cmd, FAROL_Z3_LIBS);
+#endif
+  if (!nob_cmd_run(&cmd))
+    nob_return_defer(false);
+
+defer:
+  nob_cmd_free(cmd);
+  nob_da_free(inputs);
+  nob_da_free(children);
+  return result;
+}
+
+// Instrumented build, its training runs, then the build the profile
+// optimizes. The training is farol --bench, every suite ./nob bench runs,
+// then loading each of files, which should be GOTO binaries like the ones
+// farol is meant for. Benchmarks filtered out would go untrained.
+static bool build_pgo(const char **files, size_t count) {
+  if (!nob_mkdir_if_not_exists(PGO_FOLDER) ||
+      !nob_mkdir_if_not_exists(PGO_PROFILE_FOLDER))
+    return false;
+  // Counts of an older training would add up with the new ones
+  Nob_File_Paths profiles = {0};
+  if (!nob_read_entire_dir(PGO_PROFILE_FOLDER, &profiles))
+    return false;
+  for (size_t i = 0; i < profiles.count; i++)
+    if (nob_sv_end_with(nob_sv_from_cstr(profiles.items[i]), ".gcda"))
+      nob_delete_file(
+          nob_temp_sprintf(PGO_PROFILE_FOLDER "/%s", profiles.items[i]));
+  nob_da_free(profiles);
+
+  // Both stages write the same objects, which is what profiles are keyed by
+  if (!build_farol(PROFILE_PGO_GENERATE, PGO_FOLDER, PGO_FOLDER "farol-train",
+                   true))
+    return false;
+  Nob_Cmd cmd = {0};
+  nob_cmd_append(&cmd, PGO_FOLDER "farol-train", "--bench");
+  bool trained = nob_cmd_run(&cmd);
+  for (size_t i = 0; trained && i < count; i++) {
+    nob_cmd_append(&cmd, PGO_FOLDER "farol-train", files[i]);
+    trained = nob_cmd_run(&cmd);
+  }
+  nob_cmd_free(cmd);
+  return trained &&
+         build_farol(PROFILE_PGO_USE, PGO_FOLDER, PGO_FOLDER "farol", true);
+}
+
 int main(int argc, char **argv) {
   NOB_GO_REBUILD_URSELF(argc, argv);
 
   if (argc == 2 && !strcmp(argv[1], "test")) {
     uint64_t errors = run_tests();
+#ifdef FAROL_Z3
+    // Joins the threads Z3 times solvers out with, before exit frees what
+    // they use
+    Z3_finalize_memory();
+#endif
     printf("\nIdentified %lu failures\n", errors);
     return errors;
   }
-  
-  if (!nob_mkdir_if_not_exists(BUILD_FOLDER))
-    return 1;
-  Nob_Cmd cmd = {0};
 
-  nob_cc(&cmd);
-  nob_cc_flags(&cmd);
-  nob_cc_output(&cmd, BUILD_FOLDER "farol");
-  nob_cc_inputs(&cmd, SRC_FOLDER "main.c");
+  // bench [--save FILE] [--baseline FILE] [CASE] runs farol --bench, built
+  // as for release and counting allocations, and fails when cases are more
+  // than 10% slower than the baseline
+  if (argc >= 2 && !strcmp(argv[1], "bench")) {
+    if (!build_farol(PROFILE_BENCH, BENCH_FOLDER, BENCH_FOLDER "farol", false))
+      return 1;
+    Nob_Cmd cmd = {0};
+    nob_cmd_append(&cmd, BENCH_FOLDER "farol", "--bench");
+    nob_da_append_many(&cmd, argv + 2, argc - 2);
+    bool ok = nob_cmd_run(&cmd);
+    nob_cmd_free(cmd);
+    return !ok;
+  }
 
-  if (!nob_cmd_run(&cmd))
+  if (argc >= 2 && !strcmp(argv[1], "pgo"))
+    return !build_pgo((const char **)argv + 2, argc - 2);
+  if (argc == 2 && !strcmp(argv[1], "debug"))
+    return !build_farol(PROFILE_DEBUG, BUILD_FOLDER "debug/",
+                        BUILD_FOLDER "debug/farol", false);
+  if (argc == 2 && !strcmp(argv[1], "release"))
+    return !build_farol(PROFILE_RELEASE, BUILD_FOLDER "release/",
+                        BUILD_FOLDER "release/farol", false);
+  if (argc > 1) {
+    nob_log(NOB_ERROR, "usage: %s [test | bench | debug | release | pgo]",
+            argv[0]);
     return 1;
+  }
+  return !build_farol(PROFILE_DEFAULT, BUILD_FOLDER, BUILD_FOLDER "farol",
+                      false);
 }
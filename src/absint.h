@@ -0,0 +1,1206 @@
+#ifndef ABSINT_H
+#define ABSINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bytecode.h"
+
+// Abstract interpreter over lowered bytecode, cheap enough to run before
+// every symex: it proves the assertions that hold for reasons a value
+// analysis sees, without a solver, and bounds counting loops for the
+// unwinder.
+//
+// Functions are analyzed one at a time. Blocks go through a worklist in
+// bytecode order, joining into the state at their start and widening at loop
+// heads, then two descending passes take back what widening gave away.
+// Conditional jumps and assumptions refine the variables their comparison
+// reads. Parameters, globals and locals start unknown, and a call forgets
+// every global. Each block is walked a small number of times, so the cost is
+// close to linear in the size of the code.
+//
+// The domain is pluggable. Values are fixed size blobs the analyzer copies
+// around and only the domain looks into; absint_intervals, the default,
+// keeps an interval per variable.
+
+typedef struct {
+  size_t size; // of a value
+  // Every value of the type, width 0 when even the type is unknown
+  void (*top)(void *v, uint8_t width, uint8_t flags);
+  void (*constant)(void *v, uint64_t c, uint8_t width, uint8_t flags);
+  // result = op applied to the operands: BYTECODE_ADD to BYTECODE_SELECT,
+  // with the width and flags of the instruction. Comparisons are boolean.
+  void (*apply)(uint8_t op, uint8_t width, uint8_t flags, void *result,
+                const void *const *operands);
+  // into = into join from, or widened by it. Returns whether into changed.
+  _Bool (*join)(void *into, const void *from, _Bool widen);
+  // 1 when v is never 0, 0 when it is always 0, -1 otherwise
+  int (*truth)(const void *v);
+  // Restricts a and b to where (a op b) == holds, op a comparison, b NULL
+  // for 0 of the type of a. Returns 0 if no values are left.
+  _Bool (*refine)(uint8_t op, void *a, void *b, _Bool holds);
+  // Canonical bounds of v in the order of its type, 0 if it has none. Loops
+  // are only bounded by domains that have it.
+  _Bool (*bounds)(const void *v, uint64_t *lo, uint64_t *hi);
+} absint_domain;
+
+// Canonical bounds, in signed order for BYTECODE_SIGNED. width 0 is
+// anything at all.
+typedef struct {
+  uint64_t lo, hi;
+  uint8_t width, flags;
+} absint_interval;
+
+extern const absint_domain absint_intervals;
+
+typedef struct {
+  // GOTO instruction indices of the backward jump and of where it goes
+  size_t latch, head;
+  // The backward jump is taken at most this many times per entry
+  uint64_t iterations;
+} absint_loop;
+
+typedef struct {
+  uint64_t functions;
+  uint64_t assertions;
+  uint64_t proved;
+  uint64_t loops;
+  uint64_t bounded;
+} absint_stats;
+
+typedef struct absint absint;
+
+// NULL domain for absint_intervals
+absint *absint_create(bytecode_program *bp, const absint_domain *domain);
+void absint_destroy(absint *a);
+// Lowers the function if needed. 0 if it has no body or can not be
+// lowered, or on allocation failure.
+_Bool absint_analyze(absint *a, size_t function);
+// Whether the assertion at GOTO pc holds on every run, 0 for functions not
+// analyzed and anything that is not an assertion. Unreachable assertions
+// hold.
+_Bool absint_proved(const absint *a, size_t function, size_t pc);
+// Bounded loops of an analyzed function, in bytecode order
+size_t absint_loops(const absint *a, size_t function, const absint_loop **loops);
+absint_stats absint_statistics(const absint *a);
+
+uint64_t absint_tests();
+#ifdef ABSINT_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Numbers in the order of the type, wide enough for either kind of uint64_t
+typedef __int128 absint__number;
+
+static absint__number absint__number_of(uint64_t v, uint8_t flags) {
+  return flags & BYTECODE_SIGNED ? (absint__number)(int64_t)v
+                                 : (absint__number)v;
+}
+
+static void absint__range(uint8_t width, uint8_t flags, absint__number *min,
+                          absint__number *max) {
+  if (flags & BYTECODE_SIGNED) {
+    *min = -((absint__number)1 << (width - 1));
+    *max = ((absint__number)1 << (width - 1)) - 1;
+  } else {
+    *min = 0;
+    *max = ((absint__number)1 << width) - 1;
+  }
+}
+
+static void absint__interval_top(void *v, uint8_t width, uint8_t flags) {
+  absint_interval *i = (absint_interval *)v;
+  i->width = width;
+  i->flags = flags;
+  if (!width) {
+    i->lo = 0;
+    i->hi = UINT64_MAX;
+    return;
+  }
+  absint__number min, max;
+  absint__range(width, flags, &min, &max);
+  i->lo = (uint64_t)min;
+  i->hi = (uint64_t)max;
+}
+
+static void absint__interval_constant(void *v, uint64_t c, uint8_t width,
+                                      uint8_t flags) {
+  *(absint_interval *)v = (absint_interval){c, c, width, flags};
+}
+
+// [lo, hi] if the type holds all of it, the whole type otherwise
+static absint_interval absint__make(absint__number lo, absint__number hi,
+                                    uint8_t width, uint8_t flags) {
+  absint_interval i;
+  absint__number min, max;
+  absint__range(width, flags, &min, &max);
+  if (!width || lo < min || hi > max || lo > hi) {
+    absint__interval_top(&i, width, flags);
+    return i;
+  }
+  return (absint_interval){(uint64_t)lo, (uint64_t)hi, width, flags};
+}
+
+static inline absint__number absint__lo(const absint_interval *i) {
+  return absint__number_of(i->lo, i->flags);
+}
+
+static inline absint__number absint__hi(const absint_interval *i) {
+  return absint__number_of(i->hi, i->flags);
+}
+
+static int absint__interval_truth(const void *v) {
+  const absint_interval *i = (const absint_interval *)v;
+  if (!i->width)
+    return -1;
+  if (i->lo == 0 && i->hi == 0)
+    return 0;
+  return absint__lo(i) > 0 || absint__hi(i) < 0 ? 1 : -1;
+}
+
+static absint_interval absint__boolean(int truth, uint8_t width,
+                                       uint8_t flags) {
+  return (absint_interval){truth == 1, truth != 0, width, flags};
+}
+
+// Exactly what the interpreter computes, for operands that are constants.
+// 0 for a division by zero, which stops the run.
+static _Bool absint__eval(uint8_t op, uint8_t width, uint8_t flags, uint64_t a,
+                          uint64_t b, uint64_t c, uint64_t *r) {
+  _Bool sign = flags & BYTECODE_SIGNED;
+  switch (op) {
+  case BYTECODE_ADD: *r = bytecode__norm(a + b, width, flags); break;
+  case BYTECODE_SUB: *r = bytecode__norm(a - b, width, flags); break;
+  case BYTECODE_MUL: *r = bytecode__norm(a * b, width, flags); break;
+  case BYTECODE_DIV:
+  case BYTECODE_MOD:
+    if (!b)
+      return 0;
+    if (op == BYTECODE_DIV)
+      a = !sign ? a / b
+                : b == UINT64_MAX ? -a : (uint64_t)((int64_t)a / (int64_t)b);
+    else
+      a = !sign ? a % b
+                : b == UINT64_MAX ? 0 : (uint64_t)((int64_t)a % (int64_t)b);
+    *r = bytecode__norm(a, width, flags);
+    break;
+  case BYTECODE_NEG: *r = bytecode__norm(-a, width, flags); break;
+  case BYTECODE_BAND: *r = a & b; break;
+  case BYTECODE_BOR: *r = a | b; break;
+  case BYTECODE_BXOR: *r = a ^ b; break;
+  case BYTECODE_BNOT: *r = bytecode__norm(~a, width, flags); break;
+  case BYTECODE_SHL:
+    *r = b >= width ? 0 : bytecode__norm(a << b, width, flags);
+    break;
+  case BYTECODE_SHR: *r = (uint64_t)((int64_t)a >> (b >= 64 ? 63 : b)); break;
+  case BYTECODE_LSHR:
+    *r = b >= width ? 0
+                    : bytecode__norm(bytecode__norm(a, width, 0) >> b, width,
+                                     flags);
+    break;
+  case BYTECODE_EQ: *r = a == b; break;
+  case BYTECODE_NE: *r = a != b; break;
+  case BYTECODE_LT: *r = sign ? (int64_t)a < (int64_t)b : a < b; break;
+  case BYTECODE_LE: *r = sign ? (int64_t)a <= (int64_t)b : a <= b; break;
+  case BYTECODE_GT: *r = sign ? (int64_t)a > (int64_t)b : a > b; break;
+  case BYTECODE_GE: *r = sign ? (int64_t)a >= (int64_t)b : a >= b; break;
+  case BYTECODE_LAND: *r = a && b; break;
+  case BYTECODE_LOR: *r = a || b; break;
+  case BYTECODE_LNOT: *r = !a; break;
+  case BYTECODE_CAST:
+    *r = flags & BYTECODE_BOOL ? a != 0 : bytecode__norm(a, width, flags);
+    break;
+  case BYTECODE_SELECT: *r = a ? b : c; break;
+  default: return 0;
+  }
+  return 1;
+}
+
+static int absint__operand_count(uint8_t op) {
+  switch (op) {
+  case BYTECODE_NEG:
+  case BYTECODE_BNOT:
+  case BYTECODE_LNOT:
+  case BYTECODE_CAST:
+    return 1;
+  case BYTECODE_SELECT:
+    return 3;
+  default:
+    return 2;
+  }
+}
+
+static inline _Bool absint__is_compare(uint8_t op) {
+  return op >= BYTECODE_EQ && op <= BYTECODE_GE;
+}
+
+// Comparison of intervals: 1 always, 0 never, -1 either
+static int absint__compare(uint8_t op, const absint_interval *a,
+                           const absint_interval *b) {
+  absint__number al = absint__lo(a), ah = absint__hi(a);
+  absint__number bl = absint__lo(b), bh = absint__hi(b);
+  switch (op) {
+  case BYTECODE_EQ:
+    return al == ah && bl == bh && al == bl ? 1 : ah < bl || bh < al ? 0 : -1;
+  case BYTECODE_NE:
+    return al == ah && bl == bh && al == bl ? 0 : ah < bl || bh < al ? 1 : -1;
+  case BYTECODE_LT: return ah < bl ? 1 : al >= bh ? 0 : -1;
+  case BYTECODE_LE: return ah <= bl ? 1 : al > bh ? 0 : -1;
+  case BYTECODE_GT: return al > bh ? 1 : ah <= bl ? 0 : -1;
+  case BYTECODE_GE: return al >= bh ? 1 : ah < bl ? 0 : -1;
+  }
+  return -1;
+}
+
+static _Bool absint__interval_join(void *into, const void *from, _Bool widen);
+
+static void absint__interval_apply(uint8_t op, uint8_t width, uint8_t flags,
+                                   void *result, const void *const *operands) {
+  absint_interval *r = (absint_interval *)result;
+  const absint_interval *a = (const absint_interval *)operands[0];
+  const absint_interval *b =
+      absint__operand_count(op) > 1 ? (const absint_interval *)operands[1] : a;
+  if (absint__is_compare(op)) {
+    // The instruction has the type of the operands, the result is a bool
+    width = 1;
+    flags = BYTECODE_BOOL;
+  }
+
+  if (op == BYTECODE_SELECT) {
+    int truth = absint__interval_truth(a);
+    *r = truth == 1 ? *b : *(const absint_interval *)operands[2];
+    if (truth == -1)
+      absint__interval_join(r, b, 0);
+    return;
+  }
+  if (op == BYTECODE_LNOT || op == BYTECODE_LAND || op == BYTECODE_LOR ||
+      (op == BYTECODE_CAST && (flags & BYTECODE_BOOL))) {
+    int x = absint__interval_truth(a), y = absint__interval_truth(b);
+    int truth = op == BYTECODE_LNOT   ? (x == -1 ? -1 : !x)
+                : op == BYTECODE_CAST ? x
+                : op == BYTECODE_LAND ? (x == 0 || y == 0    ? 0
+                                         : x == 1 && y == 1 ? 1
+                                                            : -1)
+                                      : (x == 1 || y == 1    ? 1
+                                         : x == 0 && y == 0 ? 0
+                                                            : -1);
+    *r = absint__boolean(truth, width, flags);
+    return;
+  }
+
+  _Bool known = a->width && b->width;
+  if (known && a->lo == a->hi && b->lo == b->hi) {
+    uint64_t v;
+    if (absint__eval(op, width, flags, a->lo, b->lo, 0, &v)) {
+      absint__interval_constant(r, v, absint__is_compare(op) ? 1 : width,
+                                absint__is_compare(op) ? BYTECODE_BOOL : flags);
+      return;
+    }
+  }
+  if (absint__is_compare(op)) {
+    *r = absint__boolean(known ? absint__compare(op, a, b) : -1, width, flags);
+    return;
+  }
+  if (!known) {
+    absint__interval_top(r, width, flags);
+    return;
+  }
+
+  absint__number al = absint__lo(a), ah = absint__hi(a);
+  absint__number bl = absint__lo(b), bh = absint__hi(b);
+  absint__number min, max;
+  absint__range(width, flags, &min, &max);
+  absint__number big = (absint__number)1 << 63;
+  switch (op) {
+  case BYTECODE_ADD: *r = absint__make(al + bl, ah + bh, width, flags); return;
+  case BYTECODE_SUB: *r = absint__make(al - bh, ah - bl, width, flags); return;
+  case BYTECODE_NEG: *r = absint__make(-ah, -al, width, flags); return;
+  case BYTECODE_MUL: {
+    if (al <= -big || ah >= big || bl <= -big || bh >= big)
+      break;
+    absint__number p[] = {al * bl, al * bh, ah * bl, ah * bh};
+    absint__number lo = p[0], hi = p[0];
+    for (int i = 1; i < 4; i++) {
+      lo = p[i] < lo ? p[i] : lo;
+      hi = p[i] > hi ? p[i] : hi;
+    }
+    *r = absint__make(lo, hi, width, flags);
+    return;
+  }
+  case BYTECODE_DIV: {
+    if (bl <= 0 && bh >= 0)
+      break;
+    // Truncating division is monotone in each operand away from 0
+    absint__number p[] = {al / bl, al / bh, ah / bl, ah / bh};
+    absint__number lo = p[0], hi = p[0];
+    for (int i = 1; i < 4; i++) {
+      lo = p[i] < lo ? p[i] : lo;
+      hi = p[i] > hi ? p[i] : hi;
+    }
+    *r = absint__make(lo, hi, width, flags);
+    return;
+  }
+  case BYTECODE_MOD:
+    if (al >= 0 && bl > 0) {
+      *r = ah < bl ? *a : absint__make(0, bh - 1 < ah ? bh - 1 : ah, width, flags);
+      return;
+    }
+    break;
+  case BYTECODE_BAND:
+    if (al >= 0 && bl >= 0) {
+      *r = absint__make(0, ah < bh ? ah : bh, width, flags);
+      return;
+    }
+    break;
+  case BYTECODE_BOR:
+  case BYTECODE_BXOR:
+    if (al >= 0 && bl >= 0) {
+      absint__number m = ah > bh ? ah : bh, all = 1;
+      while (all <= m)
+        all <<= 1;
+      *r = absint__make(op == BYTECODE_BOR ? (al > bl ? al : bl) : 0, all - 1,
+                        width, flags);
+      return;
+    }
+    break;
+  case BYTECODE_BNOT:
+    *r = flags & BYTECODE_SIGNED ? absint__make(-ah - 1, -al - 1, width, flags)
+                                 : absint__make(max - ah, max - al, width, flags);
+    return;
+  case BYTECODE_SHR:
+  case BYTECODE_LSHR:
+    if (bl == bh && bl >= 0 && bl < width && (op == BYTECODE_SHR || al >= 0)) {
+      // Floor division by a power of two, monotone
+      absint__number d = (absint__number)1 << (int)bl;
+      absint__number lo = al >= 0 ? al / d : -((-al + d - 1) / d);
+      absint__number hi = ah >= 0 ? ah / d : -((-ah + d - 1) / d);
+      *r = absint__make(lo, hi, width, flags);
+      return;
+    }
+    break;
+  case BYTECODE_CAST:
+    *r = absint__make(al, ah, width, flags);
+    return;
+  }
+  absint__interval_top(r, width, flags);
+}
+
+static _Bool absint__interval_join(void *into, const void *from, _Bool widen) {
+  absint_interval *a = (absint_interval *)into;
+  const absint_interval *b = (const absint_interval *)from;
+  if (!a->width)
+    return 0;
+  if (!b->width || a->width != b->width || a->flags != b->flags) {
+    absint__interval_top(a, 0, 0);
+    return 1;
+  }
+  absint__number min, max;
+  absint__range(a->width, a->flags, &min, &max);
+  absint__number al = absint__lo(a), ah = absint__hi(a);
+  absint__number bl = absint__lo(b), bh = absint__hi(b);
+  absint__number lo = bl < al ? (widen ? min : bl) : al;
+  absint__number hi = bh > ah ? (widen ? max : bh) : ah;
+  if (lo == al && hi == ah)
+    return 0;
+  a->lo = (uint64_t)lo;
+  a->hi = (uint64_t)hi;
+  return 1;
+}
+
+static _Bool absint__interval_refine(uint8_t op, void *va, void *vb,
+                                     _Bool holds) {
+  absint_interval *a = (absint_interval *)va, *b = (absint_interval *)vb;
+  absint_interval zero = {0, 0, a->width, a->flags};
+  if (!b)
+    b = &zero;
+  if (!a->width || !b->width || a->flags != b->flags)
+    return 1;
+  if (!holds) {
+    static const uint8_t negated[] = {
+        [BYTECODE_EQ] = BYTECODE_NE, [BYTECODE_NE] = BYTECODE_EQ,
+        [BYTECODE_LT] = BYTECODE_GE, [BYTECODE_LE] = BYTECODE_GT,
+        [BYTECODE_GT] = BYTECODE_LE, [BYTECODE_GE] = BYTECODE_LT};
+    op = negated[op];
+  }
+  if (op == BYTECODE_GT || op == BYTECODE_GE) {
+    absint_interval *swap = a;
+    a = b;
+    b = swap;
+    op = op == BYTECODE_GT ? BYTECODE_LT : BYTECODE_LE;
+  }
+
+  absint__number al = absint__lo(a), ah = absint__hi(a);
+  absint__number bl = absint__lo(b), bh = absint__hi(b);
+  switch (op) {
+  case BYTECODE_EQ:
+    al = bl = al > bl ? al : bl;
+    ah = bh = ah < bh ? ah : bh;
+    break;
+  case BYTECODE_NE:
+    // Only an end of an interval can go
+    if (bl == bh) {
+      al += al == bl;
+      ah -= ah == bl;
+    }
+    if (al == ah) {
+      bl += bl == al;
+      bh -= bh == al;
+    }
+    break;
+  case BYTECODE_LT:
+    ah = ah < bh - 1 ? ah : bh - 1;
+    bl = bl > al + 1 ? bl : al + 1;
+    break;
+  case BYTECODE_LE:
+    ah = ah < bh ? ah : bh;
+    bl = bl > al ? bl : al;
+    break;
+  }
+  if (al > ah || bl > bh)
+    return 0;
+  a->lo = (uint64_t)al;
+  a->hi = (uint64_t)ah;
+  b->lo = (uint64_t)bl;
+  b->hi = (uint64_t)bh;
+  return 1;
+}
+
+static _Bool absint__interval_bounds(const void *v, uint64_t *lo,
+                                     uint64_t *hi) {
+  const absint_interval *i = (const absint_interval *)v;
+  *lo = i->lo;
+  *hi = i->hi;
+  return i->width != 0;
+}
+
+const absint_domain absint_intervals = {
+    sizeof(absint_interval), absint__interval_top,   absint__interval_constant,
+    absint__interval_apply,  absint__interval_join,  absint__interval_truth,
+    absint__interval_refine, absint__interval_bounds,
+};
+
+
+// Where a value on the operand stack came from, to know what a test of it
+// says about the variables
+enum {
+  ABSINT__NONE,
+  ABSINT__VARIABLE, // the value of var[0]
+  ABSINT__TRUTH,    // whether var[0] is non zero
+  ABSINT__COMPARE,
+};
+
+#define ABSINT__NO_VAR UINT32_MAX
+
+typedef struct {
+  uint8_t kind;
+  uint8_t op;      // of ABSINT__COMPARE
+  _Bool negated;   // the value is the opposite of the test
+  uint32_t var[2]; // COMPARE: of each operand or NO_VAR
+} absint__origin;
+
+typedef struct {
+  _Bool analyzed;
+  uint8_t *proved; // per GOTO instruction
+  absint_loop *loops;
+  size_t loop_count;
+} absint__function;
+
+struct absint {
+  bytecode_program *bp;
+  const absint_domain *d;
+  absint__function *functions;
+  size_t function_count;
+  absint_stats stats;
+
+  // Function being analyzed. Variables are its slots, then the globals.
+  bytecode_function *f;
+  size_t vars;
+  size_t block_count;
+  uint32_t *starts;   // bytecode index of every block, plus the end
+  uint32_t *block_of; // of every bytecode index
+  uint8_t *loop_head;
+  uint8_t *reached, *next_reached;
+  uint8_t *states, *next_states; // at the start of every block
+  uint8_t *pending;
+  uint32_t *heap; // blocks to walk, first in bytecode order first
+  size_t heap_length;
+  // Scratch of a walk. Stack slots hold a value and, for comparisons, copies
+  // of the operands.
+  uint8_t *current, *branch, *entry;
+  uint8_t *stack, *result, *operands;
+  absint__origin *origins;
+  uint8_t *truths; // per GOTO instruction
+};
+
+enum { ABSINT__ASCEND, ABSINT__DESCEND, ABSINT__RECORD };
+
+// truths
+#define ABSINT__MAY_FAIL 1
+#define ABSINT__SEEN 2
+
+absint *absint_create(bytecode_program *bp, const absint_domain *domain) {
+  absint *a = (absint *)calloc(1, sizeof(absint));
+  if (!a)
+    return NULL;
+  a->bp = bp;
+  a->d = domain ? domain : &absint_intervals;
+  a->function_count = bp->program->function_count;
+  a->functions = (absint__function *)calloc(
+      a->function_count ? a->function_count : 1, sizeof(absint__function));
+  if (!a->functions) {
+    free(a);
+    return NULL;
+  }
+  return a;
+}
+
+static void absint__scratch_free(absint *a) {
+  void **scratch[] = {
+      (void **)&a->starts,       (void **)&a->block_of, (void **)&a->loop_head,
+      (void **)&a->reached,      (void **)&a->next_reached,
+      (void **)&a->states,       (void **)&a->next_states,
+      (void **)&a->pending,      (void **)&a->heap,     (void **)&a->current,
+      (void **)&a->branch,       (void **)&a->entry,    (void **)&a->stack,
+      (void **)&a->result,       (void **)&a->operands, (void **)&a->origins,
+      (void **)&a->truths};
+  for (size_t i = 0; i < sizeof(scratch) / sizeof(scratch[0]); i++) {
+    free(*scratch[i]);
+    *scratch[i] = NULL;
+  }
+}
+
+void absint_destroy(absint *a) {
+  if (!a)
+    return;
+  for (size_t i = 0; i < a->function_count; i++) {
+    free(a->functions[i].proved);
+    free(a->functions[i].loops);
+  }
+  free(a->functions);
+  absint__scratch_free(a);
+  free(a);
+}
+
+static inline uint8_t *absint__value(const absint *a, uint8_t *state,
+                                     size_t var) {
+  return state + var * a->d->size;
+}
+
+static void absint__push(absint *a, uint32_t block) {
+  if (a->pending[block])
+    return;
+  a->pending[block] = 1;
+  size_t i = a->heap_length++;
+  while (i && a->heap[(i - 1) / 2] > block) {
+    a->heap[i] = a->heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  a->heap[i] = block;
+}
+
+static uint32_t absint__pop(absint *a) {
+  uint32_t first = a->heap[0];
+  uint32_t last = a->heap[--a->heap_length];
+  size_t i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= a->heap_length)
+      break;
+    if (child + 1 < a->heap_length && a->heap[child + 1] < a->heap[child])
+      child++;
+    if (a->heap[child] >= last)
+      break;
+    a->heap[i] = a->heap[child];
+    i = child;
+  }
+  if (a->heap_length)
+    a->heap[i] = last;
+  a->pending[first] = 0;
+  return first;
+}
+
+// Joins state into the start of block. Going up, blocks that change are
+// walked again, widening at loop heads. Going down, the states of the next
+// pass are built from scratch.
+static void absint__flow(absint *a, uint32_t block, uint8_t *state, int mode) {
+  if (mode == ABSINT__RECORD)
+    return;
+  size_t bytes = a->vars * a->d->size;
+  uint8_t *reached = mode == ABSINT__ASCEND ? a->reached : a->next_reached;
+  uint8_t *into =
+      (mode == ABSINT__ASCEND ? a->states : a->next_states) + block * bytes;
+  if (!reached[block]) {
+    reached[block] = 1;
+    memcpy(into, state, bytes);
+    if (mode == ABSINT__ASCEND)
+      absint__push(a, block);
+    return;
+  }
+  _Bool widen = mode == ABSINT__ASCEND && a->loop_head[block];
+  _Bool changed = 0;
+  for (size_t v = 0; v < a->vars; v++)
+    changed |= a->d->join(absint__value(a, into, v), absint__value(a, state, v),
+                          widen);
+  if (changed && mode == ABSINT__ASCEND)
+    absint__push(a, block);
+}
+
+// Narrows state to the runs where value, coming from o, is non zero (holds)
+// or zero. 0 if there are none.
+static _Bool absint__refine(absint *a, uint8_t *state, uint8_t *value,
+                            const absint__origin *o, _Bool holds) {
+  const absint_domain *d = a->d;
+  size_t size = d->size;
+  int truth = d->truth(value);
+  if (truth != -1)
+    return truth == holds;
+  if (o->kind == ABSINT__NONE)
+    return 1;
+  holds ^= o->negated;
+
+  uint8_t *operands = a->operands;
+  if (o->kind != ABSINT__COMPARE) {
+    memcpy(operands, absint__value(a, state, o->var[0]), size);
+    if (!d->refine(BYTECODE_NE, operands, NULL, holds))
+      return 0;
+    memcpy(absint__value(a, state, o->var[0]), operands, size);
+    return 1;
+  }
+  for (int side = 0; side < 2; side++)
+    memcpy(operands + side * size,
+           o->var[side] == ABSINT__NO_VAR
+               ? value + (1 + side) * size
+               : absint__value(a, state, o->var[side]),
+           size);
+  if (!d->refine(o->op, operands, operands + size, holds))
+    return 0;
+  for (int side = 0; side < 2; side++)
+    if (o->var[side] != ABSINT__NO_VAR)
+      memcpy(absint__value(a, state, o->var[side]), operands + side * size,
+             size);
+  return 1;
+}
+
+// Stack values no longer say anything about var once it is stored to
+static void absint__forget(absint *a, size_t sp, uint32_t from, uint32_t to) {
+  for (size_t i = 0; i < sp; i++) {
+    absint__origin *o = &a->origins[i];
+    if (o->kind != ABSINT__COMPARE && o->var[0] >= from && o->var[0] < to)
+      o->kind = ABSINT__NONE;
+    for (int side = 0; o->kind == ABSINT__COMPARE && side < 2; side++)
+      if (o->var[side] != ABSINT__NO_VAR && o->var[side] >= from &&
+          o->var[side] < to)
+        o->var[side] = ABSINT__NO_VAR;
+  }
+}
+
+// Runs the block from start, flowing what comes out into its successors.
+// When recording, marks the assertions that may fail.
+static void absint__walk(absint *a, uint32_t block, const uint8_t *start,
+                         int mode) {
+  const absint_domain *d = a->d;
+  const bytecode_function *f = a->f;
+  size_t size = d->size;
+  size_t slot = 3 * size;
+  size_t bytes = a->vars * size;
+  uint32_t locals = f->slot_count;
+  uint8_t *state = a->current;
+  memcpy(state, start, bytes);
+  size_t sp = 0;
+
+  for (uint32_t pc = a->starts[block]; pc < a->starts[block + 1]; pc++) {
+    const bytecode_insn *ins = &f->code[pc];
+    uint8_t *top = a->stack + sp * slot; // first free slot
+    switch (ins->op) {
+    case BYTECODE_CONST:
+      d->constant(top, ins->imm, ins->width, ins->flags);
+      a->origins[sp++].kind = ABSINT__NONE;
+      break;
+    case BYTECODE_NONDET:
+      d->top(top, ins->width, ins->flags);
+      a->origins[sp++].kind = ABSINT__NONE;
+      break;
+    case BYTECODE_LOAD:
+    case BYTECODE_GLOAD: {
+      uint32_t var = ins->op == BYTECODE_LOAD ? ins->arg : locals + ins->arg;
+      if (var >= a->vars) { // a global of a function lowered since
+        d->top(top, 0, 0);
+        a->origins[sp++].kind = ABSINT__NONE;
+        break;
+      }
+      memcpy(top, absint__value(a, state, var), size);
+      a->origins[sp++] = (absint__origin){
+          ABSINT__VARIABLE, 0, 0, {var, ABSINT__NO_VAR}};
+      break;
+    }
+    case BYTECODE_STORE:
+    case BYTECODE_GSTORE: {
+      uint32_t var = ins->op == BYTECODE_STORE ? ins->arg : locals + ins->arg;
+      sp--;
+      if (var < a->vars) {
+        memcpy(absint__value(a, state, var), a->stack + sp * slot, size);
+        absint__forget(a, sp, var, var + 1);
+      }
+      break;
+    }
+    case BYTECODE_POP:
+      sp--;
+      break;
+
+    case BYTECODE_JUMP:
+      absint__flow(a, a->block_of[ins->arg], state, mode);
+      return;
+    case BYTECODE_JUMP_IF:
+    case BYTECODE_JUMP_IFNOT: {
+      sp--;
+      uint8_t *value = a->stack + sp * slot;
+      _Bool jumps_on = ins->op == BYTECODE_JUMP_IF;
+      memcpy(a->branch, state, bytes);
+      if (absint__refine(a, a->branch, value, &a->origins[sp], jumps_on))
+        absint__flow(a, a->block_of[ins->arg], a->branch, mode);
+      if (absint__refine(a, state, value, &a->origins[sp], !jumps_on))
+        absint__flow(a, block + 1, state, mode);
+      return;
+    }
+    case BYTECODE_ASSUME:
+      sp--;
+      if (!absint__refine(a, state, a->stack + sp * slot, &a->origins[sp], 1))
+        return;
+      break;
+    case BYTECODE_ASSERT:
+      sp--;
+      if (mode == ABSINT__RECORD && d->truth(a->stack + sp * slot) != 1)
+        a->truths[ins->arg] |= ABSINT__MAY_FAIL;
+      break;
+    case BYTECODE_CALL:
+      // Callees see only their arguments, but may change any global
+      sp -= ins->imm;
+      for (size_t v = locals; v < a->vars; v++)
+        d->top(absint__value(a, state, v), 0, 0);
+      absint__forget(a, sp, locals, (uint32_t)a->vars);
+      d->top(a->stack + sp * slot, 0, 0);
+      a->origins[sp++].kind = ABSINT__NONE;
+      break;
+    case BYTECODE_RET:
+      return;
+
+    default: {
+      int count = absint__operand_count(ins->op);
+      uint8_t *first = a->stack + (sp - count) * slot;
+      const void *operands[3];
+      for (int i = 0; i < count; i++)
+        operands[i] = first + i * slot;
+      d->apply(ins->op, ins->width, ins->flags, a->result, operands);
+      absint__origin o = {ABSINT__NONE, 0, 0, {ABSINT__NO_VAR, ABSINT__NO_VAR}};
+      const absint__origin *from = &a->origins[sp - count];
+      if (absint__is_compare(ins->op)) {
+        o.kind = ABSINT__COMPARE;
+        o.op = ins->op;
+        for (int i = 0; i < 2; i++) {
+          memcpy(a->result + (1 + i) * size, first + i * slot, size);
+          if (from[i].kind == ABSINT__VARIABLE)
+            o.var[i] = from[i].var[0];
+        }
+      } else if (ins->op == BYTECODE_LNOT ||
+                 (ins->op == BYTECODE_CAST && (ins->flags & BYTECODE_BOOL))) {
+        // Tests of tests
+        if (from->kind == ABSINT__COMPARE)
+          memcpy(a->result + size, first + size, 2 * size);
+        if (from->kind != ABSINT__NONE) {
+          o = *from;
+          o.kind = from->kind == ABSINT__VARIABLE ? ABSINT__TRUTH : from->kind;
+          o.negated ^= ins->op == BYTECODE_LNOT;
+        }
+      }
+      sp -= count;
+      memcpy(a->stack + sp * slot, a->result, slot);
+      a->origins[sp++] = o;
+      break;
+    }
+    }
+  }
+  if (a->starts[block + 1] < f->count)
+    absint__flow(a, block + 1, state, mode);
+}
+
+static inline _Bool absint__is_jump(uint8_t op) {
+  return op == BYTECODE_JUMP || op == BYTECODE_JUMP_IF ||
+         op == BYTECODE_JUMP_IFNOT;
+}
+
+// Splits the function into blocks and makes room for the passes
+static _Bool absint__prepare(absint *a, bytecode_function *f) {
+  size_t size = a->d->size;
+  a->f = f;
+  a->vars = f->slot_count + a->bp->globals.length;
+  uint8_t *leader = (uint8_t *)calloc(f->count + 1, 1);
+  if (!leader)
+    return 0;
+  leader[0] = 1;
+  for (size_t pc = 0; pc < f->count; pc++) {
+    uint8_t op = f->code[pc].op;
+    if (absint__is_jump(op))
+      leader[f->code[pc].arg] = 1;
+    if (absint__is_jump(op) || op == BYTECODE_RET)
+      leader[pc + 1] = 1;
+  }
+  a->block_count = 0;
+  for (size_t pc = 0; pc < f->count; pc++)
+    a->block_count += leader[pc];
+
+  size_t blocks = a->block_count;
+  size_t bytes = a->vars * size;
+  size_t stack = (f->max_stack + 1) * 3 * size;
+  a->starts = (uint32_t *)malloc(sizeof(uint32_t) * (blocks + 1));
+  a->block_of = (uint32_t *)malloc(sizeof(uint32_t) * f->count);
+  a->loop_head = (uint8_t *)calloc(blocks, 1);
+  a->reached = (uint8_t *)calloc(blocks, 1);
+  a->next_reached = (uint8_t *)calloc(blocks, 1);
+  a->states = (uint8_t *)malloc(blocks * bytes + 1);
+  a->next_states = (uint8_t *)malloc(blocks * bytes + 1);
+  a->pending = (uint8_t *)calloc(blocks, 1);
+  a->heap = (uint32_t *)malloc(sizeof(uint32_t) * blocks);
+  a->current = (uint8_t *)malloc(bytes + 1);
+  a->branch = (uint8_t *)malloc(bytes + 1);
+  a->entry = (uint8_t *)malloc(bytes + 1);
+  a->stack = (uint8_t *)calloc(1, stack);
+  a->result = (uint8_t *)calloc(3, size);
+  a->operands = (uint8_t *)calloc(2, size);
+  a->origins = (absint__origin *)calloc(f->max_stack + 1, sizeof(absint__origin));
+  _Bool ok = a->starts && a->block_of && a->loop_head && a->reached &&
+             a->next_reached && a->states && a->next_states && a->pending &&
+             a->heap && a->current && a->branch && a->entry && a->stack &&
+             a->result && a->operands && a->origins;
+  if (ok) {
+    uint32_t block = 0;
+    for (uint32_t pc = 0; pc < f->count; pc++) {
+      if (leader[pc])
+        a->starts[block++] = pc;
+      a->block_of[pc] = block - 1;
+    }
+    a->starts[blocks] = (uint32_t)f->count;
+    for (size_t pc = 0; pc < f->count; pc++)
+      if (absint__is_jump(f->code[pc].op) &&
+          a->block_of[f->code[pc].arg] <= a->block_of[pc])
+        a->loop_head[a->block_of[f->code[pc].arg]] = 1;
+    for (size_t v = 0; v < a->vars; v++)
+      a->d->top(absint__value(a, a->entry, v), 0, 0);
+  }
+  free(leader);
+  return ok;
+}
+
+// Upper bound on how many times the backward jump at latch is taken, found
+// from a variable the loop steps by a constant exactly once per iteration
+static _Bool absint__bound(absint *a, uint32_t latch, uint64_t *iterations) {
+  const bytecode_function *f = a->f;
+  const bytecode_insn *code = f->code;
+  uint32_t head = code[latch].arg;
+  // The loop is entered at its head only
+  for (uint32_t s = 0; s < f->count; s++) {
+    if (!absint__is_jump(code[s].op) || (s >= head && s <= latch))
+      continue;
+    uint32_t t = code[s].arg;
+    if ((t > head && t <= latch) || (t == head && s > latch))
+      return 0;
+  }
+  if (!a->reached[a->block_of[head]]) {
+    *iterations = 0;
+    return 1;
+  }
+
+  _Bool found = 0;
+  for (uint32_t q = head + 3; q <= latch; q++) {
+    // var = var + c, var = c + var or var = var - c
+    const bytecode_insn *step = &code[q - 1];
+    uint32_t var = code[q].arg;
+    if (code[q].op != BYTECODE_STORE ||
+        (step->op != BYTECODE_ADD && step->op != BYTECODE_SUB))
+      continue;
+    const bytecode_insn *x = &code[q - 3], *y = &code[q - 2];
+    if (step->op == BYTECODE_ADD && x->op == BYTECODE_CONST) {
+      const bytecode_insn *swap = x;
+      x = y;
+      y = swap;
+    }
+    if (x->op != BYTECODE_LOAD || x->arg != var || y->op != BYTECODE_CONST)
+      continue;
+    _Bool ok = 1;
+    for (uint32_t s = head; ok && s <= latch; s++) {
+      if (s != q && code[s].op == BYTECODE_STORE && code[s].arg == var)
+        ok = 0;
+      if (s == latch || !absint__is_jump(code[s].op))
+        continue;
+      // Every way around the loop goes through the step, once
+      uint32_t t = code[s].arg;
+      if (s < q - 3 && ((t > q - 3 && t <= latch) || t == head))
+        ok = 0;
+      if (s > q && t > head && t <= q)
+        ok = 0;
+    }
+    uint64_t lo, hi;
+    if (!ok || !a->d->bounds ||
+        !a->d->bounds(absint__value(a, a->states + a->block_of[head] *
+                                                       a->vars * a->d->size,
+                                    var),
+                      &lo, &hi))
+      continue;
+
+    absint__number min, max;
+    absint__range(step->width, step->flags, &min, &max);
+    absint__number c = absint__number_of(y->imm, step->flags);
+    if (step->op == BYTECODE_SUB)
+      c = -c;
+    absint__number l = absint__number_of(lo, step->flags);
+    absint__number h = absint__number_of(hi, step->flags);
+    // Values at the head never wrap around, so they go one way
+    if (!c || (c > 0 && h + c > max) || (c < 0 && l + c < min))
+      continue;
+    uint64_t n = (uint64_t)((h - l) / (c > 0 ? c : -c));
+    if (!found || n < *iterations)
+      *iterations = n;
+    found = 1;
+  }
+  return found;
+}
+
+_Bool absint_analyze(absint *a, size_t function) {
+  if (function >= a->function_count)
+    return 0;
+  absint__function *result = &a->functions[function];
+  if (result->analyzed)
+    return 1;
+  bytecode_function *f = bytecode_lower(a->bp, function);
+  goto_function *gf = goto_program_function_at(a->bp->program, function);
+  if (!f || !gf)
+    return 0;
+  if (!absint__prepare(a, f)) {
+    absint__scratch_free(a);
+    return 0;
+  }
+  size_t bytes = a->vars * a->d->size;
+
+  memset(a->reached, 0, a->block_count);
+  absint__flow(a, 0, a->entry, ABSINT__ASCEND);
+  while (a->heap_length) {
+    uint32_t block = absint__pop(a);
+    absint__walk(a, block, a->states + block * bytes, ABSINT__ASCEND);
+  }
+  // Widening overshoots, running the transfer functions again on a sound
+  // state gives one at least as precise
+  for (int pass = 0; pass < 2; pass++) {
+    memset(a->next_reached, 0, a->block_count);
+    absint__flow(a, 0, a->entry, ABSINT__DESCEND);
+    for (uint32_t block = 0; block < a->block_count; block++)
+      if (a->reached[block])
+        absint__walk(a, block, a->states + block * bytes, ABSINT__DESCEND);
+    uint8_t *swap = a->states;
+    a->states = a->next_states;
+    a->next_states = swap;
+    swap = a->reached;
+    a->reached = a->next_reached;
+    a->next_reached = swap;
+  }
+
+  result->proved = (uint8_t *)calloc(gf->count, 1);
+  a->truths = (uint8_t *)calloc(gf->count, 1);
+  if (!result->proved || !a->truths) {
+    free(result->proved);
+    result->proved = NULL;
+    absint__scratch_free(a);
+    return 0;
+  }
+  for (uint32_t block = 0; block < a->block_count; block++)
+    if (a->reached[block])
+      absint__walk(a, block, a->states + block * bytes, ABSINT__RECORD);
+  for (size_t pc = 0; pc < f->count; pc++) {
+    uint32_t at = f->code[pc].arg;
+    if (f->code[pc].op != BYTECODE_ASSERT || (a->truths[at] & ABSINT__SEEN))
+      continue;
+    a->truths[at] |= ABSINT__SEEN;
+    a->stats.assertions++;
+    if (!(a->truths[at] & ABSINT__MAY_FAIL)) {
+      result->proved[at] = 1;
+      a->stats.proved++;
+    }
+  }
+
+  size_t capacity = 0;
+  for (uint32_t pc = 0; pc < f->count; pc++) {
+    uint64_t iterations = 0;
+    if (!absint__is_jump(f->code[pc].op) || f->code[pc].arg > pc)
+      continue;
+    a->stats.loops++;
+    if (!absint__bound(a, pc, &iterations))
+      continue;
+    if (!goto__grow((void **)&result->loops, &capacity,
+                    result->loop_count + 1, sizeof(absint_loop), 0))
+      break;
+    result->loops[result->loop_count++] = (absint_loop){
+        f->origin[pc], f->origin[f->code[pc].arg], iterations};
+    a->stats.bounded++;
+  }
+
+  absint__scratch_free(a);
+  result->analyzed = 1;
+  a->stats.functions++;
+  return 1;
+}
+
+_Bool absint_proved(const absint *a, size_t function, size_t pc) {
+  if (function >= a->function_count || !a->functions[function].analyzed)
+    return 0;
+  goto_function *gf = goto_program_function_at(a->bp->program, function);
+  return pc < gf->count && a->functions[function].proved[pc];
+}
+
+size_t absint_loops(const absint *a, size_t function,
+                    const absint_loop **loops) {
+  if (function >= a->function_count || !a->functions[function].analyzed) {
+    *loops = NULL;
+    return 0;
+  }
+  *loops = a->functions[function].loops;
+  return a->functions[function].loop_count;
+}
+
+absint_stats absint_statistics(const absint *a) { return a->stats; }
+
+uint64_t absint_tests() {
+  uint64_t errors = 0;
+
+  printf("Abstract interpretation suite...\n");
+
+  {
+    printf("- Assertions and loops of the bytecode program... ");
+    bytecode__test t;
+    goto_program *p = bytecode__t_program(&t);
+    bytecode_program *bp = bytecode_program_create(p);
+    absint *a = absint_create(bp, NULL);
+    _Bool ok = a && absint_analyze(a, 0);
+    // x is only known to grow, z > 5 after the assumption, g comes from a
+    // call
+    ok &= a && absint_proved(a, 0, 12) && !absint_proved(a, 0, 6) &&
+          !absint_proved(a, 0, 7) && !absint_proved(a, 0, 9) &&
+          !absint_proved(a, 0, 0);
+    const absint_loop *loops = NULL;
+    ok &= a && absint_loops(a, 0, &loops) == 1 && loops[0].latch == 5 &&
+          loops[0].head == 2 && loops[0].iterations == 10;
+    // spin loops on nothing, bad can not be lowered
+    ok &= a && absint_analyze(a, 2) && absint_loops(a, 2, &loops) == 0;
+    ok &= a && !absint_analyze(a, 3) && !absint_proved(a, 3, 0);
+    absint_stats stats = a ? absint_statistics(a) : (absint_stats){0};
+    ok &= stats.functions == 2 && stats.assertions == 4 && stats.proved == 1 &&
+          stats.loops == 2 && stats.bounded == 1;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    absint_destroy(a);
+    bytecode_program_destroy(bp);
+    goto_program_destroy(p);
+    irep_store_destroy(t.ireps);
+    interner_destroy(t.strings);
+  }
+
+  {
+    printf("- Refinement and narrowing... ");
+    bytecode__test t = {.instruction_capacity = 16};
+    t.strings = interner_create();
+    t.ireps = irep_store_create();
+    t.program = (goto_program *)calloc(1, sizeof(goto_program));
+    goto_program *p = t.program;
+    p->strings = t.strings;
+    p->ireps = t.ireps;
+    p->functions = (goto_function *)calloc(1, sizeof(goto_function));
+    p->function_index_capacity = 16;
+    p->function_index = (uint32_t *)calloc(16, sizeof(uint32_t));
+    p->pool_capacity = 16;
+    p->pool = (uint64_t *)calloc(p->pool_capacity, sizeof(uint64_t));
+
+    uint64_t int32 = bytecode__t_type(&t, "signedbv", "32");
+    uint64_t boolean = bytecode__t_leaf(&t, "bool");
+    uint64_t nil = bytecode__t_leaf(&t, "nil");
+    uint64_t yes = bytecode__t_constant(&t, "true", boolean);
+    uint64_t n = bytecode__t_symbol(&t, "main::n", int32);
+    uint64_t i = bytecode__t_symbol(&t, "main::i", int32);
+    uint64_t zero = bytecode__t_constant(&t, "0", int32);
+    uint64_t two = bytecode__t_constant(&t, "2", int32);
+
+    // 0: decl n
+    // 1: assume n < 5
+    // 2: assume n >= 0
+    // 3: i = 0
+    // 4: if !(i < n) goto 7
+    // 5: i = i + 2
+    // 6: goto 4
+    // 7: assert i <= 6
+    // 8: assert n == 7
+    // 9: END_FUNCTION
+    goto_function *main_ = bytecode__t_function(&t, "main");
+    uint64_t subs[2];
+    bytecode__t_add(&t, main_, GOTO_DECL, bytecode__t_code(&t, "decl", &n, 1),
+                    yes, GOTO_NIL_TARGET);
+    bytecode__t_add(&t, main_, GOTO_ASSUME, nil,
+                    bytecode__t_binary(&t, "<", boolean, n,
+                                       bytecode__t_constant(&t, "5", int32)),
+                    GOTO_NIL_TARGET);
+    bytecode__t_add(&t, main_, GOTO_ASSUME, nil,
+                    bytecode__t_binary(&t, ">=", boolean, n, zero),
+                    GOTO_NIL_TARGET);
+    subs[0] = i, subs[1] = zero;
+    bytecode__t_add(&t, main_, GOTO_ASSIGN,
+                    bytecode__t_code(&t, "assign", subs, 2), yes,
+                    GOTO_NIL_TARGET);
+    uint64_t less = bytecode__t_binary(&t, "<", boolean, i, n);
+    bytecode__t_add(&t, main_, GOTO_GOTO, nil,
+                    bytecode__t_node(&t, "not", boolean, &less, 1), 7);
+    subs[0] = i, subs[1] = bytecode__t_binary(&t, "+", int32, i, two);
+    bytecode__t_add(&t, main_, GOTO_ASSIGN,
+                    bytecode__t_code(&t, "assign", subs, 2), yes,
+                    GOTO_NIL_TARGET);
+    bytecode__t_add(&t, main_, GOTO_GOTO, nil, yes, 4);
+    bytecode__t_add(&t, main_, GOTO_ASSERT, nil,
+                    bytecode__t_binary(&t, "<=", boolean, i,
+                                       bytecode__t_constant(&t, "6", int32)),
+                    GOTO_NIL_TARGET);
+    bytecode__t_add(&t, main_, GOTO_ASSERT, nil,
+                    bytecode__t_binary(&t, "=", boolean, n,
+                                       bytecode__t_constant(&t, "7", int32)),
+                    GOTO_NIL_TARGET);
+    bytecode__t_add(&t, main_, GOTO_END_FUNCTION, nil, yes, GOTO_NIL_TARGET);
+
+    bytecode_program *bp = bytecode_program_create(p);
+    absint *a = absint_create(bp, &absint_intervals);
+    _Bool ok = a && absint_analyze(a, 0);
+    // Widening loses the bound of i, the descending passes get it back
+    ok &= a && absint_proved(a, 0, 7) && !absint_proved(a, 0, 8);
+    const absint_loop *loops = NULL;
+    ok &= a && absint_loops(a, 0, &loops) == 1 && loops[0].latch == 6 &&
+          loops[0].head == 4 && loops[0].iterations == 2;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    absint_destroy(a);
+    bytecode_program_destroy(bp);
+    goto_program_destroy(p);
+    irep_store_destroy(t.ireps);
+    interner_destroy(t.strings);
+  }
+
+  return errors;
+}
+
+#endif
+#endif
@@ -0,0 +1,190 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Microbenchmark harness behind farol --bench, which ./nob bench builds
+// with the release flags and runs.
+//
+// A case is timed between bench_begin and bench_end, which prints its
+// ns/op and the allocations and bytes it asked malloc for, per op. Results
+// can be saved to a baseline file and later runs compared against it.
+//
+// Allocations are counted by redirecting malloc, calloc and realloc to
+// counting wrappers, in a translation unit that defines
+// BENCH_COUNT_ALLOCATIONS and includes this header before anything else that
+// allocates, as the farol of ./nob bench does. What libraries allocate (Z3,
+// strdup) is not seen. Elsewhere the counts stay 0 and allocation costs
+// nothing extra.
+
+typedef struct {
+  char name[64];
+  uint64_t ops;
+  double ns_per_op;
+  double allocations_per_op;
+  double bytes_per_op;
+} bench_result;
+
+typedef struct {
+  const char *filter; // only cases whose name contains it, NULL for all
+  bench_result *results;
+  size_t length, capacity;
+  // Of the running case
+  const char *name;
+  uint64_t started, allocations, bytes;
+} bench;
+
+// 0 when the case is filtered out, skip it then
+_Bool bench_begin(bench *b, const char *name);
+// Ends the case bench_begin started, ops being what it did
+void bench_end(bench *b, uint64_t ops);
+void bench_free(bench *b);
+
+// One case per line: name, ns/op, allocations/op, bytes/op
+_Bool bench_save(const bench *b, const char *path);
+// Prints every case against the baseline, returns how many are slower by
+// more than tolerance (0.1 for 10%), SIZE_MAX when the file can not be read
+size_t bench_compare(const bench *b, const char *path, double tolerance);
+
+extern atomic_uint_fast64_t bench__allocations, bench__bytes;
+void *bench__malloc(size_t size);
+void *bench__calloc(size_t count, size_t size);
+void *bench__realloc(void *p, size_t size);
+
+#ifdef BENCH_IMPL
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+atomic_uint_fast64_t bench__allocations, bench__bytes;
+
+void *bench__malloc(size_t size) {
+  atomic_fetch_add_explicit(&bench__allocations, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&bench__bytes, size, memory_order_relaxed);
+  return malloc(size);
+}
+
+void *bench__calloc(size_t count, size_t size) {
+  atomic_fetch_add_explicit(&bench__allocations, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&bench__bytes, count * size, memory_order_relaxed);
+  return calloc(count, size);
+}
+
+void *bench__realloc(void *p, size_t size) {
+  atomic_fetch_add_explicit(&bench__allocations, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&bench__bytes, size, memory_order_relaxed);
+  return realloc(p, size);
+}
+
+static uint64_t bench__nanos(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+_Bool bench_begin(bench *b, const char *name) {
+  if (b->filter && !strstr(name, b->filter))
+    return 0;
+  b->name = name;
+  b->allocations = atomic_load(&bench__allocations);
+  b->bytes = atomic_load(&bench__bytes);
+  b->started = bench__nanos();
+  return 1;
+}
+
+void bench_end(bench *b, uint64_t ops) {
+  uint64_t nanos = bench__nanos() - b->started;
+  uint64_t allocations = atomic_load(&bench__allocations) - b->allocations;
+  uint64_t bytes = atomic_load(&bench__bytes) - b->bytes;
+  if (!ops)
+    ops = 1;
+  bench_result r = {.ops = ops,
+                    .ns_per_op = (double)nanos / ops,
+                    .allocations_per_op = (double)allocations / ops,
+                    .bytes_per_op = (double)bytes / ops};
+  snprintf(r.name, sizeof(r.name), "%s", b->name);
+  printf("- %-32s %10.1f ns/op %8.3f allocs/op %10.1f B/op  (%llu ops)\n",
+         r.name, r.ns_per_op, r.allocations_per_op, r.bytes_per_op,
+         (unsigned long long)ops);
+  if (b->length == b->capacity) {
+    size_t capacity = b->capacity ? 2 * b->capacity : 16;
+    bench_result *grown =
+        (bench_result *)realloc(b->results, sizeof(bench_result) * capacity);
+    if (!grown)
+      return;
+    b->results = grown;
+    b->capacity = capacity;
+  }
+  b->results[b->length++] = r;
+}
+
+void bench_free(bench *b) {
+  free(b->results);
+  b->results = NULL;
+  b->length = b->capacity = 0;
+}
+
+_Bool bench_save(const bench *b, const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    fprintf(stderr, "bench: could not create %s\n", path);
+    return 0;
+  }
+  _Bool ok = 1;
+  for (size_t i = 0; i < b->length; i++) {
+    const bench_result *r = &b->results[i];
+    ok &= fprintf(f, "%s %.3f %.6f %.3f\n", r->name, r->ns_per_op,
+                  r->allocations_per_op, r->bytes_per_op) > 0;
+  }
+  ok &= fclose(f) == 0;
+  if (!ok)
+    fprintf(stderr, "bench: could not write %s\n", path);
+  return ok;
+}
+
+size_t bench_compare(const bench *b, const char *path, double tolerance) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "bench: could not read %s\n", path);
+    return SIZE_MAX;
+  }
+  printf("Against %s...\n", path);
+  size_t slower = 0, compared = 0;
+  char name[64];
+  double ns, allocations, bytes;
+  while (fscanf(f, "%63s %lf %lf %lf", name, &ns, &allocations, &bytes) == 4) {
+    const bench_result *r = NULL;
+    for (size_t i = 0; !r && i < b->length; i++)
+      if (!strcmp(b->results[i].name, name))
+        r = &b->results[i];
+    if (!r)
+      continue;
+    compared++;
+    double change = ns > 0 ? (r->ns_per_op - ns) / ns : 0;
+    _Bool regressed = change > tolerance;
+    slower += regressed;
+    printf("- %-32s %10.1f -> %10.1f ns/op %+7.1f%%, allocs/op %.3f -> "
+           "%.3f%s\n",
+           name, ns, r->ns_per_op, 100 * change, allocations,
+           r->allocations_per_op, regressed ? "  SLOWER" : "");
+  }
+  fclose(f);
+  printf("%zu of %zu cases slower by more than %.0f%%\n", slower, compared,
+         100 * tolerance);
+  return slower;
+}
+
+#endif
+
+// After the implementation, which needs the real ones
+#ifdef BENCH_COUNT_ALLOCATIONS
+#define malloc(size) bench__malloc(size)
+#define calloc(count, size) bench__calloc(count, size)
+#define realloc(p, size) bench__realloc(p, size)
+#endif
+
+#endif
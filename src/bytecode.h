@@ -0,0 +1,1957 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "goto_binary.h"
+#include "irep.h"
+#include "u64_map.h"
+
+// Concrete interpreter for GOTO programs. Every function is lowered once, the
+// first time it is called, from its irep trees into a flat array of fixed
+// width instructions for a stack machine, which a dispatch loop then runs.
+//
+// Values are bitvectors of up to 64 bits, kept in a uint64_t in canonical
+// form: unsigned values zero extended, signed values sign extended. Locals
+// live in frame slots (slot 0 holds the return value, parameters follow),
+// static lifetime symbols in program wide global slots. Jump targets are
+// bytecode indices. Lowering fails, with a diagnostic, on anything outside
+// that subset (memory, structs, floats, threads...).
+//
+// and, or and if evaluate every operand, as an operator on the stack, unless
+// an operand C would skip can stop the run (a division by something other
+// than a nonzero constant). Those are evaluated first, with jumps, into a
+// slot the expression then loads, so the stack is empty at every jump.
+
+#define BYTECODE_OPS(X)                                                      \
+  X(CONST) X(LOAD) X(STORE) X(GLOAD) X(GSTORE) X(POP) X(NONDET)              \
+  X(ADD) X(SUB) X(MUL) X(DIV) X(MOD) X(NEG)                                  \
+  X(BAND) X(BOR) X(BXOR) X(BNOT) X(SHL) X(SHR) X(LSHR)                       \
+  X(EQ) X(NE) X(LT) X(LE) X(GT) X(GE) X(LAND) X(LOR) X(LNOT)                 \
+  X(CAST) X(SELECT) X(JUMP) X(JUMP_IF) X(JUMP_IFNOT)                         \
+  X(ASSUME) X(ASSERT) X(CALL) X(RET)
+
+typedef enum {
+#define BYTECODE__ENUM(name) BYTECODE_##name,
+  BYTECODE_OPS(BYTECODE__ENUM)
+#undef BYTECODE__ENUM
+  BYTECODE_OP_COUNT
+} bytecode_op;
+
+// Type flags
+#define BYTECODE_SIGNED 1
+#define BYTECODE_BOOL 2 // conversions to it test against zero
+
+typedef struct {
+  uint8_t op;
+  uint8_t width; // of the result, 1..64
+  uint8_t flags; // of the result, of the operands for comparisons
+  uint8_t unused;
+  uint32_t arg;  // slot, jump target, function index, GOTO instruction index
+  uint64_t imm;  // constant, argument count or symbol id
+} bytecode_insn;
+
+// State of one run, shared by the interpreter and native code
+typedef struct bytecode_exec bytecode_exec;
+// A function compiled to native code. Arguments are in parameter order, the
+// return value goes to ret. Returns 0 when the run stopped.
+typedef _Bool (*bytecode_native)(bytecode_exec *x, const uint64_t *args,
+                                 uint64_t *ret);
+
+typedef enum {
+  BYTECODE_NOT_LOWERED = 0,
+  BYTECODE_LOWERED,
+  BYTECODE_NO_BODY, // calls return a nondet value
+  BYTECODE_FAILED,
+} bytecode_state;
+
+typedef struct {
+  bytecode_insn *code;
+  uint32_t *origin; // GOTO instruction index of every bytecode instruction
+  size_t count;
+  uint32_t slot_count;
+  uint32_t param_count;
+  uint32_t max_stack;
+  bytecode_state state;
+  // Tiering, see bytecode_tier
+  uint64_t calls;
+  uint64_t back_jumps;
+  bytecode_native native;
+  _Bool native_tried;
+} bytecode_function;
+
+#define BYTECODE_HOT_CALLS 1000
+#define BYTECODE_HOT_LOOPS 10000
+
+// Functions start in the interpreter. Once one has been called
+// call_threshold times, or has taken loop_threshold backward jumps, it is
+// handed to compile, once, and its native code is used from the next call
+// on. Without a compile function the counters just count.
+typedef struct bytecode_program bytecode_program;
+
+typedef struct {
+  bytecode_native (*compile)(void *jit, bytecode_program *bp,
+                             size_t function);
+  void *jit;
+  uint64_t call_threshold;
+  uint64_t loop_threshold;
+} bytecode_tier;
+
+typedef struct {
+#define BYTECODE__NAME_FIELD(field, string) uint64_t field;
+#define BYTECODE_NAMES(X)                                                    \
+  X(symbol, "symbol") X(identifier, "identifier") X(constant, "constant")    \
+  X(value, "value") X(type, "type") X(width, "width")                        \
+  X(signedbv, "signedbv") X(unsignedbv, "unsignedbv") X(bool_, "bool")       \
+  X(c_bool, "c_bool") X(pointer, "pointer") X(nil, "nil") X(true_, "true")   \
+  X(false_, "false") X(null, "NULL") X(statement, "statement")               \
+  X(side_effect, "side_effect") X(nondet, "nondet") X(code, "code")          \
+  X(parameters, "parameters") X(parameter_identifier, "#identifier")        \
+  X(not_, "not") X(and_, "and")
+  BYTECODE_NAMES(BYTECODE__NAME_FIELD)
+#undef BYTECODE__NAME_FIELD
+} bytecode_names;
+
+struct bytecode_program {
+  goto_program *program;
+  bytecode_function *functions; // parallel to program->functions
+  bytecode_tier tier;
+  bytecode_names names;
+  u64_map operators; // expression id -> bytecode__operators index
+  u64_map symbols;   // name -> symbol index
+  u64_map globals;   // name -> global slot
+  u64_map types;     // type node -> width | flags << 8
+  uint64_t *global_values;
+  size_t global_capacity;
+  uint32_t max_stack; // of every lowered function
+};
+
+typedef struct {
+  // Value of a nondet side effect or a fresh declaration, symbol is
+  // IREP_NIL for the former. Returns 0 when not set.
+  uint64_t (*nondet)(void *ctx, uint64_t symbol, uint8_t width,
+                     uint8_t flags);
+  // Called on every assertion and assumption with the value of its
+  // condition, the run stops when they return 0. When not set a run goes on
+  // while conditions hold.
+  _Bool (*assertion)(void *ctx, size_t function, size_t pc, _Bool holds);
+  _Bool (*assumption)(void *ctx, size_t function, size_t pc, _Bool holds);
+  void *ctx;
+  uint64_t max_steps; // jumps and calls, 0 for no limit
+} bytecode_hooks;
+
+typedef enum {
+  BYTECODE_DONE,
+  BYTECODE_ASSERTION_STOP,
+  BYTECODE_ASSUMPTION_STOP,
+  BYTECODE_STEP_LIMIT,
+  BYTECODE_ERROR,
+} bytecode_status;
+
+typedef struct {
+  bytecode_status status;
+  // Where the run stopped, pc is a GOTO instruction index
+  size_t function, pc;
+  uint64_t steps;
+} bytecode_result;
+
+bytecode_program *bytecode_program_create(goto_program *program);
+void bytecode_program_destroy(bytecode_program *bp);
+// NULL if the function has no body or can not be lowered
+bytecode_function *bytecode_lower(bytecode_program *bp, size_t function);
+// Globals start at 0 on every run, CBMC initializes them in its entry point
+bytecode_result bytecode_run(bytecode_program *bp, size_t function,
+                             const bytecode_hooks *hooks);
+// Value left by the last run, 0 for unknown symbols
+uint64_t bytecode_global(const bytecode_program *bp, uint64_t name);
+
+// How lowering reads expressions, for the other passes that need to agree
+// with it. They only read bp, so threads can share it.
+// Width and BYTECODE_ flags of a type node, 0 if it is not a bitvector or a
+// boolean
+_Bool bytecode_decode_type(const bytecode_program *bp, uint64_t type,
+                           uint8_t *width, uint8_t *flags);
+// Value of a constant expression of that type, canonical as on the stack
+_Bool bytecode_decode_constant(const bytecode_program *bp, uint64_t expr,
+                               uint8_t width, uint8_t flags, uint64_t *v);
+// BYTECODE_ operation of an expression id, -1 if it is not an operator
+int bytecode_decode_operator(const bytecode_program *bp, uint64_t id);
+
+// What native code calls back into, with the same semantics as the
+// interpreter. The _Bool ones return 0 when the run stopped, pc is a GOTO
+// instruction index.
+_Bool bytecode_exec_call(bytecode_exec *x, size_t function,
+                         const uint64_t *args, size_t argc, uint64_t *ret);
+_Bool bytecode_exec_step(bytecode_exec *x, size_t function, size_t pc);
+_Bool bytecode_exec_check(bytecode_exec *x, size_t function, size_t pc,
+                          _Bool holds, _Bool assertion);
+uint64_t bytecode_exec_nondet(bytecode_exec *x, uint64_t symbol, uint8_t width,
+                              uint8_t flags);
+_Bool bytecode_exec_error(bytecode_exec *x, size_t function, size_t pc);
+// Global slots, they move when a call adds globals
+uint64_t *bytecode_exec_globals(bytecode_exec *x);
+
+uint64_t bytecode_tests();
+// Whole runs of a small program and dispatch alone
+void bytecode_bench(bench *b, size_t runs);
+#ifdef BYTECODE_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+enum { BYTECODE__UNARY, BYTECODE__BINARY, BYTECODE__NARY, BYTECODE__COMPARE,
+       BYTECODE__TERNARY };
+
+static const struct {
+  const char *id;
+  uint8_t op;
+  uint8_t kind;
+} bytecode__operators[] = {
+    {"+", BYTECODE_ADD, BYTECODE__NARY},
+    {"-", BYTECODE_SUB, BYTECODE__BINARY},
+    {"*", BYTECODE_MUL, BYTECODE__NARY},
+    {"/", BYTECODE_DIV, BYTECODE__BINARY},
+    {"mod", BYTECODE_MOD, BYTECODE__BINARY},
+    {"unary-", BYTECODE_NEG, BYTECODE__UNARY},
+    {"bitand", BYTECODE_BAND, BYTECODE__NARY},
+    {"bitor", BYTECODE_BOR, BYTECODE__NARY},
+    {"bitxor", BYTECODE_BXOR, BYTECODE__NARY},
+    {"bitnot", BYTECODE_BNOT, BYTECODE__UNARY},
+    {"shl", BYTECODE_SHL, BYTECODE__BINARY},
+    {"ashr", BYTECODE_SHR, BYTECODE__BINARY},
+    {"lshr", BYTECODE_LSHR, BYTECODE__BINARY},
+    {"=", BYTECODE_EQ, BYTECODE__COMPARE},
+    {"notequal", BYTECODE_NE, BYTECODE__COMPARE},
+    {"<", BYTECODE_LT, BYTECODE__COMPARE},
+    {"<=", BYTECODE_LE, BYTECODE__COMPARE},
+    {">", BYTECODE_GT, BYTECODE__COMPARE},
+    {">=", BYTECODE_GE, BYTECODE__COMPARE},
+    {"and", BYTECODE_LAND, BYTECODE__NARY},
+    {"or", BYTECODE_LOR, BYTECODE__NARY},
+    {"not", BYTECODE_LNOT, BYTECODE__UNARY},
+    {"typecast", BYTECODE_CAST, BYTECODE__UNARY},
+    {"if", BYTECODE_SELECT, BYTECODE__TERNARY},
+};
+
+bytecode_program *bytecode_program_create(goto_program *program) {
+  bytecode_program *bp = (bytecode_program *)calloc(1, sizeof(*bp));
+  if (!bp)
+    return NULL;
+  bp->program = program;
+  bp->tier.call_threshold = BYTECODE_HOT_CALLS;
+  bp->tier.loop_threshold = BYTECODE_HOT_LOOPS;
+  bp->functions = (bytecode_function *)calloc(
+      program->function_count ? program->function_count : 1,
+      sizeof(bytecode_function));
+  _Bool ok = bp->functions != NULL;
+  ok &= u64_map_init(&bp->operators, sizeof(bytecode__operators) /
+                                         sizeof(bytecode__operators[0]));
+  ok &= u64_map_init(&bp->symbols, program->symbol_count);
+  ok &= u64_map_init(&bp->globals, 0);
+  ok &= u64_map_init(&bp->types, 0);
+  if (!ok) {
+    bytecode_program_destroy(bp);
+    return NULL;
+  }
+
+#define BYTECODE__NAME_INTERN(field, string)                                 \
+  bp->names.field = goto_program_intern(program, string);
+  BYTECODE_NAMES(BYTECODE__NAME_INTERN)
+#undef BYTECODE__NAME_INTERN
+  for (size_t i = 0;
+       ok && i < sizeof(bytecode__operators) / sizeof(bytecode__operators[0]);
+       i++)
+    ok &= u64_map_put(&bp->operators,
+                      goto_program_intern(program, bytecode__operators[i].id),
+                      i);
+  for (size_t i = 0; ok && i < program->symbol_count; i++)
+    ok &= u64_map_put(&bp->symbols, program->symbols[i].name, i);
+  if (!ok) {
+    bytecode_program_destroy(bp);
+    return NULL;
+  }
+  return bp;
+}
+
+void bytecode_program_destroy(bytecode_program *bp) {
+  if (bp->functions) {
+    for (size_t i = 0; i < bp->program->function_count; i++) {
+      free(bp->functions[i].code);
+      free(bp->functions[i].origin);
+    }
+  }
+  free(bp->functions);
+  free(bp->global_values);
+  u64_map_free(&bp->operators);
+  u64_map_free(&bp->symbols);
+  u64_map_free(&bp->globals);
+  u64_map_free(&bp->types);
+  free(bp);
+}
+
+uint64_t bytecode_global(const bytecode_program *bp, uint64_t name) {
+  uint64_t *slot = u64_map_get(&bp->globals, name);
+  return slot ? bp->global_values[*slot] : 0;
+}
+
+static inline uint64_t bytecode__norm(uint64_t v, uint8_t width,
+                                      uint8_t flags) {
+  if (width >= 64)
+    return v;
+  if (flags & BYTECODE_SIGNED) {
+    unsigned shift = 64 - width;
+    return (uint64_t)((int64_t)(v << shift) >> shift);
+  }
+  return v & ((UINT64_C(1) << width) - 1);
+}
+
+typedef struct {
+  bytecode_program *bp;
+  size_t index;
+  bytecode_function *f;
+  size_t capacity;
+  u64_map locals; // name -> slot
+  uint32_t depth;
+  // Bytecode indices of jumps within expressions, their targets are
+  // bytecode indices already
+  uint32_t *branches;
+  size_t branch_count, branch_capacity;
+  // Slots of the short circuits evaluated ahead of the expression being
+  // lowered, in the order it reaches them
+  uint32_t *hoisted;
+  size_t hoisted_count, hoisted_next, hoisted_capacity;
+  const char *error;
+  uint64_t error_id;
+} bytecode__lowering;
+
+static _Bool bytecode__fail(bytecode__lowering *l, const char *error,
+                            uint64_t id) {
+  if (!l->error) {
+    l->error = error;
+    l->error_id = id;
+  }
+  return 0;
+}
+
+static _Bool bytecode__emit(bytecode__lowering *l, uint8_t op, uint8_t width,
+                            uint8_t flags, uint32_t arg, uint64_t imm,
+                            int stack_effect, uint32_t origin) {
+  bytecode_function *f = l->f;
+  if (f->count == l->capacity) {
+    size_t capacity = l->capacity ? l->capacity * 2 : 64;
+    bytecode_insn *code =
+        (bytecode_insn *)realloc(f->code, sizeof(bytecode_insn) * capacity);
+    if (!code)
+      return bytecode__fail(l, "out of memory", IREP_NIL);
+    f->code = code;
+    uint32_t *origins =
+        (uint32_t *)realloc(f->origin, sizeof(uint32_t) * capacity);
+    if (!origins)
+      return bytecode__fail(l, "out of memory", IREP_NIL);
+    f->origin = origins;
+    l->capacity = capacity;
+  }
+  f->code[f->count] = (bytecode_insn){op, width, flags, 0, arg, imm};
+  f->origin[f->count] = origin;
+  f->count++;
+  l->depth += stack_effect;
+  if (l->depth > f->max_stack)
+    f->max_stack = l->depth;
+  return 1;
+}
+
+_Bool bytecode_decode_type(const bytecode_program *bp, uint64_t type,
+                           uint8_t *width, uint8_t *flags) {
+  const goto_program *p = bp->program;
+  uint64_t id = type == IREP_NIL ? IREP_NIL : irep_id(p->ireps, type);
+  uint64_t w = 0;
+  *flags = 0;
+  if (id == bp->names.bool_) {
+    w = 1;
+    *flags = BYTECODE_BOOL;
+  } else if (id == bp->names.signedbv || id == bp->names.unsignedbv ||
+             id == bp->names.c_bool || id == bp->names.pointer) {
+    uint64_t node = irep_find(p->ireps, type, bp->names.width);
+    size_t length = 0;
+    const char *digits =
+        node == IREP_NIL ? "" : goto_program_string(p, irep_id(p->ireps, node), &length);
+    for (size_t i = 0; i < length && w <= 64; i++)
+      w = digits[i] >= '0' && digits[i] <= '9' ? w * 10 + (digits[i] - '0') : 65;
+    if (w > 64)
+      w = 0;
+    if (id == bp->names.signedbv)
+      *flags = BYTECODE_SIGNED;
+    else if (id == bp->names.c_bool)
+      *flags = BYTECODE_BOOL;
+  }
+  *width = w;
+  return w != 0;
+}
+
+// Width and flags of a bitvector type, 0 if it is something else
+static _Bool bytecode__type(bytecode__lowering *l, uint64_t type,
+                            uint8_t *width, uint8_t *flags) {
+  bytecode_program *bp = l->bp;
+  uint64_t *known = u64_map_get(&bp->types, type);
+  if (known) {
+    *width = *known & 0xff;
+    *flags = *known >> 8;
+    return *width || bytecode__fail(l, "unsupported type", IREP_NIL);
+  }
+
+  _Bool ok = bytecode_decode_type(bp, type, width, flags);
+  if (!u64_map_put(&bp->types, type, *width | (uint64_t)*flags << 8))
+    return bytecode__fail(l, "out of memory", IREP_NIL);
+  if (!ok)
+    return bytecode__fail(
+        l, "unsupported type",
+        type == IREP_NIL ? IREP_NIL : irep_id(bp->program->ireps, type));
+  return 1;
+}
+
+static _Bool bytecode__expr_type(bytecode__lowering *l, uint64_t expr,
+                                 uint8_t *width, uint8_t *flags) {
+  return bytecode__type(
+      l, irep_find(l->bp->program->ireps, expr, l->bp->names.type), width,
+      flags);
+}
+
+// Constants are written as bitvectors in hex, or in binary by older CBMC
+// versions (a binary string is always as long as the type is wide)
+_Bool bytecode_decode_constant(const bytecode_program *bp, uint64_t expr,
+                               uint8_t width, uint8_t flags, uint64_t *v) {
+  const bytecode_names *n = &bp->names;
+  uint64_t node = irep_find(bp->program->ireps, expr, n->value);
+  uint64_t id = node == IREP_NIL ? IREP_NIL : irep_id(bp->program->ireps, node);
+  if (id == n->true_ || id == n->false_ || id == n->null) {
+    *v = id == n->true_;
+    return 1;
+  }
+  if (id == IREP_NIL)
+    return 0;
+
+  size_t length;
+  const char *s = goto_program_string(bp->program, id, &length);
+  _Bool binary = length == width;
+  for (size_t i = 0; binary && i < length; i++)
+    binary = s[i] == '0' || s[i] == '1';
+  uint64_t value = 0;
+  for (size_t i = 0; i < length; i++) {
+    char c = s[i];
+    unsigned digit;
+    if (c >= '0' && c <= '9')
+      digit = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      digit = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      digit = c - 'A' + 10;
+    else
+      return 0;
+    value = binary ? value << 1 | digit : value << 4 | digit;
+  }
+  *v = bytecode__norm(value, width, flags);
+  return 1;
+}
+
+static _Bool bytecode__constant(bytecode__lowering *l, uint64_t expr,
+                                uint8_t width, uint8_t flags, uint64_t *v) {
+  return bytecode_decode_constant(l->bp, expr, width, flags, v) ||
+         bytecode__fail(l, "bad constant", irep_id(l->bp->program->ireps, expr));
+}
+
+int bytecode_decode_operator(const bytecode_program *bp, uint64_t id) {
+  uint64_t *op = u64_map_get(&bp->operators, id);
+  return op ? bytecode__operators[*op].op : -1;
+}
+
+// Global slot for static lifetime symbols, local slot for the rest
+static _Bool bytecode__slot(bytecode__lowering *l, uint64_t name,
+                            _Bool *global, uint32_t *slot) {
+  bytecode_program *bp = l->bp;
+  uint64_t *symbol = u64_map_get(&bp->symbols, name);
+  *global = symbol && (bp->program->symbols[*symbol].flags &
+                       GOTO_SYMBOL_IS_STATIC_LIFETIME);
+  u64_map *slots = *global ? &bp->globals : &l->locals;
+  uint64_t *known = u64_map_get(slots, name);
+  if (known) {
+    *slot = *known;
+    return 1;
+  }
+
+  if (*global) {
+    *slot = bp->globals.length;
+    if (*slot >= bp->global_capacity) {
+      size_t capacity = bp->global_capacity ? bp->global_capacity * 2 : 64;
+      uint64_t *values =
+          (uint64_t *)realloc(bp->global_values, sizeof(uint64_t) * capacity);
+      if (!values)
+        return bytecode__fail(l, "out of memory", IREP_NIL);
+      memset(values + bp->global_capacity, 0,
+             sizeof(uint64_t) * (capacity - bp->global_capacity));
+      bp->global_values = values;
+      bp->global_capacity = capacity;
+    }
+  } else {
+    *slot = l->f->slot_count++;
+  }
+  if (!u64_map_put(slots, name, *slot))
+    return bytecode__fail(l, "out of memory", IREP_NIL);
+  return 1;
+}
+
+static _Bool bytecode__lazy(bytecode__lowering *l, uint64_t expr);
+
+static _Bool bytecode__expr(bytecode__lowering *l, uint64_t expr,
+                            uint32_t origin) {
+  bytecode_program *bp = l->bp;
+  const irep_store *ireps = bp->program->ireps;
+  bytecode_names *n = &bp->names;
+  uint64_t id = irep_id(ireps, expr);
+  uint8_t width, flags;
+  if (!bytecode__expr_type(l, expr, &width, &flags))
+    return 0;
+
+  if (id == n->symbol) {
+    uint64_t name = irep_find(ireps, expr, n->identifier);
+    _Bool global;
+    uint32_t slot;
+    if (name == IREP_NIL)
+      return bytecode__fail(l, "symbol without identifier", id);
+    if (!bytecode__slot(l, irep_id(ireps, name), &global, &slot))
+      return 0;
+    return bytecode__emit(l, global ? BYTECODE_GLOAD : BYTECODE_LOAD, width,
+                          flags, slot, 0, 1, origin);
+  }
+
+  if (id == n->constant) {
+    uint64_t value;
+    if (!bytecode__constant(l, expr, width, flags, &value))
+      return 0;
+    return bytecode__emit(l, BYTECODE_CONST, width, flags, 0, value, 1, origin);
+  }
+
+  if (id == n->side_effect) {
+    uint64_t statement = irep_find(ireps, expr, n->statement);
+    if (statement == IREP_NIL || irep_id(ireps, statement) != n->nondet)
+      return bytecode__fail(l, "unsupported side effect", id);
+    return bytecode__emit(l, BYTECODE_NONDET, width, flags, 0, IREP_NIL, 1,
+                          origin);
+  }
+
+  uint64_t *op = u64_map_get(&bp->operators, id);
+  if (!op)
+    return bytecode__fail(l, "unsupported expression", id);
+  if (bytecode__lazy(l, expr))
+    return bytecode__emit(l, BYTECODE_LOAD, width, flags,
+                          l->hoisted[l->hoisted_next++], 0, 1, origin);
+  size_t count = irep_sub_count(ireps, expr);
+  uint8_t kind = bytecode__operators[*op].kind;
+  size_t expected = kind == BYTECODE__UNARY     ? 1
+                    : kind == BYTECODE__TERNARY ? 3
+                    : kind == BYTECODE__NARY    ? (count >= 2 ? count : 2)
+                                                : 2;
+  if (count != expected)
+    return bytecode__fail(l, "bad operand count", id);
+
+  for (size_t i = 0; i < count; i++)
+    if (!bytecode__expr(l, irep_sub(ireps, expr, i), origin))
+      return 0;
+  // Comparisons go by their operands
+  if (kind == BYTECODE__COMPARE &&
+      !bytecode__expr_type(l, irep_sub(ireps, expr, 0), &width, &flags))
+    return 0;
+  int effect = kind == BYTECODE__UNARY ? 0 : kind == BYTECODE__TERNARY ? -2 : -1;
+  size_t emits = kind == BYTECODE__NARY ? count - 1 : 1;
+  for (size_t i = 0; i < emits; i++)
+    if (!bytecode__emit(l, bytecode__operators[*op].op, width, flags, 0, 0,
+                        effect, origin))
+      return 0;
+  return 1;
+}
+
+// Can evaluating expr stop the run: a division or remainder by anything
+// but a nonzero constant
+static _Bool bytecode__may_trap(bytecode__lowering *l, uint64_t expr) {
+  const bytecode_program *bp = l->bp;
+  const irep_store *ireps = bp->program->ireps;
+  uint64_t *op = u64_map_get(&bp->operators, irep_id(ireps, expr));
+  if (!op)
+    return 0;
+  size_t count = irep_sub_count(ireps, expr);
+  uint8_t code = bytecode__operators[*op].op;
+  if ((code == BYTECODE_DIV || code == BYTECODE_MOD) && count == 2) {
+    uint64_t divisor = irep_sub(ireps, expr, 1);
+    uint8_t width, flags;
+    uint64_t v;
+    if (irep_id(ireps, divisor) != bp->names.constant ||
+        !bytecode_decode_type(bp, irep_find(ireps, divisor, bp->names.type),
+                              &width, &flags) ||
+        !bytecode_decode_constant(bp, divisor, width, flags, &v) || !v)
+      return 1;
+  }
+  for (size_t i = 0; i < count; i++)
+    if (bytecode__may_trap(l, irep_sub(ireps, expr, i)))
+      return 1;
+  return 0;
+}
+
+// and, or and if that need to skip operands. The first operand is always
+// evaluated.
+static _Bool bytecode__lazy(bytecode__lowering *l, uint64_t expr) {
+  const bytecode_program *bp = l->bp;
+  const irep_store *ireps = bp->program->ireps;
+  uint64_t *op = u64_map_get(&bp->operators, irep_id(ireps, expr));
+  uint8_t code = op ? bytecode__operators[*op].op : BYTECODE_OP_COUNT;
+  size_t count = irep_sub_count(ireps, expr);
+  if (code != BYTECODE_LAND && code != BYTECODE_LOR &&
+      (code != BYTECODE_SELECT || count != 3))
+    return 0;
+  for (size_t i = 1; i < count; i++)
+    if (bytecode__may_trap(l, irep_sub(ireps, expr, i)))
+      return 1;
+  return 0;
+}
+
+#define BYTECODE__OPEN UINT32_MAX
+
+// Jump within an expression, to a target bytecode__land sets
+static _Bool bytecode__branch(bytecode__lowering *l, uint8_t op,
+                              uint32_t origin) {
+  if (l->branch_count == l->branch_capacity) {
+    size_t capacity = l->branch_capacity ? l->branch_capacity * 2 : 16;
+    uint32_t *branches =
+        (uint32_t *)realloc(l->branches, sizeof(uint32_t) * capacity);
+    if (!branches)
+      return bytecode__fail(l, "out of memory", IREP_NIL);
+    l->branches = branches;
+    l->branch_capacity = capacity;
+  }
+  l->branches[l->branch_count++] = l->f->count;
+  return bytecode__emit(l, op, 0, 0, BYTECODE__OPEN, 0,
+                        op == BYTECODE_JUMP ? 0 : -1, origin);
+}
+
+// Points the open branches of branches[from, to) at what comes next
+static void bytecode__land(bytecode__lowering *l, size_t from, size_t to) {
+  for (size_t i = from; i < to; i++)
+    if (l->f->code[l->branches[i]].arg == BYTECODE__OPEN)
+      l->f->code[l->branches[i]].arg = l->f->count;
+}
+
+static _Bool bytecode__value(bytecode__lowering *l, uint64_t expr,
+                             uint32_t origin);
+
+// Evaluates a lazy expression into a fresh slot, on an empty stack
+static _Bool bytecode__short_circuit(bytecode__lowering *l, uint64_t expr,
+                                     uint32_t origin, uint32_t *result) {
+  const irep_store *ireps = l->bp->program->ireps;
+  uint8_t width, flags;
+  if (!bytecode__expr_type(l, expr, &width, &flags))
+    return 0;
+  uint8_t op = bytecode_decode_operator(l->bp, irep_id(ireps, expr));
+  uint32_t slot = *result = l->f->slot_count++;
+  size_t count = irep_sub_count(ireps, expr);
+  size_t from = l->branch_count;
+  _Bool ok = 1;
+
+  if (op == BYTECODE_SELECT) {
+    ok = bytecode__value(l, irep_sub(ireps, expr, 0), origin) &&
+         bytecode__branch(l, BYTECODE_JUMP_IFNOT, origin) &&
+         bytecode__value(l, irep_sub(ireps, expr, 1), origin) &&
+         bytecode__emit(l, BYTECODE_STORE, 0, 0, slot, 0, -1, origin);
+    size_t end = l->branch_count;
+    ok = ok && bytecode__branch(l, BYTECODE_JUMP, origin);
+    if (ok)
+      bytecode__land(l, from, end);
+    ok = ok && bytecode__value(l, irep_sub(ireps, expr, 2), origin) &&
+         bytecode__emit(l, BYTECODE_STORE, 0, 0, slot, 0, -1, origin);
+    if (ok)
+      bytecode__land(l, end, l->branch_count);
+    return ok;
+  }
+
+  // and leaves on the first false operand, or on the first true one
+  _Bool and_ = op == BYTECODE_LAND;
+  for (size_t i = 0; ok && i < count; i++)
+    ok = bytecode__value(l, irep_sub(ireps, expr, i), origin) &&
+         bytecode__branch(l, and_ ? BYTECODE_JUMP_IFNOT : BYTECODE_JUMP_IF,
+                          origin);
+  ok = ok && bytecode__emit(l, BYTECODE_CONST, width, flags, 0, and_, 1, origin) &&
+       bytecode__emit(l, BYTECODE_STORE, 0, 0, slot, 0, -1, origin);
+  size_t end = l->branch_count;
+  ok = ok && bytecode__branch(l, BYTECODE_JUMP, origin);
+  if (ok)
+    bytecode__land(l, from, end);
+  ok = ok && bytecode__emit(l, BYTECODE_CONST, width, flags, 0, !and_, 1, origin) &&
+       bytecode__emit(l, BYTECODE_STORE, 0, 0, slot, 0, -1, origin);
+  if (ok)
+    bytecode__land(l, end, l->branch_count);
+  return ok;
+}
+
+// Evaluates the lazy expressions of expr ahead of it, in the order
+// bytecode__expr reaches them
+static _Bool bytecode__hoist(bytecode__lowering *l, uint64_t expr,
+                             uint32_t origin) {
+  const irep_store *ireps = l->bp->program->ireps;
+  if (!u64_map_get(&l->bp->operators, irep_id(ireps, expr)))
+    return 1;
+  if (!bytecode__lazy(l, expr)) {
+    for (size_t i = 0; i < irep_sub_count(ireps, expr); i++)
+      if (!bytecode__hoist(l, irep_sub(ireps, expr, i), origin))
+        return 0;
+    return 1;
+  }
+  uint32_t slot;
+  if (!bytecode__short_circuit(l, expr, origin, &slot))
+    return 0;
+  if (l->hoisted_count == l->hoisted_capacity) {
+    size_t capacity = l->hoisted_capacity ? l->hoisted_capacity * 2 : 16;
+    uint32_t *hoisted =
+        (uint32_t *)realloc(l->hoisted, sizeof(uint32_t) * capacity);
+    if (!hoisted)
+      return bytecode__fail(l, "out of memory", IREP_NIL);
+    l->hoisted = hoisted;
+    l->hoisted_capacity = capacity;
+  }
+  l->hoisted[l->hoisted_count++] = slot;
+  return 1;
+}
+
+// What statements evaluate: expr, with the stack as it was, plus its value
+static _Bool bytecode__value(bytecode__lowering *l, uint64_t expr,
+                             uint32_t origin) {
+  size_t mark = l->hoisted_count, next = l->hoisted_next;
+  _Bool ok = bytecode__hoist(l, expr, origin);
+  l->hoisted_next = mark;
+  ok = ok && bytecode__expr(l, expr, origin);
+  l->hoisted_count = mark;
+  l->hoisted_next = next;
+  return ok;
+}
+
+static _Bool bytecode__store(bytecode__lowering *l, uint64_t lhs,
+                             uint32_t origin) {
+  const irep_store *ireps = l->bp->program->ireps;
+  bytecode_names *n = &l->bp->names;
+  if (irep_id(ireps, lhs) != n->symbol)
+    return bytecode__fail(l, "unsupported assignment", irep_id(ireps, lhs));
+  uint64_t name = irep_find(ireps, lhs, n->identifier);
+  _Bool global;
+  uint32_t slot;
+  if (name == IREP_NIL)
+    return bytecode__fail(l, "symbol without identifier", n->symbol);
+  if (!bytecode__slot(l, irep_id(ireps, name), &global, &slot))
+    return 0;
+  return bytecode__emit(l, global ? BYTECODE_GSTORE : BYTECODE_STORE, 0, 0,
+                        slot, 0, -1, origin);
+}
+
+// nondet value of the type of expr, into expr
+static _Bool bytecode__havoc(bytecode__lowering *l, uint64_t expr,
+                             uint64_t symbol, uint32_t origin) {
+  uint8_t width, flags;
+  return bytecode__expr_type(l, expr, &width, &flags) &&
+         bytecode__emit(l, BYTECODE_NONDET, width, flags, 0, symbol, 1,
+                        origin) &&
+         bytecode__store(l, expr, origin);
+}
+
+static _Bool bytecode__call(bytecode__lowering *l, uint64_t code,
+                            uint32_t origin) {
+  bytecode_program *bp = l->bp;
+  const irep_store *ireps = bp->program->ireps;
+  bytecode_names *n = &bp->names;
+  if (irep_sub_count(ireps, code) != 3)
+    return bytecode__fail(l, "bad function call", irep_id(ireps, code));
+  uint64_t lhs = irep_sub(ireps, code, 0);
+  uint64_t function = irep_sub(ireps, code, 1);
+  uint64_t arguments = irep_sub(ireps, code, 2);
+  _Bool has_lhs = irep_id(ireps, lhs) != n->nil;
+
+  uint64_t name = irep_id(ireps, function) == n->symbol
+                      ? irep_find(ireps, function, n->identifier)
+                      : IREP_NIL;
+  if (name == IREP_NIL)
+    return bytecode__fail(l, "unsupported function pointer call",
+                          irep_id(ireps, function));
+  size_t callee = goto_program_find_function(bp->program, irep_id(ireps, name));
+  if (callee != SIZE_MAX && !goto_program_function_at(bp->program, callee))
+    return bytecode__fail(l, "could not decode callee", irep_id(ireps, name));
+  if (callee == SIZE_MAX || bp->program->functions[callee].count == 0) {
+    // Without a body all we know is the return type
+    return !has_lhs || bytecode__havoc(l, lhs, IREP_NIL, origin);
+  }
+
+  // Every argument's short circuits come before the first is pushed
+  size_t argc = irep_sub_count(ireps, arguments);
+  size_t mark = l->hoisted_count;
+  _Bool ok = 1;
+  for (size_t i = 0; ok && i < argc; i++)
+    ok = bytecode__hoist(l, irep_sub(ireps, arguments, i), origin);
+  l->hoisted_next = mark;
+  for (size_t i = 0; ok && i < argc; i++)
+    ok = bytecode__expr(l, irep_sub(ireps, arguments, i), origin);
+  l->hoisted_count = l->hoisted_next = mark;
+  if (!ok)
+    return 0;
+  if (!bytecode__emit(l, BYTECODE_CALL, 0, 0, callee, argc, 1 - (int)argc,
+                      origin))
+    return 0;
+  if (has_lhs)
+    return bytecode__store(l, lhs, origin);
+  return bytecode__emit(l, BYTECODE_POP, 0, 0, 0, 0, -1, origin);
+}
+
+// Parameters take the slots right after the return value, in order
+static _Bool bytecode__parameters(bytecode__lowering *l, uint64_t name) {
+  bytecode_program *bp = l->bp;
+  const irep_store *ireps = bp->program->ireps;
+  bytecode_names *n = &bp->names;
+  uint64_t *symbol = u64_map_get(&bp->symbols, name);
+  if (!symbol)
+    return 1;
+  uint64_t type = bp->program->symbols[*symbol].type;
+  if (type == IREP_NIL || irep_id(ireps, type) != n->code)
+    return 1;
+  uint64_t parameters = irep_find(ireps, type, n->parameters);
+  size_t count = parameters == IREP_NIL ? 0 : irep_sub_count(ireps, parameters);
+  for (size_t i = 0; i < count; i++) {
+    uint64_t id =
+        irep_find(ireps, irep_sub(ireps, parameters, i), n->parameter_identifier);
+    if (id == IREP_NIL)
+      return bytecode__fail(l, "parameter without identifier", n->parameters);
+    if (!u64_map_put(&l->locals, irep_id(ireps, id), l->f->slot_count++))
+      return bytecode__fail(l, "out of memory", IREP_NIL);
+  }
+  l->f->param_count = count;
+  return 1;
+}
+
+static _Bool bytecode__instruction(bytecode__lowering *l, goto_function *gf,
+                                   uint32_t i) {
+  bytecode_program *bp = l->bp;
+  const irep_store *ireps = bp->program->ireps;
+  bytecode_names *n = &bp->names;
+  goto_instruction *ins = &gf->instructions[i];
+  uint64_t code = ins->code;
+  size_t subs = code == IREP_NIL ? 0 : irep_sub_count(ireps, code);
+
+  switch (ins->type) {
+  case GOTO_SKIP:
+  case GOTO_LOCATION:
+  case GOTO_DEAD:
+  case GOTO_OTHER: // expression statements, output... nothing to compute
+  case GOTO_ATOMIC_BEGIN:
+  case GOTO_ATOMIC_END:
+    return 1;
+
+  case GOTO_GOTO: {
+    if (ins->target_count != 1)
+      return bytecode__fail(l, "nondeterministic goto", IREP_NIL);
+    uint32_t target = bp->program->pool[ins->targets];
+    _Bool always = irep_id(ireps, ins->guard) == n->constant &&
+                   irep_find(ireps, ins->guard, n->value) != IREP_NIL &&
+                   irep_id(ireps, irep_find(ireps, ins->guard, n->value)) ==
+                       n->true_;
+    if (always)
+      return bytecode__emit(l, BYTECODE_JUMP, 0, 0, target, 0, 0, i);
+    // Loop exits are mostly "if !(cond) goto"
+    if (irep_id(ireps, ins->guard) == n->not_ &&
+        irep_sub_count(ireps, ins->guard) == 1)
+      return bytecode__value(l, irep_sub(ireps, ins->guard, 0), i) &&
+             bytecode__emit(l, BYTECODE_JUMP_IFNOT, 0, 0, target, 0, -1, i);
+    return bytecode__value(l, ins->guard, i) &&
+           bytecode__emit(l, BYTECODE_JUMP_IF, 0, 0, target, 0, -1, i);
+  }
+
+  case GOTO_ASSUME:
+  case GOTO_ASSERT:
+    return bytecode__value(l, ins->guard, i) &&
+           bytecode__emit(l,
+                          ins->type == GOTO_ASSERT ? BYTECODE_ASSERT
+                                                   : BYTECODE_ASSUME,
+                          0, 0, i, 0, -1, i);
+
+  case GOTO_ASSIGN:
+    if (subs != 2)
+      return bytecode__fail(l, "bad assignment", irep_id(ireps, code));
+    return bytecode__value(l, irep_sub(ireps, code, 1), i) &&
+           bytecode__store(l, irep_sub(ireps, code, 0), i);
+
+  case GOTO_DECL: {
+    if (subs != 1)
+      return bytecode__fail(l, "bad declaration", irep_id(ireps, code));
+    uint64_t symbol = irep_sub(ireps, code, 0);
+    uint64_t name = irep_find(ireps, symbol, n->identifier);
+    return bytecode__havoc(l, symbol,
+                           name == IREP_NIL ? IREP_NIL : irep_id(ireps, name),
+                           i);
+  }
+
+  case GOTO_SET_RETURN_VALUE:
+    if (subs != 1)
+      return 1;
+    return bytecode__value(l, irep_sub(ireps, code, 0), i) &&
+           bytecode__emit(l, BYTECODE_STORE, 0, 0, 0, 0, -1, i);
+
+  case GOTO_FUNCTION_CALL:
+    return bytecode__call(l, code, i);
+
+  case GOTO_END_FUNCTION:
+    return bytecode__emit(l, BYTECODE_RET, 0, 0, 0, 0, 0, i);
+
+  default:
+    return bytecode__fail(l, "unsupported instruction", IREP_NIL);
+  }
+}
+
+static bytecode_function *bytecode__lower(bytecode_program *bp,
+                                          size_t function) {
+  bytecode_function *f = &bp->functions[function];
+
+  goto_function *gf = goto_program_function_at(bp->program, function);
+  if (!gf) {
+    f->state = BYTECODE_FAILED;
+    return NULL;
+  }
+  if (gf->count == 0) {
+    f->state = BYTECODE_NO_BODY;
+    return NULL;
+  }
+
+  bytecode__lowering l = {.bp = bp, .index = function, .f = f};
+  f->slot_count = 1;
+  // Bytecode index where every GOTO instruction starts, plus the end
+  uint32_t *starts = (uint32_t *)malloc(sizeof(uint32_t) * (gf->count + 1));
+  if (!starts || !u64_map_init(&l.locals, 16)) {
+    free(starts);
+    f->state = BYTECODE_FAILED;
+    return NULL;
+  }
+
+  _Bool ok = bytecode__parameters(&l, gf->name);
+  for (uint32_t i = 0; ok && i < gf->count; i++) {
+    starts[i] = f->count;
+    ok = bytecode__instruction(&l, gf, i);
+  }
+  // Falling off the end returns
+  ok = ok && bytecode__emit(&l, BYTECODE_RET, 0, 0, 0, 0, 0, gf->count - 1);
+  if (ok) {
+    starts[gf->count] = f->count - 1;
+    size_t branch = 0;
+    for (size_t i = 0; i < f->count; i++) {
+      uint8_t op = f->code[i].op;
+      if (branch < l.branch_count && l.branches[branch] == i)
+        branch++;
+      else if (op == BYTECODE_JUMP || op == BYTECODE_JUMP_IF ||
+               op == BYTECODE_JUMP_IFNOT)
+        f->code[i].arg = starts[f->code[i].arg];
+    }
+  }
+  free(starts);
+  free(l.branches);
+  free(l.hoisted);
+  u64_map_free(&l.locals);
+
+  if (!ok) {
+    size_t length = 0;
+    const char *name = goto_program_string(bp->program, gf->name, &length);
+    const char *what = l.error_id == IREP_NIL
+                           ? ""
+                           : goto_program_string(bp->program, l.error_id, NULL);
+    fprintf(stderr, "bytecode: %.*s: %s %s\n", (int)length, name, l.error,
+            what);
+    free(f->code);
+    free(f->origin);
+    f->code = NULL;
+    f->origin = NULL;
+    f->count = 0;
+    f->state = BYTECODE_FAILED;
+    return NULL;
+  }
+  if (f->max_stack > bp->max_stack)
+    bp->max_stack = f->max_stack;
+  f->state = BYTECODE_LOWERED;
+  return f;
+}
+
+bytecode_function *bytecode_lower(bytecode_program *bp, size_t function) {
+  bytecode_function *f = &bp->functions[function];
+  if (f->state == BYTECODE_LOWERED)
+    return f;
+  if (f->state != BYTECODE_NOT_LOWERED)
+    return NULL;
+  STATS_PHASE(STATS_LOWER) f = bytecode__lower(bp, function);
+  return f;
+}
+
+typedef struct {
+  uint32_t function;
+  uint32_t pc;
+  size_t base;
+} bytecode__frame;
+
+struct bytecode_exec {
+  bytecode_program *bp;
+  const bytecode_hooks *hooks;
+  uint64_t max_steps;
+  bytecode_result result;
+  bytecode__frame *frames;
+  size_t frame_count, frame_capacity;
+  uint64_t *values; // locals of every interpreted frame
+  size_t values_length, values_capacity;
+  uint64_t *stack;
+  size_t stack_length, stack_capacity;
+};
+
+static _Bool bytecode__stop(bytecode_exec *x, bytecode_status status,
+                            size_t function, size_t pc) {
+  x->result.status = status;
+  x->result.function = function;
+  x->result.pc = pc;
+  return 0;
+}
+
+_Bool bytecode_exec_step(bytecode_exec *x, size_t function, size_t pc) {
+  if (++x->result.steps < x->max_steps)
+    return 1;
+  return bytecode__stop(x, BYTECODE_STEP_LIMIT, function, pc);
+}
+
+_Bool bytecode_exec_check(bytecode_exec *x, size_t function, size_t pc,
+                          _Bool holds, _Bool assertion) {
+  const bytecode_hooks *h = x->hooks;
+  _Bool (*hook)(void *, size_t, size_t, _Bool) =
+      assertion ? h->assertion : h->assumption;
+  if (hook ? hook(h->ctx, function, pc, holds) : holds)
+    return 1;
+  return bytecode__stop(x,
+                        assertion ? BYTECODE_ASSERTION_STOP
+                                  : BYTECODE_ASSUMPTION_STOP,
+                        function, pc);
+}
+
+uint64_t bytecode_exec_nondet(bytecode_exec *x, uint64_t symbol, uint8_t width,
+                              uint8_t flags) {
+  const bytecode_hooks *h = x->hooks;
+  uint64_t v = h->nondet ? h->nondet(h->ctx, symbol, width, flags) : 0;
+  if (flags & BYTECODE_BOOL)
+    v = v != 0;
+  return bytecode__norm(v, width, flags);
+}
+
+_Bool bytecode_exec_error(bytecode_exec *x, size_t function, size_t pc) {
+  return bytecode__stop(x, BYTECODE_ERROR, function, pc);
+}
+
+uint64_t *bytecode_exec_globals(bytecode_exec *x) {
+  return x->bp->global_values;
+}
+
+static void bytecode__tier_up(bytecode_program *bp, size_t function) {
+  bytecode_function *f = &bp->functions[function];
+  if (f->native || f->native_tried || !bp->tier.compile)
+    return;
+  f->native_tried = 1;
+  f->native = bp->tier.compile(bp->tier.jit, bp, function);
+}
+
+static _Bool bytecode__native(bytecode_exec *x, bytecode_function *f,
+                              const uint64_t *args, size_t argc,
+                              uint64_t *ret) {
+  if (argc >= f->param_count)
+    return f->native(x, args, ret);
+  // Missing arguments are 0, as in the interpreter
+  uint64_t small[16];
+  uint64_t *padded = f->param_count <= 16
+                         ? small
+                         : (uint64_t *)malloc(sizeof(uint64_t) * f->param_count);
+  if (!padded)
+    return bytecode__stop(x, BYTECODE_ERROR, x->result.function, 0);
+  memset(padded, 0, sizeof(uint64_t) * f->param_count);
+  memcpy(padded, args, sizeof(uint64_t) * argc);
+  _Bool ok = f->native(x, padded, ret);
+  if (padded != small)
+    free(padded);
+  return ok;
+}
+
+// Pushes an interpreter frame for a lowered function. depth is where the
+// operand stack is at, arguments are copied before it can move.
+static _Bool bytecode__enter(bytecode_exec *x, size_t function,
+                             const uint64_t *args, size_t argc, size_t depth) {
+  bytecode_program *bp = x->bp;
+  bytecode_function *f = &bp->functions[function];
+  if (x->frame_count == x->frame_capacity) {
+    size_t capacity = x->frame_capacity ? x->frame_capacity * 2 : 64;
+    bytecode__frame *frames = (bytecode__frame *)realloc(
+        x->frames, sizeof(bytecode__frame) * capacity);
+    if (!frames)
+      return 0;
+    x->frames = frames;
+    x->frame_capacity = capacity;
+  }
+  size_t base = x->values_length;
+  if (base + f->slot_count > x->values_capacity) {
+    size_t capacity = x->values_capacity ? x->values_capacity : 256;
+    while (base + f->slot_count > capacity)
+      capacity *= 2;
+    uint64_t *values =
+        (uint64_t *)realloc(x->values, sizeof(uint64_t) * capacity);
+    if (!values)
+      return 0;
+    x->values = values;
+    x->values_capacity = capacity;
+  }
+
+  x->frames[x->frame_count++] = (bytecode__frame){function, 0, base};
+  x->values_length = base + f->slot_count;
+  uint64_t *locals = x->values + base;
+  memset(locals, 0, sizeof(uint64_t) * f->slot_count);
+  for (size_t i = 0; i < argc && i < f->param_count; i++)
+    locals[1 + i] = args[i];
+
+  if (depth + bp->max_stack + 1 > x->stack_capacity) {
+    size_t capacity = depth + bp->max_stack + 64;
+    uint64_t *stack =
+        (uint64_t *)realloc(x->stack, sizeof(uint64_t) * capacity);
+    if (!stack)
+      return 0;
+    x->stack = stack;
+    x->stack_capacity = capacity;
+  }
+  return 1;
+}
+
+// Runs an interpreted function to completion. Calls to other interpreted
+// functions stay in the loop, native ones are called from it.
+static _Bool bytecode__interpret(bytecode_exec *x, size_t function,
+                                 const uint64_t *args, size_t argc,
+                                 uint64_t *ret) {
+  bytecode_program *bp = x->bp;
+  size_t bottom = x->frame_count;
+  if (!bytecode__enter(x, function, args, argc, x->stack_length))
+    return bytecode__stop(x, BYTECODE_ERROR, function, 0);
+
+  size_t fi = function;
+  bytecode_function *f = &bp->functions[fi];
+  const bytecode_insn *code = f->code;
+  const bytecode_insn *ins;
+  uint64_t *locals = x->values + x->frames[x->frame_count - 1].base;
+  uint64_t *globals = bp->global_values;
+  uint64_t *sp = x->stack + x->stack_length;
+  uint32_t pc = 0;
+  uint64_t a, b;
+
+#define BYTECODE__STOP(s) return bytecode__stop(x, (s), fi, f->origin[pc - 1])
+#define BYTECODE__STEP()                                                      \
+  if (!bytecode_exec_step(x, fi, f->origin[pc - 1]))                          \
+  return 0
+#define BYTECODE__TAKE(target)                                                \
+  do {                                                                        \
+    if ((target) < pc && ++f->back_jumps >= bp->tier.loop_threshold)          \
+      bytecode__tier_up(bp, fi);                                              \
+    pc = (target);                                                            \
+  } while (0)
+#define BYTECODE__BINARY(expr)                                                \
+  b = *--sp;                                                                  \
+  a = sp[-1];                                                                 \
+  sp[-1] = (expr);
+
+  // Threaded dispatch where labels as values are available
+#if defined(__GNUC__)
+#define BYTECODE__LABEL(name) &&bytecode__op_##name,
+  static const void *labels[] = {BYTECODE_OPS(BYTECODE__LABEL)};
+#undef BYTECODE__LABEL
+#define BYTECODE__CASE(name) bytecode__op_##name:
+#define BYTECODE__NEXT()                                                      \
+  do {                                                                        \
+    ins = &code[pc++];                                                        \
+    goto *labels[ins->op];                                                    \
+  } while (0)
+  BYTECODE__NEXT();
+#else
+#define BYTECODE__CASE(name) case BYTECODE_##name:
+#define BYTECODE__NEXT() continue
+  for (;;) {
+    ins = &code[pc++];
+    switch (ins->op) {
+#endif
+
+  BYTECODE__CASE(CONST) {
+    *sp++ = ins->imm;
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(LOAD) {
+    *sp++ = locals[ins->arg];
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(STORE) {
+    locals[ins->arg] = *--sp;
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(GLOAD) {
+    *sp++ = globals[ins->arg];
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(GSTORE) {
+    globals[ins->arg] = *--sp;
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(POP) {
+    sp--;
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(NONDET) {
+    *sp++ = bytecode_exec_nondet(x, ins->imm, ins->width, ins->flags);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(ADD) {
+    BYTECODE__BINARY(bytecode__norm(a + b, ins->width, ins->flags));
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(SUB) {
+    BYTECODE__BINARY(bytecode__norm(a - b, ins->width, ins->flags));
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(MUL) {
+    BYTECODE__BINARY(bytecode__norm(a * b, ins->width, ins->flags));
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(DIV) {
+    b = *--sp;
+    a = sp[-1];
+    if (!b)
+      BYTECODE__STOP(BYTECODE_ERROR);
+    if (ins->flags & BYTECODE_SIGNED)
+      a = b == UINT64_MAX ? -a : (uint64_t)((int64_t)a / (int64_t)b);
+    else
+      a /= b;
+    sp[-1] = bytecode__norm(a, ins->width, ins->flags);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(MOD) {
+    b = *--sp;
+    a = sp[-1];
+    if (!b)
+      BYTECODE__STOP(BYTECODE_ERROR);
+    if (ins->flags & BYTECODE_SIGNED)
+      a = b == UINT64_MAX ? 0 : (uint64_t)((int64_t)a % (int64_t)b);
+    else
+      a %= b;
+    sp[-1] = bytecode__norm(a, ins->width, ins->flags);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(NEG) {
+    sp[-1] = bytecode__norm(-sp[-1], ins->width, ins->flags);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(BAND) {
+    BYTECODE__BINARY(a & b);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(BOR) {
+    BYTECODE__BINARY(a | b);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(BXOR) {
+    BYTECODE__BINARY(a ^ b);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(BNOT) {
+    sp[-1] = bytecode__norm(~sp[-1], ins->width, ins->flags);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(SHL) {
+    BYTECODE__BINARY(
+        b >= ins->width ? 0 : bytecode__norm(a << b, ins->width, ins->flags));
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(SHR) {
+    // Canonical signed values are already sign extended
+    BYTECODE__BINARY((uint64_t)((int64_t)a >> (b >= 64 ? 63 : b)));
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(LSHR) {
+    BYTECODE__BINARY(b >= ins->width
+                         ? 0
+                         : bytecode__norm(bytecode__norm(a, ins->width, 0) >> b,
+                                          ins->width, ins->flags));
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(EQ) {
+    BYTECODE__BINARY(a == b);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(NE) {
+    BYTECODE__BINARY(a != b);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(LT) {
+    BYTECODE__BINARY(ins->flags & BYTECODE_SIGNED ? (int64_t)a < (int64_t)b
+                                                  : a < b);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(LE) {
+    BYTECODE__BINARY(ins->flags & BYTECODE_SIGNED ? (int64_t)a <= (int64_t)b
+                                                  : a <= b);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(GT) {
+    BYTECODE__BINARY(ins->flags & BYTECODE_SIGNED ? (int64_t)a > (int64_t)b
+                                                  : a > b);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(GE) {
+    BYTECODE__BINARY(ins->flags & BYTECODE_SIGNED ? (int64_t)a >= (int64_t)b
+                                                  : a >= b);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(LAND) {
+    BYTECODE__BINARY(a && b);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(LOR) {
+    BYTECODE__BINARY(a || b);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(LNOT) {
+    sp[-1] = !sp[-1];
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(CAST) {
+    if (ins->flags & BYTECODE_BOOL)
+      sp[-1] = sp[-1] != 0;
+    else
+      sp[-1] = bytecode__norm(sp[-1], ins->width, ins->flags);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(SELECT) {
+    sp -= 2;
+    sp[-1] = sp[-1] ? sp[0] : sp[1];
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(JUMP) {
+    BYTECODE__STEP();
+    BYTECODE__TAKE(ins->arg);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(JUMP_IF) {
+    BYTECODE__STEP();
+    if (*--sp)
+      BYTECODE__TAKE(ins->arg);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(JUMP_IFNOT) {
+    BYTECODE__STEP();
+    if (!*--sp)
+      BYTECODE__TAKE(ins->arg);
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(ASSUME) {
+    if (!bytecode_exec_check(x, fi, ins->arg, *--sp != 0, 0))
+      return 0;
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(ASSERT) {
+    if (!bytecode_exec_check(x, fi, ins->arg, *--sp != 0, 1))
+      return 0;
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(CALL) {
+    BYTECODE__STEP();
+    bytecode_function *callee = bytecode_lower(bp, ins->arg);
+    if (!callee)
+      BYTECODE__STOP(BYTECODE_ERROR);
+    if (++callee->calls >= bp->tier.call_threshold)
+      bytecode__tier_up(bp, ins->arg);
+    sp -= ins->imm;
+    // The stack and the locals can move under both kinds of calls
+    size_t depth = sp - x->stack;
+    if (callee->native) {
+      x->stack_length = depth;
+      if (!bytecode__native(x, callee, sp, ins->imm, &a))
+        return 0;
+      sp = x->stack + depth;
+      *sp++ = a;
+      locals = x->values + x->frames[x->frame_count - 1].base;
+      globals = bp->global_values;
+      BYTECODE__NEXT();
+    }
+    x->frames[x->frame_count - 1].pc = pc;
+    if (!bytecode__enter(x, ins->arg, sp, ins->imm, depth))
+      BYTECODE__STOP(BYTECODE_ERROR);
+    sp = x->stack + depth;
+    fi = ins->arg;
+    f = callee;
+    code = f->code;
+    locals = x->values + x->frames[x->frame_count - 1].base;
+    globals = bp->global_values; // lowering can add globals
+    pc = 0;
+    BYTECODE__NEXT();
+  }
+  BYTECODE__CASE(RET) {
+    a = locals[0];
+    x->values_length = x->frames[--x->frame_count].base;
+    if (x->frame_count == bottom) {
+      x->stack_length = sp - x->stack;
+      *ret = a;
+      return 1;
+    }
+    bytecode__frame *caller = &x->frames[x->frame_count - 1];
+    fi = caller->function;
+    f = &bp->functions[fi];
+    code = f->code;
+    locals = x->values + caller->base;
+    pc = caller->pc;
+    *sp++ = a;
+    BYTECODE__NEXT();
+  }
+
+#if !defined(__GNUC__)
+    default:
+      BYTECODE__STOP(BYTECODE_ERROR);
+    }
+  }
+#endif
+#undef BYTECODE__CASE
+#undef BYTECODE__NEXT
+#undef BYTECODE__BINARY
+#undef BYTECODE__TAKE
+#undef BYTECODE__STEP
+#undef BYTECODE__STOP
+}
+
+_Bool bytecode_exec_call(bytecode_exec *x, size_t function,
+                         const uint64_t *args, size_t argc, uint64_t *ret) {
+  bytecode_program *bp = x->bp;
+  bytecode_function *f = bytecode_lower(bp, function);
+  if (!f)
+    return bytecode__stop(x, BYTECODE_ERROR, function, 0);
+  if (++f->calls >= bp->tier.call_threshold)
+    bytecode__tier_up(bp, function);
+  if (f->native)
+    return bytecode__native(x, f, args, argc, ret);
+  return bytecode__interpret(x, function, args, argc, ret);
+}
+
+bytecode_result bytecode_run(bytecode_program *bp, size_t function,
+                             const bytecode_hooks *hooks) {
+  bytecode_hooks none = {0};
+  bytecode_exec x = {.bp = bp, .hooks = hooks ? hooks : &none};
+  x.max_steps = x.hooks->max_steps ? x.hooks->max_steps : UINT64_MAX;
+  x.result = (bytecode_result){BYTECODE_DONE, function, 0, 0};
+  if (bp->global_values)
+    memset(bp->global_values, 0, sizeof(uint64_t) * bp->global_capacity);
+
+  uint64_t ret;
+  if (bytecode_exec_call(&x, function, NULL, 0, &ret)) {
+    x.result.function = function;
+    x.result.pc = 0;
+  }
+  free(x.frames);
+  free(x.values);
+  free(x.stack);
+  return x.result;
+}
+
+// Builds expressions and hand written programs for the tests
+typedef struct {
+  string_interner *strings;
+  irep_store *ireps;
+  goto_program *program;
+  size_t instruction_capacity;
+} bytecode__test;
+
+static uint64_t bytecode__t_leaf(bytecode__test *t, const char *s) {
+  return irep_make(t->ireps, interner_intern(t->strings, s), NULL, 0, NULL, 0);
+}
+
+static uint64_t bytecode__t_node(bytecode__test *t, const char *id,
+                                 uint64_t type, const uint64_t *subs,
+                                 size_t count) {
+  irep_named named = {interner_intern(t->strings, "type"), type};
+  return irep_make(t->ireps, interner_intern(t->strings, id), subs, count,
+                   &named, type == IREP_NIL ? 0 : 1);
+}
+
+static uint64_t bytecode__t_type(bytecode__test *t, const char *id,
+                                 const char *width) {
+  irep_named named = {interner_intern(t->strings, "width"),
+                      bytecode__t_leaf(t, width)};
+  return irep_make(t->ireps, interner_intern(t->strings, id), NULL, 0, &named,
+                   1);
+}
+
+static uint64_t bytecode__t_symbol(bytecode__test *t, const char *name,
+                                   uint64_t type) {
+  irep_named named[] = {{interner_intern(t->strings, "type"), type},
+                        {interner_intern(t->strings, "identifier"),
+                         bytecode__t_leaf(t, name)}};
+  return irep_make(t->ireps, interner_intern(t->strings, "symbol"), NULL, 0,
+                   named, 2);
+}
+
+static uint64_t bytecode__t_constant(bytecode__test *t, const char *value,
+                                     uint64_t type) {
+  irep_named named[] = {{interner_intern(t->strings, "type"), type},
+                        {interner_intern(t->strings, "value"),
+                         bytecode__t_leaf(t, value)}};
+  return irep_make(t->ireps, interner_intern(t->strings, "constant"), NULL, 0,
+                   named, 2);
+}
+
+static uint64_t bytecode__t_binary(bytecode__test *t, const char *id,
+                                   uint64_t type, uint64_t a, uint64_t b) {
+  uint64_t subs[] = {a, b};
+  return bytecode__t_node(t, id, type, subs, 2);
+}
+
+static uint64_t bytecode__t_code(bytecode__test *t, const char *statement,
+                                 const uint64_t *subs, size_t count) {
+  irep_named named = {interner_intern(t->strings, "statement"),
+                      bytecode__t_leaf(t, statement)};
+  return irep_make(t->ireps, interner_intern(t->strings, "code"), subs, count,
+                   &named, 1);
+}
+
+static goto_function *bytecode__t_function(bytecode__test *t,
+                                           const char *name) {
+  goto_program *p = t->program;
+  goto_function *f = &p->functions[p->function_count];
+  f->name = interner_intern(t->strings, name);
+  f->loaded = 1;
+  f->instructions =
+      (goto_instruction *)calloc(t->instruction_capacity, sizeof(goto_instruction));
+  size_t mask = p->function_index_capacity - 1;
+  size_t slot = goto__name_slot(f->name, p->function_index_capacity);
+  while (p->function_index[slot])
+    slot = (slot + 1) & mask;
+  p->function_index[slot] = ++p->function_count;
+  return f;
+}
+
+static void bytecode__t_add(bytecode__test *t, goto_function *f, uint32_t type,
+                            uint64_t code, uint64_t guard, uint32_t target) {
+  goto_program *p = t->program;
+  goto_instruction *ins = &f->instructions[f->count++];
+  ins->type = type;
+  ins->code = code;
+  ins->guard = guard;
+  ins->source_location = IREP_NIL;
+  ins->target_number = GOTO_NIL_TARGET;
+  if (target != GOTO_NIL_TARGET) {
+    ins->targets = p->pool_length;
+    ins->target_count = 1;
+    p->pool[p->pool_length++] = target;
+  }
+}
+
+typedef struct {
+  size_t failed;
+  size_t failed_pc[4];
+  uint64_t nondet;
+} bytecode__t_run;
+
+static _Bool bytecode__t_assertion(void *ctx, size_t function, size_t pc,
+                                   _Bool holds) {
+  (void)function;
+  bytecode__t_run *run = (bytecode__t_run *)ctx;
+  if (!holds && run->failed < 4)
+    run->failed_pc[run->failed++] = pc;
+  return 1;
+}
+
+static uint64_t bytecode__t_nondet(void *ctx, uint64_t symbol, uint8_t width,
+                                   uint8_t flags) {
+  (void)symbol;
+  (void)width;
+  (void)flags;
+  return ((bytecode__t_run *)ctx)->nondet;
+}
+
+// Stands in for the JIT: inc gets a hand written native version
+static _Bool bytecode__t_native_inc(bytecode_exec *x, const uint64_t *args,
+                                    uint64_t *ret) {
+  (void)x;
+  *ret = (args[0] + 1) & 0xff;
+  return 1;
+}
+
+static bytecode_native bytecode__t_compile(void *jit, bytecode_program *bp,
+                                           size_t function) {
+  (void)bp;
+  size_t *requests = (size_t *)jit;
+  requests[function]++;
+  return function == 1 ? bytecode__t_native_inc : NULL;
+}
+
+// main, inc, spin and bad, shared with the native tier tests
+static goto_program *bytecode__t_program(bytecode__test *t) {
+  *t = (bytecode__test){.instruction_capacity = 32};
+  t->strings = interner_create();
+  t->ireps = irep_store_create();
+  t->program = (goto_program *)calloc(1, sizeof(goto_program));
+  goto_program *p = t->program;
+  p->strings = t->strings;
+  p->ireps = t->ireps;
+  p->functions = (goto_function *)calloc(4, sizeof(goto_function));
+  p->function_index_capacity = 16;
+  p->function_index = (uint32_t *)calloc(16, sizeof(uint32_t));
+  p->pool_capacity = 16;
+  p->pool = (uint64_t *)calloc(p->pool_capacity, sizeof(uint64_t));
+  p->symbols = (goto_symbol *)calloc(2, sizeof(goto_symbol));
+
+  uint64_t int32 = bytecode__t_type(t, "signedbv", "32");
+  uint64_t uint8 = bytecode__t_type(t, "unsignedbv", "8");
+  uint64_t boolean = irep_make(t->ireps, interner_intern(t->strings, "bool"),
+                               NULL, 0, NULL, 0);
+  uint64_t nil = bytecode__t_leaf(t, "nil");
+  uint64_t yes = bytecode__t_constant(t, "true", boolean);
+  uint64_t x = bytecode__t_symbol(t, "main::x", int32);
+  uint64_t i = bytecode__t_symbol(t, "main::i", int32);
+  uint64_t z = bytecode__t_symbol(t, "main::z", int32);
+  uint64_t g = bytecode__t_symbol(t, "g", uint8);
+  uint64_t a = bytecode__t_symbol(t, "inc::a", uint8);
+  uint64_t zero = bytecode__t_constant(t, "0", int32);
+  uint64_t two = bytecode__t_constant(t, "2", int32);
+  uint64_t one = bytecode__t_constant(t, "1", int32);
+
+  // g is a static lifetime uint8, inc(uint8 a) returns a + 1
+  p->symbols[0].name = interner_intern(t->strings, "g");
+  p->symbols[0].type = uint8;
+  p->symbols[0].value = IREP_NIL;
+  p->symbols[0].flags = GOTO_SYMBOL_IS_STATIC_LIFETIME;
+  irep_named param_named = {interner_intern(t->strings, "#identifier"),
+                            bytecode__t_leaf(t, "inc::a")};
+  uint64_t param = irep_make(t->ireps, interner_intern(t->strings, "parameter"),
+                             NULL, 0, &param_named, 1);
+  irep_named code_named = {
+      interner_intern(t->strings, "parameters"),
+      irep_make(t->ireps, interner_intern(t->strings, "parameters"), &param, 1,
+                NULL, 0)};
+  p->symbols[1].name = interner_intern(t->strings, "inc");
+  p->symbols[1].type = irep_make(t->ireps, interner_intern(t->strings, "code"),
+                                 NULL, 0, &code_named, 1);
+  p->symbols[1].value = IREP_NIL;
+  p->symbol_count = 2;
+
+  //  0: x = 0
+  //  1: i = 0
+  //  2: if !(i < 10) goto 6
+  //  3: x = x + i * 2
+  //  4: i = i + 1
+  //  5: goto 2
+  //  6: assert x == 90
+  //  7: assert x == 91
+  //  8: g = inc(255)
+  //  9: assert g == 0
+  // 10: decl z
+  // 11: assume z > 5
+  // 12: assert z > 3
+  // 13: END_FUNCTION
+  goto_function *main = bytecode__t_function(t, "main");
+  uint64_t subs[3];
+  subs[0] = x, subs[1] = zero;
+  bytecode__t_add(t, main, GOTO_ASSIGN, bytecode__t_code(t, "assign", subs, 2),
+                  yes, GOTO_NIL_TARGET);
+  subs[0] = i;
+  bytecode__t_add(t, main, GOTO_ASSIGN, bytecode__t_code(t, "assign", subs, 2),
+                  yes, GOTO_NIL_TARGET);
+  uint64_t ten = bytecode__t_constant(t, "0000000000000000000000000000" "1010",
+                                      int32);
+  uint64_t less = bytecode__t_binary(t, "<", boolean, i, ten);
+  bytecode__t_add(t, main, GOTO_GOTO, nil,
+                  bytecode__t_node(t, "not", boolean, &less, 1), 6);
+  subs[0] = x;
+  subs[1] = bytecode__t_binary(t, "+", int32, x,
+                               bytecode__t_binary(t, "*", int32, i, two));
+  bytecode__t_add(t, main, GOTO_ASSIGN, bytecode__t_code(t, "assign", subs, 2),
+                  yes, GOTO_NIL_TARGET);
+  subs[0] = i;
+  subs[1] = bytecode__t_binary(t, "+", int32, i, one);
+  bytecode__t_add(t, main, GOTO_ASSIGN, bytecode__t_code(t, "assign", subs, 2),
+                  yes, GOTO_NIL_TARGET);
+  bytecode__t_add(t, main, GOTO_GOTO, nil, yes, 2);
+  bytecode__t_add(
+      t, main, GOTO_ASSERT, nil,
+      bytecode__t_binary(t, "=", boolean, x,
+                         bytecode__t_constant(t, "5A", int32)),
+      GOTO_NIL_TARGET);
+  bytecode__t_add(
+      t, main, GOTO_ASSERT, nil,
+      bytecode__t_binary(t, "=", boolean, x,
+                         bytecode__t_constant(t, "5b", int32)),
+      GOTO_NIL_TARGET);
+  uint64_t args_subs = bytecode__t_constant(t, "FF", uint8);
+  subs[0] = g;
+  subs[1] = bytecode__t_symbol(t, "inc", IREP_NIL);
+  subs[2] = irep_make(t->ireps, interner_intern(t->strings, "arguments"),
+                      &args_subs, 1, NULL, 0);
+  bytecode__t_add(t, main, GOTO_FUNCTION_CALL,
+                  bytecode__t_code(t, "function_call", subs, 3), yes,
+                  GOTO_NIL_TARGET);
+  bytecode__t_add(t, main, GOTO_ASSERT, nil,
+                  bytecode__t_binary(t, "=", boolean, g,
+                                     bytecode__t_constant(t, "0", uint8)),
+                  GOTO_NIL_TARGET);
+  bytecode__t_add(t, main, GOTO_DECL, bytecode__t_code(t, "decl", &z, 1), yes,
+                  GOTO_NIL_TARGET);
+  bytecode__t_add(t, main, GOTO_ASSUME, nil,
+                  bytecode__t_binary(t, ">", boolean, z,
+                                     bytecode__t_constant(t, "5", int32)),
+                  GOTO_NIL_TARGET);
+  bytecode__t_add(t, main, GOTO_ASSERT, nil,
+                  bytecode__t_binary(t, ">", boolean, z,
+                                     bytecode__t_constant(t, "3", int32)),
+                  GOTO_NIL_TARGET);
+  bytecode__t_add(t, main, GOTO_END_FUNCTION, nil, yes, GOTO_NIL_TARGET);
+
+  goto_function *inc = bytecode__t_function(t, "inc");
+  uint64_t sum =
+      bytecode__t_binary(t, "+", uint8, a, bytecode__t_constant(t, "1", uint8));
+  bytecode__t_add(t, inc, GOTO_SET_RETURN_VALUE,
+                  bytecode__t_code(t, "set_return_value", &sum, 1), yes,
+                  GOTO_NIL_TARGET);
+  bytecode__t_add(t, inc, GOTO_END_FUNCTION, nil, yes, GOTO_NIL_TARGET);
+
+  // spin: goto spin
+  goto_function *spin = bytecode__t_function(t, "spin");
+  bytecode__t_add(t, spin, GOTO_GOTO, nil, yes, 0);
+
+  // bad: x = *g
+  goto_function *bad = bytecode__t_function(t, "bad");
+  subs[0] = x;
+  subs[1] = bytecode__t_node(t, "dereference", int32, &g, 1);
+  bytecode__t_add(t, bad, GOTO_ASSIGN, bytecode__t_code(t, "assign", subs, 2),
+                  yes, GOTO_NIL_TARGET);
+
+  return p;
+}
+
+uint64_t bytecode_tests() {
+  uint64_t errors = 0;
+
+  printf("Bytecode suite...\n");
+
+  bytecode__test t;
+  goto_program *p = bytecode__t_program(&t);
+  bytecode_program *bp = bytecode_program_create(p);
+
+  {
+    printf("- Loops, calls and wrap around... ");
+    bytecode__t_run run = {.nondet = 7};
+    bytecode_hooks hooks = {.nondet = bytecode__t_nondet,
+                            .assertion = bytecode__t_assertion,
+                            .ctx = &run};
+    bytecode_result r = bytecode_run(bp, 0, &hooks);
+    _Bool ok = r.status == BYTECODE_DONE && run.failed == 1 &&
+               run.failed_pc[0] == 7;
+    ok &= bytecode_global(bp, interner_intern(t.strings, "g")) == 0;
+    // 10 loop iterations, the exit and one call
+    ok &= r.steps == 22;
+    ok &= bp->functions[1].state == BYTECODE_LOWERED &&
+          bp->functions[1].param_count == 1;
+    ok &= bp->functions[2].state == BYTECODE_NOT_LOWERED;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Stops... ");
+    bytecode__t_run run = {.nondet = 2};
+    bytecode_hooks hooks = {.nondet = bytecode__t_nondet, .ctx = &run};
+    bytecode_result r = bytecode_run(bp, 0, &hooks);
+    // Without an assertion hook the first failure stops the run
+    _Bool ok = r.status == BYTECODE_ASSERTION_STOP && r.function == 0 &&
+               r.pc == 7;
+    hooks.assertion = bytecode__t_assertion;
+    r = bytecode_run(bp, 0, &hooks);
+    ok &= r.status == BYTECODE_ASSUMPTION_STOP && r.pc == 11;
+    hooks.max_steps = 1000;
+    r = bytecode_run(bp, 2, &hooks);
+    ok &= r.status == BYTECODE_STEP_LIMIT && r.steps == 1000;
+    r = bytecode_run(bp, 3, &hooks);
+    ok &= r.status == BYTECODE_ERROR &&
+          bp->functions[3].state == BYTECODE_FAILED;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Tiering... ");
+    bytecode_program *tiered = bytecode_program_create(p);
+    size_t requests[4] = {0};
+    tiered->tier = (bytecode_tier){bytecode__t_compile, requests, 2, 5};
+    bytecode__t_run run = {.nondet = 7};
+    bytecode_hooks hooks = {.nondet = bytecode__t_nondet,
+                            .assertion = bytecode__t_assertion,
+                            .ctx = &run};
+    // main is hot by its loop on the first run but does not compile, inc is
+    // hot by calls on the second
+    bytecode_result r1 = bytecode_run(tiered, 0, &hooks);
+    _Bool ok = requests[0] == 1 && requests[1] == 0;
+    bytecode_result r2 = bytecode_run(tiered, 0, &hooks);
+    ok &= requests[0] == 1 && requests[1] == 1;
+    ok &= tiered->functions[1].native == bytecode__t_native_inc;
+    ok &= tiered->functions[0].calls == 2 && tiered->functions[1].calls == 2;
+    ok &= r1.status == BYTECODE_DONE && r2.status == BYTECODE_DONE;
+    ok &= r1.steps == r2.steps && run.failed == 2;
+    ok &= bytecode_global(tiered, interner_intern(t.strings, "g")) == 0;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    bytecode_program_destroy(tiered);
+  }
+
+  {
+    printf("- Guarded division... ");
+    bytecode__test g = {.instruction_capacity = 8};
+    g.strings = interner_create();
+    g.ireps = irep_store_create();
+    g.program = (goto_program *)calloc(1, sizeof(goto_program));
+    goto_program *gp = g.program;
+    gp->strings = g.strings;
+    gp->ireps = g.ireps;
+    gp->functions = (goto_function *)calloc(1, sizeof(goto_function));
+    gp->function_index_capacity = 16;
+    gp->function_index = (uint32_t *)calloc(16, sizeof(uint32_t));
+
+    uint64_t int32 = bytecode__t_type(&g, "signedbv", "32");
+    uint64_t boolean = bytecode__t_leaf(&g, "bool");
+    uint64_t nil = bytecode__t_leaf(&g, "nil");
+    uint64_t yes = bytecode__t_constant(&g, "true", boolean);
+    uint64_t zero = bytecode__t_constant(&g, "0", int32);
+    uint64_t ten = bytecode__t_constant(&g, "A", int32);
+    uint64_t x = bytecode__t_symbol(&g, "guard::x", int32);
+    uint64_t y = bytecode__t_symbol(&g, "guard::y", boolean);
+    uint64_t z = bytecode__t_symbol(&g, "guard::z", int32);
+    uint64_t quotient = bytecode__t_binary(&g, "/", int32, ten, x);
+    uint64_t nonzero = bytecode__t_binary(&g, "notequal", boolean, x, zero);
+    uint64_t subs[3];
+
+    // 0: decl x
+    // 1: y = x != 0 && 10 / x > 1
+    // 2: z = 1 + (x != 0 ? 10 / x : 0)
+    // 3: assert x == 0 || (x != 0 && 10 / x + 1 == z)
+    // 4: assert y
+    // 5: END_FUNCTION
+    goto_function *guard = bytecode__t_function(&g, "guard");
+    bytecode__t_add(&g, guard, GOTO_DECL, bytecode__t_code(&g, "decl", &x, 1),
+                    yes, GOTO_NIL_TARGET);
+    subs[0] = y;
+    subs[1] = bytecode__t_binary(
+        &g, "and", boolean, nonzero,
+        bytecode__t_binary(&g, ">", boolean, quotient,
+                           bytecode__t_constant(&g, "1", int32)));
+    bytecode__t_add(&g, guard, GOTO_ASSIGN,
+                    bytecode__t_code(&g, "assign", subs, 2), yes,
+                    GOTO_NIL_TARGET);
+    uint64_t select[] = {nonzero, quotient, zero};
+    subs[0] = z;
+    subs[1] = bytecode__t_binary(&g, "+", int32,
+                                 bytecode__t_constant(&g, "1", int32),
+                                 bytecode__t_node(&g, "if", int32, select, 3));
+    bytecode__t_add(&g, guard, GOTO_ASSIGN,
+                    bytecode__t_code(&g, "assign", subs, 2), yes,
+                    GOTO_NIL_TARGET);
+    uint64_t sum = bytecode__t_binary(&g, "+", int32, quotient,
+                                      bytecode__t_constant(&g, "1", int32));
+    bytecode__t_add(
+        &g, guard, GOTO_ASSERT, nil,
+        bytecode__t_binary(
+            &g, "or", boolean, bytecode__t_binary(&g, "=", boolean, x, zero),
+            bytecode__t_binary(&g, "and", boolean, nonzero,
+                               bytecode__t_binary(&g, "=", boolean, sum, z))),
+        GOTO_NIL_TARGET);
+    bytecode__t_add(&g, guard, GOTO_ASSERT, nil, y, GOTO_NIL_TARGET);
+    bytecode__t_add(&g, guard, GOTO_END_FUNCTION, nil, yes, GOTO_NIL_TARGET);
+
+    bytecode_program *gbp = bytecode_program_create(gp);
+    bytecode__t_run run = {.nondet = 0};
+    bytecode_hooks hooks = {.nondet = bytecode__t_nondet, .ctx = &run};
+    // C never divides by x when it is 0, only y fails
+    bytecode_result r = bytecode_run(gbp, 0, &hooks);
+    _Bool ok = r.status == BYTECODE_ASSERTION_STOP && r.pc == 4;
+    run.nondet = 5;
+    r = bytecode_run(gbp, 0, &hooks);
+    ok &= r.status == BYTECODE_DONE;
+    // The return value, x, y, z and a slot per short circuit: and, if, or
+    // and the and within it
+    ok &= gbp->functions[0].slot_count == 1 + 3 + 4;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    bytecode_program_destroy(gbp);
+    goto_program_destroy(gp);
+    irep_store_destroy(g.ireps);
+    interner_destroy(g.strings);
+  }
+
+  bytecode_program_destroy(bp);
+  goto_program_destroy(p);
+  irep_store_destroy(t.ireps);
+  interner_destroy(t.strings);
+  return errors;
+}
+
+void bytecode_bench(bench *b, size_t runs) {
+  printf("Interpreter benchmark (%zu runs)...\n", runs);
+
+  bytecode__test t;
+  goto_program *p = bytecode__t_program(&t);
+  bytecode_program *bp = bytecode_program_create(p);
+  bytecode__t_run run = {.nondet = 7};
+  bytecode_hooks hooks = {.nondet = bytecode__t_nondet,
+                          .assertion = bytecode__t_assertion,
+                          .ctx = &run};
+  // Lowered before timing, as it is after the first run of a search
+  _Bool ok = bp && bytecode_run(bp, 0, &hooks).status == BYTECODE_DONE;
+
+  // main end to end: a loop, a call, assertions and a nondet declaration
+  if (ok && bench_begin(b, "bytecode/main")) {
+    for (size_t i = 0; i < runs; i++)
+      bytecode_run(bp, 0, &hooks);
+    bench_end(b, runs);
+  }
+  // Dispatch alone, a goto to itself
+  hooks.max_steps = 100 * (uint64_t)runs;
+  if (ok && bench_begin(b, "bytecode/jump")) {
+    bytecode_result r = bytecode_run(bp, 2, &hooks);
+    bench_end(b, r.steps);
+  }
+
+  bytecode_program_destroy(bp);
+  goto_program_destroy(p);
+  irep_store_destroy(t.ireps);
+  interner_destroy(t.strings);
+}
+
+#endif
+#endif
@@ -0,0 +1,974 @@
+#ifndef BYTECODE_JIT_H
+#define BYTECODE_JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bytecode.h"
+#include "code_cache.h"
+
+// Native tier of the interpreter, plugged in through bytecode_tier: hot
+// functions are compiled from their bytecode with libgccjit, one context
+// per function. The operand stack and the frame slots become locals of the
+// generated function, which gcc keeps in registers. Everything that reaches
+// outside of the function (nondet values, assertions, assumptions, calls,
+// the step limit, division by zero) goes through the same bytecode_exec
+// helpers the interpreter uses, so both tiers behave the same.
+//
+// With a cache directory every function is built as a shared library, keyed
+// by its bytecode (which carries the widths and signedness of its types),
+// its function index (which stops are reported against), the code generator
+// version and the optimization level, and later runs
+// load it instead of compiling again. Generated code holds no addresses:
+// it reaches the helpers through a table filled in when it is loaded.
+//
+// Only built when FAROL_GCCJIT is defined, it links against libgccjit.
+
+typedef struct bytecode_jit bytecode_jit;
+
+// Bump when the generated code changes, cached code is keyed by it
+#define BYTECODE_JIT_VERSION 1
+
+// cache_dir can be NULL, for no disk cache
+bytecode_jit *bytecode_jit_create(int optimization_level,
+                                  const char *cache_dir);
+// Frees the generated code, programs attached to it must not run after
+void bytecode_jit_destroy(bytecode_jit *j);
+// Compile hot functions of bp from now on
+void bytecode_jit_attach(bytecode_jit *j, bytecode_program *bp);
+// NULL if the function can not be compiled
+bytecode_native bytecode_jit_compile(bytecode_jit *j, bytecode_program *bp,
+                                     size_t function);
+
+uint64_t bytecode_jit_tests();
+#ifdef BYTECODE_JIT_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <libgccjit.h>
+#include <unistd.h>
+
+struct bytecode_jit {
+  int optimization_level;
+  code_cache *cache;
+  size_t cache_hits, cache_misses;
+  // Generated code lives as long as these
+  gcc_jit_result **results;
+  size_t result_count, result_capacity;
+  void **libraries;
+  size_t library_count, library_capacity;
+};
+
+// Layout of farol_runtime in the generated code
+typedef struct {
+  _Bool (*step)(bytecode_exec *, size_t, size_t);
+  _Bool (*error)(bytecode_exec *, size_t, size_t);
+  _Bool (*check)(bytecode_exec *, size_t, size_t, _Bool, _Bool);
+  uint64_t (*nondet)(bytecode_exec *, uint64_t, uint8_t, uint8_t);
+  _Bool (*call)(bytecode_exec *, size_t, const uint64_t *, size_t, uint64_t *);
+  uint64_t *(*globals)(bytecode_exec *);
+} bytecode_jit__runtime;
+
+typedef struct {
+  gcc_jit_context *ctxt;
+  gcc_jit_function *fn;
+  gcc_jit_block *block; // being filled
+  gcc_jit_type *u64, *i64, *u8, *size, *boolean, *u64_ptr;
+  gcc_jit_rvalue *exec, *args, *ret;
+  gcc_jit_lvalue *globals; // reloaded after calls, they can add globals
+  gcc_jit_lvalue **stack;
+  gcc_jit_lvalue **slots;
+  gcc_jit_lvalue *argv, *result;
+  // bytecode_exec helpers, from farol_runtime
+  gcc_jit_rvalue *step, *check, *nondet, *error, *call, *get_globals;
+  size_t function;
+} bytecode_jit__emitter;
+
+bytecode_jit *bytecode_jit_create(int optimization_level,
+                                  const char *cache_dir) {
+  bytecode_jit *j = (bytecode_jit *)calloc(1, sizeof(*j));
+  if (!j)
+    return NULL;
+  j->optimization_level = optimization_level;
+  if (cache_dir && !(j->cache = code_cache_open(cache_dir))) {
+    free(j);
+    return NULL;
+  }
+  return j;
+}
+
+void bytecode_jit_destroy(bytecode_jit *j) {
+  for (size_t i = 0; i < j->result_count; i++)
+    gcc_jit_result_release(j->results[i]);
+  for (size_t i = 0; i < j->library_count; i++)
+    dlclose(j->libraries[i]);
+  free(j->results);
+  free(j->libraries);
+  if (j->cache)
+    code_cache_close(j->cache);
+  free(j);
+}
+
+static _Bool bytecode_jit__keep(void ***items, size_t *count,
+                                size_t *capacity, void *item) {
+  if (*count == *capacity) {
+    size_t grown = *capacity ? *capacity * 2 : 16;
+    void **resized = (void **)realloc(*items, sizeof(void *) * grown);
+    if (!resized)
+      return 0;
+    *items = resized;
+    *capacity = grown;
+  }
+  (*items)[(*count)++] = item;
+  return 1;
+}
+
+static bytecode_native bytecode_jit__bind(void *runtime, void *code) {
+  if (!runtime || !code)
+    return NULL;
+  bytecode_jit__runtime *r = (bytecode_jit__runtime *)runtime;
+  r->step = bytecode_exec_step;
+  r->error = bytecode_exec_error;
+  r->check = bytecode_exec_check;
+  r->nondet = bytecode_exec_nondet;
+  r->call = bytecode_exec_call;
+  r->globals = bytecode_exec_globals;
+  return (bytecode_native)code;
+}
+
+static bytecode_native bytecode_jit__load(bytecode_jit *j, const char *path) {
+  void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!library) {
+    fprintf(stderr, "bytecode jit: %s\n", dlerror());
+    return NULL;
+  }
+  if (!bytecode_jit__keep(&j->libraries, &j->library_count,
+                          &j->library_capacity, library)) {
+    dlclose(library);
+    return NULL;
+  }
+  return bytecode_jit__bind(dlsym(library, "farol_runtime"),
+                            dlsym(library, "farol_native"));
+}
+
+static bytecode_native bytecode_jit__compile(void *jit, bytecode_program *bp,
+                                             size_t function) {
+  return bytecode_jit_compile((bytecode_jit *)jit, bp, function);
+}
+
+void bytecode_jit_attach(bytecode_jit *j, bytecode_program *bp) {
+  bp->tier.compile = bytecode_jit__compile;
+  bp->tier.jit = j;
+}
+
+static gcc_jit_rvalue *bytecode_jit__u64(bytecode_jit__emitter *e,
+                                         uint64_t v) {
+  // From long through the signed type keeps every bit
+  return gcc_jit_context_new_cast(
+      e->ctxt, NULL, gcc_jit_context_new_rvalue_from_long(e->ctxt, e->i64, (long)v),
+      e->u64);
+}
+
+static gcc_jit_rvalue *bytecode_jit__size(bytecode_jit__emitter *e,
+                                          size_t v) {
+  return gcc_jit_context_new_rvalue_from_long(e->ctxt, e->size, (long)v);
+}
+
+static gcc_jit_rvalue *bytecode_jit__get(gcc_jit_lvalue *l) {
+  return gcc_jit_lvalue_as_rvalue(l);
+}
+
+static gcc_jit_rvalue *bytecode_jit__binary(bytecode_jit__emitter *e,
+                                            enum gcc_jit_binary_op op,
+                                            gcc_jit_rvalue *a,
+                                            gcc_jit_rvalue *b) {
+  return gcc_jit_context_new_binary_op(e->ctxt, NULL, op, e->u64, a, b);
+}
+
+static gcc_jit_rvalue *bytecode_jit__compare(bytecode_jit__emitter *e,
+                                             enum gcc_jit_comparison op,
+                                             gcc_jit_rvalue *a,
+                                             gcc_jit_rvalue *b,
+                                             uint8_t flags) {
+  if (flags & BYTECODE_SIGNED) {
+    a = gcc_jit_context_new_cast(e->ctxt, NULL, a, e->i64);
+    b = gcc_jit_context_new_cast(e->ctxt, NULL, b, e->i64);
+  }
+  return gcc_jit_context_new_comparison(e->ctxt, NULL, op, a, b);
+}
+
+static gcc_jit_rvalue *bytecode_jit__from_bool(bytecode_jit__emitter *e,
+                                               gcc_jit_rvalue *v) {
+  return gcc_jit_context_new_cast(e->ctxt, NULL, v, e->u64);
+}
+
+static gcc_jit_rvalue *bytecode_jit__nonzero(bytecode_jit__emitter *e,
+                                             gcc_jit_rvalue *v) {
+  return gcc_jit_context_new_comparison(e->ctxt, NULL, GCC_JIT_COMPARISON_NE,
+                                        v, bytecode_jit__u64(e, 0));
+}
+
+// Same as bytecode__norm
+static gcc_jit_rvalue *bytecode_jit__norm(bytecode_jit__emitter *e,
+                                          gcc_jit_rvalue *v, uint8_t width,
+                                          uint8_t flags) {
+  if (width >= 64)
+    return v;
+  if (flags & BYTECODE_SIGNED) {
+    gcc_jit_rvalue *shift = bytecode_jit__u64(e, 64 - width);
+    gcc_jit_rvalue *up = gcc_jit_context_new_cast(
+        e->ctxt, NULL, bytecode_jit__binary(e, GCC_JIT_BINARY_OP_LSHIFT, v, shift),
+        e->i64);
+    gcc_jit_rvalue *down = gcc_jit_context_new_binary_op(
+        e->ctxt, NULL, GCC_JIT_BINARY_OP_RSHIFT, e->i64, up,
+        gcc_jit_context_new_cast(e->ctxt, NULL, shift, e->i64));
+    return gcc_jit_context_new_cast(e->ctxt, NULL, down, e->u64);
+  }
+  return bytecode_jit__binary(e, GCC_JIT_BINARY_OP_BITWISE_AND, v,
+                              bytecode_jit__u64(e, (UINT64_C(1) << width) - 1));
+}
+
+// dst = cond ? then : otherwise, each side only evaluated when taken
+static void bytecode_jit__select(bytecode_jit__emitter *e, gcc_jit_rvalue *cond,
+                                 gcc_jit_lvalue *dst, gcc_jit_rvalue *then,
+                                 gcc_jit_rvalue *otherwise) {
+  gcc_jit_block *t = gcc_jit_function_new_block(e->fn, NULL);
+  gcc_jit_block *f = gcc_jit_function_new_block(e->fn, NULL);
+  gcc_jit_block *join = gcc_jit_function_new_block(e->fn, NULL);
+  gcc_jit_block_end_with_conditional(e->block, NULL, cond, t, f);
+  gcc_jit_block_add_assignment(t, NULL, dst, then);
+  gcc_jit_block_end_with_jump(t, NULL, join);
+  gcc_jit_block_add_assignment(f, NULL, dst, otherwise);
+  gcc_jit_block_end_with_jump(f, NULL, join);
+  e->block = join;
+}
+
+// Returns 0 from the generated function unless ok holds
+static void bytecode_jit__or_stop(bytecode_jit__emitter *e,
+                                  gcc_jit_rvalue *ok) {
+  gcc_jit_block *go_on = gcc_jit_function_new_block(e->fn, NULL);
+  gcc_jit_block *stop = gcc_jit_function_new_block(e->fn, NULL);
+  gcc_jit_block_end_with_conditional(e->block, NULL, ok, go_on, stop);
+  gcc_jit_block_end_with_return(
+      stop, NULL, gcc_jit_context_new_rvalue_from_int(e->ctxt, e->boolean, 0));
+  e->block = go_on;
+}
+
+static gcc_jit_rvalue *bytecode_jit__call(bytecode_jit__emitter *e,
+                                          gcc_jit_rvalue *fn, int count,
+                                          gcc_jit_rvalue **args) {
+  return gcc_jit_context_new_call_through_ptr(e->ctxt, NULL, fn, count, args);
+}
+
+static gcc_jit_rvalue *bytecode_jit__step(bytecode_jit__emitter *e,
+                                          size_t pc) {
+  gcc_jit_rvalue *args[] = {e->exec, bytecode_jit__size(e, e->function),
+                            bytecode_jit__size(e, pc)};
+  return bytecode_jit__call(e, e->step, 3, args);
+}
+
+static void bytecode_jit__reload_globals(bytecode_jit__emitter *e) {
+  gcc_jit_block_add_assignment(e->block, NULL, e->globals,
+                               bytecode_jit__call(e, e->get_globals, 1, &e->exec));
+}
+
+static gcc_jit_lvalue *bytecode_jit__global(bytecode_jit__emitter *e,
+                                            uint32_t slot) {
+  gcc_jit_rvalue *values = bytecode_jit__get(e->globals);
+  return gcc_jit_context_new_array_access(
+      e->ctxt, NULL, values,
+      gcc_jit_context_new_rvalue_from_int(e->ctxt, e->size, slot));
+}
+
+static const int bytecode_jit__effect[BYTECODE_OP_COUNT] = {
+    [BYTECODE_CONST] = 1,  [BYTECODE_LOAD] = 1,    [BYTECODE_STORE] = -1,
+    [BYTECODE_GLOAD] = 1,  [BYTECODE_GSTORE] = -1, [BYTECODE_POP] = -1,
+    [BYTECODE_NONDET] = 1, [BYTECODE_ADD] = -1,    [BYTECODE_SUB] = -1,
+    [BYTECODE_MUL] = -1,   [BYTECODE_DIV] = -1,    [BYTECODE_MOD] = -1,
+    [BYTECODE_BAND] = -1,  [BYTECODE_BOR] = -1,    [BYTECODE_BXOR] = -1,
+    [BYTECODE_SHL] = -1,   [BYTECODE_SHR] = -1,    [BYTECODE_LSHR] = -1,
+    [BYTECODE_EQ] = -1,    [BYTECODE_NE] = -1,     [BYTECODE_LT] = -1,
+    [BYTECODE_LE] = -1,    [BYTECODE_GT] = -1,     [BYTECODE_GE] = -1,
+    [BYTECODE_LAND] = -1,  [BYTECODE_LOR] = -1,    [BYTECODE_SELECT] = -2,
+    [BYTECODE_JUMP_IF] = -1, [BYTECODE_JUMP_IFNOT] = -1,
+    [BYTECODE_ASSUME] = -1, [BYTECODE_ASSERT] = -1,
+};
+
+static void bytecode_jit__emit(bytecode_jit__emitter *e,
+                               const bytecode_function *f, size_t i,
+                               uint32_t depth, gcc_jit_block **blocks) {
+  const bytecode_insn *ins = &f->code[i];
+  gcc_jit_context *ctxt = e->ctxt;
+  size_t origin = f->origin[i];
+  // Operands on top of the stack, when the instruction has them
+  gcc_jit_lvalue *top = depth ? e->stack[depth - 1] : NULL;
+  gcc_jit_lvalue *under = depth > 1 ? e->stack[depth - 2] : NULL;
+  gcc_jit_rvalue *a = under ? bytecode_jit__get(under) : NULL;
+  gcc_jit_rvalue *b = top ? bytecode_jit__get(top) : NULL;
+  gcc_jit_rvalue *v;
+
+#define BYTECODE_JIT__SET(dst, value)                                        \
+  gcc_jit_block_add_assignment(e->block, NULL, (dst), (value))
+#define BYTECODE_JIT__ARITH(op)                                              \
+  BYTECODE_JIT__SET(under, bytecode_jit__norm(e, bytecode_jit__binary(e, op, a, b), \
+                                              ins->width, ins->flags))
+#define BYTECODE_JIT__CMP(op)                                                \
+  BYTECODE_JIT__SET(under, bytecode_jit__from_bool(                          \
+                               e, bytecode_jit__compare(e, op, a, b, ins->flags)))
+
+  switch (ins->op) {
+  case BYTECODE_CONST:
+    BYTECODE_JIT__SET(e->stack[depth], bytecode_jit__u64(e, ins->imm));
+    break;
+  case BYTECODE_LOAD:
+    BYTECODE_JIT__SET(e->stack[depth], bytecode_jit__get(e->slots[ins->arg]));
+    break;
+  case BYTECODE_STORE:
+    BYTECODE_JIT__SET(e->slots[ins->arg], b);
+    break;
+  case BYTECODE_GLOAD:
+    BYTECODE_JIT__SET(e->stack[depth],
+                      bytecode_jit__get(bytecode_jit__global(e, ins->arg)));
+    break;
+  case BYTECODE_GSTORE:
+    BYTECODE_JIT__SET(bytecode_jit__global(e, ins->arg), b);
+    break;
+  case BYTECODE_POP:
+    break;
+  case BYTECODE_NONDET: {
+    gcc_jit_rvalue *args[] = {
+        e->exec, bytecode_jit__u64(e, ins->imm),
+        gcc_jit_context_new_rvalue_from_int(ctxt, e->u8, ins->width),
+        gcc_jit_context_new_rvalue_from_int(ctxt, e->u8, ins->flags)};
+    BYTECODE_JIT__SET(e->stack[depth], bytecode_jit__call(e, e->nondet, 4, args));
+    break;
+  }
+  case BYTECODE_ADD:
+    BYTECODE_JIT__ARITH(GCC_JIT_BINARY_OP_PLUS);
+    break;
+  case BYTECODE_SUB:
+    BYTECODE_JIT__ARITH(GCC_JIT_BINARY_OP_MINUS);
+    break;
+  case BYTECODE_MUL:
+    BYTECODE_JIT__ARITH(GCC_JIT_BINARY_OP_MULT);
+    break;
+  case BYTECODE_DIV:
+  case BYTECODE_MOD: {
+    gcc_jit_rvalue *error[] = {e->exec, bytecode_jit__size(e, e->function),
+                               bytecode_jit__size(e, origin)};
+    gcc_jit_block *fail = gcc_jit_function_new_block(e->fn, NULL);
+    gcc_jit_block *go_on = gcc_jit_function_new_block(e->fn, NULL);
+    gcc_jit_block_end_with_conditional(
+        e->block, NULL,
+        gcc_jit_context_new_comparison(ctxt, NULL, GCC_JIT_COMPARISON_EQ, b,
+                                       bytecode_jit__u64(e, 0)),
+        fail, go_on);
+    gcc_jit_block_end_with_return(fail, NULL,
+                                  bytecode_jit__call(e, e->error, 3, error));
+    e->block = go_on;
+    enum gcc_jit_binary_op op = ins->op == BYTECODE_DIV
+                                    ? GCC_JIT_BINARY_OP_DIVIDE
+                                    : GCC_JIT_BINARY_OP_MODULO;
+    if (ins->flags & BYTECODE_SIGNED) {
+      // INT64_MIN / -1 traps, the interpreter special cases -1 as well
+      gcc_jit_rvalue *sa = gcc_jit_context_new_cast(ctxt, NULL, a, e->i64);
+      gcc_jit_rvalue *sb = gcc_jit_context_new_cast(ctxt, NULL, b, e->i64);
+      gcc_jit_rvalue *q = gcc_jit_context_new_cast(
+          ctxt, NULL,
+          gcc_jit_context_new_binary_op(ctxt, NULL, op, e->i64, sa, sb), e->u64);
+      gcc_jit_rvalue *minus_one =
+          ins->op == BYTECODE_DIV
+              ? gcc_jit_context_new_unary_op(ctxt, NULL,
+                                             GCC_JIT_UNARY_OP_MINUS, e->u64, a)
+              : bytecode_jit__u64(e, 0);
+      bytecode_jit__select(
+          e,
+          gcc_jit_context_new_comparison(ctxt, NULL, GCC_JIT_COMPARISON_EQ, b,
+                                         bytecode_jit__u64(e, UINT64_MAX)),
+          under, minus_one, q);
+    } else {
+      BYTECODE_JIT__SET(under, bytecode_jit__binary(e, op, a, b));
+    }
+    BYTECODE_JIT__SET(under, bytecode_jit__norm(e, bytecode_jit__get(under),
+                                                ins->width, ins->flags));
+    break;
+  }
+  case BYTECODE_NEG:
+    BYTECODE_JIT__SET(
+        top, bytecode_jit__norm(e,
+                                gcc_jit_context_new_unary_op(
+                                    ctxt, NULL, GCC_JIT_UNARY_OP_MINUS, e->u64, b),
+                                ins->width, ins->flags));
+    break;
+  case BYTECODE_BAND:
+    BYTECODE_JIT__SET(under,
+                      bytecode_jit__binary(e, GCC_JIT_BINARY_OP_BITWISE_AND, a, b));
+    break;
+  case BYTECODE_BOR:
+    BYTECODE_JIT__SET(under,
+                      bytecode_jit__binary(e, GCC_JIT_BINARY_OP_BITWISE_OR, a, b));
+    break;
+  case BYTECODE_BXOR:
+    BYTECODE_JIT__SET(under,
+                      bytecode_jit__binary(e, GCC_JIT_BINARY_OP_BITWISE_XOR, a, b));
+    break;
+  case BYTECODE_BNOT:
+    BYTECODE_JIT__SET(
+        top, bytecode_jit__norm(e,
+                                gcc_jit_context_new_unary_op(
+                                    ctxt, NULL, GCC_JIT_UNARY_OP_BITWISE_NEGATE,
+                                    e->u64, b),
+                                ins->width, ins->flags));
+    break;
+  case BYTECODE_SHL:
+  case BYTECODE_LSHR: {
+    gcc_jit_rvalue *shifted =
+        ins->op == BYTECODE_SHL
+            ? bytecode_jit__binary(e, GCC_JIT_BINARY_OP_LSHIFT, a, b)
+            : bytecode_jit__binary(e, GCC_JIT_BINARY_OP_RSHIFT,
+                                   bytecode_jit__norm(e, a, ins->width, 0), b);
+    bytecode_jit__select(
+        e,
+        gcc_jit_context_new_comparison(ctxt, NULL, GCC_JIT_COMPARISON_GE, b,
+                                       bytecode_jit__u64(e, ins->width)),
+        under, bytecode_jit__u64(e, 0),
+        bytecode_jit__norm(e, shifted, ins->width, ins->flags));
+    break;
+  }
+  case BYTECODE_SHR: {
+    gcc_jit_lvalue *amount = gcc_jit_function_new_local(e->fn, NULL, e->u64, NULL);
+    bytecode_jit__select(
+        e,
+        gcc_jit_context_new_comparison(ctxt, NULL, GCC_JIT_COMPARISON_GE, b,
+                                       bytecode_jit__u64(e, 64)),
+        amount, bytecode_jit__u64(e, 63), b);
+    v = gcc_jit_context_new_binary_op(
+        ctxt, NULL, GCC_JIT_BINARY_OP_RSHIFT, e->i64,
+        gcc_jit_context_new_cast(ctxt, NULL, a, e->i64),
+        gcc_jit_context_new_cast(ctxt, NULL, bytecode_jit__get(amount), e->i64));
+    BYTECODE_JIT__SET(under, gcc_jit_context_new_cast(ctxt, NULL, v, e->u64));
+    break;
+  }
+  case BYTECODE_EQ:
+    BYTECODE_JIT__CMP(GCC_JIT_COMPARISON_EQ);
+    break;
+  case BYTECODE_NE:
+    BYTECODE_JIT__CMP(GCC_JIT_COMPARISON_NE);
+    break;
+  case BYTECODE_LT:
+    BYTECODE_JIT__CMP(GCC_JIT_COMPARISON_LT);
+    break;
+  case BYTECODE_LE:
+    BYTECODE_JIT__CMP(GCC_JIT_COMPARISON_LE);
+    break;
+  case BYTECODE_GT:
+    BYTECODE_JIT__CMP(GCC_JIT_COMPARISON_GT);
+    break;
+  case BYTECODE_GE:
+    BYTECODE_JIT__CMP(GCC_JIT_COMPARISON_GE);
+    break;
+  case BYTECODE_LAND:
+  case BYTECODE_LOR:
+    v = gcc_jit_context_new_binary_op(
+        ctxt, NULL,
+        ins->op == BYTECODE_LAND ? GCC_JIT_BINARY_OP_LOGICAL_AND
+                                 : GCC_JIT_BINARY_OP_LOGICAL_OR,
+        e->boolean, bytecode_jit__nonzero(e, a), bytecode_jit__nonzero(e, b));
+    BYTECODE_JIT__SET(under, bytecode_jit__from_bool(e, v));
+    break;
+  case BYTECODE_LNOT:
+    BYTECODE_JIT__SET(
+        top, bytecode_jit__from_bool(
+                 e, gcc_jit_context_new_comparison(ctxt, NULL,
+                                                   GCC_JIT_COMPARISON_EQ, b,
+                                                   bytecode_jit__u64(e, 0))));
+    break;
+  case BYTECODE_CAST:
+    if (ins->flags & BYTECODE_BOOL)
+      BYTECODE_JIT__SET(top, bytecode_jit__from_bool(e, bytecode_jit__nonzero(e, b)));
+    else
+      BYTECODE_JIT__SET(top, bytecode_jit__norm(e, b, ins->width, ins->flags));
+    break;
+  case BYTECODE_SELECT:
+    bytecode_jit__select(e, bytecode_jit__nonzero(e, bytecode_jit__get(e->stack[depth - 3])),
+                         e->stack[depth - 3], a, b);
+    break;
+  case BYTECODE_JUMP:
+    bytecode_jit__or_stop(e, bytecode_jit__step(e, origin));
+    gcc_jit_block_end_with_jump(e->block, NULL, blocks[ins->arg]);
+    return;
+  case BYTECODE_JUMP_IF:
+  case BYTECODE_JUMP_IFNOT: {
+    bytecode_jit__or_stop(e, bytecode_jit__step(e, origin));
+    gcc_jit_rvalue *taken = bytecode_jit__nonzero(e, b);
+    if (ins->op == BYTECODE_JUMP_IFNOT)
+      taken = gcc_jit_context_new_unary_op(ctxt, NULL,
+                                           GCC_JIT_UNARY_OP_LOGICAL_NEGATE,
+                                           e->boolean, taken);
+    gcc_jit_block_end_with_conditional(e->block, NULL, taken, blocks[ins->arg],
+                                       blocks[i + 1]);
+    return;
+  }
+  case BYTECODE_ASSUME:
+  case BYTECODE_ASSERT: {
+    gcc_jit_rvalue *args[] = {
+        e->exec, bytecode_jit__size(e, e->function), bytecode_jit__size(e, ins->arg),
+        bytecode_jit__nonzero(e, b),
+        gcc_jit_context_new_rvalue_from_int(ctxt, e->boolean,
+                                            ins->op == BYTECODE_ASSERT)};
+    bytecode_jit__or_stop(e, bytecode_jit__call(e, e->check, 5, args));
+    break;
+  }
+  case BYTECODE_CALL: {
+    // Arguments go through argv, the result lands where the first was
+    bytecode_jit__or_stop(e, bytecode_jit__step(e, origin));
+    size_t argc = ins->imm;
+    for (size_t k = 0; k < argc; k++)
+      BYTECODE_JIT__SET(
+          gcc_jit_context_new_array_access(ctxt, NULL, bytecode_jit__get(e->argv),
+                                           bytecode_jit__size(e, k)),
+          bytecode_jit__get(e->stack[depth - argc + k]));
+    gcc_jit_rvalue *args[] = {
+        e->exec, bytecode_jit__size(e, ins->arg),
+        gcc_jit_lvalue_get_address(
+            gcc_jit_context_new_array_access(ctxt, NULL,
+                                             bytecode_jit__get(e->argv),
+                                             bytecode_jit__size(e, 0)),
+            NULL),
+        bytecode_jit__size(e, argc), gcc_jit_lvalue_get_address(e->result, NULL)};
+    bytecode_jit__or_stop(e, bytecode_jit__call(e, e->call, 5, args));
+    bytecode_jit__reload_globals(e);
+    BYTECODE_JIT__SET(e->stack[depth - argc], bytecode_jit__get(e->result));
+    break;
+  }
+  case BYTECODE_RET:
+    gcc_jit_block_add_assignment(e->block, NULL,
+                                 gcc_jit_rvalue_dereference(e->ret, NULL),
+                                 bytecode_jit__get(e->slots[0]));
+    gcc_jit_block_end_with_return(
+        e->block, NULL, gcc_jit_context_new_rvalue_from_int(ctxt, e->boolean, 1));
+    return;
+  }
+#undef BYTECODE_JIT__CMP
+#undef BYTECODE_JIT__ARITH
+#undef BYTECODE_JIT__SET
+  gcc_jit_block_end_with_jump(e->block, NULL, blocks[i + 1]);
+}
+
+// What cached code is keyed by: everything the generated code depends on,
+// the function index included since every helper call passes it
+static uint8_t *bytecode_jit__key(bytecode_jit *j, const bytecode_function *f,
+                                  size_t function, size_t *length) {
+  uint32_t header[] = {BYTECODE_JIT_VERSION, BYTECODE_OP_COUNT,
+                       (uint32_t)j->optimization_level, f->slot_count,
+                       f->param_count, f->max_stack, (uint32_t)f->count,
+                       (uint32_t)function, (uint32_t)(function >> 32)};
+  size_t code = sizeof(bytecode_insn) * f->count;
+  *length = sizeof(header) + code + sizeof(uint32_t) * f->count;
+  uint8_t *key = (uint8_t *)malloc(*length);
+  if (!key)
+    return NULL;
+  memcpy(key, header, sizeof(header));
+  memcpy(key + sizeof(header), f->code, code);
+  memcpy(key + sizeof(header) + code, f->origin, sizeof(uint32_t) * f->count);
+  return key;
+}
+
+// Emits farol_native for f into a new context, NULL if f does not fit
+static gcc_jit_context *bytecode_jit__build(bytecode_jit *j,
+                                            const bytecode_function *f,
+                                            size_t function) {
+  // Stack depth before every instruction. Lowering only jumps between
+  // statements, where the stack is empty, so one pass is enough.
+  uint32_t *depths = (uint32_t *)malloc(sizeof(uint32_t) * f->count);
+  if (!depths)
+    return NULL;
+  uint32_t depth = 0, max_argc = 0;
+  _Bool ok = 1;
+  for (size_t i = 0; i < f->count; i++) {
+    depths[i] = depth;
+    const bytecode_insn *ins = &f->code[i];
+    depth += ins->op == BYTECODE_CALL ? 1 - (int)ins->imm
+                                      : bytecode_jit__effect[ins->op];
+    if (ins->op == BYTECODE_CALL && ins->imm > max_argc)
+      max_argc = ins->imm;
+  }
+  for (size_t i = 0; ok && i < f->count; i++) {
+    uint8_t op = f->code[i].op;
+    if (op == BYTECODE_JUMP || op == BYTECODE_JUMP_IF ||
+        op == BYTECODE_JUMP_IFNOT)
+      ok = depths[f->code[i].arg] == 0 && depths[i] == (op != BYTECODE_JUMP);
+  }
+  if (!ok) {
+    free(depths);
+    return NULL;
+  }
+
+  bytecode_jit__emitter e = {.function = function};
+  e.ctxt = gcc_jit_context_acquire();
+  gcc_jit_context_set_int_option(e.ctxt, GCC_JIT_INT_OPTION_OPTIMIZATION_LEVEL,
+                                 j->optimization_level);
+  e.u64 = gcc_jit_context_get_int_type(e.ctxt, 8, 0);
+  e.i64 = gcc_jit_context_get_int_type(e.ctxt, 8, 1);
+  e.u8 = gcc_jit_context_get_int_type(e.ctxt, 1, 0);
+  e.size = gcc_jit_context_get_type(e.ctxt, GCC_JIT_TYPE_SIZE_T);
+  e.boolean = gcc_jit_context_get_type(e.ctxt, GCC_JIT_TYPE_BOOL);
+  e.u64_ptr = gcc_jit_type_get_pointer(e.u64);
+  gcc_jit_type *void_ptr = gcc_jit_context_get_type(e.ctxt, GCC_JIT_TYPE_VOID_PTR);
+
+  gcc_jit_param *params[] = {
+      gcc_jit_context_new_param(e.ctxt, NULL, void_ptr, "x"),
+      gcc_jit_context_new_param(e.ctxt, NULL, e.u64_ptr, "args"),
+      gcc_jit_context_new_param(e.ctxt, NULL, e.u64_ptr, "ret")};
+  e.fn = gcc_jit_context_new_function(e.ctxt, NULL, GCC_JIT_FUNCTION_EXPORTED,
+                                      e.boolean, "farol_native", 3, params, 0);
+  e.exec = gcc_jit_param_as_rvalue(params[0]);
+  e.args = gcc_jit_param_as_rvalue(params[1]);
+  e.ret = gcc_jit_param_as_rvalue(params[2]);
+
+  // farol_runtime, in bytecode_jit__runtime order
+  gcc_jit_type *step_params[] = {void_ptr, e.size, e.size};
+  gcc_jit_type *check_params[] = {void_ptr, e.size, e.size, e.boolean,
+                                  e.boolean};
+  gcc_jit_type *nondet_params[] = {void_ptr, e.u64, e.u8, e.u8};
+  gcc_jit_type *call_params[] = {void_ptr, e.size, e.u64_ptr, e.size,
+                                 e.u64_ptr};
+  gcc_jit_type *helper_types[] = {
+      gcc_jit_context_new_function_ptr_type(e.ctxt, NULL, e.boolean, 3,
+                                            step_params, 0),
+      gcc_jit_context_new_function_ptr_type(e.ctxt, NULL, e.boolean, 3,
+                                            step_params, 0),
+      gcc_jit_context_new_function_ptr_type(e.ctxt, NULL, e.boolean, 5,
+                                            check_params, 0),
+      gcc_jit_context_new_function_ptr_type(e.ctxt, NULL, e.u64, 4,
+                                            nondet_params, 0),
+      gcc_jit_context_new_function_ptr_type(e.ctxt, NULL, e.boolean, 5,
+                                            call_params, 0),
+      gcc_jit_context_new_function_ptr_type(e.ctxt, NULL, e.u64_ptr, 1,
+                                            &void_ptr, 0)};
+  const char *helper_names[] = {"step", "error", "check",
+                                "nondet", "call", "globals"};
+  gcc_jit_field *fields[6];
+  for (int k = 0; k < 6; k++)
+    fields[k] = gcc_jit_context_new_field(e.ctxt, NULL, helper_types[k],
+                                          helper_names[k]);
+  gcc_jit_struct *runtime_type = gcc_jit_context_new_struct_type(
+      e.ctxt, NULL, "farol_runtime_t", 6, fields);
+  gcc_jit_lvalue *runtime = gcc_jit_context_new_global(
+      e.ctxt, NULL, GCC_JIT_GLOBAL_EXPORTED, gcc_jit_struct_as_type(runtime_type),
+      "farol_runtime");
+  gcc_jit_rvalue **helpers[] = {&e.step, &e.error, &e.check,
+                                &e.nondet, &e.call, &e.get_globals};
+  for (int k = 0; k < 6; k++)
+    *helpers[k] = bytecode_jit__get(gcc_jit_lvalue_access_field(runtime, NULL, fields[k]));
+
+  e.stack = (gcc_jit_lvalue **)malloc(sizeof(gcc_jit_lvalue *) * (f->max_stack + 1));
+  e.slots = (gcc_jit_lvalue **)malloc(sizeof(gcc_jit_lvalue *) * f->slot_count);
+  gcc_jit_block **blocks =
+      (gcc_jit_block **)malloc(sizeof(gcc_jit_block *) * f->count);
+  if (!e.stack || !e.slots || !blocks) {
+    free(e.stack);
+    free(e.slots);
+    free(blocks);
+    free(depths);
+    gcc_jit_context_release(e.ctxt);
+    return NULL;
+  }
+  for (uint32_t k = 0; k <= f->max_stack; k++)
+    e.stack[k] = gcc_jit_function_new_local(e.fn, NULL, e.u64, NULL);
+  for (uint32_t k = 0; k < f->slot_count; k++)
+    e.slots[k] = gcc_jit_function_new_local(e.fn, NULL, e.u64, NULL);
+  e.argv = gcc_jit_function_new_local(
+      e.fn, NULL,
+      gcc_jit_context_new_array_type(e.ctxt, NULL, e.u64, max_argc ? max_argc : 1),
+      "argv");
+  e.result = gcc_jit_function_new_local(e.fn, NULL, e.u64, "result");
+  e.globals = gcc_jit_function_new_local(e.fn, NULL, e.u64_ptr, "globals");
+  for (size_t i = 0; i < f->count; i++)
+    blocks[i] = gcc_jit_function_new_block(e.fn, NULL);
+
+  // Slots start at 0 but for the parameters, read before any call
+  e.block = gcc_jit_function_new_block(e.fn, "entry");
+  for (uint32_t k = 0; k < f->slot_count; k++) {
+    gcc_jit_rvalue *init =
+        k >= 1 && k <= f->param_count
+            ? bytecode_jit__get(gcc_jit_context_new_array_access(
+                  e.ctxt, NULL, e.args, bytecode_jit__size(&e, k - 1)))
+            : bytecode_jit__u64(&e, 0);
+    gcc_jit_block_add_assignment(e.block, NULL, e.slots[k], init);
+  }
+  bytecode_jit__reload_globals(&e);
+  gcc_jit_block_end_with_jump(e.block, NULL, blocks[0]);
+
+  for (size_t i = 0; i < f->count; i++) {
+    e.block = blocks[i];
+    bytecode_jit__emit(&e, f, i, depths[i], blocks);
+  }
+
+  free(e.stack);
+  free(e.slots);
+  free(blocks);
+  free(depths);
+  return e.ctxt;
+}
+
+// Through the cache directory when there is one, in memory otherwise
+static bytecode_native bytecode_jit__generate(bytecode_jit *j,
+                                              gcc_jit_context *ctxt,
+                                              const uint8_t *key,
+                                              size_t length) {
+  bytecode_native native = NULL;
+  const char *error = NULL;
+  if (j->cache) {
+    char *temp = code_cache_temp(j->cache, ".so");
+    char *path = NULL;
+    if (temp) {
+      gcc_jit_context_compile_to_file(ctxt, GCC_JIT_OUTPUT_KIND_DYNAMIC_LIBRARY,
+                                      temp);
+      error = gcc_jit_context_get_first_error(ctxt);
+      if (!error)
+        path = code_cache_insert(j->cache, key, length, ".so", temp);
+      else
+        unlink(temp);
+    }
+    if (path)
+      native = bytecode_jit__load(j, path);
+    free(path);
+    free(temp);
+  } else {
+    gcc_jit_result *result = gcc_jit_context_compile(ctxt);
+    error = gcc_jit_context_get_first_error(ctxt);
+    if (result && bytecode_jit__keep((void ***)&j->results, &j->result_count,
+                                     &j->result_capacity, result))
+      native = bytecode_jit__bind(gcc_jit_result_get_global(result, "farol_runtime"),
+                                  gcc_jit_result_get_code(result, "farol_native"));
+    else if (result)
+      gcc_jit_result_release(result);
+  }
+  if (error)
+    fprintf(stderr, "bytecode jit: %s\n", error);
+  return native;
+}
+
+bytecode_native bytecode_jit_compile(bytecode_jit *j, bytecode_program *bp,
+                                     size_t function) {
+  bytecode_function *f = bytecode_lower(bp, function);
+  if (!f || !f->count)
+    return NULL;
+
+  size_t length;
+  uint8_t *key = bytecode_jit__key(j, f, function, &length);
+  if (!key)
+    return NULL;
+  bytecode_native native = NULL;
+  if (j->cache) {
+    char *path = code_cache_find(j->cache, key, length, ".so");
+    if (path)
+      native = bytecode_jit__load(j, path);
+    free(path);
+    if (native) {
+      j->cache_hits++;
+      free(key);
+      return native;
+    }
+    j->cache_misses++;
+  }
+
+  gcc_jit_context *ctxt = bytecode_jit__build(j, f, function);
+  if (ctxt) {
+    native = bytecode_jit__generate(j, ctxt, key, length);
+    gcc_jit_context_release(ctxt);
+  }
+  free(key);
+  return native;
+}
+
+uint64_t bytecode_jit_tests() {
+  uint64_t errors = 0;
+
+  printf("Bytecode JIT suite...\n");
+
+  bytecode__test t;
+  goto_program *p = bytecode__t_program(&t);
+
+  {
+    printf("- Native tier matches the interpreter... ");
+    bytecode_program *interpreted = bytecode_program_create(p);
+    bytecode_program *native = bytecode_program_create(p);
+    bytecode_jit *j = bytecode_jit_create(2, NULL);
+    bytecode_jit_attach(j, native);
+    native->tier.call_threshold = 1;
+
+    _Bool ok = 1;
+    // Same failures, stops and globals, nondet 7 runs to the end and 2
+    // stops at the assumption
+    for (uint64_t nondet = 2; nondet <= 7; nondet += 5) {
+      bytecode__t_run run1 = {.nondet = nondet}, run2 = {.nondet = nondet};
+      bytecode_hooks hooks1 = {.nondet = bytecode__t_nondet,
+                               .assertion = bytecode__t_assertion,
+                               .ctx = &run1};
+      bytecode_hooks hooks2 = hooks1;
+      hooks2.ctx = &run2;
+      bytecode_result r1 = bytecode_run(interpreted, 0, &hooks1);
+      bytecode_result r2 = bytecode_run(native, 0, &hooks2);
+      ok &= r1.status == r2.status && r1.function == r2.function &&
+            r1.pc == r2.pc && r1.steps == r2.steps;
+      ok &= run1.failed == run2.failed && run1.failed_pc[0] == run2.failed_pc[0];
+      ok &= bytecode_global(interpreted, interner_intern(t.strings, "g")) ==
+            bytecode_global(native, interner_intern(t.strings, "g"));
+    }
+    ok &= native->functions[0].native != NULL &&
+          native->functions[1].native != NULL;
+
+    bytecode_hooks limit = {.max_steps = 1000};
+    bytecode_result r1 = bytecode_run(interpreted, 2, &limit);
+    bytecode_result r2 = bytecode_run(native, 2, &limit);
+    ok &= r1.status == BYTECODE_STEP_LIMIT && r2.status == BYTECODE_STEP_LIMIT &&
+          r1.steps == r2.steps;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    bytecode_program_destroy(interpreted);
+    bytecode_program_destroy(native);
+    bytecode_jit_destroy(j);
+  }
+
+  {
+    printf("- Cached native code... ");
+    char dir[64];
+    snprintf(dir, sizeof(dir), "/tmp/farol_jit_cache_%ld", (long)getpid());
+
+    // The second run finds everything the first one built
+    _Bool ok = 1;
+    uint64_t g[2] = {0};
+    size_t hits[2] = {0}, misses[2] = {0};
+    for (int k = 0; k < 2; k++) {
+      bytecode_program *bp = bytecode_program_create(p);
+      bytecode_jit *j = bytecode_jit_create(2, dir);
+      ok &= bp && j;
+      if (!ok)
+        break;
+      bytecode_jit_attach(j, bp);
+      bp->tier.call_threshold = 1;
+      bytecode__t_run run = {.nondet = 7};
+      bytecode_hooks hooks = {.nondet = bytecode__t_nondet,
+                              .assertion = bytecode__t_assertion,
+                              .ctx = &run};
+      bytecode_result r = bytecode_run(bp, 0, &hooks);
+      ok &= r.status == BYTECODE_DONE && bp->functions[1].native != NULL;
+      g[k] = bytecode_global(bp, interner_intern(t.strings, "g"));
+      hits[k] = j->cache_hits;
+      misses[k] = j->cache_misses;
+      bytecode_program_destroy(bp);
+      bytecode_jit_destroy(j);
+    }
+    ok &= g[0] == g[1] && hits[0] == 0 && misses[0] > 0 &&
+          hits[1] == misses[0] && misses[1] == 0;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    DIR *entries = opendir(dir);
+    for (struct dirent *entry; entries && (entry = readdir(entries));) {
+      char path[384];
+      snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+      if (entry->d_name[0] != '.')
+        unlink(path);
+    }
+    if (entries)
+      closedir(entries);
+    rmdir(dir);
+  }
+
+  {
+    printf("- Identical bodies at other indices... ");
+    bytecode__test twin = {.instruction_capacity = 4};
+    twin.strings = interner_create();
+    twin.ireps = irep_store_create();
+    twin.program = (goto_program *)calloc(1, sizeof(goto_program));
+    goto_program *tp = twin.program;
+    tp->strings = twin.strings;
+    tp->ireps = twin.ireps;
+    tp->functions = (goto_function *)calloc(2, sizeof(goto_function));
+    tp->function_index_capacity = 16;
+    tp->function_index = (uint32_t *)calloc(16, sizeof(uint32_t));
+
+    // first and second: assert false, the same bytecode
+    uint64_t boolean = bytecode__t_leaf(&twin, "bool");
+    uint64_t nil = bytecode__t_leaf(&twin, "nil");
+    uint64_t yes = bytecode__t_constant(&twin, "true", boolean);
+    uint64_t no = bytecode__t_constant(&twin, "false", boolean);
+    const char *names[] = {"first", "second"};
+    for (int k = 0; k < 2; k++) {
+      goto_function *f = bytecode__t_function(&twin, names[k]);
+      bytecode__t_add(&twin, f, GOTO_ASSERT, nil, no, GOTO_NIL_TARGET);
+      bytecode__t_add(&twin, f, GOTO_END_FUNCTION, nil, yes, GOTO_NIL_TARGET);
+    }
+
+    char dir[64];
+    snprintf(dir, sizeof(dir), "/tmp/farol_jit_twins_%ld", (long)getpid());
+    bytecode_program *bp = bytecode_program_create(tp);
+    bytecode_jit *j = bytecode_jit_create(2, dir);
+    _Bool ok = bp && j;
+    if (ok) {
+      bytecode_jit_attach(j, bp);
+      bp->tier.call_threshold = 1;
+      // Hot on the first run, native on the second
+      bytecode_hooks hooks = {0};
+      for (size_t function = 0; function < 2; function++)
+        for (int run = 0; run < 2; run++) {
+          bytecode_result r = bytecode_run(bp, function, &hooks);
+          ok &= r.status == BYTECODE_ASSERTION_STOP && r.function == function &&
+                r.pc == 0;
+        }
+      ok &= bp->functions[0].native && bp->functions[1].native &&
+            j->cache_hits == 0;
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (bp)
+      bytecode_program_destroy(bp);
+    if (j)
+      bytecode_jit_destroy(j);
+    goto_program_destroy(tp);
+    irep_store_destroy(twin.ireps);
+    interner_destroy(twin.strings);
+    DIR *entries = opendir(dir);
+    for (struct dirent *entry; entries && (entry = readdir(entries));) {
+      char path[384];
+      snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+      if (entry->d_name[0] != '.')
+        unlink(path);
+    }
+    if (entries)
+      closedir(entries);
+    rmdir(dir);
+  }
+
+  goto_program_destroy(p);
+  irep_store_destroy(t.ireps);
+  interner_destroy(t.strings);
+  return errors;
+}
+
+#endif
+#endif
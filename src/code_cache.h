@@ -0,0 +1,232 @@
+#ifndef CODE_CACHE_H
+#define CODE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "string_interner.h"
+
+// Directory of build artifacts keyed by the content they were built from,
+// for work that is worth keeping across runs (native code for the
+// interpreter). An entry is <hash><suffix> next to <hash>.key, which holds
+// the exact key bytes. Lookups compare the whole key, so a collision is a
+// miss, and changed content hashes to a different entry: there is nothing
+// to invalidate. Entries are moved into place with rename, runs sharing a
+// directory never see half written ones.
+
+typedef struct {
+  char *dir;
+  unsigned temp_counter;
+} code_cache;
+
+// Creates dir as needed, NULL if it can not
+code_cache *code_cache_open(const char *dir);
+void code_cache_close(code_cache *c);
+// Path of the artifact built from key, NULL if there is none. Free it.
+char *code_cache_find(code_cache *c, const void *key, size_t length,
+                      const char *suffix);
+// Fresh path in the directory to build an artifact at. Free it.
+char *code_cache_temp(code_cache *c, const char *suffix);
+// Moves the artifact at temp into the entry for key, returns its final path
+// or NULL. Free it.
+char *code_cache_insert(code_cache *c, const void *key, size_t length,
+                        const char *suffix, const char *temp);
+
+uint64_t code_cache_tests();
+#ifdef CODE_CACHE_IMPL
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+static _Bool code_cache__mkdirs(char *path) {
+  for (char *p = path + 1;; p++) {
+    if (*p != '/' && *p)
+      continue;
+    char saved = *p;
+    *p = 0;
+    int failed = mkdir(path, 0755) < 0 && errno != EEXIST;
+    *p = saved;
+    if (failed)
+      return 0;
+    if (!saved)
+      return 1;
+  }
+}
+
+code_cache *code_cache_open(const char *dir) {
+  code_cache *c = (code_cache *)calloc(1, sizeof(*c));
+  if (!c)
+    return NULL;
+  c->dir = strdup(dir);
+  if (!c->dir || !code_cache__mkdirs(c->dir)) {
+    fprintf(stderr, "code cache: could not create %s\n", dir);
+    free(c->dir);
+    free(c);
+    return NULL;
+  }
+  return c;
+}
+
+void code_cache_close(code_cache *c) {
+  free(c->dir);
+  free(c);
+}
+
+static char *code_cache__path(code_cache *c, const void *key, size_t length,
+                              const char *suffix) {
+  size_t size = strlen(c->dir) + strlen(suffix) + 32;
+  char *path = (char *)malloc(size);
+  if (path)
+    snprintf(path, size, "%s/%016llx%s", c->dir,
+             (unsigned long long)interner_hash((const char *)key, length),
+             suffix);
+  return path;
+}
+
+static _Bool code_cache__same_key(const char *path, const void *key,
+                                  size_t length) {
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return 0;
+  _Bool same = 1;
+  const uint8_t *bytes = (const uint8_t *)key;
+  uint8_t buffer[4096];
+  size_t offset = 0;
+  for (size_t n; same && (n = fread(buffer, 1, sizeof(buffer), file)) > 0;
+       offset += n)
+    same = offset + n <= length && memcmp(buffer, bytes + offset, n) == 0;
+  fclose(file);
+  return same && offset == length;
+}
+
+char *code_cache_find(code_cache *c, const void *key, size_t length,
+                      const char *suffix) {
+  char *key_path = code_cache__path(c, key, length, ".key");
+  char *path = code_cache__path(c, key, length, suffix);
+  _Bool found = key_path && path &&
+                code_cache__same_key(key_path, key, length) &&
+                access(path, R_OK) == 0;
+  free(key_path);
+  if (!found) {
+    free(path);
+    return NULL;
+  }
+  return path;
+}
+
+char *code_cache_temp(code_cache *c, const char *suffix) {
+  size_t size = strlen(c->dir) + strlen(suffix) + 48;
+  char *path = (char *)malloc(size);
+  if (path)
+    snprintf(path, size, "%s/tmp-%ld-%u%s", c->dir, (long)getpid(),
+             c->temp_counter++, suffix);
+  return path;
+}
+
+char *code_cache_insert(code_cache *c, const void *key, size_t length,
+                        const char *suffix, const char *temp) {
+  char *path = code_cache__path(c, key, length, suffix);
+  char *key_path = code_cache__path(c, key, length, ".key");
+  char *key_temp = code_cache_temp(c, ".key");
+  _Bool ok = path && key_path && key_temp;
+
+  if (ok) {
+    FILE *file = fopen(key_temp, "wb");
+    ok = file && fwrite(key, 1, length, file) == length;
+    if (file)
+      ok &= fclose(file) == 0;
+  }
+  // Artifact first, a key without its artifact is a miss
+  ok = ok && rename(temp, path) == 0 && rename(key_temp, key_path) == 0;
+  if (!ok) {
+    if (key_temp)
+      unlink(key_temp);
+    unlink(temp);
+    free(path);
+    path = NULL;
+  }
+  free(key_path);
+  free(key_temp);
+  return path;
+}
+
+static _Bool code_cache__test_write(const char *path, const char *content) {
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return 0;
+  fputs(content, file);
+  return fclose(file) == 0;
+}
+
+uint64_t code_cache_tests() {
+  uint64_t errors = 0;
+
+  printf("Code cache suite...\n");
+
+  char dir[64];
+  snprintf(dir, sizeof(dir), "/tmp/farol_code_cache_%ld/a/b", (long)getpid());
+
+  {
+    printf("- Insert and find by content... ");
+    code_cache *c = code_cache_open(dir);
+    _Bool ok = c != NULL;
+    const char key[] = "bytecode of f";
+    const char other[] = "bytecode of g";
+    ok &= ok && code_cache_find(c, key, sizeof(key), ".so") == NULL;
+
+    char *temp = ok ? code_cache_temp(c, ".so") : NULL;
+    char *path = NULL;
+    if (temp && code_cache__test_write(temp, "native f"))
+      path = code_cache_insert(c, key, sizeof(key), ".so", temp);
+    ok &= path != NULL && access(temp, F_OK) != 0;
+
+    // Reopening the directory, as another run would
+    if (ok) {
+      code_cache_close(c);
+      c = code_cache_open(dir);
+      ok &= c != NULL;
+    }
+    char *found = ok ? code_cache_find(c, key, sizeof(key), ".so") : NULL;
+    ok &= found && !strcmp(found, path);
+    ok &= ok && code_cache_find(c, other, sizeof(other), ".so") == NULL;
+    ok &= ok && code_cache_find(c, key, sizeof(key), ".o") == NULL;
+    ok &= ok && code_cache_find(c, key, sizeof(key) - 1, ".so") == NULL;
+
+    // A key file that does not match, as after a hash collision, is a miss
+    char *key_path = ok ? code_cache__path(c, key, sizeof(key), ".key") : NULL;
+    ok &= key_path && code_cache__test_write(key_path, "bytecode of h");
+    ok &= ok && code_cache_find(c, key, sizeof(key), ".so") == NULL;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (key_path)
+      unlink(key_path);
+    if (path)
+      unlink(path);
+    free(key_path);
+    free(found);
+    free(path);
+    free(temp);
+    if (c)
+      code_cache_close(c);
+    for (int i = 0; i < 3; i++) {
+      rmdir(dir);
+      *strrchr(dir, '/') = 0;
+    }
+  }
+
+  return errors;
+}
+
+#endif
+#endif
@@ -0,0 +1,1143 @@
+#ifndef GOTO_BINARY_H
+#define GOTO_BINARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "irep.h"
+#include "shared_interner.h"
+#include "string_interner.h"
+
+// Reader for GOTO binaries as written by CBMC (goto-cc, version 6 of the
+// format). The file is memory mapped and decoded in place: strings are
+// interned straight from the mapped bytes and ireps are rebuilt in an
+// irep_store, following the reference numbers the writer used for sharing.
+//
+// Opening a binary skims it once, recording where every string and irep
+// reference number is defined and where each function body starts, without
+// interning or building anything. Symbols are decoded right away, function
+// bodies only the first time they are asked for. A body can refer to ireps
+// first written in a body that was never decoded, those are decoded from
+// the recorded offsets. Loading is not thread safe.
+
+#define GOTO_BINARY_VERSION 6
+#define GOTO_NIL_TARGET UINT32_MAX
+
+typedef enum {
+  GOTO_NO_INSTRUCTION_TYPE = 0,
+  GOTO_GOTO,
+  GOTO_ASSUME,
+  GOTO_ASSERT,
+  GOTO_OTHER,
+  GOTO_SKIP,
+  GOTO_START_THREAD,
+  GOTO_END_THREAD,
+  GOTO_LOCATION,
+  GOTO_END_FUNCTION,
+  GOTO_ATOMIC_BEGIN,
+  GOTO_ATOMIC_END,
+  GOTO_SET_RETURN_VALUE,
+  GOTO_ASSIGN,
+  GOTO_DECL,
+  GOTO_DEAD,
+  GOTO_FUNCTION_CALL,
+  GOTO_THROW,
+  GOTO_CATCH,
+  GOTO_INCOMPLETE_GOTO,
+} goto_instruction_type;
+
+// Symbol flags, same bit positions as in the file
+#define GOTO_SYMBOL_IS_VOLATILE (1u << 0)
+#define GOTO_SYMBOL_IS_EXTERN (1u << 1)
+#define GOTO_SYMBOL_IS_FILE_LOCAL (1u << 2)
+#define GOTO_SYMBOL_IS_THREAD_LOCAL (1u << 3)
+#define GOTO_SYMBOL_IS_STATIC_LIFETIME (1u << 4)
+#define GOTO_SYMBOL_IS_LVALUE (1u << 5)
+#define GOTO_SYMBOL_IS_AUXILIARY (1u << 7)
+#define GOTO_SYMBOL_IS_PARAMETER (1u << 8)
+#define GOTO_SYMBOL_IS_STATE_VAR (1u << 9)
+#define GOTO_SYMBOL_IS_OUTPUT (1u << 10)
+#define GOTO_SYMBOL_IS_INPUT (1u << 11)
+#define GOTO_SYMBOL_IS_EXPORTED (1u << 12)
+#define GOTO_SYMBOL_IS_MACRO (1u << 13)
+#define GOTO_SYMBOL_IS_PROPERTY (1u << 14)
+#define GOTO_SYMBOL_IS_TYPE (1u << 15)
+#define GOTO_SYMBOL_IS_WEAK (1u << 16)
+
+typedef struct {
+  uint64_t type, value, location; // ireps
+  uint64_t name, module, base_name, mode, pretty_name; // strings
+  uint32_t flags;
+} goto_symbol;
+
+typedef struct {
+  uint64_t code, source_location, guard; // ireps
+  uint32_t type;
+  uint32_t target_number; // GOTO_NIL_TARGET unless something jumps here
+  // Ranges of goto_program.pool: targets as instruction indices in the same
+  // function, labels as string ids.
+  uint32_t targets, target_count;
+  uint32_t labels, label_count;
+} goto_instruction;
+
+typedef struct {
+  uint64_t name;
+  goto_instruction *instructions; // NULL until loaded
+  size_t count;
+  size_t offset; // of the body in the binary
+  _Bool loaded;
+} goto_function;
+
+typedef struct {
+  // Exactly one of them is set, see goto_program_string
+  string_interner *strings;
+  shared_interner *shared_strings;
+  irep_store *ireps;
+  goto_symbol *symbols;
+  size_t symbol_count;
+  goto_function *functions;
+  size_t function_count;
+  uint64_t *pool;
+  size_t pool_length;
+  size_t pool_capacity;
+  size_t loaded_function_count;
+
+  // Name -> function index + 1, open addressing
+  uint32_t *function_index;
+  size_t function_index_capacity;
+  struct goto__reader *reader;
+  void *map;
+  size_t map_size;
+} goto_program;
+
+// Strings and ireps are added to the given stores, which the program does not
+// own. Both return NULL and print a diagnostic on malformed input. A parsed
+// buffer must outlive the program, bodies are decoded from it on demand.
+goto_program *goto_program_load(const char *path, string_interner *strings,
+                                irep_store *ireps);
+goto_program *goto_program_parse(const uint8_t *data, size_t size,
+                                 string_interner *strings, irep_store *ireps);
+// Same as goto_program_load, interning through a thread safe interner
+goto_program *goto_program_load_shared(const char *path,
+                                       shared_interner *strings,
+                                       irep_store *ireps);
+void goto_program_destroy(goto_program *p);
+const char *goto_program_string(const goto_program *p, uint64_t id,
+                                size_t *length);
+// Interns through whichever interner the program uses
+uint64_t goto_program_intern(goto_program *p, const char *s);
+// Index of the function called name without decoding it, SIZE_MAX if none
+size_t goto_program_find_function(const goto_program *p, uint64_t name);
+// Decode the body on first use. NULL if there is no function with that name
+// or its body is malformed.
+goto_function *goto_program_function(goto_program *p, uint64_t name);
+goto_function *goto_program_function_at(goto_program *p, size_t i);
+
+uint64_t goto_binary_tests();
+#ifdef GOTO_BINARY_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+// Ireps are decoded recursively, one level per nesting. Deeper input fails
+// instead of running out of stack.
+#define GOTO__MAX_DEPTH 10000
+
+// Where a reference number is first written, and what it decoded to
+typedef struct {
+  size_t start; // 0 when not defined
+  size_t end;
+  uint64_t value; // decoded id + 1, 0 while not decoded
+} goto__def;
+
+typedef struct goto__reader {
+  const uint8_t *data;
+  size_t size;
+  size_t pos;
+  const char *error;
+  size_t error_pos;
+
+  goto_program *program;
+  goto__def *string_defs;
+  size_t string_defs_capacity;
+  goto__def *irep_defs;
+  size_t irep_defs_capacity;
+  // Operands of the ireps being decoded, nested ireps push on top
+  uint64_t *stack;
+  size_t stack_length;
+  size_t stack_capacity;
+  size_t depth; // of the irep being decoded or skimmed
+  // Only used for strings containing escapes
+  char *unescaped;
+  size_t unescaped_capacity;
+} goto__reader;
+
+static _Bool goto__fail(goto__reader *r, const char *error) {
+  if (!r->error) {
+    r->error = error;
+    r->error_pos = r->pos;
+  }
+  r->pos = r->size;
+  return 0;
+}
+
+static uint64_t goto__word(goto__reader *r) {
+  uint64_t result = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    if (r->pos >= r->size)
+      return goto__fail(r, "unexpected end of file");
+    uint8_t byte = r->data[r->pos++];
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return result;
+  }
+  return goto__fail(r, "word too long");
+}
+
+static int goto__peek(goto__reader *r) {
+  return r->pos < r->size ? r->data[r->pos] : -1;
+}
+
+static _Bool goto__grow(void **items, size_t *capacity, size_t needed,
+                        size_t item_size, _Bool zero) {
+  if (needed <= *capacity)
+    return 1;
+  size_t capacity_new = *capacity ? *capacity : 256;
+  while (capacity_new < needed) {
+    if (capacity_new > SIZE_MAX / 2)
+      return 0;
+    capacity_new *= 2;
+  }
+  if (capacity_new > SIZE_MAX / item_size)
+    return 0;
+  void *grown = realloc(*items, capacity_new * item_size);
+  if (!grown)
+    return 0;
+  if (zero)
+    memset((char *)grown + *capacity * item_size, 0,
+           (capacity_new - *capacity) * item_size);
+  *items = grown;
+  *capacity = capacity_new;
+  return 1;
+}
+
+// NUL terminated, '\\' escapes the next byte. Returns whether there are
+// escapes.
+static _Bool goto__skip_string(goto__reader *r) {
+  _Bool escaped = 0;
+  while (r->pos < r->size && r->data[r->pos]) {
+    if (r->data[r->pos] == '\\') {
+      escaped = 1;
+      if (++r->pos == r->size)
+        break;
+    }
+    r->pos++;
+  }
+  if (r->pos >= r->size)
+    return goto__fail(r, "unterminated string");
+  r->pos++;
+  return escaped;
+}
+
+static uint64_t goto__intern(goto__reader *r, const char *data, size_t length) {
+  uint64_t id =
+      r->program->shared_strings
+          ? shared_interner_intern_n(r->program->shared_strings, data, length)
+          : interner_intern_n(r->program->strings, data, length);
+  if (id == INTERNER_ERROR)
+    return goto__fail(r, "could not intern a string");
+  return id;
+}
+
+// Strings without escapes are interned directly from the input
+static uint64_t goto__string(goto__reader *r) {
+  size_t start = r->pos;
+  _Bool escaped = goto__skip_string(r);
+  if (r->error)
+    return 0;
+  size_t end = r->pos - 1;
+  const char *str = (const char *)r->data + start;
+  if (!escaped)
+    return goto__intern(r, str, end - start);
+
+  if (!goto__grow((void **)&r->unescaped, &r->unescaped_capacity, end - start,
+                  1, 0))
+    return goto__fail(r, "out of memory");
+  size_t length = 0;
+  for (size_t i = start; i < end; i++) {
+    if (r->data[i] == '\\')
+      i++;
+    r->unescaped[length++] = r->data[i];
+  }
+  return goto__intern(r, r->unescaped, length);
+}
+
+// Reads a reference number. When this is where it is defined, *inline_def
+// is set, and for a new number the definition is recorded as starting here.
+// The table can move when nested references are read, so this returns the
+// number rather than the entry, or SIZE_MAX on errors.
+static size_t goto__def_ref(goto__reader *r, goto__def **defs,
+                            size_t *capacity, _Bool record, _Bool *inline_def) {
+  uint64_t number = goto__word(r);
+  if (r->error)
+    return SIZE_MAX;
+  // Numbers are handed out in order and every definition takes input, so
+  // one past the input is malformed rather than a table to allocate
+  if (number >= r->size) {
+    goto__fail(r, "reference number out of range");
+    return SIZE_MAX;
+  }
+  if (!goto__grow((void **)defs, capacity, number + 1, sizeof(goto__def), 1)) {
+    goto__fail(r, "out of memory");
+    return SIZE_MAX;
+  }
+  goto__def *def = &(*defs)[number];
+  if (record && !def->start)
+    def->start = r->pos;
+  if (!def->start) {
+    goto__fail(r, "reference to an undefined number");
+    return SIZE_MAX;
+  }
+  *inline_def = def->start == r->pos;
+  return number;
+}
+
+static void goto__skim_string_ref(goto__reader *r) {
+  _Bool inline_def;
+  size_t number = goto__def_ref(r, &r->string_defs, &r->string_defs_capacity,
+                                1, &inline_def);
+  // Only the first occurrence carries the string
+  if (number != SIZE_MAX && inline_def && !r->string_defs[number].end) {
+    goto__skip_string(r);
+    r->string_defs[number].end = r->pos;
+  }
+}
+
+static void goto__skim_irep_ref(goto__reader *r) {
+  _Bool inline_def;
+  size_t number =
+      goto__def_ref(r, &r->irep_defs, &r->irep_defs_capacity, 1, &inline_def);
+  if (number == SIZE_MAX || !inline_def || r->irep_defs[number].end)
+    return;
+  if (r->depth == GOTO__MAX_DEPTH) {
+    goto__fail(r, "irep nested too deeply");
+    return;
+  }
+  r->depth++;
+
+  goto__skim_string_ref(r);
+  while (goto__peek(r) == 'S') {
+    r->pos++;
+    goto__skim_irep_ref(r);
+  }
+  // 'C' are comments in older versions, now they are plain named subs
+  while (goto__peek(r) == 'N' || goto__peek(r) == 'C') {
+    r->pos++;
+    goto__skim_string_ref(r);
+    goto__skim_irep_ref(r);
+  }
+  if (goto__peek(r) != 0)
+    goto__fail(r, "irep not terminated");
+  else
+    r->pos++;
+  if (!r->error)
+    r->irep_defs[number].end = r->pos;
+  r->depth--;
+}
+
+static uint64_t goto__string_ref(goto__reader *r) {
+  _Bool inline_def;
+  size_t number = goto__def_ref(r, &r->string_defs, &r->string_defs_capacity,
+                                0, &inline_def);
+  if (number == SIZE_MAX)
+    return 0;
+  goto__def *def = &r->string_defs[number];
+  if (!def->value) {
+    size_t resume = inline_def ? 0 : r->pos;
+    r->pos = def->start;
+    def->value = goto__string(r) + 1;
+    if (resume && !r->error)
+      r->pos = resume;
+  } else if (inline_def) {
+    r->pos = def->end;
+  }
+  return def->value - 1;
+}
+
+static _Bool goto__push(goto__reader *r, uint64_t word) {
+  if (!goto__grow((void **)&r->stack, &r->stack_capacity, r->stack_length + 1,
+                  sizeof(uint64_t), 0))
+    return goto__fail(r, "out of memory");
+  r->stack[r->stack_length++] = word;
+  return 1;
+}
+
+static uint64_t goto__irep_ref(goto__reader *r);
+
+static uint64_t goto__irep(goto__reader *r) {
+  if (r->depth == GOTO__MAX_DEPTH)
+    return goto__fail(r, "irep nested too deeply");
+  r->depth++;
+  uint64_t id = goto__string_ref(r);
+  size_t base = r->stack_length;
+
+  size_t sub_count = 0;
+  while (goto__peek(r) == 'S') {
+    r->pos++;
+    goto__push(r, goto__irep_ref(r));
+    sub_count++;
+  }
+  size_t named_count = 0;
+  while (goto__peek(r) == 'N' || goto__peek(r) == 'C') {
+    r->pos++;
+    goto__push(r, goto__string_ref(r));
+    goto__push(r, goto__irep_ref(r));
+    named_count++;
+  }
+  if (goto__peek(r) != 0)
+    goto__fail(r, "irep not terminated");
+  else
+    r->pos++;
+
+  uint64_t node = 0;
+  if (!r->error)
+    node = irep_make(r->program->ireps, id, r->stack + base, sub_count,
+                     (const irep_named *)(r->stack + base + sub_count),
+                     named_count);
+  r->stack_length = base;
+  r->depth--;
+  return node;
+}
+
+static uint64_t goto__irep_ref(goto__reader *r) {
+  _Bool inline_def;
+  size_t number =
+      goto__def_ref(r, &r->irep_defs, &r->irep_defs_capacity, 0, &inline_def);
+  if (number == SIZE_MAX)
+    return 0;
+  goto__def *def = &r->irep_defs[number];
+  if (!def->value) {
+    // Defined in a body that was not decoded, go and get it
+    size_t resume = inline_def ? 0 : r->pos;
+    r->pos = def->start;
+    uint64_t node = goto__irep(r);
+    // Nested decoding may have moved the table
+    r->irep_defs[number].value = node + 1;
+    if (resume && !r->error)
+      r->pos = resume;
+  } else if (inline_def) {
+    r->pos = def->end;
+  }
+  return r->irep_defs[number].value - 1;
+}
+
+static uint32_t goto__pool_push(goto__reader *r, uint64_t word) {
+  goto_program *p = r->program;
+  if (!goto__grow((void **)&p->pool, &p->pool_capacity, p->pool_length + 1,
+                  sizeof(uint64_t), 0))
+    return goto__fail(r, "out of memory");
+  p->pool[p->pool_length] = word;
+  return p->pool_length++;
+}
+
+static void goto__skim_symbols(goto__reader *r, uint64_t count) {
+  for (uint64_t i = 0; i < count && !r->error; i++) {
+    goto__skim_irep_ref(r); // type
+    goto__skim_irep_ref(r); // value
+    goto__skim_irep_ref(r); // location
+    for (int s = 0; s < 5; s++)
+      goto__skim_string_ref(r);
+    goto__word(r); // ordering
+    goto__word(r); // flags
+  }
+}
+
+static void goto__symbols(goto__reader *r, uint64_t count) {
+  goto_program *p = r->program;
+  for (uint64_t i = 0; i < count && !r->error; i++) {
+    goto_symbol *sym = &p->symbols[i];
+    sym->type = goto__irep_ref(r);
+    sym->value = goto__irep_ref(r);
+    sym->location = goto__irep_ref(r);
+    sym->name = goto__string_ref(r);
+    sym->module = goto__string_ref(r);
+    sym->base_name = goto__string_ref(r);
+    sym->mode = goto__string_ref(r);
+    sym->pretty_name = goto__string_ref(r);
+    goto__word(r); // ordering, always 0
+    sym->flags = goto__word(r);
+    p->symbol_count++;
+  }
+}
+
+static void goto__skim_function_body(goto__reader *r) {
+  uint64_t count = goto__word(r);
+  for (uint64_t i = 0; i < count && !r->error; i++) {
+    goto__skim_irep_ref(r); // code
+    goto__skim_irep_ref(r); // source location
+    goto__word(r);          // type
+    goto__skim_irep_ref(r); // guard
+    goto__word(r);          // target number
+    uint64_t targets = goto__word(r);
+    for (uint64_t t = 0; t < targets && !r->error; t++)
+      goto__word(r);
+    uint64_t labels = goto__word(r);
+    for (uint64_t l = 0; l < labels && !r->error; l++)
+      goto__skim_string_ref(r);
+  }
+}
+
+static _Bool goto__function_body(goto__reader *r, goto_function *f) {
+  uint64_t count = goto__word(r);
+  if (count > r->size)
+    return goto__fail(r, "bad instruction count");
+  f->instructions =
+      (goto_instruction *)calloc(count ? count : 1, sizeof(goto_instruction));
+  if (!f->instructions)
+    return goto__fail(r, "out of memory");
+
+  for (uint64_t i = 0; i < count && !r->error; i++) {
+    goto_instruction *ins = &f->instructions[i];
+    ins->code = goto__irep_ref(r);
+    ins->source_location = goto__irep_ref(r);
+    ins->type = goto__word(r);
+    ins->guard = goto__irep_ref(r);
+    ins->target_number = goto__word(r);
+    ins->target_count = goto__word(r);
+    ins->targets = r->program->pool_length;
+    for (uint32_t t = 0; t < ins->target_count && !r->error; t++)
+      goto__pool_push(r, goto__word(r));
+    ins->label_count = goto__word(r);
+    ins->labels = r->program->pool_length;
+    for (uint32_t l = 0; l < ins->label_count && !r->error; l++)
+      goto__pool_push(r, goto__string_ref(r));
+    f->count++;
+  }
+  if (r->error)
+    return 0;
+
+  // Targets are written as target numbers, resolve them to indices. CBMC
+  // numbers targets 1, 2, 3... in order, so a direct map is almost always
+  // small.
+  uint32_t max_number = 0;
+  for (size_t i = 0; i < f->count; i++)
+    if (f->instructions[i].target_number != GOTO_NIL_TARGET &&
+        f->instructions[i].target_number > max_number)
+      max_number = f->instructions[i].target_number;
+  uint32_t *number_to_index = NULL;
+  if (max_number <= 4 * f->count + 16)
+    number_to_index = (uint32_t *)malloc(sizeof(uint32_t) * (max_number + 1));
+  if (number_to_index) {
+    memset(number_to_index, 0xff, sizeof(uint32_t) * (max_number + 1));
+    for (size_t i = 0; i < f->count; i++)
+      if (f->instructions[i].target_number != GOTO_NIL_TARGET)
+        number_to_index[f->instructions[i].target_number] = i;
+  }
+
+  for (size_t i = 0; i < f->count && !r->error; i++) {
+    goto_instruction *ins = &f->instructions[i];
+    for (uint32_t t = 0; t < ins->target_count; t++) {
+      uint64_t *target = &r->program->pool[ins->targets + t];
+      size_t j = f->count;
+      if (number_to_index) {
+        if (*target <= max_number && number_to_index[*target] != UINT32_MAX)
+          j = number_to_index[*target];
+      } else {
+        for (j = 0; j < f->count; j++)
+          if (f->instructions[j].target_number == *target)
+            break;
+      }
+      if (j == f->count) {
+        goto__fail(r, "jump to unknown target");
+        break;
+      }
+      *target = j;
+    }
+  }
+  free(number_to_index);
+  return !r->error;
+}
+
+static inline size_t goto__name_slot(uint64_t name, size_t capacity) {
+  return (name * 0x9e3779b97f4a7c15ULL) >> 32 & (capacity - 1);
+}
+
+static void goto__skim_functions(goto__reader *r) {
+  goto_program *p = r->program;
+  uint64_t count = goto__word(r);
+  if (count > r->size) {
+    goto__fail(r, "bad function count");
+    return;
+  }
+  p->functions = (goto_function *)calloc(count ? count : 1, sizeof(goto_function));
+  p->function_index_capacity = 16;
+  while (p->function_index_capacity < 2 * count)
+    p->function_index_capacity *= 2;
+  p->function_index =
+      (uint32_t *)calloc(p->function_index_capacity, sizeof(uint32_t));
+  if (!p->functions || !p->function_index) {
+    goto__fail(r, "out of memory");
+    return;
+  }
+
+  size_t mask = p->function_index_capacity - 1;
+  for (uint64_t i = 0; i < count && !r->error; i++) {
+    goto_function *f = &p->functions[p->function_count];
+    f->name = goto__string(r);
+    f->offset = r->pos;
+    goto__skim_function_body(r);
+    if (r->error)
+      break;
+    size_t slot = goto__name_slot(f->name, p->function_index_capacity);
+    while (p->function_index[slot])
+      slot = (slot + 1) & mask;
+    p->function_index[slot] = ++p->function_count;
+  }
+}
+
+static void goto__reader_free(goto__reader *r) {
+  free(r->string_defs);
+  free(r->irep_defs);
+  free(r->stack);
+  free(r->unescaped);
+  free(r);
+}
+
+static goto_program *goto__parse(const uint8_t *data, size_t size,
+                                 string_interner *strings,
+                                 shared_interner *shared_strings,
+                                 irep_store *ireps, const char **error,
+                                 size_t *error_pos) {
+  goto_program *p = (goto_program *)calloc(1, sizeof(*p));
+  goto__reader *r = (goto__reader *)calloc(1, sizeof(*r));
+  if (!p || !r) {
+    free(p);
+    free(r);
+    *error = "out of memory";
+    *error_pos = 0;
+    return NULL;
+  }
+  p->strings = strings;
+  p->shared_strings = shared_strings;
+  p->ireps = ireps;
+  p->reader = r;
+  r->data = data;
+  r->size = size;
+  r->program = p;
+
+  uint64_t symbol_count = 0;
+  size_t symbols = 0;
+  if (size < 4 || memcmp(data, "\x7fGBF", 4) != 0) {
+    goto__fail(r, "not a GOTO binary");
+  } else {
+    r->pos = 4;
+    uint64_t version = goto__word(r);
+    if (!r->error && version != GOTO_BINARY_VERSION)
+      goto__fail(r, "unsupported GOTO binary version");
+    symbol_count = goto__word(r);
+    symbols = r->pos;
+    if (symbol_count > size)
+      goto__fail(r, "bad symbol count");
+  }
+  if (!r->error) {
+    goto__skim_symbols(r, symbol_count);
+    goto__skim_functions(r);
+  }
+  if (!r->error) {
+    p->symbols = (goto_symbol *)calloc(symbol_count ? symbol_count : 1,
+                                       sizeof(goto_symbol));
+    if (!p->symbols)
+      goto__fail(r, "out of memory");
+    r->pos = symbols;
+    // Where most strings of a file and the ireps of its symbols are interned
+    STATS_PHASE(STATS_INTERN) goto__symbols(r, symbol_count);
+  }
+
+  if (r->error) {
+    *error = r->error;
+    *error_pos = r->error_pos;
+    goto_program_destroy(p);
+    return NULL;
+  }
+  return p;
+}
+
+goto_program *goto_program_parse(const uint8_t *data, size_t size,
+                                 string_interner *strings, irep_store *ireps) {
+  const char *error = NULL;
+  size_t error_pos = 0;
+  goto_program *p = NULL;
+  STATS_PHASE(STATS_PARSE)
+  p = goto__parse(data, size, strings, NULL, ireps, &error, &error_pos);
+  if (!p)
+    fprintf(stderr, "goto binary: %s at byte %zu\n", error, error_pos);
+  return p;
+}
+
+static goto_program *goto__load(const char *path, string_interner *strings,
+                                shared_interner *shared_strings,
+                                irep_store *ireps) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "goto binary: could not open %s\n", path);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    fprintf(stderr, "goto binary: could not read %s\n", path);
+    close(fd);
+    return NULL;
+  }
+  size_t size = st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "goto binary: could not map %s\n", path);
+    return NULL;
+  }
+  // Skimming is sequential, decoding bodies later jumps around
+  madvise(map, size, MADV_SEQUENTIAL);
+
+  const char *error = NULL;
+  size_t error_pos = 0;
+  goto_program *p = NULL;
+  STATS_PHASE(STATS_PARSE)
+  p = goto__parse((const uint8_t *)map, size, strings, shared_strings, ireps,
+                  &error, &error_pos);
+  if (!p) {
+    fprintf(stderr, "goto binary: %s: %s at byte %zu\n", path, error,
+            error_pos);
+    munmap(map, size);
+    return NULL;
+  }
+  madvise(map, size, MADV_RANDOM);
+  p->map = map;
+  p->map_size = size;
+  return p;
+}
+
+goto_program *goto_program_load(const char *path, string_interner *strings,
+                                irep_store *ireps) {
+  return goto__load(path, strings, NULL, ireps);
+}
+
+goto_program *goto_program_load_shared(const char *path,
+                                       shared_interner *strings,
+                                       irep_store *ireps) {
+  return goto__load(path, NULL, strings, ireps);
+}
+
+const char *goto_program_string(const goto_program *p, uint64_t id,
+                                size_t *length) {
+  if (p->shared_strings)
+    return shared_interner_get(p->shared_strings, id, length);
+  return interner_get(p->strings, id, length);
+}
+
+uint64_t goto_program_intern(goto_program *p, const char *s) {
+  if (p->shared_strings)
+    return shared_interner_intern(p->shared_strings, s);
+  return interner_intern(p->strings, s);
+}
+
+void goto_program_destroy(goto_program *p) {
+  for (size_t i = 0; i < p->function_count; i++)
+    free(p->functions[i].instructions);
+  free(p->functions);
+  free(p->function_index);
+  free(p->symbols);
+  free(p->pool);
+  if (p->reader)
+    goto__reader_free(p->reader);
+  if (p->map)
+    munmap(p->map, p->map_size);
+  free(p);
+}
+
+goto_function *goto_program_function_at(goto_program *p, size_t i) {
+  goto_function *f = &p->functions[i];
+  if (f->loaded)
+    return f;
+  if (f->instructions)
+    return NULL; // failed before
+
+  goto__reader *r = p->reader;
+  r->error = NULL;
+  r->pos = f->offset;
+  r->stack_length = 0;
+  _Bool decoded;
+  STATS_PHASE(STATS_PARSE) decoded = goto__function_body(r, f);
+  if (!decoded) {
+    fprintf(stderr, "goto binary: %s at byte %zu\n", r->error, r->error_pos);
+    return NULL;
+  }
+  f->loaded = 1;
+  p->loaded_function_count++;
+  return f;
+}
+
+size_t goto_program_find_function(const goto_program *p, uint64_t name) {
+  size_t mask = p->function_index_capacity - 1;
+  for (size_t slot = goto__name_slot(name, p->function_index_capacity);
+       p->function_index[slot]; slot = (slot + 1) & mask) {
+    if (p->functions[p->function_index[slot] - 1].name == name)
+      return p->function_index[slot] - 1;
+  }
+  return SIZE_MAX;
+}
+
+goto_function *goto_program_function(goto_program *p, uint64_t name) {
+  size_t i = goto_program_find_function(p, name);
+  return i == SIZE_MAX ? NULL : goto_program_function_at(p, i);
+}
+
+// Just enough of a writer to produce test inputs
+typedef struct {
+  uint8_t data[1024];
+  size_t length;
+} goto__test_buffer;
+
+static void goto__test_word(goto__test_buffer *b, uint64_t u) {
+  while (u >= 0x80) {
+    b->data[b->length++] = (u & 0x7f) | 0x80;
+    u >>= 7;
+  }
+  b->data[b->length++] = u;
+}
+
+static void goto__test_string(goto__test_buffer *b, const char *s) {
+  for (; *s; s++) {
+    if (*s == '\\')
+      b->data[b->length++] = '\\';
+    b->data[b->length++] = *s;
+  }
+  b->data[b->length++] = 0;
+}
+
+static void goto__test_string_ref(goto__test_buffer *b, uint64_t number,
+                                  const char *s) {
+  goto__test_word(b, number);
+  if (s)
+    goto__test_string(b, s);
+}
+
+// Leaf irep with a fresh reference number and string
+static void goto__test_leaf(goto__test_buffer *b, uint64_t number,
+                            uint64_t string_number, const char *s) {
+  goto__test_word(b, number);
+  goto__test_string_ref(b, string_number, s);
+  b->data[b->length++] = 0;
+}
+
+// f: SKIP
+// main: x = 1; l\\oop: goto l\\oop; END_FUNCTION
+static void goto__test_binary(goto__test_buffer *b) {
+  memcpy(b->data, "\x7fGBF", 4);
+  b->length = 4;
+  goto__test_word(b, GOTO_BINARY_VERSION);
+
+  goto__test_word(b, 1); // symbols
+  // type: irep 1 = signedbv { width: irep 2 = "32" }
+  goto__test_word(b, 1);
+  goto__test_string_ref(b, 100, "signedbv");
+  b->data[b->length++] = 'N';
+  goto__test_string_ref(b, 101, "width");
+  goto__test_leaf(b, 2, 102, "32");
+  b->data[b->length++] = 0;
+  goto__test_leaf(b, 3, 103, "nil"); // value
+  goto__test_word(b, 3);             // location, shared with value
+  goto__test_string_ref(b, 104, "c::main::1::x");
+  goto__test_string_ref(b, 105, "main");
+  goto__test_string_ref(b, 106, "x");
+  goto__test_string_ref(b, 107, "C");
+  goto__test_string_ref(b, 106, NULL);
+  goto__test_word(b, 0);
+  goto__test_word(b, GOTO_SYMBOL_IS_LVALUE);
+
+  goto__test_word(b, 2); // functions
+  goto__test_string(b, "f");
+  goto__test_word(b, 1);
+  // SKIP, defines irep 6 and 7 that main refers back to
+  goto__test_word(b, 6);
+  goto__test_string_ref(b, 111, "code");
+  b->data[b->length++] = 'S';
+  goto__test_word(b, 1);
+  b->data[b->length++] = 0;
+  goto__test_word(b, 3);
+  goto__test_word(b, GOTO_SKIP);
+  goto__test_leaf(b, 7, 112, "false");
+  goto__test_word(b, GOTO_NIL_TARGET);
+  goto__test_word(b, 0);
+  goto__test_word(b, 0);
+
+  goto__test_string(b, "main");
+  goto__test_word(b, 3);
+  // ASSIGN, code irep 4 = assign, shares type 1 through sub
+  goto__test_word(b, 4);
+  goto__test_string_ref(b, 108, "assign");
+  b->data[b->length++] = 'S';
+  goto__test_word(b, 1);
+  b->data[b->length++] = 0;
+  goto__test_word(b, 3);
+  goto__test_word(b, GOTO_ASSIGN);
+  goto__test_word(b, 7);
+  goto__test_word(b, GOTO_NIL_TARGET);
+  goto__test_word(b, 0);
+  goto__test_word(b, 0);
+  // GOTO to itself, target number 7
+  goto__test_word(b, 3);
+  goto__test_word(b, 3);
+  goto__test_word(b, GOTO_GOTO);
+  goto__test_leaf(b, 5, 109, "true");
+  goto__test_word(b, 7);
+  goto__test_word(b, 1);
+  goto__test_word(b, 7);
+  goto__test_word(b, 1);
+  goto__test_string_ref(b, 110, "l\\oop");
+  // END_FUNCTION
+  goto__test_word(b, 3);
+  goto__test_word(b, 3);
+  goto__test_word(b, GOTO_END_FUNCTION);
+  goto__test_word(b, 5);
+  goto__test_word(b, GOTO_NIL_TARGET);
+  goto__test_word(b, 0);
+  goto__test_word(b, 0);
+}
+
+uint64_t goto_binary_tests() {
+  uint64_t errors = 0;
+
+  printf("GOTO binary suite...\n");
+
+  goto__test_buffer b = {0};
+  goto__test_binary(&b);
+
+  {
+    printf("- Symbols and shared ireps... ");
+    string_interner *strings = interner_create();
+    irep_store *ireps = irep_store_create();
+    goto_program *p = goto_program_parse(b.data, b.length, strings, ireps);
+
+    _Bool ok = p && p->symbol_count == 1;
+    if (ok) {
+      goto_symbol *x = &p->symbols[0];
+      ok &= x->name == interner_intern(strings, "c::main::1::x");
+      ok &= x->base_name == interner_intern(strings, "x");
+      ok &= x->pretty_name == x->base_name;
+      ok &= x->value == x->location;
+      ok &= x->flags == GOTO_SYMBOL_IS_LVALUE;
+      ok &= irep_id(ireps, x->type) == interner_intern(strings, "signedbv");
+      uint64_t width = irep_find(ireps, x->type, interner_intern(strings, "width"));
+      ok &= width != IREP_NIL &&
+            irep_id(ireps, width) == interner_intern(strings, "32");
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (p)
+      goto_program_destroy(p);
+    irep_store_destroy(ireps);
+    interner_destroy(strings);
+  }
+
+  {
+    printf("- Functions, targets and labels... ");
+    string_interner *strings = interner_create();
+    irep_store *ireps = irep_store_create();
+    goto_program *p = goto_program_parse(b.data, b.length, strings, ireps);
+
+    goto_function *f = p ? goto_program_function(p, interner_intern(strings, "main"))
+                         : NULL;
+    _Bool ok = f && f->count == 3;
+    if (ok) {
+      goto_instruction *assign = &f->instructions[0];
+      goto_instruction *jump = &f->instructions[1];
+      ok &= assign->type == GOTO_ASSIGN && jump->type == GOTO_GOTO;
+      ok &= irep_sub(ireps, assign->code, 0) == p->symbols[0].type;
+      ok &= jump->target_count == 1 && p->pool[jump->targets] == 1;
+      ok &= jump->label_count == 1 &&
+            p->pool[jump->labels] == interner_intern(strings, "l\\oop");
+      ok &= f->instructions[2].type == GOTO_END_FUNCTION;
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (p)
+      goto_program_destroy(p);
+    irep_store_destroy(ireps);
+    interner_destroy(strings);
+  }
+
+  {
+    printf("- Lazy function bodies... ");
+    string_interner *strings = interner_create();
+    irep_store *ireps = irep_store_create();
+    goto_program *p = goto_program_parse(b.data, b.length, strings, ireps);
+
+    _Bool ok = p && p->function_count == 2 && p->loaded_function_count == 0;
+    goto_function *main_ =
+        ok ? goto_program_function(p, interner_intern(strings, "main")) : NULL;
+    ok &= main_ && p->loaded_function_count == 1 && !p->functions[0].loaded;
+    // main refers to ireps first written in the body of f
+    uint64_t false_ = interner_intern(strings, "false");
+    ok &= main_ && irep_id(ireps, main_->instructions[0].guard) == false_;
+    // Decoding f now has to step over definitions that were already decoded
+    goto_function *f =
+        ok ? goto_program_function(p, interner_intern(strings, "f")) : NULL;
+    ok &= f && f->count == 1 && p->loaded_function_count == 2;
+    ok &= f && f->instructions[0].guard == main_->instructions[0].guard;
+    ok &= f && irep_id(ireps, f->instructions[0].code) ==
+                   interner_intern(strings, "code");
+    ok &= f && irep_sub(ireps, f->instructions[0].code, 0) == p->symbols[0].type;
+    ok &= p && goto_program_function(p, interner_intern(strings, "g")) == NULL;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (p)
+      goto_program_destroy(p);
+    irep_store_destroy(ireps);
+    interner_destroy(strings);
+  }
+
+  {
+    printf("- Reference numbers past the input... ");
+    string_interner *strings = interner_create();
+    irep_store *ireps = irep_store_create();
+
+    // The type of the only symbol refers to the number
+    const uint64_t numbers[] = {UINT64_MAX, (uint64_t)1 << 62, 4096};
+    _Bool ok = 1;
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(*numbers); i++) {
+      goto__test_buffer bad = {0};
+      memcpy(bad.data, "\x7fGBF", 4);
+      bad.length = 4;
+      goto__test_word(&bad, GOTO_BINARY_VERSION);
+      goto__test_word(&bad, 1);
+      goto__test_word(&bad, numbers[i]);
+      goto__test_string_ref(&bad, 1, "signedbv");
+      const char *error = NULL;
+      size_t error_pos;
+      goto_program *p = goto__parse(bad.data, bad.length, strings, NULL, ireps,
+                                    &error, &error_pos);
+      ok &= p == NULL && error &&
+            strcmp(error, "reference number out of range") == 0;
+      if (p)
+        goto_program_destroy(p);
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    irep_store_destroy(ireps);
+    interner_destroy(strings);
+  }
+
+  {
+    printf("- Deeply nested ireps... ");
+    string_interner *strings = interner_create();
+    irep_store *ireps = irep_store_create();
+
+    // The type of the only symbol is irep 1 { S irep 2 { S ... } }, one
+    // level deeper than the decoder goes
+    size_t levels = GOTO__MAX_DEPTH + 1;
+    uint8_t *data = (uint8_t *)malloc(16 + 5 * levels);
+    _Bool ok = data != NULL;
+    if (ok) {
+      goto__test_buffer header = {0};
+      memcpy(header.data, "\x7fGBF", 4);
+      header.length = 4;
+      goto__test_word(&header, GOTO_BINARY_VERSION);
+      goto__test_word(&header, 1);
+      memcpy(data, header.data, header.length);
+      size_t length = header.length;
+      for (size_t i = 0; i < levels; i++) {
+        for (uint64_t u = i + 1; u; u >>= 7)
+          data[length++] = (u & 0x7f) | (u >= 0x80 ? 0x80 : 0);
+        data[length++] = 1; // string 1, "x" the first time
+        if (!i)
+          data[length++] = 'x', data[length++] = 0;
+        if (i + 1 < levels)
+          data[length++] = 'S';
+      }
+      memset(data + length, 0, levels);
+      length += levels;
+      const char *error = NULL;
+      size_t error_pos;
+      goto_program *p = goto__parse(data, length, strings, NULL, ireps, &error,
+                                    &error_pos);
+      ok = p == NULL && error && strcmp(error, "irep nested too deeply") == 0;
+      if (p)
+        goto_program_destroy(p);
+    }
+    free(data);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    irep_store_destroy(ireps);
+    interner_destroy(strings);
+  }
+
+  {
+    printf("- Truncated input... ");
+    string_interner *strings = interner_create();
+    irep_store *ireps = irep_store_create();
+
+    _Bool ok = 1;
+    for (size_t length = 0; length < b.length; length++) {
+      const char *error = NULL;
+      size_t error_pos;
+      goto_program *p =
+          goto__parse(b.data, length, strings, NULL, ireps, &error, &error_pos);
+      ok &= p == NULL && error && error_pos <= length;
+      if (p)
+        goto_program_destroy(p);
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    irep_store_destroy(ireps);
+    interner_destroy(strings);
+  }
+
+  return errors;
+}
+
+#endif
+#endif
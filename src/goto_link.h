@@ -0,0 +1,501 @@
+#ifndef GOTO_LINK_H
+#define GOTO_LINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "goto_binary.h"
+#include "irep.h"
+#include "shared_interner.h"
+
+// Loads several GOTO binaries on a pool of worker threads and links them into
+// one program. Workers decode every body of their file into a private
+// irep_store, all of them interning strings through the same
+// shared_interner. The link pass then runs alone, in input order:
+// it imports the nodes into the final store, where hash consing merges
+// whatever the files have in common, and then merges the symbol tables and
+// functions.
+//
+// Linking rules: identical symbols merge, a definition replaces a declaration
+// (nil value) of the same name, weak symbols give way to strong ones, and
+// anything else with the same name is a conflict. Functions defined in more
+// than one file must have identical bodies. File local symbols are not
+// renamed, so they conflict like the rest.
+
+// workers == 0 uses one thread per processor. Returns NULL and prints a
+// diagnostic if a file cannot be loaded or the files do not link.
+goto_program *goto_link_files(const char **paths, size_t count,
+                              shared_interner *strings, irep_store *ireps,
+                              size_t workers);
+
+uint64_t goto_link_tests();
+#ifdef GOTO_LINK_IMPL
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+  const char **paths;
+  size_t count;
+  shared_interner *strings;
+  atomic_size_t next;
+  goto_program **programs;
+  irep_store **stores;
+} goto_link__jobs;
+
+static void *goto_link__worker(void *arg) {
+  goto_link__jobs *jobs = (goto_link__jobs *)arg;
+  for (;;) {
+    size_t i = atomic_fetch_add(&jobs->next, 1);
+    if (i >= jobs->count)
+      return NULL;
+    jobs->stores[i] = irep_store_create();
+    if (!jobs->stores[i])
+      continue;
+    goto_program *p =
+        goto_program_load_shared(jobs->paths[i], jobs->strings, jobs->stores[i]);
+    for (size_t f = 0; p && f < p->function_count; f++) {
+      if (!goto_program_function_at(p, f)) {
+        goto_program_destroy(p);
+        p = NULL;
+      }
+    }
+    jobs->programs[i] = p;
+  }
+}
+
+typedef struct {
+  const irep_store *from;
+  irep_store *to;
+  uint64_t *map; // node in from -> node in to + 1
+  uint64_t *scratch;
+  size_t scratch_length;
+  size_t scratch_capacity;
+} goto_link__importer;
+
+static _Bool goto_link__push(goto_link__importer *im, uint64_t word) {
+  if (im->scratch_length == im->scratch_capacity) {
+    size_t capacity = im->scratch_capacity ? im->scratch_capacity * 2 : 256;
+    uint64_t *grown =
+        (uint64_t *)realloc(im->scratch, sizeof(uint64_t) * capacity);
+    if (!grown)
+      return 0;
+    im->scratch = grown;
+    im->scratch_capacity = capacity;
+  }
+  im->scratch[im->scratch_length++] = word;
+  return 1;
+}
+
+static uint64_t goto_link__import(goto_link__importer *im, uint64_t node) {
+  if (im->map[node])
+    return im->map[node] - 1;
+
+  size_t base = im->scratch_length;
+  size_t sub_count = irep_sub_count(im->from, node);
+  size_t named_count = irep_named_count(im->from, node);
+  for (size_t i = 0; i < sub_count; i++)
+    goto_link__push(im, goto_link__import(im, irep_sub(im->from, node, i)));
+  for (size_t i = 0; i < named_count; i++) {
+    irep_named named = irep_named_at(im->from, node, i);
+    goto_link__push(im, named.name);
+    goto_link__push(im, goto_link__import(im, named.node));
+  }
+  uint64_t imported = IREP_NIL;
+  if (im->scratch_length == base + sub_count + 2 * named_count)
+    imported = irep_make(im->to, irep_id(im->from, node), im->scratch + base,
+                         sub_count,
+                         (const irep_named *)(im->scratch + base + sub_count),
+                         named_count);
+  im->scratch_length = base;
+  im->map[node] = imported + 1;
+  return imported;
+}
+
+typedef struct {
+  goto_program *out;
+  // Name -> index + 1, open addressing over symbols and functions
+  uint32_t *symbol_index;
+  uint32_t *function_index;
+  size_t index_capacity;
+  uint64_t nil;
+} goto_link__linker;
+
+// Both return the slot holding name, or the empty slot where it belongs.
+// The function index uses the same hashing as goto_program_function.
+static uint32_t *goto_link__find_symbol(goto_link__linker *l, uint64_t name) {
+  size_t mask = l->index_capacity - 1;
+  size_t slot = goto__name_slot(name, l->index_capacity);
+  while (l->symbol_index[slot] &&
+         l->out->symbols[l->symbol_index[slot] - 1].name != name)
+    slot = (slot + 1) & mask;
+  return &l->symbol_index[slot];
+}
+
+static uint32_t *goto_link__find_function(goto_link__linker *l, uint64_t name) {
+  size_t mask = l->index_capacity - 1;
+  size_t slot = goto__name_slot(name, l->index_capacity);
+  while (l->function_index[slot] &&
+         l->out->functions[l->function_index[slot] - 1].name != name)
+    slot = (slot + 1) & mask;
+  return &l->function_index[slot];
+}
+
+static _Bool goto_link__is_declaration(const goto_link__linker *l,
+                                       const goto_symbol *sym) {
+  return irep_id(l->out->ireps, sym->value) == l->nil &&
+         !(sym->flags & GOTO_SYMBOL_IS_TYPE);
+}
+
+static _Bool goto_link__symbol(goto_link__linker *l, goto_symbol sym,
+                               const char *path) {
+  goto_program *out = l->out;
+  uint32_t *slot = goto_link__find_symbol(l, sym.name);
+  if (!*slot) {
+    out->symbols[out->symbol_count] = sym;
+    *slot = ++out->symbol_count;
+    return 1;
+  }
+
+  goto_symbol *have = &out->symbols[*slot - 1];
+  // Thanks to hash consing equal symbols are a handful of id compares
+  if (have->type == sym.type && have->value == sym.value &&
+      have->flags == sym.flags)
+    return 1;
+  _Bool have_decl = goto_link__is_declaration(l, have);
+  _Bool sym_decl = goto_link__is_declaration(l, &sym);
+  if (sym_decl && (have_decl || have->type == sym.type))
+    return 1;
+  if (have_decl && !sym_decl) {
+    *have = sym;
+    return 1;
+  }
+  if (sym.flags & GOTO_SYMBOL_IS_WEAK)
+    return 1;
+  if (have->flags & GOTO_SYMBOL_IS_WEAK) {
+    *have = sym;
+    return 1;
+  }
+  fprintf(stderr, "goto link: %s: conflicting definitions of %s\n", path,
+          shared_interner_get(out->shared_strings, sym.name, NULL));
+  return 0;
+}
+
+static _Bool goto_link__same_body(const goto_program *a,
+                                  const goto_function *fa,
+                                  const goto_program *b,
+                                  const goto_function *fb) {
+  if (fa->count != fb->count)
+    return 0;
+  for (size_t i = 0; i < fa->count; i++) {
+    const goto_instruction *x = &fa->instructions[i];
+    const goto_instruction *y = &fb->instructions[i];
+    if (x->code != y->code || x->guard != y->guard || x->type != y->type ||
+        x->target_count != y->target_count)
+      return 0;
+    for (uint32_t t = 0; t < x->target_count; t++)
+      if (a->pool[x->targets + t] != b->pool[y->targets + t])
+        return 0;
+  }
+  return 1;
+}
+
+static _Bool goto_link__pool_push(goto_program *out, uint64_t word) {
+  if (out->pool_length == out->pool_capacity) {
+    size_t capacity = out->pool_capacity ? out->pool_capacity * 2 : 256;
+    uint64_t *grown = (uint64_t *)realloc(out->pool, sizeof(uint64_t) * capacity);
+    if (!grown)
+      return 0;
+    out->pool = grown;
+    out->pool_capacity = capacity;
+  }
+  out->pool[out->pool_length++] = word;
+  return 1;
+}
+
+static _Bool goto_link__function(goto_link__linker *l, goto_link__importer *im,
+                                 const goto_program *in,
+                                 const goto_function *f, const char *path) {
+  goto_program *out = l->out;
+  goto_function imported = {0};
+  imported.name = f->name;
+  imported.count = f->count;
+  imported.loaded = 1;
+  imported.instructions =
+      (goto_instruction *)malloc(sizeof(goto_instruction) * (f->count ? f->count : 1));
+  if (!imported.instructions)
+    return 0;
+  for (size_t i = 0; i < f->count; i++) {
+    goto_instruction ins = f->instructions[i];
+    ins.code = goto_link__import(im, ins.code);
+    ins.source_location = goto_link__import(im, ins.source_location);
+    ins.guard = goto_link__import(im, ins.guard);
+    size_t targets = out->pool_length;
+    for (uint32_t t = 0; t < ins.target_count; t++)
+      goto_link__pool_push(out, in->pool[ins.targets + t]);
+    size_t labels = out->pool_length;
+    for (uint32_t t = 0; t < ins.label_count; t++)
+      goto_link__pool_push(out, in->pool[ins.labels + t]);
+    ins.targets = targets;
+    ins.labels = labels;
+    imported.instructions[i] = ins;
+  }
+
+  uint32_t *slot = goto_link__find_function(l, f->name);
+  if (!*slot) {
+    out->functions[out->function_count] = imported;
+    *slot = ++out->function_count;
+    out->loaded_function_count++;
+    return 1;
+  }
+  _Bool same = goto_link__same_body(out, &out->functions[*slot - 1], out,
+                                    &imported);
+  free(imported.instructions);
+  if (!same)
+    fprintf(stderr, "goto link: %s: conflicting bodies for %s\n", path,
+            shared_interner_get(out->shared_strings, f->name, NULL));
+  return same;
+}
+
+goto_program *goto_link_files(const char **paths, size_t count,
+                              shared_interner *strings, irep_store *ireps,
+                              size_t workers) {
+  if (!workers)
+    workers = sysconf(_SC_NPROCESSORS_ONLN);
+  if (workers > count)
+    workers = count;
+  if (!workers)
+    workers = 1;
+
+  goto_link__jobs jobs = {0};
+  jobs.paths = paths;
+  jobs.count = count;
+  jobs.strings = strings;
+  atomic_init(&jobs.next, 0);
+  jobs.programs = (goto_program **)calloc(count ? count : 1, sizeof(goto_program *));
+  jobs.stores = (irep_store **)calloc(count ? count : 1, sizeof(irep_store *));
+  pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * workers);
+  if (!jobs.programs || !jobs.stores || !threads) {
+    free(jobs.programs);
+    free(jobs.stores);
+    free(threads);
+    return NULL;
+  }
+  // The calling thread is one of the workers
+  size_t started = 1;
+  for (; started < workers; started++)
+    if (pthread_create(&threads[started], NULL, goto_link__worker, &jobs))
+      break;
+  goto_link__worker(&jobs);
+  for (size_t i = 1; i < started; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+
+  _Bool ok = 1;
+  size_t symbol_count = 0, function_count = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (!jobs.programs[i]) {
+      ok = 0;
+      continue;
+    }
+    symbol_count += jobs.programs[i]->symbol_count;
+    function_count += jobs.programs[i]->function_count;
+  }
+
+  goto_link__linker l = {0};
+  l.out = (goto_program *)calloc(1, sizeof(goto_program));
+  l.index_capacity = 16;
+  while (l.index_capacity < 2 * (symbol_count + function_count))
+    l.index_capacity *= 2;
+  if (ok && l.out) {
+    l.out->shared_strings = strings;
+    l.out->ireps = ireps;
+    l.out->symbols = (goto_symbol *)malloc(sizeof(goto_symbol) * (symbol_count + 1));
+    l.out->functions =
+        (goto_function *)malloc(sizeof(goto_function) * (function_count + 1));
+    l.symbol_index = (uint32_t *)calloc(l.index_capacity, sizeof(uint32_t));
+    l.function_index = (uint32_t *)calloc(l.index_capacity, sizeof(uint32_t));
+    l.nil = shared_interner_intern(strings, "nil");
+    ok = l.out->symbols && l.out->functions && l.symbol_index && l.function_index;
+  } else {
+    ok = 0;
+  }
+
+  // Hash consing every file's ireps again, in the shared store
+  STATS_PHASE(STATS_INTERN)
+  for (size_t i = 0; ok && i < count; i++) {
+    goto_program *in = jobs.programs[i];
+    goto_link__importer im = {0};
+    im.from = jobs.stores[i];
+    im.to = ireps;
+    im.map = (uint64_t *)calloc(irep_store_count(im.from) + 1, sizeof(uint64_t));
+    ok = im.map != NULL;
+    for (size_t s = 0; ok && s < in->symbol_count; s++) {
+      goto_symbol sym = in->symbols[s];
+      sym.type = goto_link__import(&im, sym.type);
+      sym.value = goto_link__import(&im, sym.value);
+      sym.location = goto_link__import(&im, sym.location);
+      ok = goto_link__symbol(&l, sym, paths[i]);
+    }
+    for (size_t f = 0; ok && f < in->function_count; f++)
+      ok = goto_link__function(&l, &im, in, &in->functions[f], paths[i]);
+    free(im.map);
+    free(im.scratch);
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (jobs.programs[i])
+      goto_program_destroy(jobs.programs[i]);
+    if (jobs.stores[i])
+      irep_store_destroy(jobs.stores[i]);
+  }
+  free(jobs.programs);
+  free(jobs.stores);
+  free(l.symbol_index);
+
+  if (!ok) {
+    free(l.function_index);
+    if (l.out)
+      goto_program_destroy(l.out);
+    return NULL;
+  }
+  // The function index doubles as the lookup table of the linked program
+  l.out->function_index = l.function_index;
+  l.out->function_index_capacity = l.index_capacity;
+  return l.out;
+}
+
+// Writes a binary with one symbol and one single instruction function
+static _Bool goto_link__test_file(const char *path, const char *symbol,
+                                  const char *value, const char *function,
+                                  uint32_t type) {
+  goto__test_buffer b = {0};
+  memcpy(b.data, "\x7fGBF", 4);
+  b.length = 4;
+  goto__test_word(&b, GOTO_BINARY_VERSION);
+
+  goto__test_word(&b, 1);
+  goto__test_word(&b, 1); // type, signedbv { width: 32 }
+  goto__test_string_ref(&b, 1, "signedbv");
+  b.data[b.length++] = 'N';
+  goto__test_string_ref(&b, 2, "width");
+  goto__test_leaf(&b, 2, 3, "32");
+  b.data[b.length++] = 0;
+  goto__test_leaf(&b, 3, 4, value);
+  goto__test_leaf(&b, 4, 5, "nil"); // location
+  goto__test_string_ref(&b, 6, symbol);
+  goto__test_string_ref(&b, 7, "main");
+  goto__test_string_ref(&b, 6, NULL);
+  goto__test_string_ref(&b, 8, "C");
+  goto__test_string_ref(&b, 6, NULL);
+  goto__test_word(&b, 0);
+  goto__test_word(&b, 0);
+
+  goto__test_word(&b, 1);
+  goto__test_string(&b, function);
+  goto__test_word(&b, 1);
+  goto__test_word(&b, 1); // code shares the type
+  goto__test_word(&b, 4);
+  goto__test_word(&b, type);
+  goto__test_word(&b, 4);
+  goto__test_word(&b, GOTO_NIL_TARGET);
+  goto__test_word(&b, 0);
+  goto__test_word(&b, 0);
+
+  FILE *f = fopen(path, "wb");
+  if (!f)
+    return 0;
+  _Bool ok = fwrite(b.data, 1, b.length, f) == b.length;
+  return fclose(f) == 0 && ok;
+}
+
+uint64_t goto_link_tests() {
+  uint64_t errors = 0;
+
+  printf("GOTO link suite...\n");
+
+  char names[3][sizeof("/tmp/farol-link-XXXXXX")];
+  const char *paths[3];
+  for (size_t i = 0; i < 3; i++) {
+    memcpy(names[i], "/tmp/farol-link-XXXXXX", sizeof(names[i]));
+    int fd = mkstemp(names[i]);
+    if (fd < 0) {
+      printf("- Temporary files... FAIL\n");
+      for (size_t j = 0; j < i; j++)
+        remove(paths[j]);
+      return 1;
+    }
+    close(fd);
+    paths[i] = names[i];
+  }
+  _Bool written = goto_link__test_file(paths[0], "c::x", "nil", "main", GOTO_SKIP) &&
+                  goto_link__test_file(paths[1], "c::x", "42", "f", GOTO_SKIP) &&
+                  goto_link__test_file(paths[2], "c::x", "7", "main", GOTO_SKIP);
+
+  {
+    printf("- Declaration and definition... ");
+    shared_interner *strings = shared_interner_create();
+    irep_store *ireps = irep_store_create();
+    goto_program *p =
+        written ? goto_link_files(paths, 2, strings, ireps, 2) : NULL;
+
+    _Bool ok = p && p->symbol_count == 1 && p->function_count == 2;
+    if (ok) {
+      ok &= irep_id(ireps, p->symbols[0].value) ==
+            shared_interner_intern(strings, "42");
+      goto_function *main_ =
+          goto_program_function(p, shared_interner_intern(strings, "main"));
+      goto_function *f =
+          goto_program_function(p, shared_interner_intern(strings, "f"));
+      // Both files spelled out the same type, now it is one node
+      ok &= main_ && f && main_->instructions[0].code == f->instructions[0].code;
+      ok &= main_ && main_->instructions[0].code == p->symbols[0].type;
+      ok &= strcmp(goto_program_string(p, p->symbols[0].name, NULL), "c::x") == 0;
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (p)
+      goto_program_destroy(p);
+    irep_store_destroy(ireps);
+    shared_interner_destroy(strings);
+  }
+
+  {
+    printf("- Conflicts... ");
+    shared_interner *strings = shared_interner_create();
+    irep_store *ireps = irep_store_create();
+
+    // c::x is defined twice, with different values
+    goto_program *p =
+        written ? goto_link_files(paths + 1, 2, strings, ireps, 0) : NULL;
+
+    if (!written || p) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (p)
+      goto_program_destroy(p);
+    irep_store_destroy(ireps);
+    shared_interner_destroy(strings);
+  }
+
+  for (size_t i = 0; i < 3; i++)
+    remove(paths[i]);
+  return errors;
+}
+
+#endif
+#endif
@@ -0,0 +1,610 @@
+#ifndef GOTO_WRITER_H
+#define GOTO_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "goto_binary.h"
+#include "u64_map.h"
+
+// Writer for GOTO binaries in the format goto_binary.h reads (version 6).
+// Output is streamed through a fixed buffer into a file opened with
+// nob_fd_open_for_write, so the size of the program never matters: the
+// header, then symbols and function bodies are written as they are handed
+// over. Like CBMC, the first occurrence of an irep or a string writes it out
+// under a fresh reference number and every later occurrence writes just the
+// number. Hash consing makes irep node ids a perfect sharing key, so a node is
+// written once however many times it appears.
+//
+// Jump targets are renumbered 1, 2, 3... in instruction order, instructions
+// nothing jumps to get GOTO_NIL_TARGET. Strings and ireps are looked up in the
+// stores of the program given when opening. Uses nob.h for the file.
+
+typedef struct goto_writer goto_writer;
+
+// Opens path for a binary with exactly symbol_count symbols and
+// function_count functions, and writes the header. NULL and a diagnostic if
+// the file can not be created.
+goto_writer *goto_writer_open(const char *path, goto_program *p,
+                              size_t symbol_count, size_t function_count);
+// Ireps of the symbol set to IREP_NIL are written as a nil irep
+_Bool goto_writer_symbol(goto_writer *w, const goto_symbol *s);
+// Targets and labels are ranges of pool, as in goto_program
+_Bool goto_writer_function(goto_writer *w, uint64_t name,
+                           const goto_instruction *instructions, size_t count,
+                           const uint64_t *pool);
+// Flushes, closes and frees the writer. Returns 0 and removes the file if
+// anything failed along the way or fewer symbols or functions were written
+// than announced.
+_Bool goto_writer_close(goto_writer *w);
+
+// Writes the whole program. Bodies that were not decoded yet are decoded one
+// at a time and dropped again once written, so memory stays at one body on
+// top of the sharing tables.
+_Bool goto_program_write(goto_program *p, const char *path);
+
+uint64_t goto_writer_tests();
+// Writes a binary of function_count functions and times loading it and
+// decoding every body
+void goto_writer_bench(bench *b, size_t function_count);
+#ifdef GOTO_WRITER_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#define GOTO_WRITER__BUFFER (64 * 1024)
+
+struct goto_writer {
+  Nob_Fd fd;
+  char *path;
+  goto_program *program;
+  const char *error;
+  size_t symbols_left, functions_left;
+
+  // Node or string id -> reference number
+  u64_map irep_numbers;
+  u64_map string_numbers;
+  uint64_t nil;
+  // Instruction index -> target number, for the body being written
+  uint32_t *target_numbers;
+  size_t target_numbers_capacity;
+
+  size_t length;
+  uint8_t buffer[GOTO_WRITER__BUFFER];
+};
+
+static _Bool goto_writer__fail(goto_writer *w, const char *error) {
+  if (!w->error)
+    w->error = error;
+  return 0;
+}
+
+static void goto_writer__flush(goto_writer *w) {
+  size_t done = 0;
+  while (done < w->length && !w->error) {
+    ssize_t n = write(w->fd, w->buffer + done, w->length - done);
+    if (n < 0)
+      goto_writer__fail(w, "write failed");
+    else
+      done += n;
+  }
+  w->length = 0;
+}
+
+static inline void goto_writer__byte(goto_writer *w, uint8_t byte) {
+  if (w->length == GOTO_WRITER__BUFFER)
+    goto_writer__flush(w);
+  w->buffer[w->length++] = byte;
+}
+
+static void goto_writer__word(goto_writer *w, uint64_t u) {
+  while (u >= 0x80) {
+    goto_writer__byte(w, (u & 0x7f) | 0x80);
+    u >>= 7;
+  }
+  goto_writer__byte(w, u);
+}
+
+// NUL terminated, escaping '\\' and the NULs the string may contain
+static void goto_writer__string(goto_writer *w, const char *s, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (s[i] == '\\' || s[i] == 0)
+      goto_writer__byte(w, '\\');
+    goto_writer__byte(w, s[i]);
+  }
+  goto_writer__byte(w, 0);
+}
+
+// Writes the reference number of key, returning whether this is its first
+// occurrence and the definition has to follow
+static _Bool goto_writer__ref(goto_writer *w, u64_map *numbers, uint64_t key) {
+  uint64_t *number = u64_map_get(numbers, key);
+  if (number) {
+    goto_writer__word(w, *number);
+    return 0;
+  }
+  uint64_t fresh = numbers->length;
+  if (!u64_map_put(numbers, key, fresh))
+    return goto_writer__fail(w, "out of memory");
+  goto_writer__word(w, fresh);
+  return 1;
+}
+
+static void goto_writer__string_ref(goto_writer *w, uint64_t id) {
+  if (!goto_writer__ref(w, &w->string_numbers, id))
+    return;
+  size_t length;
+  const char *s = goto_program_string(w->program, id, &length);
+  goto_writer__string(w, s, length);
+}
+
+static void goto_writer__irep_ref(goto_writer *w, uint64_t node) {
+  irep_store *ireps = w->program->ireps;
+  if (node == IREP_NIL) {
+    // Numbered apart from the nodes, IREP_NIL is the empty key of the map
+    if (w->nil != UINT64_MAX) {
+      goto_writer__word(w, w->nil);
+      return;
+    }
+    w->nil = w->irep_numbers.length;
+    if (!u64_map_put(&w->irep_numbers, UINT64_MAX - 1, w->nil)) {
+      goto_writer__fail(w, "out of memory");
+      return;
+    }
+    goto_writer__word(w, w->nil);
+    goto_writer__string_ref(w, goto_program_intern(w->program, "nil"));
+    goto_writer__byte(w, 0);
+    return;
+  }
+  if (!goto_writer__ref(w, &w->irep_numbers, node))
+    return;
+
+  goto_writer__string_ref(w, irep_id(ireps, node));
+  size_t sub_count = irep_sub_count(ireps, node);
+  for (size_t i = 0; i < sub_count; i++) {
+    goto_writer__byte(w, 'S');
+    goto_writer__irep_ref(w, irep_sub(ireps, node, i));
+  }
+  size_t named_count = irep_named_count(ireps, node);
+  for (size_t i = 0; i < named_count; i++) {
+    irep_named named = irep_named_at(ireps, node, i);
+    goto_writer__byte(w, 'N');
+    goto_writer__string_ref(w, named.name);
+    goto_writer__irep_ref(w, named.node);
+  }
+  goto_writer__byte(w, 0);
+}
+
+goto_writer *goto_writer_open(const char *path, goto_program *p,
+                              size_t symbol_count, size_t function_count) {
+  goto_writer *w = (goto_writer *)malloc(sizeof(*w));
+  if (!w) {
+    fprintf(stderr, "goto writer: out of memory\n");
+    return NULL;
+  }
+  memset(w, 0, offsetof(goto_writer, buffer));
+  w->path = strdup(path);
+  _Bool maps = u64_map_init(&w->irep_numbers, 1024);
+  maps &= u64_map_init(&w->string_numbers, 1024);
+  if (!w->path || !maps) {
+    fprintf(stderr, "goto writer: out of memory\n");
+    free(w->path);
+    u64_map_free(&w->irep_numbers);
+    u64_map_free(&w->string_numbers);
+    free(w);
+    return NULL;
+  }
+  w->fd = nob_fd_open_for_write(path);
+  if (w->fd == NOB_INVALID_FD) {
+    fprintf(stderr, "goto writer: could not create %s\n", path);
+    free(w->path);
+    u64_map_free(&w->irep_numbers);
+    u64_map_free(&w->string_numbers);
+    free(w);
+    return NULL;
+  }
+  w->program = p;
+  w->nil = UINT64_MAX;
+  w->symbols_left = symbol_count;
+  w->functions_left = function_count;
+
+  memcpy(w->buffer, "\x7fGBF", 4);
+  w->length = 4;
+  goto_writer__word(w, GOTO_BINARY_VERSION);
+  goto_writer__word(w, symbol_count);
+  if (!symbol_count)
+    goto_writer__word(w, function_count);
+  return w;
+}
+
+_Bool goto_writer_symbol(goto_writer *w, const goto_symbol *s) {
+  if (!w->symbols_left)
+    return goto_writer__fail(w, "more symbols than announced");
+  w->symbols_left--;
+  goto_writer__irep_ref(w, s->type);
+  goto_writer__irep_ref(w, s->value);
+  goto_writer__irep_ref(w, s->location);
+  goto_writer__string_ref(w, s->name);
+  goto_writer__string_ref(w, s->module);
+  goto_writer__string_ref(w, s->base_name);
+  goto_writer__string_ref(w, s->mode);
+  goto_writer__string_ref(w, s->pretty_name);
+  goto_writer__word(w, 0); // ordering
+  goto_writer__word(w, s->flags);
+  // Function counts come right after the last symbol
+  if (!w->symbols_left)
+    goto_writer__word(w, w->functions_left);
+  return !w->error;
+}
+
+_Bool goto_writer_function(goto_writer *w, uint64_t name,
+                           const goto_instruction *instructions, size_t count,
+                           const uint64_t *pool) {
+  if (w->symbols_left)
+    return goto_writer__fail(w, "function before the last symbol");
+  if (!w->functions_left)
+    return goto_writer__fail(w, "more functions than announced");
+  w->functions_left--;
+
+  if (count > w->target_numbers_capacity) {
+    size_t capacity = w->target_numbers_capacity ? w->target_numbers_capacity : 256;
+    while (capacity < count)
+      capacity *= 2;
+    uint32_t *grown =
+        (uint32_t *)realloc(w->target_numbers, capacity * sizeof(uint32_t));
+    if (!grown)
+      return goto_writer__fail(w, "out of memory");
+    w->target_numbers = grown;
+    w->target_numbers_capacity = capacity;
+  }
+  if (count)
+    memset(w->target_numbers, 0, count * sizeof(uint32_t));
+  for (size_t i = 0; i < count; i++) {
+    const goto_instruction *ins = &instructions[i];
+    for (uint32_t t = 0; t < ins->target_count; t++) {
+      uint64_t target = pool[ins->targets + t];
+      if (target >= count)
+        return goto_writer__fail(w, "jump out of the function");
+      w->target_numbers[target] = 1;
+    }
+  }
+  uint32_t next = 1;
+  for (size_t i = 0; i < count; i++)
+    w->target_numbers[i] = w->target_numbers[i] ? next++ : GOTO_NIL_TARGET;
+
+  size_t length;
+  const char *s = goto_program_string(w->program, name, &length);
+  goto_writer__string(w, s, length);
+  goto_writer__word(w, count);
+  for (size_t i = 0; i < count && !w->error; i++) {
+    const goto_instruction *ins = &instructions[i];
+    goto_writer__irep_ref(w, ins->code);
+    goto_writer__irep_ref(w, ins->source_location);
+    goto_writer__word(w, ins->type);
+    goto_writer__irep_ref(w, ins->guard);
+    goto_writer__word(w, w->target_numbers[i]);
+    goto_writer__word(w, ins->target_count);
+    for (uint32_t t = 0; t < ins->target_count; t++)
+      goto_writer__word(w, w->target_numbers[pool[ins->targets + t]]);
+    goto_writer__word(w, ins->label_count);
+    for (uint32_t l = 0; l < ins->label_count; l++)
+      goto_writer__string_ref(w, pool[ins->labels + l]);
+  }
+  return !w->error;
+}
+
+_Bool goto_writer_close(goto_writer *w) {
+  if (w->symbols_left || w->functions_left)
+    goto_writer__fail(w, "fewer symbols or functions than announced");
+  goto_writer__flush(w);
+  nob_fd_close(w->fd);
+
+  _Bool ok = !w->error;
+  if (!ok) {
+    fprintf(stderr, "goto writer: %s: %s\n", w->path, w->error);
+    remove(w->path);
+  }
+  free(w->path);
+  free(w->target_numbers);
+  u64_map_free(&w->irep_numbers);
+  u64_map_free(&w->string_numbers);
+  free(w);
+  return ok;
+}
+
+_Bool goto_program_write(goto_program *p, const char *path) {
+  goto_writer *w =
+      goto_writer_open(path, p, p->symbol_count, p->function_count);
+  if (!w)
+    return 0;
+  for (size_t i = 0; i < p->symbol_count; i++)
+    goto_writer_symbol(w, &p->symbols[i]);
+
+  for (size_t i = 0; i < p->function_count; i++) {
+    _Bool loaded = p->functions[i].loaded;
+    // Decoding only ever appends to the pool
+    size_t pool_length = p->pool_length;
+    goto_function *f = goto_program_function_at(p, i);
+    if (!f) {
+      goto_writer__fail(w, "could not decode a function body");
+      break;
+    }
+    if (!goto_writer_function(w, f->name, f->instructions, f->count, p->pool))
+      break;
+    if (!loaded) {
+      free(f->instructions);
+      f->instructions = NULL;
+      f->count = 0;
+      f->loaded = 0;
+      p->loaded_function_count--;
+      p->pool_length = pool_length;
+    }
+  }
+  return goto_writer_close(w);
+}
+
+uint64_t goto_writer_tests() {
+  uint64_t errors = 0;
+
+  printf("GOTO writer suite...\n");
+
+  char path[] = "/tmp/farol-writer-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    printf("- Temporary file... FAIL\n");
+    return 1;
+  }
+  close(fd);
+
+  goto__test_buffer b = {0};
+  goto__test_binary(&b);
+
+  {
+    printf("- Round trip... ");
+    string_interner *strings = interner_create();
+    irep_store *ireps = irep_store_create();
+    goto_program *p = goto_program_parse(b.data, b.length, strings, ireps);
+    _Bool ok = p && goto_program_write(p, path);
+    // Nothing was decoded for writing that was not decoded before
+    ok &= p && p->loaded_function_count == 0;
+    size_t nodes = irep_store_count(ireps);
+    // Same stores, so whatever was read before has the same ids
+    goto_program *q = ok ? goto_program_load(path, strings, ireps) : NULL;
+    ok &= q && q->symbol_count == 1 && q->function_count == 2;
+    if (ok) {
+      ok &= !memcmp(&p->symbols[0], &q->symbols[0], sizeof(goto_symbol));
+      for (size_t i = 0; i < 2 && ok; i++) {
+        goto_function *f = goto_program_function_at(p, i);
+        goto_function *g = goto_program_function_at(q, i);
+        ok &= f && g && f->name == g->name && f->count == g->count;
+        for (size_t j = 0; ok && j < f->count; j++) {
+          goto_instruction *a = &f->instructions[j], *c = &g->instructions[j];
+          ok &= a->code == c->code && a->source_location == c->source_location;
+          ok &= a->type == c->type && a->guard == c->guard;
+          ok &= a->target_count == c->target_count &&
+                a->label_count == c->label_count;
+          for (uint32_t t = 0; ok && t < a->target_count; t++)
+            ok &= p->pool[a->targets + t] == q->pool[c->targets + t];
+          for (uint32_t l = 0; ok && l < a->label_count; l++)
+            ok &= p->pool[a->labels + l] == q->pool[c->labels + l];
+        }
+      }
+      ok &= irep_store_count(ireps) == nodes;
+      goto_function *main_ = goto_program_function_at(q, 1);
+      ok &= main_ && main_->instructions[1].target_number == 1;
+      ok &= main_ && main_->instructions[0].target_number == GOTO_NIL_TARGET;
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (q)
+      goto_program_destroy(q);
+    if (p)
+      goto_program_destroy(p);
+    irep_store_destroy(ireps);
+    interner_destroy(strings);
+  }
+
+  {
+    printf("- Strings and ireps written once... ");
+    string_interner *strings = interner_create();
+    irep_store *ireps = irep_store_create();
+    goto_program *p = goto_program_parse(b.data, b.length, strings, ireps);
+    _Bool ok = p && goto_program_write(p, path);
+
+    Nob_String_Builder sb = {0};
+    ok &= ok && nob_read_entire_file(path, &sb);
+    size_t signedbv = 0, oop = 0;
+    for (size_t i = 0; ok && i + 9 <= sb.count; i++) {
+      signedbv += !memcmp(sb.items + i, "signedbv", 9);
+      oop += !memcmp(sb.items + i, "l\\\\oop", 7);
+    }
+    // The type is shared by the symbol and the assignment, the input
+    // already shares it so the output is no larger
+    ok &= signedbv == 1 && oop == 1 && sb.count <= b.length;
+    nob_sb_free(sb);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (p)
+      goto_program_destroy(p);
+    irep_store_destroy(ireps);
+    interner_destroy(strings);
+  }
+
+  {
+    printf("- Streamed functions... ");
+    string_interner *strings = interner_create();
+    irep_store *ireps = irep_store_create();
+    goto_program p = {.strings = strings, .ireps = ireps};
+    uint64_t skip = irep_make(ireps, interner_intern(strings, "skip"), NULL, 0,
+                              NULL, 0);
+    uint64_t labels = interner_intern_n(strings, "a\0b\\", 4);
+    // 0: goto 2, 1: goto 0, 2: end, target numbers in the input are ignored
+    uint64_t pool[] = {2, 0, labels};
+    goto_instruction body[3] = {
+        {skip, IREP_NIL, skip, GOTO_GOTO, 42, 0, 1, 2, 1},
+        {skip, IREP_NIL, skip, GOTO_GOTO, GOTO_NIL_TARGET, 1, 1, 0, 0},
+        {skip, IREP_NIL, skip, GOTO_END_FUNCTION, 7, 0, 0, 0, 0},
+    };
+    goto_symbol symbol = {IREP_NIL, IREP_NIL, IREP_NIL, labels, labels,
+                          labels, labels, labels, GOTO_SYMBOL_IS_STATIC_LIFETIME};
+
+    goto_writer *w = goto_writer_open(path, &p, 1, 2);
+    _Bool ok = w != NULL;
+    ok &= w && goto_writer_symbol(w, &symbol);
+    for (int i = 0; ok && i < 2; i++)
+      ok &= goto_writer_function(
+          w, interner_intern(strings, i ? "g" : "f"), body, 3, pool);
+    ok &= w && goto_writer_close(w);
+
+    goto_program *q = ok ? goto_program_load(path, strings, ireps) : NULL;
+    uint64_t nil = interner_intern(strings, "nil");
+    ok &= q && q->symbol_count == 1 && q->function_count == 2;
+    ok &= q && q->symbols[0].flags == GOTO_SYMBOL_IS_STATIC_LIFETIME &&
+          q->symbols[0].name == labels;
+    ok &= q && irep_id(ireps, q->symbols[0].type) == nil &&
+          q->symbols[0].type == q->symbols[0].value;
+    goto_function *g =
+        q ? goto_program_function(q, interner_intern(strings, "g")) : NULL;
+    ok &= g && g->count == 3;
+    if (ok) {
+      ok &= g->instructions[0].target_number == 1 &&
+            g->instructions[1].target_number == GOTO_NIL_TARGET &&
+            g->instructions[2].target_number == 2;
+      ok &= q->pool[g->instructions[0].targets] == 2 &&
+            q->pool[g->instructions[1].targets] == 0;
+      ok &= g->instructions[0].label_count == 1 &&
+            q->pool[g->instructions[0].labels] == labels;
+      ok &= g->instructions[0].code == skip &&
+            irep_id(ireps, g->instructions[0].source_location) == nil;
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (q)
+      goto_program_destroy(q);
+    irep_store_destroy(ireps);
+    interner_destroy(strings);
+  }
+
+  {
+    printf("- Misuse... ");
+    string_interner *strings = interner_create();
+    irep_store *ireps = irep_store_create();
+    goto_program p = {.strings = strings, .ireps = ireps};
+    uint64_t skip = irep_make(ireps, interner_intern(strings, "skip"), NULL, 0,
+                              NULL, 0);
+    uint64_t name = interner_intern(strings, "f");
+    uint64_t pool[] = {5};
+    goto_instruction out = {skip, skip, skip, GOTO_GOTO, GOTO_NIL_TARGET, 0, 1, 0, 0};
+
+    goto_writer *w = goto_writer_open(path, &p, 0, 2);
+    _Bool ok = w != NULL;
+    // Missing second function
+    ok &= w && goto_writer_function(w, name, &out, 0, pool);
+    ok &= w && !goto_writer_close(w);
+    ok &= access(path, F_OK) != 0;
+
+    w = goto_writer_open(path, &p, 0, 1);
+    ok &= w && !goto_writer_function(w, name, &out, 1, pool);
+    ok &= w && !goto_writer_close(w);
+    ok &= goto_writer_open("/nonexistent/farol.gb", &p, 0, 0) == NULL;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    irep_store_destroy(ireps);
+    interner_destroy(strings);
+  }
+
+  remove(path);
+  return errors;
+}
+
+void goto_writer_bench(bench *b, size_t function_count) {
+  printf("GOTO parsing benchmark (%zu functions)...\n", function_count);
+
+  char path[] = "/tmp/farol-bench-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    fprintf(stderr, "goto writer: could not create a temporary file\n");
+    return;
+  }
+  close(fd);
+
+  // The bodies of the test binary over and over, under names of their own
+  goto__test_buffer t = {0};
+  goto__test_binary(&t);
+  string_interner *strings = interner_create();
+  irep_store *ireps = irep_store_create();
+  goto_program *p = goto_program_parse(t.data, t.length, strings, ireps);
+  goto_writer *w =
+      p ? goto_writer_open(path, p, p->symbol_count, function_count) : NULL;
+  _Bool ok = w != NULL;
+  for (size_t i = 0; ok && i < p->symbol_count; i++)
+    ok = goto_writer_symbol(w, &p->symbols[i]);
+  char name[32];
+  for (size_t i = 0; ok && i < function_count; i++) {
+    goto_function *f = goto_program_function_at(p, i % p->function_count);
+    snprintf(name, sizeof(name), "f%zu", i);
+    ok = f && goto_writer_function(w, interner_intern(strings, name),
+                                   f->instructions, f->count, p->pool);
+  }
+  ok = w && goto_writer_close(w) && ok;
+  if (p)
+    goto_program_destroy(p);
+  irep_store_destroy(ireps);
+  interner_destroy(strings);
+
+  // Fresh stores, so every string and irep is interned again as it would
+  // be for a new file
+  strings = interner_create();
+  ireps = irep_store_create();
+  p = NULL;
+  if (ok && bench_begin(b, "goto/load")) {
+    p = goto_program_load(path, strings, ireps);
+    bench_end(b, function_count);
+  } else if (ok) {
+    p = goto_program_load(path, strings, ireps);
+  }
+  if (p && bench_begin(b, "goto/decode")) {
+    size_t instructions = 0;
+    for (size_t i = 0; i < p->function_count; i++) {
+      goto_function *f = goto_program_function_at(p, i);
+      instructions += f ? f->count : 0;
+    }
+    bench_end(b, instructions);
+  }
+  if (p)
+    goto_program_destroy(p);
+  irep_store_destroy(ireps);
+  interner_destroy(strings);
+  remove(path);
+}
+
+#endif // GOTO_WRITER_IMPL
+#endif // GOTO_WRITER_H
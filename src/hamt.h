@@ -0,0 +1,459 @@
+#ifndef HAMT_H
+#define HAMT_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Persistent map from uint64_t to uint64_t, a hash array mapped trie in the
+// CHAMP layout: every node has a bitmap of inline entries followed by one
+// of children, 32 ways per level. Copying a map is O(1) and updates copy
+// only the path to the changed entry, so maps forked from each other share
+// everything they do not disagree on.
+//
+// Nodes are reference counted (atomically, maps can move between threads)
+// and updated in place when only one map holds them, so a map that is not
+// shared costs about what a mutable one would. Keys are spread by a
+// bijective mix, distinct keys never collide and the trie is at most 13
+// levels deep.
+
+typedef struct hamt_node hamt_node;
+
+// A value, pass it around with hamt_copy and hamt_release
+typedef struct {
+  hamt_node *root;
+  size_t length;
+} hamt;
+
+#define HAMT_EMPTY ((hamt){NULL, 0})
+
+// O(1), both maps can then change independently
+hamt hamt_copy(hamt m);
+void hamt_release(hamt m);
+// NULL when key is not there
+const uint64_t *hamt_get(hamt m, uint64_t key);
+// Inserts or overwrites, 0 on allocation failure (m is unchanged then)
+_Bool hamt_set(hamt *m, uint64_t key, uint64_t value);
+// 0 when key was not there
+_Bool hamt_remove(hamt *m, uint64_t key);
+// Order is by hash, not by key
+void hamt_each(hamt m, void (*fn)(void *ctx, uint64_t key, uint64_t value),
+               void *ctx);
+
+uint64_t hamt_tests();
+#ifdef HAMT_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HAMT__BITS 5
+#define HAMT__MASK ((1u << HAMT__BITS) - 1)
+
+typedef struct {
+  uint64_t key;
+  uint64_t value;
+} hamt__entry;
+
+// Followed by popcount(datamap) entries, then popcount(nodemap) children
+struct hamt_node {
+  atomic_uint refs;
+  uint32_t datamap;
+  uint32_t nodemap;
+  uint32_t unused;
+};
+
+static inline uint64_t hamt__hash(uint64_t key) {
+  // Murmur3's finalizer, every step is invertible
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+static inline uint32_t hamt__bit(uint64_t hash, unsigned shift) {
+  return 1u << ((hash >> shift) & HAMT__MASK);
+}
+
+static inline unsigned hamt__index(uint32_t map, uint32_t bit) {
+  return __builtin_popcount(map & (bit - 1));
+}
+
+static inline hamt__entry *hamt__entries(hamt_node *n) {
+  return (hamt__entry *)(n + 1);
+}
+
+static inline hamt_node **hamt__children(hamt_node *n) {
+  return (hamt_node **)(hamt__entries(n) + __builtin_popcount(n->datamap));
+}
+
+static hamt_node *hamt__alloc(uint32_t datamap, uint32_t nodemap) {
+  hamt_node *n = (hamt_node *)malloc(
+      sizeof(hamt_node) + sizeof(hamt__entry) * __builtin_popcount(datamap) +
+      sizeof(hamt_node *) * __builtin_popcount(nodemap));
+  if (!n)
+    return NULL;
+  atomic_init(&n->refs, 1);
+  n->datamap = datamap;
+  n->nodemap = nodemap;
+  n->unused = 0;
+  return n;
+}
+
+static void hamt__retain(hamt_node *n) {
+  atomic_fetch_add_explicit(&n->refs, 1, memory_order_relaxed);
+}
+
+static void hamt__release(hamt_node *n) {
+  if (!n || atomic_fetch_sub_explicit(&n->refs, 1, memory_order_acq_rel) != 1)
+    return;
+  hamt_node **children = hamt__children(n);
+  for (int i = 0; i < __builtin_popcount(n->nodemap); i++)
+    hamt__release(children[i]);
+  free(n);
+}
+
+static _Bool hamt__unique(hamt_node *n) {
+  return atomic_load_explicit(&n->refs, memory_order_acquire) == 1;
+}
+
+// n with the given bitmaps, keeping the entries and children whose bits
+// stay. The new slots are left for the caller. Takes over the caller's
+// reference to n.
+static hamt_node *hamt__reshape(hamt_node *n, uint32_t datamap,
+                                uint32_t nodemap) {
+  hamt_node *r = hamt__alloc(datamap, nodemap);
+  if (!r)
+    return NULL;
+  _Bool unique = hamt__unique(n);
+  hamt__entry *from = hamt__entries(n), *to = hamt__entries(r);
+  for (uint32_t map = n->datamap & datamap; map; map &= map - 1) {
+    uint32_t bit = map & -map;
+    to[hamt__index(datamap, bit)] = from[hamt__index(n->datamap, bit)];
+  }
+  hamt_node **old = hamt__children(n), **children = hamt__children(r);
+  for (uint32_t map = n->nodemap & nodemap; map; map &= map - 1) {
+    uint32_t bit = map & -map;
+    hamt_node *child = old[hamt__index(n->nodemap, bit)];
+    if (!unique)
+      hamt__retain(child);
+    children[hamt__index(nodemap, bit)] = child;
+  }
+  // Children of a unique n were moved, and those whose bit went away are
+  // the caller's now
+  if (unique)
+    free(n);
+  else
+    hamt__release(n);
+  return r;
+}
+
+// A node only the caller holds, n itself when it already is
+static hamt_node *hamt__own(hamt_node *n) {
+  return hamt__unique(n) ? n : hamt__reshape(n, n->datamap, n->nodemap);
+}
+
+static hamt_node *hamt__pair(hamt__entry a, uint64_t a_hash, hamt__entry b,
+                             uint64_t b_hash, unsigned shift) {
+  uint32_t a_bit = hamt__bit(a_hash, shift), b_bit = hamt__bit(b_hash, shift);
+  if (a_bit == b_bit) {
+    hamt_node *child = hamt__pair(a, a_hash, b, b_hash, shift + HAMT__BITS);
+    hamt_node *n = child ? hamt__alloc(0, a_bit) : NULL;
+    if (!n) {
+      hamt__release(child);
+      return NULL;
+    }
+    hamt__children(n)[0] = child;
+    return n;
+  }
+  hamt_node *n = hamt__alloc(a_bit | b_bit, 0);
+  if (n) {
+    hamt__entries(n)[a_bit > b_bit] = a;
+    hamt__entries(n)[b_bit > a_bit] = b;
+  }
+  return n;
+}
+
+// The set and remove steps take over the caller's reference to n and
+// return what replaces it. On allocation failure they set *failed and
+// return a node with the same contents.
+
+static hamt_node *hamt__set(hamt_node *n, uint64_t hash, unsigned shift,
+                            hamt__entry entry, _Bool *added, _Bool *failed) {
+  uint32_t bit = hamt__bit(hash, shift);
+  hamt_node *r;
+  if (n->datamap & bit) {
+    hamt__entry *existing = &hamt__entries(n)[hamt__index(n->datamap, bit)];
+    if (existing->key == entry.key) {
+      if (existing->value == entry.value)
+        return n;
+      if (!(r = hamt__own(n)))
+        goto fail;
+      hamt__entries(r)[hamt__index(r->datamap, bit)].value = entry.value;
+      return r;
+    }
+    // Both go one level down
+    hamt_node *child = hamt__pair(*existing, hamt__hash(existing->key), entry,
+                                  hash, shift + HAMT__BITS);
+    if (!child)
+      goto fail;
+    if (!(r = hamt__reshape(n, n->datamap & ~bit, n->nodemap | bit))) {
+      hamt__release(child);
+      goto fail;
+    }
+    hamt__children(r)[hamt__index(r->nodemap, bit)] = child;
+    *added = 1;
+    return r;
+  }
+  if (n->nodemap & bit) {
+    // Owning n first, a child is only changed in place when every node
+    // above it is
+    if (!(r = hamt__own(n)))
+      goto fail;
+    hamt_node **slot = &hamt__children(r)[hamt__index(r->nodemap, bit)];
+    *slot = hamt__set(*slot, hash, shift + HAMT__BITS, entry, added, failed);
+    return r;
+  }
+  if (!(r = hamt__reshape(n, n->datamap | bit, n->nodemap)))
+    goto fail;
+  hamt__entries(r)[hamt__index(r->datamap, bit)] = entry;
+  *added = 1;
+  return r;
+fail:
+  *failed = 1;
+  return n;
+}
+
+// key must be in n. NULL when n ends up empty.
+static hamt_node *hamt__remove(hamt_node *n, uint64_t hash, unsigned shift,
+                               uint64_t key, _Bool *failed) {
+  uint32_t bit = hamt__bit(hash, shift);
+  hamt_node *r;
+  if (n->datamap & bit) {
+    if (n->datamap == bit && !n->nodemap) {
+      hamt__release(n);
+      return NULL;
+    }
+    if (!(r = hamt__reshape(n, n->datamap & ~bit, n->nodemap))) {
+      *failed = 1;
+      return n;
+    }
+    return r;
+  }
+
+  if (!(r = hamt__own(n))) {
+    *failed = 1;
+    return n;
+  }
+  hamt_node **slot = &hamt__children(r)[hamt__index(r->nodemap, bit)];
+  hamt_node *smaller = hamt__remove(*slot, hash, shift + HAMT__BITS, key, failed);
+  *slot = smaller;
+  // Children always hold two entries or more: one left is folded into r,
+  // so equal maps have the same shape. Failing that the shape is only
+  // less compact.
+  if (!*failed && smaller && !smaller->nodemap &&
+      __builtin_popcount(smaller->datamap) == 1) {
+    hamt__entry last = hamt__entries(smaller)[0];
+    hamt_node *folded = hamt__reshape(r, r->datamap | bit, r->nodemap & ~bit);
+    if (folded) {
+      hamt__entries(folded)[hamt__index(folded->datamap, bit)] = last;
+      hamt__release(smaller);
+      r = folded;
+    }
+  }
+  return r;
+}
+
+hamt hamt_copy(hamt m) {
+  if (m.root)
+    hamt__retain(m.root);
+  return m;
+}
+
+void hamt_release(hamt m) { hamt__release(m.root); }
+
+const uint64_t *hamt_get(hamt m, uint64_t key) {
+  uint64_t hash = hamt__hash(key);
+  hamt_node *n = m.root;
+  for (unsigned shift = 0; n; shift += HAMT__BITS) {
+    uint32_t bit = hamt__bit(hash, shift);
+    if (n->datamap & bit) {
+      hamt__entry *e = &hamt__entries(n)[hamt__index(n->datamap, bit)];
+      return e->key == key ? &e->value : NULL;
+    }
+    if (!(n->nodemap & bit))
+      return NULL;
+    n = hamt__children(n)[hamt__index(n->nodemap, bit)];
+  }
+  return NULL;
+}
+
+_Bool hamt_set(hamt *m, uint64_t key, uint64_t value) {
+  hamt__entry entry = {key, value};
+  uint64_t hash = hamt__hash(key);
+  if (!m->root) {
+    hamt_node *n = hamt__alloc(hamt__bit(hash, 0), 0);
+    if (!n)
+      return 0;
+    hamt__entries(n)[0] = entry;
+    m->root = n;
+    m->length = 1;
+    return 1;
+  }
+  _Bool added = 0, failed = 0;
+  m->root = hamt__set(m->root, hash, 0, entry, &added, &failed);
+  m->length += added;
+  return !failed;
+}
+
+_Bool hamt_remove(hamt *m, uint64_t key) {
+  if (!hamt_get(*m, key))
+    return 0;
+  _Bool failed = 0;
+  m->root = hamt__remove(m->root, hamt__hash(key), 0, key, &failed);
+  m->length -= !failed;
+  return !failed;
+}
+
+static void hamt__each(hamt_node *n,
+                       void (*fn)(void *ctx, uint64_t key, uint64_t value),
+                       void *ctx) {
+  hamt__entry *entries = hamt__entries(n);
+  for (int i = 0; i < __builtin_popcount(n->datamap); i++)
+    fn(ctx, entries[i].key, entries[i].value);
+  hamt_node **children = hamt__children(n);
+  for (int i = 0; i < __builtin_popcount(n->nodemap); i++)
+    hamt__each(children[i], fn, ctx);
+}
+
+void hamt_each(hamt m, void (*fn)(void *ctx, uint64_t key, uint64_t value),
+               void *ctx) {
+  if (m.root)
+    hamt__each(m.root, fn, ctx);
+}
+
+typedef struct {
+  uint64_t sum;
+  size_t count;
+} hamt__t_total;
+
+static void hamt__t_add(void *ctx, uint64_t key, uint64_t value) {
+  hamt__t_total *total = (hamt__t_total *)ctx;
+  total->sum += key ^ value;
+  total->count++;
+}
+
+// Nodes of n that are not where they were in the trie it was forked from
+static size_t hamt__t_unshared(hamt_node *n, hamt_node *from) {
+  if (n == from)
+    return 0;
+  size_t count = 1;
+  for (uint32_t map = n->nodemap; map; map &= map - 1) {
+    uint32_t bit = map & -map;
+    hamt_node *other =
+        from && (from->nodemap & bit)
+            ? hamt__children(from)[hamt__index(from->nodemap, bit)]
+            : NULL;
+    count += hamt__t_unshared(hamt__children(n)[hamt__index(n->nodemap, bit)],
+                              other);
+  }
+  return count;
+}
+
+uint64_t hamt_tests() {
+  uint64_t errors = 0;
+
+  printf("HAMT suite...\n");
+
+  {
+    printf("- Set, get and remove... ");
+    hamt m = HAMT_EMPTY;
+    _Bool ok = 1;
+    for (uint64_t i = 0; ok && i < 5000; i++)
+      ok &= hamt_set(&m, i * 3, i);
+    for (uint64_t i = 0; ok && i < 5000; i++) {
+      const uint64_t *v = hamt_get(m, i * 3);
+      ok &= v && *v == i;
+    }
+    ok &= m.length == 5000 && hamt_get(m, 1) == NULL;
+    ok &= hamt_set(&m, 3, 42) && *hamt_get(m, 3) == 42 && m.length == 5000;
+
+    for (uint64_t i = 0; ok && i < 5000; i += 2)
+      ok &= hamt_remove(&m, i * 3);
+    ok &= !hamt_remove(&m, 0) && !hamt_remove(&m, 1);
+    ok &= m.length == 2500;
+    for (uint64_t i = 0; ok && i < 5000; i++)
+      ok &= (hamt_get(m, i * 3) != NULL) == (i % 2 == 1);
+
+    hamt__t_total total = {0};
+    hamt_each(m, hamt__t_add, &total);
+    uint64_t expected = 0;
+    for (uint64_t i = 1; i < 5000; i += 2)
+      expected += (i * 3) ^ (i == 1 ? 42 : i);
+    ok &= total.count == 2500 && total.sum == expected;
+
+    for (uint64_t i = 1; ok && i < 5000; i += 2)
+      ok &= hamt_remove(&m, i * 3);
+    ok &= m.length == 0 && m.root == NULL;
+    hamt_release(m);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Forks share what they agree on... ");
+    hamt base = HAMT_EMPTY;
+    _Bool ok = 1;
+    for (uint64_t i = 0; ok && i < 10000; i++)
+      ok &= hamt_set(&base, i, i);
+
+    enum { FORKS = 64 };
+    hamt forks[FORKS];
+    for (int f = 0; f < FORKS; f++) {
+      forks[f] = hamt_copy(base);
+      ok &= hamt_set(&forks[f], f, 1000000 + f);
+      ok &= hamt_set(&forks[f], 20000 + f, f);
+      if (f % 2)
+        ok &= hamt_remove(&forks[f], 5000 + f);
+    }
+    for (int f = 0; ok && f < FORKS; f++) {
+      ok &= *hamt_get(forks[f], f) == 1000000 + (uint64_t)f;
+      ok &= *hamt_get(forks[f], 20000 + f) == (uint64_t)f;
+      ok &= hamt_get(forks[f], 20000 + f + 1) == NULL;
+      ok &= (hamt_get(forks[f], 5000 + f) == NULL) == (f % 2);
+      ok &= forks[f].length == (size_t)(10001 - f % 2);
+      // Only the paths to the changed keys were copied
+      ok &= hamt__t_unshared(forks[f].root, base.root) <= 3 * 4;
+    }
+    for (uint64_t i = 0; ok && i < 10000; i++)
+      ok &= *hamt_get(base, i) == i;
+    ok &= base.length == 10000 && hamt_get(base, 20000) == NULL;
+
+    // Dropping the original keeps the forks whole
+    hamt_release(base);
+    for (int f = 0; ok && f < FORKS; f++)
+      ok &= *hamt_get(forks[f], 9999) == 9999 &&
+            *hamt_get(forks[f], f) == 1000000 + (uint64_t)f;
+    for (int f = 0; f < FORKS; f++)
+      hamt_release(forks[f]);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  return errors;
+}
+
+#endif
+#endif
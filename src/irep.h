@@ -0,0 +1,248 @@
+#ifndef IREP_H
+#define IREP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "string_interner.h"
+
+// Nodes of the CProver irep tree. A node is an id plus ordered sub nodes and
+// named sub nodes. Ids and names are string ids from the interner the caller
+// uses, the store itself never sees the strings.
+//
+// Nodes are hash consed: a node is encoded as a string of words
+//   id, sub_count, named_count, subs..., (name, node)...
+// with named subs sorted by name, and that string is interned. Node ids are
+// therefore dense, in creation order, and structurally equal nodes have the
+// same id.
+
+#define IREP_NIL UINT64_MAX
+
+typedef struct {
+  uint64_t name;
+  uint64_t node;
+} irep_named;
+
+typedef struct {
+  string_interner *nodes;
+  // Encoding of the node being made
+  uint64_t *scratch;
+  size_t scratch_capacity;
+} irep_store;
+
+irep_store *irep_store_create(void);
+void irep_store_destroy(irep_store *s);
+size_t irep_store_count(const irep_store *s);
+// IREP_NIL when it runs out of memory
+uint64_t irep_make(irep_store *s, uint64_t id, const uint64_t *subs,
+                   size_t sub_count, const irep_named *named,
+                   size_t named_count);
+
+uint64_t irep_id(const irep_store *s, uint64_t node);
+size_t irep_sub_count(const irep_store *s, uint64_t node);
+uint64_t irep_sub(const irep_store *s, uint64_t node, size_t i);
+size_t irep_named_count(const irep_store *s, uint64_t node);
+irep_named irep_named_at(const irep_store *s, uint64_t node, size_t i);
+// IREP_NIL when node has no named sub called name
+uint64_t irep_find(const irep_store *s, uint64_t node, uint64_t name);
+
+uint64_t irep_tests();
+#ifdef IREP_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IREP__ID 0
+#define IREP__SUB_COUNT 1
+#define IREP__NAMED_COUNT 2
+#define IREP__OPERANDS 3
+
+irep_store *irep_store_create(void) {
+  irep_store *s = (irep_store *)malloc(sizeof(*s));
+  if (!s)
+    return NULL;
+  s->nodes = interner_create(.arena_chunk_size = INTERNER_DEFAULT_CHUNK_SIZE);
+  s->scratch_capacity = 64;
+  s->scratch = (uint64_t *)malloc(sizeof(uint64_t) * s->scratch_capacity);
+  if (!s->nodes || !s->scratch) {
+    if (s->nodes)
+      interner_destroy(s->nodes);
+    free(s->scratch);
+    free(s);
+    return NULL;
+  }
+  return s;
+}
+
+void irep_store_destroy(irep_store *s) {
+  interner_destroy(s->nodes);
+  free(s->scratch);
+  free(s);
+}
+
+size_t irep_store_count(const irep_store *s) { return interner_count(s->nodes); }
+
+uint64_t irep_make(irep_store *s, uint64_t id, const uint64_t *subs,
+                   size_t sub_count, const irep_named *named,
+                   size_t named_count) {
+  size_t length = IREP__OPERANDS + sub_count + 2 * named_count;
+  if (length > s->scratch_capacity) {
+    size_t capacity = s->scratch_capacity;
+    while (length > capacity)
+      capacity *= 2;
+    uint64_t *scratch =
+        (uint64_t *)realloc(s->scratch, sizeof(uint64_t) * capacity);
+    if (!scratch) {
+      fprintf(stderr, "irep: out of memory\n");
+      return IREP_NIL;
+    }
+    s->scratch = scratch;
+    s->scratch_capacity = capacity;
+  }
+
+  uint64_t *w = s->scratch;
+  w[IREP__ID] = id;
+  w[IREP__SUB_COUNT] = sub_count;
+  w[IREP__NAMED_COUNT] = named_count;
+  w += IREP__OPERANDS;
+  for (size_t i = 0; i < sub_count; i++)
+    *w++ = subs[i];
+  // Insertion sort by name, nodes rarely have more than a handful
+  for (size_t i = 0; i < named_count; i++) {
+    size_t j = i;
+    while (j > 0 && w[2 * (j - 1)] > named[i].name) {
+      w[2 * j] = w[2 * (j - 1)];
+      w[2 * j + 1] = w[2 * (j - 1) + 1];
+      j--;
+    }
+    w[2 * j] = named[i].name;
+    w[2 * j + 1] = named[i].node;
+  }
+
+  return interner_intern_n(s->nodes, (const char *)s->scratch,
+                           sizeof(uint64_t) * length);
+}
+
+// Encodings are not aligned in the arena, read words with memcpy
+static inline uint64_t irep__word(const irep_store *s, uint64_t node,
+                                  size_t i) {
+  uint64_t word;
+  memcpy(&word, interner_get(s->nodes, node, NULL) + sizeof(uint64_t) * i,
+         sizeof(word));
+  return word;
+}
+
+uint64_t irep_id(const irep_store *s, uint64_t node) {
+  return irep__word(s, node, IREP__ID);
+}
+
+size_t irep_sub_count(const irep_store *s, uint64_t node) {
+  return irep__word(s, node, IREP__SUB_COUNT);
+}
+
+uint64_t irep_sub(const irep_store *s, uint64_t node, size_t i) {
+  return irep__word(s, node, IREP__OPERANDS + i);
+}
+
+size_t irep_named_count(const irep_store *s, uint64_t node) {
+  return irep__word(s, node, IREP__NAMED_COUNT);
+}
+
+irep_named irep_named_at(const irep_store *s, uint64_t node, size_t i) {
+  size_t base = IREP__OPERANDS + irep_sub_count(s, node) + 2 * i;
+  return (irep_named){irep__word(s, node, base), irep__word(s, node, base + 1)};
+}
+
+uint64_t irep_find(const irep_store *s, uint64_t node, uint64_t name) {
+  size_t count = irep_named_count(s, node);
+  for (size_t i = 0; i < count; i++) {
+    irep_named named = irep_named_at(s, node, i);
+    if (named.name == name)
+      return named.node;
+    if (named.name > name)
+      break;
+  }
+  return IREP_NIL;
+}
+
+uint64_t irep_tests() {
+  uint64_t errors = 0;
+
+  printf("Irep suite...\n");
+
+  {
+    printf("- Building nodes... ");
+    irep_store *test = irep_store_create();
+
+    // ids stand in for interned strings here
+    enum { SIGNEDBV = 1, WIDTH, N32, SYMBOL, TYPE, IDENTIFIER, X };
+    uint64_t n32 = irep_make(test, N32, NULL, 0, NULL, 0);
+    irep_named width = {WIDTH, n32};
+    uint64_t type = irep_make(test, SIGNEDBV, NULL, 0, &width, 1);
+    uint64_t x = irep_make(test, X, NULL, 0, NULL, 0);
+    irep_named sym_named[] = {{TYPE, type}, {IDENTIFIER, x}};
+    uint64_t sym = irep_make(test, SYMBOL, NULL, 0, sym_named, 2);
+    uint64_t subs[] = {sym, sym};
+    uint64_t plus = irep_make(test, 42, subs, 2, NULL, 0);
+
+    _Bool ok = irep_id(test, plus) == 42 && irep_sub_count(test, plus) == 2;
+    ok &= irep_sub(test, plus, 1) == sym;
+    ok &= irep_named_count(test, sym) == 2;
+    ok &= irep_find(test, sym, IDENTIFIER) == x;
+    ok &= irep_find(test, irep_find(test, sym, TYPE), WIDTH) == n32;
+    ok &= irep_find(test, sym, WIDTH) == IREP_NIL;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    irep_store_destroy(test);
+  }
+
+  {
+    printf("- Structural sharing... ");
+    irep_store *test = irep_store_create();
+
+    enum { CONSTANT = 1, VALUE, TYPE, UNSIGNEDBV, WIDTH, N8, N1, PLUS };
+    uint64_t n8 = irep_make(test, N8, NULL, 0, NULL, 0);
+    irep_named width = {WIDTH, n8};
+    uint64_t t1 = irep_make(test, UNSIGNEDBV, NULL, 0, &width, 1);
+    uint64_t t2 = irep_make(test, UNSIGNEDBV, NULL, 0, &width, 1);
+    uint64_t one = irep_make(test, N1, NULL, 0, NULL, 0);
+    // Named subs in either order make the same node
+    irep_named c1_named[] = {{TYPE, t1}, {VALUE, one}};
+    irep_named c2_named[] = {{VALUE, one}, {TYPE, t2}};
+    uint64_t c1 = irep_make(test, CONSTANT, NULL, 0, c1_named, 2);
+    uint64_t c2 = irep_make(test, CONSTANT, NULL, 0, c2_named, 2);
+    uint64_t subs[] = {c1, c2};
+    uint64_t sum = irep_make(test, PLUS, subs, 2, NULL, 0);
+    // c1 and c2 are the same node, so swapping them changes nothing
+    uint64_t swapped_subs[] = {c2, c1};
+    uint64_t sum2 = irep_make(test, PLUS, swapped_subs, 2, NULL, 0);
+    uint64_t count = irep_store_count(test);
+    uint64_t shorter = irep_make(test, PLUS, subs, 1, NULL, 0);
+
+    _Bool ok = t1 == t2 && c1 == c2 && sum == sum2;
+    ok &= count == 5 && shorter != sum;
+    ok &= irep_find(test, c1, VALUE) == one && irep_find(test, c1, TYPE) == t1;
+    ok &= irep_named_at(test, c2, 0).name == VALUE;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    irep_store_destroy(test);
+  }
+
+  return errors;
+}
+
+#endif
+#endif
@@ -1,13 +1,320 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#define BENCH_IMPL
+#include "bench.h"
+#define STATS_IMPL
+#include "stats.h"
 #define STRING_INTERNER_IMPL
 #include "string_interner.h"
+#define SHARED_INTERNER_IMPL
+#include "shared_interner.h"
+#define IREP_IMPL
+#include "irep.h"
+#define GOTO_BINARY_IMPL
+#include "goto_binary.h"
+#define GOTO_LINK_IMPL
+#include "goto_link.h"
+// For the files of goto_writer.h
+#define NOB_IMPLEMENTATION
+#include "../nob.h"
+#define U64_MAP_IMPL
+#include "u64_map.h"
+#define GOTO_WRITER_IMPL
+#include "goto_writer.h"
+#define BYTECODE_IMPL
+#include "bytecode.h"
+#define HAMT_IMPL
+#include "hamt.h"
+#define MEMORY_IMPL
+#include "memory.h"
+#define SYMEX_STATE_IMPL
+#include "symex_state.h"
+#ifdef FAROL_Z3
+#define SIMPLIFIER_IMPL
+#include "simplifier.h"
+#define SLICER_IMPL
+#include "slicer.h"
+#define ABSINT_IMPL
+#include "absint.h"
+#define SSA_EQUATION_IMPL
+#include "ssa_equation.h"
+#define WITNESS_IMPL
+#include "witness.h"
+#define SMT_IMPL
+#include "smt.h"
+#define SMT_PORTFOLIO_IMPL
+#include "smt_portfolio.h"
+#define SMT_CACHE_IMPL
+#include "smt_cache.h"
+#define BMC_IMPL
+#include "bmc.h"
+#endif
+
+static FILE *stats_out;
+
+static void write_stats(void) {
+  fflush(stdout);
+  if (!stats_write_json(stats_out))
+    fprintf(stderr, "farol: could not write the stats\n");
+  if (stats_out != stderr)
+    fclose(stats_out);
+}
+
+#ifdef FAROL_Z3
+// --verify FILE [--entry NAME] [--max-k K] [--no-induction] checks every
+// assertion reachable from the entry function, __CPROVER__start or else
+// main. Exits as cbmc does, 0 when safe and 10 when an assertion fails, and
+// with 1 when neither was shown.
+//
+// A counterexample is written to --witness OUT, as JSON or with
+// --witness-format graphml as an SV-COMP witness of the source file given
+// with --program-file SRC. --replay runs it in the interpreter.
+#define FAROL_PORTFOLIO_WORDS 16
+
+// Splits command at spaces, in place, into the words of a backend
+static _Bool portfolio_command(char *command, const char **words) {
+  size_t count = 0;
+  for (char *word = strtok(command, " "); word; word = strtok(NULL, " ")) {
+    if (count == FAROL_PORTFOLIO_WORDS - 1)
+      return 0;
+    words[count++] = word;
+  }
+  words[count] = NULL;
+  return count > 0;
+}
+
+static int verify(int argc, char **argv) {
+  const char *path = NULL, *entry_name = NULL, *witness_path = NULL;
+  bmc_options options = {0};
+  char hash[65];
+  static const char *words[SMT_PORTFOLIO_BACKENDS][FAROL_PORTFOLIO_WORDS];
+  static const char *const *backends[SMT_PORTFOLIO_BACKENDS + 1];
+  size_t backend_count = 0;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "--witness") && i + 1 < argc) {
+      witness_path = argv[++i];
+    } else if (!strcmp(argv[i], "--witness-format") && i + 1 < argc &&
+               (!strcmp(argv[i + 1], "json") ||
+                !strcmp(argv[i + 1], "graphml"))) {
+      options.witness_format =
+          !strcmp(argv[++i], "json") ? WITNESS_JSON : WITNESS_GRAPHML;
+    } else if (!strcmp(argv[i], "--program-file") && i + 1 < argc) {
+      options.witness_program.file = argv[++i];
+      if (!witness_hash_file(options.witness_program.file, hash))
+        return 1;
+      options.witness_program.hash = hash;
+    } else if (!strcmp(argv[i], "--replay")) {
+      options.replay = 1;
+    } else if (!strcmp(argv[i], "--entry") && i + 1 < argc) {
+      entry_name = argv[++i];
+    } else if (!strcmp(argv[i], "--max-k") && i + 1 < argc) {
+      options.max_k = (uint32_t)strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--no-induction")) {
+      options.no_induction = 1;
+    } else if (!strcmp(argv[i], "--solver-timeout") && i + 1 < argc) {
+      options.solver_timeout_ms = strtoull(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--portfolio") && i + 1 < argc) {
+      if (backend_count == SMT_PORTFOLIO_BACKENDS ||
+          !portfolio_command(argv[++i], words[backend_count])) {
+        fprintf(stderr, "farol: can not race %s\n", argv[i]);
+        return 1;
+      }
+      backends[backend_count] = words[backend_count];
+      options.portfolio = backends;
+      backend_count++;
+    } else if (!path && argv[i][0] != '-') {
+      path = argv[i];
+    } else {
+      fprintf(stderr, "farol: unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (!path) {
+    fprintf(stderr, "farol: usage: %s --verify FILE [--entry NAME] "
+                    "[--max-k K] [--no-induction] [--witness OUT] "
+                    "[--witness-format json|graphml] [--program-file SRC] "
+                    "[--replay] [--solver-timeout MS] "
+                    "[--portfolio \"CMD ARGS\"]...\n",
+            argv[0]);
+    return 1;
+  }
+  if (witness_path) {
+    options.witness = fopen(witness_path, "w");
+    if (!options.witness) {
+      fprintf(stderr, "farol: could not create %s\n", witness_path);
+      return 1;
+    }
+  }
+
+  string_interner *strings = interner_create(.arena_chunk_size =
+                                                 INTERNER_DEFAULT_CHUNK_SIZE);
+  irep_store *ireps = irep_store_create();
+  goto_program *program = goto_program_load(path, strings, ireps);
+  int status = 1;
+  if (!program)
+    goto done;
+  size_t entry = SIZE_MAX;
+  if (entry_name) {
+    entry = goto_program_find_function(
+        program, goto_program_intern(program, entry_name));
+  } else {
+    entry = goto_program_find_function(
+        program, goto_program_intern(program, "__CPROVER__start"));
+    if (entry == SIZE_MAX)
+      entry = goto_program_find_function(program,
+                                         goto_program_intern(program, "main"));
+  }
+  if (entry == SIZE_MAX) {
+    fprintf(stderr, "farol: %s has no function %s\n", path,
+            entry_name ? entry_name : "__CPROVER__start or main");
+    goto done;
+  }
+
+  bmc_result r = bmc_verify_program(program, entry, &options);
+  switch (r.verdict) {
+  case BMC_SAFE:
+    printf("%s: SAFE, %s round %u\n", path,
+           r.by_induction ? "by induction in" : "explored in", r.k);
+    status = 0;
+    break;
+  case BMC_UNSAFE: {
+    size_t length;
+    const char *function =
+        goto_program_string(program, program->functions[r.function].name,
+                            &length);
+    printf("%s: UNSAFE, the assertion at %.*s:%zu fails in round %u\n", path,
+           (int)length, function, r.pc, r.k);
+    if (options.replay)
+      printf("the counterexample %s\n",
+             r.replayed ? "replays" : "does not replay");
+    status = 10;
+    break;
+  }
+  case BMC_UNKNOWN:
+    printf("%s: UNKNOWN after round %u\n", path, r.k);
+    break;
+  }
+  printf("%lu paths, %lu queries, %lu answered by the caches\n",
+         (unsigned long)r.paths, (unsigned long)r.queries,
+         (unsigned long)r.hits);
+  if (options.portfolio)
+    printf("%lu handed to the portfolio\n", (unsigned long)r.escalated);
+
+done:
+  if (options.witness && fclose(options.witness)) {
+    fprintf(stderr, "farol: could not write %s\n", witness_path);
+    status = 1;
+  }
+  if (program)
+    goto_program_destroy(program);
+  irep_store_destroy(ireps);
+  interner_destroy(strings);
+  // Joins the threads Z3 times solvers out with, before exit frees what
+  // they use
+  Z3_finalize_memory();
+  return status;
+}
+#endif
 
 int main(int argc, char **argv) {
+  // --stats anywhere writes the timers and counters as JSON to stderr at
+  // exit, --stats=FILE to FILE. Loading a file times parse and intern, the
+  // other phases run in --verify, which farol only has when built with Z3.
+  int kept = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--stats")) {
+      stats_out = stderr;
+    } else if (!strncmp(argv[i], "--stats=", 8)) {
+      stats_out = fopen(argv[i] + 8, "w");
+      if (!stats_out) {
+        fprintf(stderr, "farol: could not open %s\n", argv[i] + 8);
+        return 1;
+      }
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  argc = kept;
+  argv[argc] = NULL;
+  if (stats_out)
+    atexit(write_stats);
+
+  // --bench [--save FILE] [--baseline FILE] [CASE] runs the benchmarks of
+  // what farol is built from, which are also the training run of ./nob pgo.
+  // Exits with the number of cases more than 10% slower than the baseline.
+  if (argc >= 2 && !strcmp(argv[1], "--bench")) {
+    const char *save = NULL, *baseline = NULL;
+    bench b = {0};
+    for (int i = 2; i < argc; i++) {
+      if (!strcmp(argv[i], "--save") && i + 1 < argc)
+        save = argv[++i];
+      else if (!strcmp(argv[i], "--baseline") && i + 1 < argc)
+        baseline = argv[++i];
+      else
+        b.filter = argv[i];
+    }
+    string_interner_bench(&b, 1000000);
+    goto_writer_bench(&b, 100000);
+    bytecode_bench(&b, 100000);
+    symex_state_bench(&b, 100000);
+    memory_bench(&b, 100000);
+    size_t slower = 0;
+    if (baseline)
+      slower = bench_compare(&b, baseline, 0.1);
+    if (save && !bench_save(&b, save))
+      slower = SIZE_MAX;
+    bench_free(&b);
+    return slower > 125 ? 125 : (int)slower;
+  }
+
+  if (argc >= 2 && !strcmp(argv[1], "--verify")) {
+#ifdef FAROL_Z3
+    return verify(argc, argv);
+#else
+    fprintf(stderr, "farol: --verify needs a build with Z3, see README.md\n");
+    return 1;
+#endif
+  }
+
   printf("Hello Farol!\n");
 
-  printf("Running tests\n");
-  string_interner_tests();
-  
+  if (argc < 2) {
+    printf("Running tests\n");
+    string_interner_tests();
+    return 0;
+  }
+
+  if (argc > 2) {
+    shared_interner *strings = shared_interner_create();
+    irep_store *ireps = irep_store_create();
+    goto_program *program =
+        goto_link_files((const char **)argv + 1, argc - 1, strings, ireps, 0);
+    if (!program)
+      return 1;
+    printf("linked %d files: %zu symbols, %zu functions, %zu ireps\n", argc - 1,
+           program->symbol_count, program->function_count,
+           irep_store_count(ireps));
+
+    goto_program_destroy(program);
+    irep_store_destroy(ireps);
+    shared_interner_destroy(strings);
+    return 0;
+  }
+
+  string_interner *strings = interner_create(.arena_chunk_size =
+                                                 INTERNER_DEFAULT_CHUNK_SIZE);
+  irep_store *ireps = irep_store_create();
+  goto_program *program = goto_program_load(argv[1], strings, ireps);
+  if (!program)
+    return 1;
+  printf("%s: %zu symbols, %zu functions, %zu strings, %zu ireps\n", argv[1],
+         program->symbol_count, program->function_count,
+         interner_count(strings), irep_store_count(ireps));
+
+  goto_program_destroy(program);
+  irep_store_destroy(ireps);
+  interner_destroy(strings);
   return 0;
 }
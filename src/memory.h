@@ -0,0 +1,591 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+
+// Byte precise memory of one path: objects (a variable, an array, a heap
+// block) by id, each a byte array split into fixed size pages.
+//
+// A memory is a value like a hamt, copying it is O(1) and the copies share
+// everything. The object table, every object and every page are reference
+// counted and copied on the first write through a memory that shares them,
+// the table and an object's page pointers once per fork, a page only when
+// a byte of it is written. A fork of a path holding a megabyte buffer that
+// writes a byte of it copies 2048 pointers and one page, not the megabyte.
+// Pages never written are not there and read as zeros.
+//
+// Every page has a bitmap of its symbolic bytes, whose values are byte
+// wide irep expressions kept next to the concrete bytes, allocated the
+// first time the page gets a symbolic byte. Reads of bytes that are all
+// concrete are a copy, the caller only builds an expression when
+// memory_read says some byte is symbolic.
+
+#define MEMORY_PAGE_SIZE 512
+
+typedef struct memory__table memory__table;
+
+// A value, pass it around with memory_copy and memory_release
+typedef struct {
+  memory__table *table;
+} memory;
+
+#define MEMORY_EMPTY ((memory){NULL})
+
+// O(1), both can then change independently
+memory memory_copy(memory m);
+void memory_release(memory m);
+
+// A zeroed, concrete object of size bytes. Ids start at 1 and are never
+// reused along a path, 0 on allocation failure.
+uint64_t memory_allocate(memory *m, uint64_t size);
+// 0 when object was never allocated or is deallocated already
+_Bool memory_deallocate(memory *m, uint64_t object);
+// 0 for objects not live
+uint64_t memory_object_size(memory m, uint64_t object);
+
+// Bytes [offset, offset + n) of object, the concrete ones in bytes and, if
+// exprs is not NULL, the symbolic ones in exprs with IREP_NIL for the
+// concrete ones (whose bytes are 0 then). Returns the number of symbolic
+// bytes, SIZE_MAX when the range is not inside a live object.
+size_t memory_read(memory m, uint64_t object, uint64_t offset, size_t n,
+                   uint8_t *bytes, uint64_t *exprs);
+// 1 if the bytes are all concrete, and read into bytes
+_Bool memory_read_concrete(memory m, uint64_t object, uint64_t offset,
+                           size_t n, uint8_t *bytes);
+// Both return 0 when the range is not inside a live object or memory ran
+// out, what m reads is unchanged then. Bytes written concrete stop being
+// symbolic.
+_Bool memory_write(memory *m, uint64_t object, uint64_t offset, size_t n,
+                   const uint8_t *bytes);
+_Bool memory_write_symbolic(memory *m, uint64_t object, uint64_t offset,
+                            size_t n, const uint64_t *exprs);
+
+uint64_t memory_tests();
+// Forks of a path with a large buffer, each writing a few bytes
+void memory_bench(bench *b, size_t forks);
+#ifdef MEMORY_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "irep.h"
+
+#define MEMORY__WORDS (MEMORY_PAGE_SIZE / 64)
+
+typedef struct {
+  atomic_uint refs;
+  uint32_t symbolic_count; // bits set in symbolic
+  uint64_t symbolic[MEMORY__WORDS];
+  uint64_t *exprs; // MEMORY_PAGE_SIZE of them once a byte was symbolic
+  uint8_t bytes[MEMORY_PAGE_SIZE];
+} memory__page;
+
+typedef struct {
+  atomic_uint refs;
+  uint64_t size;
+  size_t page_count;
+  memory__page *pages[]; // NULL for pages never written
+} memory__object;
+
+struct memory__table {
+  atomic_uint refs;
+  size_t count, capacity;
+  memory__object **objects; // id - 1, NULL once deallocated
+};
+
+static void memory__page_release(memory__page *p) {
+  if (!p || atomic_fetch_sub_explicit(&p->refs, 1, memory_order_acq_rel) != 1)
+    return;
+  free(p->exprs);
+  free(p);
+}
+
+static void memory__object_release(memory__object *o) {
+  if (!o || atomic_fetch_sub_explicit(&o->refs, 1, memory_order_acq_rel) != 1)
+    return;
+  for (size_t i = 0; i < o->page_count; i++)
+    memory__page_release(o->pages[i]);
+  free(o);
+}
+
+static void memory__retain(atomic_uint *refs) {
+  atomic_fetch_add_explicit(refs, 1, memory_order_relaxed);
+}
+
+static _Bool memory__unique(atomic_uint *refs) {
+  return atomic_load_explicit(refs, memory_order_acquire) == 1;
+}
+
+memory memory_copy(memory m) {
+  if (m.table)
+    memory__retain(&m.table->refs);
+  return m;
+}
+
+void memory_release(memory m) {
+  memory__table *t = m.table;
+  if (!t || atomic_fetch_sub_explicit(&t->refs, 1, memory_order_acq_rel) != 1)
+    return;
+  for (size_t i = 0; i < t->count; i++)
+    memory__object_release(t->objects[i]);
+  free(t->objects);
+  free(t);
+}
+
+static memory__object *memory__object_of(memory m, uint64_t object) {
+  if (!m.table || object == 0 || object > m.table->count)
+    return NULL;
+  return m.table->objects[object - 1];
+}
+
+// A table only m holds, with room for one more object
+static memory__table *memory__own_table(memory *m, _Bool grow) {
+  memory__table *t = m->table;
+  if (t && memory__unique(&t->refs)) {
+    if (grow && t->count == t->capacity) {
+      size_t capacity = t->capacity ? 2 * t->capacity : 8;
+      memory__object **objects = (memory__object **)realloc(
+          t->objects, sizeof(memory__object *) * capacity);
+      if (!objects)
+        return NULL;
+      t->objects = objects;
+      t->capacity = capacity;
+    }
+    return t;
+  }
+  memory__table *c = (memory__table *)calloc(1, sizeof(*c));
+  size_t count = t ? t->count : 0;
+  size_t capacity = count + grow > 8 ? count + grow : 8;
+  memory__object **objects =
+      c ? (memory__object **)malloc(sizeof(memory__object *) * capacity) : NULL;
+  if (!objects) {
+    free(c);
+    return NULL;
+  }
+  atomic_init(&c->refs, 1);
+  c->count = count;
+  c->capacity = capacity;
+  c->objects = objects;
+  for (size_t i = 0; i < count; i++) {
+    c->objects[i] = t->objects[i];
+    if (c->objects[i])
+      memory__retain(&c->objects[i]->refs);
+  }
+  memory_release(*m);
+  m->table = c;
+  return c;
+}
+
+// The object at slot i of an unshared table, unshared too
+static memory__object *memory__own_object(memory__table *t, size_t i) {
+  memory__object *o = t->objects[i];
+  if (memory__unique(&o->refs))
+    return o;
+  size_t bytes = sizeof(memory__object) + sizeof(memory__page *) * o->page_count;
+  memory__object *c = (memory__object *)malloc(bytes);
+  if (!c)
+    return NULL;
+  // Not refs, other threads may be changing it
+  atomic_init(&c->refs, 1);
+  c->size = o->size;
+  c->page_count = o->page_count;
+  memcpy(c->pages, o->pages, sizeof(memory__page *) * o->page_count);
+  for (size_t p = 0; p < c->page_count; p++)
+    if (c->pages[p])
+      memory__retain(&c->pages[p]->refs);
+  memory__object_release(o);
+  t->objects[i] = c;
+  return c;
+}
+
+// Page p of an unshared object, unshared and there
+static memory__page *memory__own_page(memory__object *o, size_t p) {
+  memory__page *page = o->pages[p];
+  if (page && memory__unique(&page->refs))
+    return page;
+  memory__page *c = (memory__page *)malloc(sizeof(memory__page));
+  if (!c)
+    return NULL;
+  if (page) {
+    c->symbolic_count = page->symbolic_count;
+    memcpy(c->symbolic, page->symbolic, sizeof(c->symbolic));
+    memcpy(c->bytes, page->bytes, sizeof(c->bytes));
+    c->exprs = NULL;
+    if (page->exprs) {
+      c->exprs = (uint64_t *)malloc(sizeof(uint64_t) * MEMORY_PAGE_SIZE);
+      if (!c->exprs) {
+        free(c);
+        return NULL;
+      }
+      memcpy(c->exprs, page->exprs, sizeof(uint64_t) * MEMORY_PAGE_SIZE);
+    }
+  } else {
+    memset(c, 0, sizeof(*c));
+  }
+  atomic_init(&c->refs, 1);
+  memory__page_release(page);
+  o->pages[p] = c;
+  return c;
+}
+
+uint64_t memory_allocate(memory *m, uint64_t size) {
+  if (size > SIZE_MAX - MEMORY_PAGE_SIZE)
+    return 0;
+  size_t page_count = (size + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE;
+  if (page_count > (SIZE_MAX - sizeof(memory__object)) / sizeof(memory__page *))
+    return 0;
+  memory__object *o = (memory__object *)calloc(
+      1, sizeof(memory__object) + sizeof(memory__page *) * page_count);
+  if (!o)
+    return 0;
+  memory__table *t = memory__own_table(m, 1);
+  if (!t) {
+    free(o);
+    return 0;
+  }
+  atomic_init(&o->refs, 1);
+  o->size = size;
+  o->page_count = page_count;
+  t->objects[t->count++] = o;
+  return t->count;
+}
+
+_Bool memory_deallocate(memory *m, uint64_t object) {
+  if (!memory__object_of(*m, object))
+    return 0;
+  memory__table *t = memory__own_table(m, 0);
+  if (!t)
+    return 0;
+  memory__object_release(t->objects[object - 1]);
+  t->objects[object - 1] = NULL;
+  return 1;
+}
+
+uint64_t memory_object_size(memory m, uint64_t object) {
+  memory__object *o = memory__object_of(m, object);
+  return o ? o->size : 0;
+}
+
+static _Bool memory__in_bounds(const memory__object *o, uint64_t offset,
+                               size_t n) {
+  return o && offset <= o->size && n <= o->size - offset;
+}
+
+// Sets or clears the symbolic bits of [from, from + n) of a page
+static void memory__mark(memory__page *page, size_t from, size_t n,
+                         _Bool symbolic) {
+  for (size_t i = from; i < from + n;) {
+    size_t word = i / 64, bit = i % 64;
+    size_t span = 64 - bit < from + n - i ? 64 - bit : from + n - i;
+    uint64_t mask = (span == 64 ? ~0ull : ((1ull << span) - 1)) << bit;
+    uint64_t before = page->symbolic[word];
+    page->symbolic[word] = symbolic ? before | mask : before & ~mask;
+    page->symbolic_count += __builtin_popcountll(page->symbolic[word]) -
+                            __builtin_popcountll(before);
+    i += span;
+  }
+}
+
+size_t memory_read(memory m, uint64_t object, uint64_t offset, size_t n,
+                   uint8_t *bytes, uint64_t *exprs) {
+  memory__object *o = memory__object_of(m, object);
+  if (!memory__in_bounds(o, offset, n))
+    return SIZE_MAX;
+  size_t symbolic = 0;
+  for (size_t done = 0; done < n;) {
+    uint64_t at = offset + done;
+    size_t p = at / MEMORY_PAGE_SIZE, from = at % MEMORY_PAGE_SIZE;
+    size_t span = MEMORY_PAGE_SIZE - from < n - done ? MEMORY_PAGE_SIZE - from
+                                                     : n - done;
+    const memory__page *page = o->pages[p];
+    if (!page || !page->symbolic_count) {
+      // Concrete, nothing to look at but the bytes
+      if (page)
+        memcpy(bytes + done, page->bytes + from, span);
+      else
+        memset(bytes + done, 0, span);
+      for (size_t i = 0; exprs && i < span; i++)
+        exprs[done + i] = IREP_NIL;
+    } else {
+      for (size_t i = 0; i < span; i++) {
+        size_t j = from + i;
+        _Bool is = (page->symbolic[j / 64] >> (j % 64)) & 1;
+        symbolic += is;
+        bytes[done + i] = is ? 0 : page->bytes[j];
+        if (exprs)
+          exprs[done + i] = is ? page->exprs[j] : IREP_NIL;
+      }
+    }
+    done += span;
+  }
+  return symbolic;
+}
+
+_Bool memory_read_concrete(memory m, uint64_t object, uint64_t offset,
+                           size_t n, uint8_t *bytes) {
+  return memory_read(m, object, offset, n, bytes, NULL) == 0;
+}
+
+// Unshares the pages of the range, so writing them can not fail halfway
+static memory__object *memory__own_range(memory *m, uint64_t object,
+                                         uint64_t offset, size_t n,
+                                         _Bool symbolic) {
+  if (!memory__in_bounds(memory__object_of(*m, object), offset, n))
+    return NULL;
+  memory__table *t = memory__own_table(m, 0);
+  memory__object *o = t ? memory__own_object(t, object - 1) : NULL;
+  if (!o || !n)
+    return o;
+  size_t last = (offset + n - 1) / MEMORY_PAGE_SIZE;
+  for (size_t p = offset / MEMORY_PAGE_SIZE; p <= last; p++) {
+    memory__page *page = memory__own_page(o, p);
+    if (!page)
+      return NULL;
+    if (symbolic && !page->exprs) {
+      page->exprs = (uint64_t *)malloc(sizeof(uint64_t) * MEMORY_PAGE_SIZE);
+      if (!page->exprs)
+        return NULL;
+    }
+  }
+  return o;
+}
+
+_Bool memory_write(memory *m, uint64_t object, uint64_t offset, size_t n,
+                   const uint8_t *bytes) {
+  memory__object *o = memory__own_range(m, object, offset, n, 0);
+  if (!o)
+    return 0;
+  for (size_t done = 0; done < n;) {
+    uint64_t at = offset + done;
+    size_t from = at % MEMORY_PAGE_SIZE;
+    size_t span = MEMORY_PAGE_SIZE - from < n - done ? MEMORY_PAGE_SIZE - from
+                                                     : n - done;
+    memory__page *page = o->pages[at / MEMORY_PAGE_SIZE];
+    memcpy(page->bytes + from, bytes + done, span);
+    if (page->symbolic_count)
+      memory__mark(page, from, span, 0);
+    done += span;
+  }
+  return 1;
+}
+
+_Bool memory_write_symbolic(memory *m, uint64_t object, uint64_t offset,
+                            size_t n, const uint64_t *exprs) {
+  memory__object *o = memory__own_range(m, object, offset, n, 1);
+  if (!o)
+    return 0;
+  for (size_t done = 0; done < n;) {
+    uint64_t at = offset + done;
+    size_t from = at % MEMORY_PAGE_SIZE;
+    size_t span = MEMORY_PAGE_SIZE - from < n - done ? MEMORY_PAGE_SIZE - from
+                                                     : n - done;
+    memory__page *page = o->pages[at / MEMORY_PAGE_SIZE];
+    memcpy(page->exprs + from, exprs + done, sizeof(uint64_t) * span);
+    // What the bytes held concrete is of no use any more
+    memset(page->bytes + from, 0, span);
+    memory__mark(page, from, span, 1);
+    done += span;
+  }
+  return 1;
+}
+
+uint64_t memory_tests() {
+  uint64_t errors = 0;
+
+  printf("Memory suite...\n");
+
+  {
+    printf("- Concrete bytes across pages... ");
+    memory m = MEMORY_EMPTY;
+    uint64_t a = memory_allocate(&m, 3 * MEMORY_PAGE_SIZE + 10);
+    uint64_t b = memory_allocate(&m, 4);
+    uint8_t in[MEMORY_PAGE_SIZE + 20], out[MEMORY_PAGE_SIZE + 20];
+    for (size_t i = 0; i < sizeof(in); i++)
+      in[i] = (uint8_t)(i * 7 + 1);
+    _Bool ok = a == 1 && b == 2 && memory_object_size(m, a) == 3 * MEMORY_PAGE_SIZE + 10;
+    // Never written, zeros
+    ok &= memory_read_concrete(m, a, 100, 8, out) && !out[0] && !out[7];
+    ok &= memory_write(&m, a, MEMORY_PAGE_SIZE - 10, sizeof(in), in);
+    ok &= memory_read(m, a, MEMORY_PAGE_SIZE - 10, sizeof(out), out, NULL) == 0 &&
+          !memcmp(in, out, sizeof(in));
+    ok &= memory_write(&m, a, 3 * MEMORY_PAGE_SIZE + 6, 4, in);
+    // Past the end, or of objects that are not there
+    ok &= !memory_write(&m, a, 3 * MEMORY_PAGE_SIZE + 7, 4, in);
+    ok &= memory_read(m, a, 3 * MEMORY_PAGE_SIZE + 11, 0, out, NULL) ==
+          SIZE_MAX;
+    ok &= memory_read(m, 3, 0, 1, out, NULL) == SIZE_MAX &&
+          !memory_write(&m, 0, 0, 1, in);
+    ok &= memory_deallocate(&m, b) && !memory_deallocate(&m, b) &&
+          memory_object_size(m, b) == 0 && !memory_write(&m, b, 0, 1, in);
+    ok &= memory_allocate(&m, 1) == 3;
+    memory_release(m);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Forks copy the pages they write... ");
+    memory m = MEMORY_EMPTY;
+    uint64_t a = memory_allocate(&m, 8 * MEMORY_PAGE_SIZE);
+    uint8_t one = 1, two = 2, out = 0;
+    _Bool ok = a && memory_write(&m, a, 0, 1, &one) &&
+               memory_write(&m, a, 5 * MEMORY_PAGE_SIZE, 1, &one);
+    memory f = memory_copy(m);
+    ok &= f.table == m.table;
+    ok &= memory_write(&f, a, 5 * MEMORY_PAGE_SIZE, 1, &two);
+    memory__object *mo = m.table->objects[0], *fo = f.table->objects[0];
+    ok &= f.table != m.table && fo != mo;
+    // The page written is the fork's own, the other is still shared
+    ok &= fo->pages[5] != mo->pages[5] && fo->pages[0] == mo->pages[0];
+    ok &= !fo->pages[1] && atomic_load(&mo->pages[0]->refs) == 2;
+    ok &= memory_read_concrete(m, a, 5 * MEMORY_PAGE_SIZE, 1, &out) && out == 1;
+    ok &= memory_read_concrete(f, a, 5 * MEMORY_PAGE_SIZE, 1, &out) && out == 2;
+    // Objects allocated after the fork are the fork's alone
+    uint64_t c = memory_allocate(&f, 1);
+    ok &= c == 2 && memory_object_size(m, c) == 0;
+    memory_release(m);
+    ok &= memory_read_concrete(f, a, 0, 1, &out) && out == 1;
+    memory_release(f);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Symbolic bytes... ");
+    memory m = MEMORY_EMPTY;
+    uint64_t a = memory_allocate(&m, 2 * MEMORY_PAGE_SIZE);
+    uint8_t in[8] = {1, 2, 3, 4, 5, 6, 7, 8}, out[8];
+    uint64_t exprs[8], symbols[3] = {100, 101, 102};
+    _Bool ok = a && memory_write(&m, a, MEMORY_PAGE_SIZE - 4, 8, in);
+    // Two bytes at the end of a page and one at the start of the next
+    ok &= memory_write_symbolic(&m, a, MEMORY_PAGE_SIZE - 2, 3, symbols);
+    ok &= memory_read(m, a, MEMORY_PAGE_SIZE - 4, 8, out, exprs) == 3;
+    ok &= out[0] == 1 && out[1] == 2 && out[2] == 0 && out[5] == 6;
+    ok &= exprs[0] == IREP_NIL && exprs[2] == 100 && exprs[3] == 101 &&
+          exprs[4] == 102 && exprs[5] == IREP_NIL;
+    ok &= !memory_read_concrete(m, a, MEMORY_PAGE_SIZE - 1, 2, out);
+    uint8_t page[MEMORY_PAGE_SIZE];
+    ok &= memory_read_concrete(m, a, 0, MEMORY_PAGE_SIZE - 2, page);
+    // A fork sees them too and overwriting one with a constant makes it
+    // concrete again on the fork only
+    memory f = memory_copy(m);
+    ok &= memory_write(&f, a, MEMORY_PAGE_SIZE - 1, 1, in);
+    ok &= memory_read(f, a, MEMORY_PAGE_SIZE - 4, 8, out, exprs) == 2 &&
+          out[3] == 1 && exprs[3] == IREP_NIL && exprs[2] == 100;
+    ok &= memory_read(m, a, MEMORY_PAGE_SIZE - 4, 8, out, exprs) == 3;
+    ok &= memory_write(&f, a, MEMORY_PAGE_SIZE - 2, 3, in);
+    ok &= memory_read_concrete(f, a, 0, 8, out) &&
+          f.table->objects[0]->pages[0]->symbolic_count == 0 &&
+          f.table->objects[0]->pages[1]->symbolic_count == 0;
+    memory_release(f);
+    memory_release(m);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Many forks of a large buffer... ");
+    // A 1 MiB packet buffer, a thousand paths each writing a byte of it
+    enum { SIZE = 1 << 20, FORKS = 1000 };
+    memory m = MEMORY_EMPTY;
+    uint64_t a = memory_allocate(&m, SIZE);
+    uint8_t *filled = (uint8_t *)malloc(SIZE);
+    _Bool ok = a && filled;
+    if (ok) {
+      memset(filled, 0xAB, SIZE);
+      ok = memory_write(&m, a, 0, SIZE, filled);
+    }
+    memory forks[FORKS];
+    size_t made = 0;
+    for (; ok && made < FORKS; made++) {
+      forks[made] = memory_copy(m);
+      uint8_t byte = (uint8_t)made;
+      ok = memory_write(&forks[made], a, (made * 4099) % SIZE, 1, &byte);
+    }
+    size_t own = 0;
+    for (size_t i = 0; ok && i < made; i++) {
+      memory__object *o = forks[i].table->objects[0];
+      memory__object *base = m.table->objects[0];
+      for (size_t p = 0; p < o->page_count; p++)
+        own += o->pages[p] != base->pages[p];
+      uint8_t byte = 0;
+      ok &= memory_read_concrete(forks[i], a, (i * 4099) % SIZE, 1, &byte) &&
+            byte == (uint8_t)i;
+    }
+    // One page per fork, nothing else copied
+    ok &= own == FORKS;
+    for (size_t i = 0; i < made; i++)
+      memory_release(forks[i]);
+    memory_release(m);
+    free(filled);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  return errors;
+}
+
+void memory_bench(bench *b, size_t forks) {
+  printf("Memory benchmark (%zu forks)...\n", forks);
+
+  enum { SIZE = 64 * 1024 };
+  memory m = MEMORY_EMPTY;
+  uint64_t a = memory_allocate(&m, SIZE);
+  uint8_t *filled = (uint8_t *)calloc(1, SIZE);
+  _Bool ok = a && filled && memory_write(&m, a, 0, SIZE, filled);
+
+  if (ok && bench_begin(b, "memory/fork")) {
+    for (size_t i = 0; ok && i < forks; i++) {
+      memory f = memory_copy(m);
+      uint32_t word = (uint32_t)i;
+      ok = memory_write(&f, a, (i * 4099) % (SIZE - 4), 4, (uint8_t *)&word);
+      memory_release(f);
+    }
+    bench_end(b, forks);
+  }
+
+  if (ok && bench_begin(b, "memory/read")) {
+    uint64_t sum = 0;
+    uint8_t bytes[8];
+    for (size_t i = 0; ok && i < 16 * forks; i++) {
+      ok = memory_read_concrete(m, a, (i * 4099) % (SIZE - 8), 8, bytes);
+      sum += bytes[0];
+    }
+    bench_end(b, 16 * forks);
+    if (sum == 1)
+      printf("\n");
+  }
+  if (!ok)
+    fprintf(stderr, "memory: out of memory\n");
+
+  memory_release(m);
+  free(filled);
+}
+
+#endif
+#endif
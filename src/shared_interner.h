@@ -0,0 +1,269 @@
+#ifndef SHARED_INTERNER_H
+#define SHARED_INTERNER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "string_interner.h"
+
+// Thread safe string interner. Strings are spread over shards by hash, each
+// shard is a string_interner in arena mode behind its own lock. An id is
+// (local id << SHARED_INTERNER_SHARD_BITS) | shard, so ids are stable and
+// unique but not dense.
+//
+// Looking up the string of an existing id never locks: every shard publishes
+// its entries in segments that never move once allocated.
+
+#define SHARED_INTERNER_SHARD_BITS 6
+#define SHARED_INTERNER_SHARDS (1 << SHARED_INTERNER_SHARD_BITS)
+// Segment k holds SHARED_INTERNER_SEGMENT_BASE << k entries
+#define SHARED_INTERNER_SEGMENT_BITS 8
+#define SHARED_INTERNER_SEGMENT_BASE (1 << SHARED_INTERNER_SEGMENT_BITS)
+#define SHARED_INTERNER_SEGMENTS 32
+// Of one shard
+#define SHARED_INTERNER_MAX_STRINGS                                           \
+  ((size_t)SHARED_INTERNER_SEGMENT_BASE * ((1ull << SHARED_INTERNER_SEGMENTS) - 1))
+
+typedef struct {
+  pthread_mutex_t lock;
+  string_interner *strings;
+  _Atomic(intern_entry *) segments[SHARED_INTERNER_SEGMENTS];
+} shared_interner_shard;
+
+typedef struct {
+  shared_interner_shard shards[SHARED_INTERNER_SHARDS];
+} shared_interner;
+
+shared_interner *shared_interner_create(void);
+void shared_interner_destroy(shared_interner *si);
+// INTERNER_ERROR when the string is new and can not be added
+uint64_t shared_interner_intern(shared_interner *si, const char *key);
+uint64_t shared_interner_intern_n(shared_interner *si, const char *data,
+                                  size_t len);
+// Wait free. id must have been returned by this interner.
+const char *shared_interner_get(shared_interner *si, uint64_t id,
+                                size_t *length);
+
+uint64_t shared_interner_tests();
+#ifdef SHARED_INTERNER_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline size_t shared_interner__shard(uint64_t hash) {
+  // The shard interner indexes by the low bits and filters by the high bits
+  // of the same hash, so the shard is picked from a remix of all of them.
+  return (hash * 0x9e3779b97f4a7c15ULL) >> (64 - SHARED_INTERNER_SHARD_BITS);
+}
+
+static inline void shared_interner__locate(uint64_t local, size_t *segment,
+                                           size_t *offset) {
+  uint64_t biased = local + SHARED_INTERNER_SEGMENT_BASE;
+  size_t msb = 63 - __builtin_clzll(biased);
+  *segment = msb - SHARED_INTERNER_SEGMENT_BITS;
+  *offset = biased - (1ULL << msb);
+}
+
+shared_interner *shared_interner_create(void) {
+  shared_interner *si = (shared_interner *)calloc(1, sizeof(*si));
+  if (!si)
+    return NULL;
+  for (size_t i = 0; i < SHARED_INTERNER_SHARDS; i++) {
+    shared_interner_shard *shard = &si->shards[i];
+    pthread_mutex_init(&shard->lock, NULL);
+    // At most what the segments and the ids have room for
+    shard->strings = interner_create(
+        .arena_chunk_size = INTERNER_DEFAULT_CHUNK_SIZE,
+        .max_strings = SHARED_INTERNER_MAX_STRINGS);
+    for (size_t s = 0; s < SHARED_INTERNER_SEGMENTS; s++)
+      atomic_init(&shard->segments[s], NULL);
+    if (!shard->strings) {
+      for (size_t j = 0; j <= i; j++)
+        if (si->shards[j].strings)
+          interner_destroy(si->shards[j].strings);
+      free(si);
+      return NULL;
+    }
+  }
+  return si;
+}
+
+void shared_interner_destroy(shared_interner *si) {
+  for (size_t i = 0; i < SHARED_INTERNER_SHARDS; i++) {
+    shared_interner_shard *shard = &si->shards[i];
+    for (size_t s = 0; s < SHARED_INTERNER_SEGMENTS; s++)
+      free(atomic_load_explicit(&shard->segments[s], memory_order_relaxed));
+    interner_destroy(shard->strings);
+    pthread_mutex_destroy(&shard->lock);
+  }
+  free(si);
+}
+
+uint64_t shared_interner_intern(shared_interner *si, const char *key) {
+  return shared_interner_intern_n(si, key, strlen(key));
+}
+
+uint64_t shared_interner_intern_n(shared_interner *si, const char *key,
+                                  size_t length) {
+  uint64_t hash = interner_hash(key, length);
+  size_t shard_id = shared_interner__shard(hash);
+  shared_interner_shard *shard = &si->shards[shard_id];
+
+  pthread_mutex_lock(&shard->lock);
+  // The segment a new string would go to exists before it is interned, so
+  // every id handed out can be published
+  size_t before = shard->strings->length;
+  size_t segment, offset;
+  shared_interner__locate(before, &segment, &offset);
+  intern_entry *entries =
+      atomic_load_explicit(&shard->segments[segment], memory_order_relaxed);
+  if (!entries) {
+    entries = (intern_entry *)malloc(sizeof(intern_entry) *
+                                     (SHARED_INTERNER_SEGMENT_BASE << segment));
+    if (!entries) {
+      pthread_mutex_unlock(&shard->lock);
+      fprintf(stderr, "shared interner: out of memory\n");
+      return INTERNER_ERROR;
+    }
+    atomic_store_explicit(&shard->segments[segment], entries,
+                          memory_order_release);
+  }
+  uint64_t local = interner_intern_hashed(shard->strings, key, length, hash);
+  if (local != INTERNER_ERROR && shard->strings->length != before)
+    // New string, publish it before anyone can see the id
+    entries[offset] = shard->strings->entries[local];
+  pthread_mutex_unlock(&shard->lock);
+
+  if (local == INTERNER_ERROR)
+    return INTERNER_ERROR;
+  return (local << SHARED_INTERNER_SHARD_BITS) | shard_id;
+}
+
+const char *shared_interner_get(shared_interner *si, uint64_t id,
+                                size_t *length) {
+  shared_interner_shard *shard = &si->shards[id & (SHARED_INTERNER_SHARDS - 1)];
+  size_t segment, offset;
+  shared_interner__locate(id >> SHARED_INTERNER_SHARD_BITS, &segment, &offset);
+  intern_entry *entries =
+      atomic_load_explicit(&shard->segments[segment], memory_order_acquire);
+  if (length)
+    *length = entries[offset].length;
+  return entries[offset].str;
+}
+
+typedef struct {
+  shared_interner *si;
+  int seed;
+  uint64_t ids[2000];
+} shared_interner__test_worker;
+
+static void *shared_interner__test_run(void *arg) {
+  shared_interner__test_worker *w = (shared_interner__test_worker *)arg;
+  char str[32];
+  // Every worker interns the same names, in a different order
+  for (int i = 0; i < 2000; i++) {
+    int n = (i * 7 + w->seed * 331) % 2000;
+    snprintf(str, sizeof(str), "c::main::1::x%d", n);
+    w->ids[n] = shared_interner_intern(w->si, str);
+  }
+  return NULL;
+}
+
+uint64_t shared_interner_tests() {
+  uint64_t errors = 0;
+
+  printf("Shared interner suite...\n");
+
+  {
+    printf("- Same id for the same string... ");
+    shared_interner *test = shared_interner_create();
+
+    uint64_t a = shared_interner_intern(test, "hello");
+    uint64_t b = shared_interner_intern_n(test, "hello world", 5);
+    uint64_t c = shared_interner_intern(test, "world");
+    size_t length = 0;
+    const char *str = shared_interner_get(test, c, &length);
+
+    if (a != b || a == c || length != 5 || strcmp(str, "world")) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    shared_interner_destroy(test);
+  }
+
+  {
+    printf("- Concurrent interning... ");
+    shared_interner *test = shared_interner_create();
+
+    enum { WORKERS = 4 };
+    static shared_interner__test_worker workers[WORKERS];
+    pthread_t threads[WORKERS];
+    for (int i = 0; i < WORKERS; i++) {
+      workers[i].si = test;
+      workers[i].seed = i;
+      pthread_create(&threads[i], NULL, shared_interner__test_run, &workers[i]);
+    }
+    for (int i = 0; i < WORKERS; i++)
+      pthread_join(threads[i], NULL);
+
+    _Bool ok = 1;
+    char str[32];
+    for (int n = 0; n < 2000; n++) {
+      for (int i = 1; i < WORKERS; i++)
+        ok &= workers[i].ids[n] == workers[0].ids[n];
+      snprintf(str, sizeof(str), "c::main::1::x%d", n);
+      ok &= strcmp(shared_interner_get(test, workers[0].ids[n], NULL), str) == 0;
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    shared_interner_destroy(test);
+  }
+
+  {
+    printf("- A full shard... ");
+    shared_interner *test = shared_interner_create();
+
+    uint64_t a = shared_interner_intern(test, "a");
+    shared_interner_shard *shard = &test->shards[a & (SHARED_INTERNER_SHARDS - 1)];
+    shard->strings->max_strings = 1;
+    // Another name of the same shard
+    char str[32];
+    size_t length = 0;
+    for (int n = 0;; n++) {
+      snprintf(str, sizeof(str), "x%d", n);
+      length = strlen(str);
+      if (&test->shards[shared_interner__shard(interner_hash(str, length))] ==
+          shard)
+        break;
+    }
+    _Bool ok = shared_interner_intern(test, str) == INTERNER_ERROR;
+    ok &= shared_interner_intern(test, "a") == a;
+    ok &= shard->strings->length == 1;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    shared_interner_destroy(test);
+  }
+
+  return errors;
+}
+
+#endif
+#endif
@@ -0,0 +1,1013 @@
+#ifndef SLICER_H
+#define SLICER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "goto_binary.h"
+#include "u64_map.h"
+
+// Cuts a loaded GOTO program down to what can affect a set of assertions,
+// before symex ever sees it.
+//
+// Only bodies reachable from the entry function in the call graph are
+// decoded, so everything else in the binary (most of a linked libc model)
+// is dropped without ever being read. Calls through function pointers can
+// reach any function whose address is taken in reachable code.
+//
+// Within the reachable code the slice is the backward closure of the
+// assertions over data and control dependencies:
+//  - data: an instruction is kept when it writes a variable something kept
+//    reads. This is flow insensitive over fully qualified names, which CBMC
+//    makes unique per function. Variables whose address is taken are all one
+//    "memory" variable, as is anything written or read through a pointer.
+//    Calls write the parameters of their callees and read their return
+//    values, instructions the slicer does not understand write memory.
+//  - control: every jump in a function that keeps anything is kept, and so
+//    are the calls to it.
+// Assumptions are kept like assertions, dropping one could make an
+// assertion fail on paths it rules out. Programs that start threads only
+// lose their unreachable functions.
+//
+// Dropped instructions are removed, jumps to them go to the next
+// instruction kept. Dropped functions are removed from the program, and so
+// are their symbols and the static lifetime variables nothing kept refers
+// to. Function indices change, look functions up by name afterwards.
+
+typedef struct {
+  size_t function; // index before slicing
+  size_t pc;
+} slicer_assertion;
+
+typedef struct {
+  size_t functions_decoded; // bodies only the slicer needed
+  size_t functions_dropped;
+  size_t instructions_dropped; // in the functions that stay
+  size_t symbols_dropped;
+} slicer_stats;
+
+// Slices in place for the given assertions, every reachable one when count
+// is 0. Returns 0 with a diagnostic, leaving the program as it was, when a
+// reachable body can not be decoded or an assertion is not one. stats can
+// be NULL.
+_Bool slicer_slice(goto_program *p, size_t entry,
+                   const slicer_assertion *assertions, size_t count,
+                   slicer_stats *stats);
+
+uint64_t slicer_tests();
+#ifdef SLICER_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "irep.h"
+#include "stats.h"
+
+// Keys of the variables dependencies go through, besides names
+#define SLICER__MEMORY (UINT64_MAX - 1)
+#define SLICER__RETURN(function) ((1ull << 62) + (function))
+
+// Lists hanging off a map, the map holds the index of the head + 1
+typedef struct {
+  uint64_t item;
+  size_t next; // + 1, 0 ends the list
+} slicer__link;
+
+typedef struct {
+  goto_program *p;
+  slicer_stats stats;
+  struct {
+    uint64_t symbol, identifier, address_of, dereference, member, index,
+        byte_extract_little_endian, byte_extract_big_endian, nil, code,
+        parameters, parameter_identifier;
+  } names;
+  u64_map symbols; // name -> symbol index
+
+  // Reachable functions, in the order they were found
+  size_t *reached;
+  size_t reached_length, reached_capacity;
+  size_t *base; // first instruction number of each function, SIZE_MAX if not
+                // reachable
+  uint32_t *owner; // function of every instruction number
+  size_t instruction_count;
+  _Bool indirect; // a call through a pointer was seen
+  _Bool threads;
+
+  u64_map taken; // names whose address is taken
+  uint8_t *function_taken;
+  size_t *taken_functions;
+  size_t taken_length, taken_capacity;
+
+  u64_map writers; // key -> instructions writing it
+  u64_map callers; // function -> calls that can reach it
+  slicer__link *links;
+  size_t link_length, link_capacity;
+
+  u64_map relevant; // keys something kept reads
+  uint8_t *kept;    // per instruction number
+  uint8_t *relevant_functions;
+  size_t *stack; // kept instructions not looked at yet
+  size_t stack_length, stack_capacity;
+  uint64_t *keys; // of the instruction being looked at
+  size_t key_length, key_capacity;
+  size_t callee; // storage for a direct callee, see slicer__callees
+  _Bool failed;
+} slicer__ctx;
+
+static _Bool slicer__push(slicer__ctx *c, void **items, size_t *length,
+                          size_t *capacity, size_t item_size,
+                          const void *item) {
+  if (!goto__grow(items, capacity, *length + 1, item_size, 0)) {
+    c->failed = 1;
+    return 0;
+  }
+  memcpy((char *)*items + *length * item_size, item, item_size);
+  ++*length;
+  return 1;
+}
+
+static void slicer__key(slicer__ctx *c, uint64_t key) {
+  slicer__push(c, (void **)&c->keys, &c->key_length, &c->key_capacity,
+               sizeof(uint64_t), &key);
+}
+
+static void slicer__link_add(slicer__ctx *c, u64_map *lists, uint64_t key,
+                             uint64_t item) {
+  uint64_t *head = u64_map_get(lists, key);
+  slicer__link link = {item, head ? *head : 0};
+  if (slicer__push(c, (void **)&c->links, &c->link_length, &c->link_capacity,
+                   sizeof(slicer__link), &link) &&
+      !u64_map_put(lists, key, c->link_length))
+    c->failed = 1;
+}
+
+static uint64_t slicer__identifier(slicer__ctx *c, uint64_t expr) {
+  uint64_t name = irep_find(c->p->ireps, expr, c->names.identifier);
+  return name == IREP_NIL ? IREP_NIL : irep_id(c->p->ireps, name);
+}
+
+static inline uint64_t slicer__canonical(slicer__ctx *c, uint64_t name) {
+  return u64_map_get(&c->taken, name) ? SLICER__MEMORY : name;
+}
+
+// Name of the variable an lvalue is part of, IREP_NIL when it goes through
+// memory
+static uint64_t slicer__root(slicer__ctx *c, uint64_t lhs) {
+  const irep_store *ireps = c->p->ireps;
+  for (;;) {
+    uint64_t id = irep_id(ireps, lhs);
+    if (id == c->names.symbol)
+      return slicer__identifier(c, lhs);
+    if ((id == c->names.member || id == c->names.index ||
+         id == c->names.byte_extract_little_endian ||
+         id == c->names.byte_extract_big_endian) &&
+        irep_sub_count(ireps, lhs) > 0)
+      lhs = irep_sub(ireps, lhs, 0);
+    else
+      return IREP_NIL;
+  }
+}
+
+static void slicer__reach(slicer__ctx *c, size_t function) {
+  if (c->base[function] != SIZE_MAX)
+    return;
+  c->base[function] = 0; // numbered once everything is found
+  slicer__push(c, (void **)&c->reached, &c->reached_length,
+               &c->reached_capacity, sizeof(size_t), &function);
+}
+
+// Records taken addresses and functions used as values. Operands are the
+// unnamed subs, named ones are attributes (types, identifiers...).
+static void slicer__scan(slicer__ctx *c, uint64_t expr) {
+  if (expr == IREP_NIL)
+    return;
+  const irep_store *ireps = c->p->ireps;
+  uint64_t id = irep_id(ireps, expr);
+  if (id == c->names.symbol) {
+    uint64_t name = slicer__identifier(c, expr);
+    size_t function = name == IREP_NIL
+                          ? SIZE_MAX
+                          : goto_program_find_function(c->p, name);
+    if (function != SIZE_MAX && !c->function_taken[function]) {
+      c->function_taken[function] = 1;
+      slicer__push(c, (void **)&c->taken_functions, &c->taken_length,
+                   &c->taken_capacity, sizeof(size_t), &function);
+      if (c->indirect)
+        slicer__reach(c, function);
+    }
+    return;
+  }
+  if (id == c->names.address_of && irep_sub_count(ireps, expr) == 1) {
+    uint64_t root = slicer__root(c, irep_sub(ireps, expr, 0));
+    if (root != IREP_NIL && !u64_map_put(&c->taken, root, 1))
+      c->failed = 1;
+  }
+  size_t count = irep_sub_count(ireps, expr);
+  for (size_t i = 0; i < count; i++)
+    slicer__scan(c, irep_sub(ireps, expr, i));
+}
+
+static void slicer__scan_instruction(slicer__ctx *c, const goto_instruction *ins) {
+  const irep_store *ireps = c->p->ireps;
+  slicer__scan(c, ins->guard);
+  if (ins->type == GOTO_START_THREAD)
+    c->threads = 1;
+  if (ins->type != GOTO_FUNCTION_CALL || ins->code == IREP_NIL ||
+      irep_sub_count(ireps, ins->code) != 3) {
+    slicer__scan(c, ins->code);
+    return;
+  }
+
+  slicer__scan(c, irep_sub(ireps, ins->code, 0));
+  slicer__scan(c, irep_sub(ireps, ins->code, 2));
+  uint64_t function = irep_sub(ireps, ins->code, 1);
+  if (irep_id(ireps, function) == c->names.symbol) {
+    uint64_t name = slicer__identifier(c, function);
+    size_t callee =
+        name == IREP_NIL ? SIZE_MAX : goto_program_find_function(c->p, name);
+    if (callee != SIZE_MAX)
+      slicer__reach(c, callee);
+    return;
+  }
+  slicer__scan(c, function);
+  if (!c->indirect) {
+    c->indirect = 1;
+    for (size_t i = 0; i < c->taken_length; i++)
+      slicer__reach(c, c->taken_functions[i]);
+  }
+}
+
+// Functions a call can enter, *callees points to them
+static size_t slicer__callees(slicer__ctx *c, const goto_instruction *ins,
+                              const size_t **callees) {
+  const irep_store *ireps = c->p->ireps;
+  if (ins->code == IREP_NIL || irep_sub_count(ireps, ins->code) != 3)
+    return 0;
+  uint64_t function = irep_sub(ireps, ins->code, 1);
+  if (irep_id(ireps, function) != c->names.symbol) {
+    *callees = c->taken_functions;
+    return c->taken_length;
+  }
+  uint64_t name = slicer__identifier(c, function);
+  c->callee = name == IREP_NIL ? SIZE_MAX : goto_program_find_function(c->p, name);
+  *callees = &c->callee;
+  return c->callee != SIZE_MAX;
+}
+
+static void slicer__parameters(slicer__ctx *c, size_t function) {
+  const irep_store *ireps = c->p->ireps;
+  uint64_t *symbol = u64_map_get(&c->symbols, c->p->functions[function].name);
+  if (!symbol)
+    return;
+  uint64_t type = c->p->symbols[*symbol].type;
+  if (type == IREP_NIL || irep_id(ireps, type) != c->names.code)
+    return;
+  uint64_t parameters = irep_find(ireps, type, c->names.parameters);
+  size_t count = parameters == IREP_NIL ? 0 : irep_sub_count(ireps, parameters);
+  for (size_t i = 0; i < count; i++) {
+    uint64_t id = irep_find(ireps, irep_sub(ireps, parameters, i),
+                            c->names.parameter_identifier);
+    if (id != IREP_NIL)
+      slicer__key(c, slicer__canonical(c, irep_id(ireps, id)));
+  }
+}
+
+static void slicer__lvalue(slicer__ctx *c, uint64_t lhs) {
+  uint64_t root = slicer__root(c, lhs);
+  slicer__key(c, root == IREP_NIL ? SLICER__MEMORY : slicer__canonical(c, root));
+}
+
+// Keys an instruction writes
+static void slicer__writes(slicer__ctx *c, const goto_instruction *ins,
+                           size_t function) {
+  const irep_store *ireps = c->p->ireps;
+  size_t subs = ins->code == IREP_NIL ? 0 : irep_sub_count(ireps, ins->code);
+  switch (ins->type) {
+  case GOTO_ASSIGN:
+    if (subs == 2)
+      slicer__lvalue(c, irep_sub(ireps, ins->code, 0));
+    break;
+  case GOTO_DECL:
+  case GOTO_DEAD:
+    if (subs == 1)
+      slicer__lvalue(c, irep_sub(ireps, ins->code, 0));
+    break;
+  case GOTO_FUNCTION_CALL: {
+    if (subs != 3)
+      break;
+    uint64_t lhs = irep_sub(ireps, ins->code, 0);
+    if (irep_id(ireps, lhs) != c->names.nil)
+      slicer__lvalue(c, lhs);
+    const size_t *callees;
+    size_t count = slicer__callees(c, ins, &callees);
+    for (size_t i = 0; i < count; i++)
+      slicer__parameters(c, callees[i]);
+    break;
+  }
+  case GOTO_SET_RETURN_VALUE:
+    slicer__key(c, SLICER__RETURN(function));
+    break;
+  case GOTO_OTHER:
+    slicer__key(c, SLICER__MEMORY);
+    break;
+  default:
+    break;
+  }
+}
+
+static void slicer__reads(slicer__ctx *c, uint64_t expr) {
+  if (expr == IREP_NIL)
+    return;
+  const irep_store *ireps = c->p->ireps;
+  uint64_t id = irep_id(ireps, expr);
+  if (id == c->names.symbol) {
+    uint64_t name = slicer__identifier(c, expr);
+    if (name != IREP_NIL)
+      slicer__key(c, slicer__canonical(c, name));
+    return;
+  }
+  if (id == c->names.dereference)
+    slicer__key(c, SLICER__MEMORY);
+  size_t count = irep_sub_count(ireps, expr);
+  for (size_t i = 0; i < count; i++)
+    slicer__reads(c, irep_sub(ireps, expr, i));
+}
+
+// What writing to lhs reads: indices, pointers...
+static void slicer__lvalue_reads(slicer__ctx *c, uint64_t lhs) {
+  const irep_store *ireps = c->p->ireps;
+  uint64_t id = irep_id(ireps, lhs);
+  size_t count = irep_sub_count(ireps, lhs);
+  if (id == c->names.symbol)
+    return;
+  if ((id == c->names.member || id == c->names.index ||
+       id == c->names.byte_extract_little_endian ||
+       id == c->names.byte_extract_big_endian) &&
+      count > 0) {
+    slicer__lvalue_reads(c, irep_sub(ireps, lhs, 0));
+    for (size_t i = 1; i < count; i++)
+      slicer__reads(c, irep_sub(ireps, lhs, i));
+    return;
+  }
+  slicer__reads(c, lhs);
+}
+
+// Keys a kept instruction depends on
+static void slicer__instruction_reads(slicer__ctx *c,
+                                      const goto_instruction *ins) {
+  const irep_store *ireps = c->p->ireps;
+  size_t subs = ins->code == IREP_NIL ? 0 : irep_sub_count(ireps, ins->code);
+  switch (ins->type) {
+  case GOTO_ASSIGN:
+    if (subs == 2) {
+      slicer__lvalue_reads(c, irep_sub(ireps, ins->code, 0));
+      slicer__reads(c, irep_sub(ireps, ins->code, 1));
+    }
+    break;
+  case GOTO_DECL:
+  case GOTO_DEAD:
+    break;
+  case GOTO_FUNCTION_CALL: {
+    if (subs != 3)
+      break;
+    uint64_t lhs = irep_sub(ireps, ins->code, 0);
+    slicer__reads(c, irep_sub(ireps, ins->code, 1));
+    slicer__reads(c, irep_sub(ireps, ins->code, 2));
+    if (irep_id(ireps, lhs) == c->names.nil)
+      break;
+    slicer__lvalue_reads(c, lhs);
+    const size_t *callees;
+    size_t count = slicer__callees(c, ins, &callees);
+    for (size_t i = 0; i < count; i++)
+      slicer__key(c, SLICER__RETURN(callees[i]));
+    break;
+  }
+  default:
+    slicer__reads(c, ins->code);
+    slicer__reads(c, ins->guard);
+    break;
+  }
+}
+
+static void slicer__keep(slicer__ctx *c, size_t n) {
+  if (c->kept[n])
+    return;
+  c->kept[n] = 1;
+  slicer__push(c, (void **)&c->stack, &c->stack_length, &c->stack_capacity,
+               sizeof(size_t), &n);
+}
+
+// Keeps what decides whether the kept instructions of a function run: its
+// jumps and the calls to it
+static void slicer__function(slicer__ctx *c, size_t function) {
+  if (c->relevant_functions[function])
+    return;
+  c->relevant_functions[function] = 1;
+  goto_function *f = &c->p->functions[function];
+  for (size_t pc = 0; pc < f->count; pc++) {
+    uint32_t type = f->instructions[pc].type;
+    if (type == GOTO_GOTO || type == GOTO_INCOMPLETE_GOTO ||
+        type == GOTO_THROW || type == GOTO_CATCH ||
+        type == GOTO_ATOMIC_BEGIN || type == GOTO_ATOMIC_END ||
+        type == GOTO_END_FUNCTION || pc + 1 == f->count)
+      slicer__keep(c, c->base[function] + pc);
+  }
+  uint64_t *head = u64_map_get(&c->callers, function);
+  for (size_t l = head ? *head : 0; l; l = c->links[l - 1].next)
+    slicer__keep(c, c->links[l - 1].item);
+}
+
+static void slicer__close(slicer__ctx *c) {
+  while (c->stack_length && !c->failed) {
+    size_t n = c->stack[--c->stack_length];
+    size_t function = c->owner[n];
+    goto_instruction *ins =
+        &c->p->functions[function].instructions[n - c->base[function]];
+    slicer__function(c, function);
+
+    c->key_length = 0;
+    slicer__instruction_reads(c, ins);
+    for (size_t k = 0; k < c->key_length; k++) {
+      uint64_t key = c->keys[k];
+      if (u64_map_get(&c->relevant, key))
+        continue;
+      if (!u64_map_put(&c->relevant, key, 1)) {
+        c->failed = 1;
+        return;
+      }
+      uint64_t *head = u64_map_get(&c->writers, key);
+      for (size_t l = head ? *head : 0; l; l = c->links[l - 1].next)
+        slicer__keep(c, c->links[l - 1].item);
+    }
+  }
+}
+
+// Names of every symbol expression below expr
+static void slicer__used(slicer__ctx *c, u64_map *used, uint64_t expr) {
+  if (expr == IREP_NIL)
+    return;
+  const irep_store *ireps = c->p->ireps;
+  if (irep_id(ireps, expr) == c->names.symbol) {
+    uint64_t name = slicer__identifier(c, expr);
+    if (name != IREP_NIL && !u64_map_put(used, name, 1))
+      c->failed = 1;
+    return;
+  }
+  size_t count = irep_sub_count(ireps, expr);
+  for (size_t i = 0; i < count; i++)
+    slicer__used(c, used, irep_sub(ireps, expr, i));
+}
+
+// Everything is decided, drop what is not kept
+static _Bool slicer__rewrite(slicer__ctx *c) {
+  goto_program *p = c->p;
+  u64_map used = {0}, dropped = {0};
+  if (!u64_map_init(&used, 0) || !u64_map_init(&dropped, 0)) {
+    u64_map_free(&used);
+    u64_map_free(&dropped);
+    return 0;
+  }
+
+  size_t function_count = 0;
+  for (size_t i = 0; i < p->function_count; i++) {
+    goto_function *f = &p->functions[i];
+    if (!c->relevant_functions[i]) {
+      u64_map_put(&dropped, f->name, 1);
+      free(f->instructions);
+      c->stats.functions_dropped++;
+      continue;
+    }
+    // New index of every instruction, or of the next one kept
+    size_t base = c->base[i];
+    size_t next = 0;
+    for (size_t pc = 0; pc < f->count; pc++)
+      if (c->kept[base + pc])
+        next++;
+    size_t kept_count = next;
+    uint32_t *index = (uint32_t *)c->owner + base; // owner is done with
+    for (size_t pc = f->count; pc-- > 0;) {
+      if (c->kept[base + pc])
+        next--;
+      index[pc] = next;
+    }
+    size_t length = 0;
+    for (size_t pc = 0; pc < f->count; pc++) {
+      if (!c->kept[base + pc])
+        continue;
+      goto_instruction *ins = &f->instructions[length++];
+      *ins = f->instructions[pc];
+      for (uint32_t t = 0; t < ins->target_count; t++)
+        p->pool[ins->targets + t] = index[p->pool[ins->targets + t]];
+      slicer__used(c, &used, ins->code);
+      slicer__used(c, &used, ins->guard);
+    }
+    c->stats.instructions_dropped += f->count - kept_count;
+    f->count = kept_count;
+    p->functions[function_count++] = *f;
+  }
+
+  p->function_count = function_count;
+  p->loaded_function_count = function_count;
+  memset(p->function_index, 0, sizeof(uint32_t) * p->function_index_capacity);
+  size_t mask = p->function_index_capacity - 1;
+  for (size_t i = 0; i < function_count; i++) {
+    size_t slot = goto__name_slot(p->functions[i].name, p->function_index_capacity);
+    while (p->function_index[slot])
+      slot = (slot + 1) & mask;
+    p->function_index[slot] = i + 1;
+  }
+
+  size_t symbol_count = 0;
+  for (size_t i = 0; i < p->symbol_count; i++) {
+    goto_symbol *s = &p->symbols[i];
+    _Bool variable = (s->flags & GOTO_SYMBOL_IS_STATIC_LIFETIME) &&
+                     !(s->flags & GOTO_SYMBOL_IS_TYPE);
+    if (u64_map_get(&dropped, s->name) ||
+        (variable && !u64_map_get(&used, s->name) &&
+         goto_program_find_function(p, s->name) == SIZE_MAX)) {
+      c->stats.symbols_dropped++;
+      continue;
+    }
+    p->symbols[symbol_count++] = *s;
+  }
+  p->symbol_count = symbol_count;
+  u64_map_free(&used);
+  u64_map_free(&dropped);
+  return 1;
+}
+
+static void slicer__free(slicer__ctx *c) {
+  u64_map_free(&c->symbols);
+  u64_map_free(&c->taken);
+  u64_map_free(&c->writers);
+  u64_map_free(&c->callers);
+  u64_map_free(&c->relevant);
+  free(c->reached);
+  free(c->base);
+  free(c->owner);
+  free(c->function_taken);
+  free(c->taken_functions);
+  free(c->links);
+  free(c->kept);
+  free(c->relevant_functions);
+  free(c->stack);
+  free(c->keys);
+}
+
+static _Bool slicer__slice(goto_program *p, size_t entry,
+                          const slicer_assertion *assertions, size_t count,
+                          slicer_stats *stats) {
+  slicer__ctx c = {.p = p};
+#define SLICER__NAME(field, string) c.names.field = goto_program_intern(p, string);
+  SLICER__NAME(symbol, "symbol")
+  SLICER__NAME(identifier, "identifier")
+  SLICER__NAME(address_of, "address_of")
+  SLICER__NAME(dereference, "dereference")
+  SLICER__NAME(member, "member")
+  SLICER__NAME(index, "index")
+  SLICER__NAME(byte_extract_little_endian, "byte_extract_little_endian")
+  SLICER__NAME(byte_extract_big_endian, "byte_extract_big_endian")
+  SLICER__NAME(nil, "nil")
+  SLICER__NAME(code, "code")
+  SLICER__NAME(parameters, "parameters")
+  SLICER__NAME(parameter_identifier, "#identifier")
+#undef SLICER__NAME
+
+  size_t functions = p->function_count ? p->function_count : 1;
+  c.base = (size_t *)malloc(sizeof(size_t) * functions);
+  c.function_taken = (uint8_t *)calloc(functions, 1);
+  c.relevant_functions = (uint8_t *)calloc(functions, 1);
+  _Bool ok = c.base && c.function_taken && c.relevant_functions &&
+             u64_map_init(&c.symbols, p->symbol_count) &&
+             u64_map_init(&c.taken, 0) && u64_map_init(&c.writers, 0) &&
+             u64_map_init(&c.callers, 0) && u64_map_init(&c.relevant, 0);
+  if (!ok || entry >= p->function_count) {
+    fprintf(stderr, ok ? "slicer: no entry function\n"
+                       : "slicer: out of memory\n");
+    slicer__free(&c);
+    return 0;
+  }
+  for (size_t i = 0; i < p->symbol_count; i++)
+    if (!u64_map_put(&c.symbols, p->symbols[i].name, i))
+      c.failed = 1;
+
+  // Reachable functions, decoding each body once found
+  memset(c.base, 0xff, sizeof(size_t) * functions);
+  slicer__reach(&c, entry);
+  for (size_t r = 0; r < c.reached_length && !c.failed; r++) {
+    size_t function = c.reached[r];
+    _Bool loaded = p->functions[function].loaded;
+    goto_function *f = goto_program_function_at(p, function);
+    if (!f) {
+      size_t length;
+      const char *name =
+          goto_program_string(p, p->functions[function].name, &length);
+      fprintf(stderr, "slicer: could not decode %.*s\n", (int)length, name);
+      slicer__free(&c);
+      return 0;
+    }
+    c.stats.functions_decoded += !loaded;
+    for (size_t pc = 0; pc < f->count; pc++)
+      slicer__scan_instruction(&c, &f->instructions[pc]);
+  }
+
+  // Numbers for every reachable instruction, and who writes what
+  for (size_t r = 0; r < c.reached_length; r++) {
+    c.base[c.reached[r]] = c.instruction_count;
+    c.instruction_count += p->functions[c.reached[r]].count;
+  }
+  size_t instructions = c.instruction_count ? c.instruction_count : 1;
+  c.owner = (uint32_t *)malloc(sizeof(uint32_t) * instructions);
+  c.kept = (uint8_t *)calloc(instructions, 1);
+  if (!c.owner || !c.kept)
+    c.failed = 1;
+  for (size_t r = 0; r < c.reached_length && !c.failed; r++) {
+    size_t function = c.reached[r];
+    goto_function *f = &p->functions[function];
+    for (size_t pc = 0; pc < f->count; pc++) {
+      size_t n = c.base[function] + pc;
+      goto_instruction *ins = &f->instructions[pc];
+      c.owner[n] = function;
+      c.key_length = 0;
+      slicer__writes(&c, ins, function);
+      for (size_t k = 0; k < c.key_length; k++)
+        slicer__link_add(&c, &c.writers, c.keys[k], n);
+      if (ins->type != GOTO_FUNCTION_CALL)
+        continue;
+      const size_t *callees;
+      size_t callee_count = slicer__callees(&c, ins, &callees);
+      for (size_t i = 0; i < callee_count; i++)
+        slicer__link_add(&c, &c.callers, callees[i], n);
+    }
+  }
+
+  // The criteria, then everything they depend on
+  slicer__function(&c, entry);
+  for (size_t i = 0; i < count && !c.failed; i++) {
+    const slicer_assertion *a = &assertions[i];
+    if (a->function >= p->function_count || c.base[a->function] == SIZE_MAX ||
+        a->pc >= p->functions[a->function].count ||
+        p->functions[a->function].instructions[a->pc].type != GOTO_ASSERT) {
+      fprintf(stderr, "slicer: no reachable assertion at %zu:%zu\n",
+              a->function, a->pc);
+      slicer__free(&c);
+      return 0;
+    }
+    slicer__keep(&c, c.base[a->function] + a->pc);
+  }
+  for (size_t n = 0; n < c.instruction_count && !c.failed; n++) {
+    size_t function = c.owner[n];
+    uint32_t type = p->functions[function].instructions[n - c.base[function]].type;
+    if (c.threads || type == GOTO_ASSUME || (type == GOTO_ASSERT && !count))
+      slicer__keep(&c, n);
+  }
+  slicer__close(&c);
+
+  if (c.failed || !slicer__rewrite(&c)) {
+    fprintf(stderr, "slicer: out of memory\n");
+    slicer__free(&c);
+    return 0;
+  }
+  if (stats)
+    *stats = c.stats;
+  slicer__free(&c);
+  return 1;
+}
+
+_Bool slicer_slice(goto_program *p, size_t entry,
+                   const slicer_assertion *assertions, size_t count,
+                   slicer_stats *stats) {
+  _Bool ok;
+  STATS_PHASE(STATS_SLICE)
+  ok = slicer__slice(p, entry, assertions, count, stats);
+  return ok;
+}
+
+// main, inc, noise and lib, see slicer_tests
+static goto_program *slicer__t_program(bytecode__test *t) {
+  *t = (bytecode__test){.instruction_capacity = 16};
+  t->strings = interner_create();
+  t->ireps = irep_store_create();
+  t->program = (goto_program *)calloc(1, sizeof(goto_program));
+  goto_program *p = t->program;
+  p->strings = t->strings;
+  p->ireps = t->ireps;
+  p->functions = (goto_function *)calloc(4, sizeof(goto_function));
+  p->function_index_capacity = 16;
+  p->function_index = (uint32_t *)calloc(16, sizeof(uint32_t));
+  p->pool_capacity = 16;
+  p->pool = (uint64_t *)calloc(p->pool_capacity, sizeof(uint64_t));
+  p->symbols = (goto_symbol *)calloc(5, sizeof(goto_symbol));
+
+  uint64_t int32 = bytecode__t_type(t, "signedbv", "32");
+  uint64_t boolean = bytecode__t_leaf(t, "bool");
+  uint64_t nil = bytecode__t_leaf(t, "nil");
+  uint64_t yes = bytecode__t_constant(t, "true", boolean);
+  uint64_t x = bytecode__t_symbol(t, "main::x", int32);
+  uint64_t y = bytecode__t_symbol(t, "main::y", int32);
+  uint64_t g = bytecode__t_symbol(t, "g", int32);
+  uint64_t h = bytecode__t_symbol(t, "h", int32);
+  uint64_t a = bytecode__t_symbol(t, "inc::a", int32);
+  uint64_t zero = bytecode__t_constant(t, "0", int32);
+  uint64_t one = bytecode__t_constant(t, "1", int32);
+  uint64_t three = bytecode__t_constant(t, "3", int32);
+  uint64_t five = bytecode__t_constant(t, "5", int32);
+  uint64_t no_arguments = bytecode__t_leaf(t, "arguments");
+
+  const char *globals[] = {"g", "h", "u"};
+  for (int i = 0; i < 3; i++) {
+    p->symbols[i].name = interner_intern(t->strings, globals[i]);
+    p->symbols[i].type = int32;
+    p->symbols[i].value = IREP_NIL;
+    p->symbols[i].flags = GOTO_SYMBOL_IS_STATIC_LIFETIME;
+  }
+  irep_named param_named = {interner_intern(t->strings, "#identifier"),
+                            bytecode__t_leaf(t, "inc::a")};
+  uint64_t param = irep_make(t->ireps, interner_intern(t->strings, "parameter"),
+                             NULL, 0, &param_named, 1);
+  irep_named code_named = {
+      interner_intern(t->strings, "parameters"),
+      irep_make(t->ireps, interner_intern(t->strings, "parameters"), &param, 1,
+                NULL, 0)};
+  p->symbols[3].name = interner_intern(t->strings, "inc");
+  p->symbols[3].type = irep_make(t->ireps, interner_intern(t->strings, "code"),
+                                 NULL, 0, &code_named, 1);
+  p->symbols[3].value = IREP_NIL;
+  p->symbols[4].name = interner_intern(t->strings, "noise");
+  p->symbols[4].type = bytecode__t_leaf(t, "code");
+  p->symbols[4].value = IREP_NIL;
+  p->symbol_count = 5;
+
+  // 0: x = 0
+  // 1: y = 5
+  // 2: h = y
+  // 3: g = inc(x)
+  // 4: noise()
+  // 5: if !(x < 3) goto 7
+  // 6: x = x + 1
+  // 7: assert g == 1
+  // 8: assert y == 5
+  // 9: END_FUNCTION
+  goto_function *main = bytecode__t_function(t, "main");
+  uint64_t subs[3];
+  subs[0] = x, subs[1] = zero;
+  bytecode__t_add(t, main, GOTO_ASSIGN, bytecode__t_code(t, "assign", subs, 2),
+                  yes, GOTO_NIL_TARGET);
+  subs[0] = y, subs[1] = five;
+  bytecode__t_add(t, main, GOTO_ASSIGN, bytecode__t_code(t, "assign", subs, 2),
+                  yes, GOTO_NIL_TARGET);
+  subs[0] = h, subs[1] = y;
+  bytecode__t_add(t, main, GOTO_ASSIGN, bytecode__t_code(t, "assign", subs, 2),
+                  yes, GOTO_NIL_TARGET);
+  subs[0] = g;
+  subs[1] = bytecode__t_symbol(t, "inc", IREP_NIL);
+  subs[2] = irep_make(t->ireps, interner_intern(t->strings, "arguments"), &x, 1,
+                      NULL, 0);
+  bytecode__t_add(t, main, GOTO_FUNCTION_CALL,
+                  bytecode__t_code(t, "function_call", subs, 3), yes,
+                  GOTO_NIL_TARGET);
+  subs[0] = nil;
+  subs[1] = bytecode__t_symbol(t, "noise", IREP_NIL);
+  subs[2] = no_arguments;
+  bytecode__t_add(t, main, GOTO_FUNCTION_CALL,
+                  bytecode__t_code(t, "function_call", subs, 3), yes,
+                  GOTO_NIL_TARGET);
+  uint64_t less = bytecode__t_binary(t, "<", boolean, x, three);
+  bytecode__t_add(t, main, GOTO_GOTO, nil,
+                  bytecode__t_node(t, "not", boolean, &less, 1), 7);
+  subs[0] = x;
+  subs[1] = bytecode__t_binary(t, "+", int32, x, one);
+  bytecode__t_add(t, main, GOTO_ASSIGN, bytecode__t_code(t, "assign", subs, 2),
+                  yes, GOTO_NIL_TARGET);
+  bytecode__t_add(t, main, GOTO_ASSERT, nil,
+                  bytecode__t_binary(t, "=", boolean, g, one), GOTO_NIL_TARGET);
+  bytecode__t_add(t, main, GOTO_ASSERT, nil,
+                  bytecode__t_binary(t, "=", boolean, y, five), GOTO_NIL_TARGET);
+  bytecode__t_add(t, main, GOTO_END_FUNCTION, nil, yes, GOTO_NIL_TARGET);
+
+  goto_function *inc = bytecode__t_function(t, "inc");
+  uint64_t sum = bytecode__t_binary(t, "+", int32, a, one);
+  bytecode__t_add(t, inc, GOTO_SET_RETURN_VALUE,
+                  bytecode__t_code(t, "set_return_value", &sum, 1), yes,
+                  GOTO_NIL_TARGET);
+  bytecode__t_add(t, inc, GOTO_END_FUNCTION, nil, yes, GOTO_NIL_TARGET);
+
+  goto_function *noise = bytecode__t_function(t, "noise");
+  subs[0] = h, subs[1] = three;
+  bytecode__t_add(t, noise, GOTO_ASSIGN, bytecode__t_code(t, "assign", subs, 2),
+                  yes, GOTO_NIL_TARGET);
+  bytecode__t_add(t, noise, GOTO_END_FUNCTION, nil, yes, GOTO_NIL_TARGET);
+
+  // Writes g, but nothing calls it
+  goto_function *lib = bytecode__t_function(t, "lib");
+  subs[0] = g, subs[1] = zero;
+  bytecode__t_add(t, lib, GOTO_ASSIGN, bytecode__t_code(t, "assign", subs, 2),
+                  yes, GOTO_NIL_TARGET);
+  bytecode__t_add(t, lib, GOTO_END_FUNCTION, nil, yes, GOTO_NIL_TARGET);
+  return p;
+}
+
+static void slicer__t_destroy(bytecode__test *t) {
+  goto_program_destroy(t->program);
+  irep_store_destroy(t->ireps);
+  interner_destroy(t->strings);
+}
+
+uint64_t slicer_tests() {
+  uint64_t errors = 0;
+
+  printf("Slicer suite...\n");
+
+  {
+    printf("- Unreachable bodies are never decoded... ");
+    bytecode__test t;
+    goto_program *built = slicer__t_program(&t);
+    char path[] = "/tmp/farol-slicer-XXXXXX";
+    int fd = mkstemp(path);
+    _Bool ok = fd >= 0;
+    if (ok)
+      close(fd);
+    ok = ok && goto_program_write(built, path);
+    goto_program *p = ok ? goto_program_load(path, t.strings, t.ireps) : NULL;
+    slicer_stats stats = {0};
+    ok = p && slicer_slice(p, 0, NULL, 0, &stats);
+    // main, inc and noise are reachable, noise and lib go
+    ok &= stats.functions_decoded == 3 && stats.functions_dropped == 2;
+    ok &= p && p->function_count == 2 && p->functions[1].count == 2;
+    goto_function *main_ =
+        p ? goto_program_function(p, interner_intern(t.strings, "main")) : NULL;
+    ok &= p && goto_program_find_function(p, interner_intern(t.strings, "lib")) ==
+                   SIZE_MAX;
+    // h = y and noise() go, the jump now lands on the first assertion
+    ok &= main_ && main_->count == 8 && stats.instructions_dropped == 2;
+    ok &= main_ && main_->instructions[3].type == GOTO_GOTO &&
+          p->pool[main_->instructions[3].targets] == 5;
+    ok &= main_ && main_->instructions[2].type == GOTO_FUNCTION_CALL;
+    // h, u and noise
+    ok &= stats.symbols_dropped == 3 && p->symbol_count == 2;
+
+    bytecode_program *bp = ok ? bytecode_program_create(p) : NULL;
+    bytecode__t_run run = {0};
+    bytecode_hooks hooks = {.assertion = bytecode__t_assertion, .ctx = &run};
+    bytecode_result r = {BYTECODE_ERROR, 0, 0, 0};
+    if (bp)
+      r = bytecode_run(bp, 0, &hooks);
+    ok &= r.status == BYTECODE_DONE && run.failed == 0;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (bp)
+      bytecode_program_destroy(bp);
+    if (p)
+      goto_program_destroy(p);
+    remove(path);
+    slicer__t_destroy(&t);
+  }
+
+  {
+    printf("- One assertion... ");
+    bytecode__test t;
+    goto_program *p = slicer__t_program(&t);
+    slicer_assertion bad = {0, 2};
+    slicer_assertion y_is_5 = {0, 8};
+    slicer_stats stats;
+    _Bool ok = !slicer_slice(p, 0, &bad, 1, NULL);
+    ok &= p->function_count == 4 && p->functions[0].count == 10;
+    ok &= slicer_slice(p, 0, &y_is_5, 1, &stats);
+    // x = 0, y = 5, the jump and what it reads, the assertion, the end
+    goto_function *main_ = &p->functions[0];
+    ok &= p->function_count == 1 && main_->count == 6;
+    ok &= main_->instructions[4].type == GOTO_ASSERT &&
+          main_->instructions[2].type == GOTO_GOTO &&
+          p->pool[main_->instructions[2].targets] == 4;
+    ok &= stats.functions_decoded == 0 && stats.symbols_dropped == 5;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    slicer__t_destroy(&t);
+  }
+
+  {
+    printf("- Pointers and indirect calls... ");
+    bytecode__test t = {.instruction_capacity = 16};
+    t.strings = interner_create();
+    t.ireps = irep_store_create();
+    t.program = (goto_program *)calloc(1, sizeof(goto_program));
+    goto_program *p = t.program;
+    p->strings = t.strings;
+    p->ireps = t.ireps;
+    p->functions = (goto_function *)calloc(3, sizeof(goto_function));
+    p->function_index_capacity = 16;
+    p->function_index = (uint32_t *)calloc(16, sizeof(uint32_t));
+    p->symbols = (goto_symbol *)calloc(1, sizeof(goto_symbol));
+
+    uint64_t int32 = bytecode__t_type(&t, "signedbv", "32");
+    uint64_t boolean = bytecode__t_leaf(&t, "bool");
+    uint64_t nil = bytecode__t_leaf(&t, "nil");
+    uint64_t yes = bytecode__t_constant(&t, "true", boolean);
+    uint64_t x = bytecode__t_symbol(&t, "main::x", int32);
+    uint64_t y = bytecode__t_symbol(&t, "main::y", int32);
+    uint64_t ptr = bytecode__t_symbol(&t, "main::p", int32);
+    uint64_t fp = bytecode__t_symbol(&t, "main::fp", int32);
+    uint64_t g = bytecode__t_symbol(&t, "g", int32);
+    uint64_t zero = bytecode__t_constant(&t, "0", int32);
+    uint64_t one = bytecode__t_constant(&t, "1", int32);
+    p->symbols[0].name = interner_intern(t.strings, "g");
+    p->symbols[0].flags = GOTO_SYMBOL_IS_STATIC_LIFETIME;
+    p->symbol_count = 1;
+
+    // 0: x = 0
+    // 1: p = &x
+    // 2: *p = 1
+    // 3: y = 0
+    // 4: fp = &bump
+    // 5: (*fp)()
+    // 6: assert x == 1
+    // 7: assert g == 1
+    // 8: END_FUNCTION
+    goto_function *main_ = bytecode__t_function(&t, "main");
+    uint64_t subs[3];
+    subs[0] = x, subs[1] = zero;
+    bytecode__t_add(&t, main_, GOTO_ASSIGN,
+                    bytecode__t_code(&t, "assign", subs, 2), yes,
+                    GOTO_NIL_TARGET);
+    subs[0] = ptr, subs[1] = bytecode__t_node(&t, "address_of", int32, &x, 1);
+    bytecode__t_add(&t, main_, GOTO_ASSIGN,
+                    bytecode__t_code(&t, "assign", subs, 2), yes,
+                    GOTO_NIL_TARGET);
+    subs[0] = bytecode__t_node(&t, "dereference", int32, &ptr, 1);
+    subs[1] = one;
+    bytecode__t_add(&t, main_, GOTO_ASSIGN,
+                    bytecode__t_code(&t, "assign", subs, 2), yes,
+                    GOTO_NIL_TARGET);
+    subs[0] = y, subs[1] = zero;
+    bytecode__t_add(&t, main_, GOTO_ASSIGN,
+                    bytecode__t_code(&t, "assign", subs, 2), yes,
+                    GOTO_NIL_TARGET);
+    uint64_t bump = bytecode__t_symbol(&t, "bump", IREP_NIL);
+    subs[0] = fp, subs[1] = bytecode__t_node(&t, "address_of", int32, &bump, 1);
+    bytecode__t_add(&t, main_, GOTO_ASSIGN,
+                    bytecode__t_code(&t, "assign", subs, 2), yes,
+                    GOTO_NIL_TARGET);
+    subs[0] = nil;
+    subs[1] = bytecode__t_node(&t, "dereference", int32, &fp, 1);
+    subs[2] = bytecode__t_leaf(&t, "arguments");
+    bytecode__t_add(&t, main_, GOTO_FUNCTION_CALL,
+                    bytecode__t_code(&t, "function_call", subs, 3), yes,
+                    GOTO_NIL_TARGET);
+    bytecode__t_add(&t, main_, GOTO_ASSERT, nil,
+                    bytecode__t_binary(&t, "=", boolean, x, one),
+                    GOTO_NIL_TARGET);
+    bytecode__t_add(&t, main_, GOTO_ASSERT, nil,
+                    bytecode__t_binary(&t, "=", boolean, g, one),
+                    GOTO_NIL_TARGET);
+    bytecode__t_add(&t, main_, GOTO_END_FUNCTION, nil, yes, GOTO_NIL_TARGET);
+
+    goto_function *bump_ = bytecode__t_function(&t, "bump");
+    subs[0] = g, subs[1] = one;
+    bytecode__t_add(&t, bump_, GOTO_ASSIGN,
+                    bytecode__t_code(&t, "assign", subs, 2), yes,
+                    GOTO_NIL_TARGET);
+    bytecode__t_add(&t, bump_, GOTO_END_FUNCTION, nil, yes, GOTO_NIL_TARGET);
+    goto_function *lonely = bytecode__t_function(&t, "lonely");
+    bytecode__t_add(&t, lonely, GOTO_END_FUNCTION, nil, yes, GOTO_NIL_TARGET);
+
+    slicer_stats stats;
+    _Bool ok = slicer_slice(p, 0, NULL, 0, &stats);
+    // Only y = 0 goes, bump stays as the target of the pointer
+    ok &= p->function_count == 2 && stats.functions_dropped == 1;
+    ok &= p->functions[0].count == 8 && stats.instructions_dropped == 1;
+    ok &= p->functions[0].instructions[3].type == GOTO_ASSIGN &&
+          irep_sub(t.ireps, p->functions[0].instructions[3].code, 0) == fp;
+    ok &= p->functions[1].name == interner_intern(t.strings, "bump") &&
+          p->functions[1].count == 2;
+    ok &= p->symbol_count == 1;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    slicer__t_destroy(&t);
+  }
+
+  return errors;
+}
+
+#endif // SLICER_IMPL
+#endif // SLICER_H
@@ -0,0 +1,911 @@
+#ifndef SMT_H
+#define SMT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bytecode.h"
+#include "ssa_equation.h"
+#include "symex_state.h"
+
+// Decides path conditions with Z3. Formulas are irep expressions read the
+// way bytecode lowering reads them (bytecode_decode_*), so a path the
+// interpreter can run is one the solver can reason about, with the same
+// wrap around and signedness.
+//
+// SMT_INCREMENTAL keeps one live solver. Every path constraint c gets a
+// literal p once, p => c is asserted for good, and a check passes the
+// literals of the current path as assumptions. Backtracking to a sibling
+// path only drops literals, so what the solver learned stays, and a
+// constraint both paths share (the same irep id, thanks to hash consing) is
+// encoded once. SMT_FULL solves every query from scratch, for comparison.
+//
+// A solver is single threaded, give every symex worker its own. Workers
+// that share the irep store can hand it the lock of the store, which a
+// check lets go of while Z3 solves and takes back before it returns.
+
+typedef enum {
+  SMT_INCREMENTAL,
+  SMT_FULL,
+} smt_mode;
+
+typedef enum {
+  SMT_SAT,
+  SMT_UNSAT,
+  SMT_UNKNOWN,
+  // The formula uses something the encoding does not support
+  SMT_ERROR,
+} smt_result;
+
+typedef struct smt_solver smt_solver;
+
+smt_solver *smt_solver_create(const bytecode_program *bp, smt_mode mode);
+void smt_solver_destroy(smt_solver *s);
+// Held by the caller of every check from now on, NULL for none (the default)
+void smt_solver_share(smt_solver *s, pthread_mutex_t *lock);
+// Checks from now on give up with SMT_UNKNOWN after ms, 0 for never (the
+// default). Returns the budget before.
+uint64_t smt_solver_timeout(smt_solver *s, uint64_t ms);
+
+// Number of constraints on the current path
+size_t smt_solver_depth(const smt_solver *s);
+// Adds cond to the path, 0 if it can not be encoded (the path is unchanged)
+_Bool smt_solver_push(smt_solver *s, uint64_t cond);
+// Back to the first depth constraints
+void smt_solver_pop(smt_solver *s, size_t depth);
+// Makes the path the guard of state, keeping the prefix they share
+_Bool smt_solver_sync(smt_solver *s, const symex_state *state);
+// Is the path satisfiable together with the assumptions
+smt_result smt_solver_check(smt_solver *s, const uint64_t *assumptions,
+                            size_t count);
+// The same question as an SMT-LIB 2 script ending in (check-sat), for other
+// solvers. Allocated, NULL on failure.
+char *smt_solver_script(smt_solver *s, const uint64_t *assumptions,
+                        size_t count);
+// Value of expr in the model of the last SMT_SAT check, canonical as in
+// bytecode. 0 if there is none.
+_Bool smt_solver_value(smt_solver *s, uint64_t expr, uint64_t *value);
+// Can an assertion of eq fail, given its assignments and assumptions. One
+// pass over the steps, independent of the path, and no model is kept.
+smt_result smt_solver_check_equation(smt_solver *s, const ssa_equation *eq);
+
+uint64_t smt_tests();
+#ifdef SMT_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <z3.h>
+
+#include "stats.h"
+#include "u64_map.h"
+
+struct smt_solver {
+  const bytecode_program *bp;
+  smt_mode mode;
+  Z3_context ctx;
+  // The live one, a fresh one per check in SMT_FULL
+  Z3_solver solver;
+  Z3_sort bool_sort;
+  Z3_sort bv_sorts[65];
+  // irep -> index in asts, of terms and of the literals of constraints
+  u64_map terms, literals;
+  u64_map types; // type node -> width | flags << 8, 0 if unsupported
+  Z3_ast *asts;
+  size_t ast_count, ast_capacity;
+  // Current path, oldest first
+  uint64_t *path;
+  size_t path_length, path_capacity;
+  // Scratch
+  Z3_ast *assumed;
+  size_t assumed_capacity;
+  char *name;
+  size_t name_capacity;
+  _Bool has_model;
+  pthread_mutex_t *lock; // let go of while solving
+  uint64_t timeout_ms;
+};
+
+static _Bool smt__fail(smt_solver *s, const char *error, uint64_t id) {
+  size_t length = 0;
+  const char *name =
+      id == IREP_NIL ? "" : goto_program_string(s->bp->program, id, &length);
+  fprintf(stderr, "smt: %s %.*s\n", error, (int)length, name);
+  return 0;
+}
+
+static _Bool smt__grow(void **items, size_t *capacity, size_t needed,
+                       size_t size) {
+  if (needed <= *capacity)
+    return 1;
+  size_t grown = *capacity ? *capacity : 16;
+  while (grown < needed)
+    grown *= 2;
+  void *resized = realloc(*items, size * grown);
+  if (!resized)
+    return 0;
+  *items = resized;
+  *capacity = grown;
+  return 1;
+}
+
+static _Bool smt__remember(smt_solver *s, u64_map *memo, uint64_t key,
+                           Z3_ast a) {
+  if (!smt__grow((void **)&s->asts, &s->ast_capacity, s->ast_count + 1,
+                 sizeof(Z3_ast)) ||
+      !u64_map_put(memo, key, s->ast_count))
+    return 0;
+  s->asts[s->ast_count++] = a;
+  return 1;
+}
+
+static _Bool smt__type(smt_solver *s, uint64_t expr, uint8_t *width,
+                       uint8_t *flags) {
+  const bytecode_program *bp = s->bp;
+  uint64_t type = irep_find(bp->program->ireps, expr, bp->names.type);
+  uint64_t *known = u64_map_get(&s->types, type);
+  if (!known) {
+    if (!bytecode_decode_type(bp, type, width, flags))
+      *width = *flags = 0;
+    if (!u64_map_put(&s->types, type, *width | (uint64_t)*flags << 8))
+      return 0;
+  } else {
+    *width = *known & 0xff;
+    *flags = *known >> 8;
+  }
+  return *width || smt__fail(s, "unsupported type of",
+                             irep_id(bp->program->ireps, expr));
+}
+
+// Bool sort for bool, bitvectors for the rest (c_bool included)
+static inline _Bool smt__is_bool(uint8_t width, uint8_t flags) {
+  return width == 1 && (flags & BYTECODE_BOOL);
+}
+
+static Z3_sort smt__sort(smt_solver *s, uint8_t width, uint8_t flags) {
+  return smt__is_bool(width, flags) ? s->bool_sort : s->bv_sorts[width];
+}
+
+static Z3_ast smt__as_bool(smt_solver *s, Z3_ast a) {
+  Z3_sort sort = Z3_get_sort(s->ctx, a);
+  if (Z3_get_sort_kind(s->ctx, sort) == Z3_BOOL_SORT)
+    return a;
+  return Z3_mk_not(s->ctx, Z3_mk_eq(s->ctx, a, Z3_mk_int(s->ctx, 0, sort)));
+}
+
+// a, of type (from, from_flags), as a value of type (width, flags)
+static Z3_ast smt__convert(smt_solver *s, Z3_ast a, uint8_t from,
+                           uint8_t from_flags, uint8_t width, uint8_t flags) {
+  Z3_context c = s->ctx;
+  if (smt__is_bool(width, flags))
+    return smt__as_bool(s, a);
+  if (smt__is_bool(from, from_flags) || (flags & BYTECODE_BOOL))
+    return Z3_mk_ite(c, smt__as_bool(s, a), Z3_mk_int(c, 1, s->bv_sorts[width]),
+                     Z3_mk_int(c, 0, s->bv_sorts[width]));
+  if (width < from)
+    return Z3_mk_extract(c, width - 1, 0, a);
+  if (width > from)
+    return from_flags & BYTECODE_SIGNED ? Z3_mk_sign_ext(c, width - from, a)
+                                        : Z3_mk_zero_ext(c, width - from, a);
+  return a;
+}
+
+static Z3_ast smt__term(smt_solver *s, uint64_t expr);
+
+static Z3_ast smt__term_as(smt_solver *s, uint64_t expr, uint8_t width,
+                           uint8_t flags) {
+  uint8_t from, from_flags;
+  Z3_ast a = smt__term(s, expr);
+  if (!a || !smt__type(s, expr, &from, &from_flags))
+    return NULL;
+  return smt__convert(s, a, from, from_flags, width, flags);
+}
+
+static Z3_ast smt__symbol(smt_solver *s, uint64_t expr, uint8_t width,
+                          uint8_t flags) {
+  const bytecode_program *bp = s->bp;
+  uint64_t name = irep_find(bp->program->ireps, expr, bp->names.identifier);
+  if (name == IREP_NIL)
+    return smt__fail(s, "symbol without identifier", IREP_NIL), NULL;
+  size_t length;
+  const char *string = goto_program_string(
+      bp->program, irep_id(bp->program->ireps, name), &length);
+  if (!smt__grow((void **)&s->name, &s->name_capacity, length + 1, 1))
+    return NULL;
+  memcpy(s->name, string, length);
+  s->name[length] = 0;
+  return Z3_mk_const(s->ctx, Z3_mk_string_symbol(s->ctx, s->name),
+                     smt__sort(s, width, flags));
+}
+
+static Z3_ast smt__operator(smt_solver *s, uint64_t expr, int op,
+                            uint8_t width, uint8_t flags) {
+  Z3_context c = s->ctx;
+  const irep_store *ireps = s->bp->program->ireps;
+  size_t count = irep_sub_count(ireps, expr);
+  _Bool is_signed = flags & BYTECODE_SIGNED;
+  _Bool is_bool = smt__is_bool(width, flags);
+  Z3_ast a[3] = {NULL, NULL, NULL};
+
+  switch (op) {
+  case BYTECODE_LAND:
+  case BYTECODE_LOR:
+  case BYTECODE_LNOT: {
+    if (count < 1 || (op == BYTECODE_LNOT) != (count == 1))
+      break;
+    Z3_ast r = NULL;
+    for (size_t i = 0; i < count; i++) {
+      Z3_ast b = smt__term(s, irep_sub(ireps, expr, i));
+      if (!b)
+        return NULL;
+      b = smt__as_bool(s, b);
+      Z3_ast both[2] = {r, b};
+      r = !r ? b : op == BYTECODE_LAND ? Z3_mk_and(c, 2, both)
+                                       : Z3_mk_or(c, 2, both);
+    }
+    if (op == BYTECODE_LNOT)
+      r = Z3_mk_not(c, r);
+    return smt__convert(s, r, 1, BYTECODE_BOOL, width, flags);
+  }
+
+  case BYTECODE_EQ:
+  case BYTECODE_NE:
+  case BYTECODE_LT:
+  case BYTECODE_LE:
+  case BYTECODE_GT:
+  case BYTECODE_GE: {
+    // Compared as the first operand's type, as lowered
+    uint8_t w, f;
+    if (count != 2 || !smt__type(s, irep_sub(ireps, expr, 0), &w, &f))
+      break;
+    a[0] = smt__term_as(s, irep_sub(ireps, expr, 0), w, f);
+    a[1] = smt__term_as(s, irep_sub(ireps, expr, 1), w, f);
+    if (!a[0] || !a[1])
+      return NULL;
+    _Bool sign = f & BYTECODE_SIGNED;
+    Z3_ast r;
+    if (op == BYTECODE_EQ || op == BYTECODE_NE) {
+      r = Z3_mk_eq(c, a[0], a[1]);
+      if (op == BYTECODE_NE)
+        r = Z3_mk_not(c, r);
+    } else if (smt__is_bool(w, f)) {
+      break;
+    } else if (op == BYTECODE_LT) {
+      r = sign ? Z3_mk_bvslt(c, a[0], a[1]) : Z3_mk_bvult(c, a[0], a[1]);
+    } else if (op == BYTECODE_LE) {
+      r = sign ? Z3_mk_bvsle(c, a[0], a[1]) : Z3_mk_bvule(c, a[0], a[1]);
+    } else if (op == BYTECODE_GT) {
+      r = sign ? Z3_mk_bvsgt(c, a[0], a[1]) : Z3_mk_bvugt(c, a[0], a[1]);
+    } else {
+      r = sign ? Z3_mk_bvsge(c, a[0], a[1]) : Z3_mk_bvuge(c, a[0], a[1]);
+    }
+    return smt__convert(s, r, 1, BYTECODE_BOOL, width, flags);
+  }
+
+  case BYTECODE_CAST:
+    if (count != 1)
+      break;
+    return smt__term_as(s, irep_sub(ireps, expr, 0), width, flags);
+
+  case BYTECODE_SELECT: {
+    if (count != 3)
+      break;
+    Z3_ast cond = smt__term(s, irep_sub(ireps, expr, 0));
+    a[1] = smt__term_as(s, irep_sub(ireps, expr, 1), width, flags);
+    a[2] = smt__term_as(s, irep_sub(ireps, expr, 2), width, flags);
+    if (!cond || !a[1] || !a[2])
+      return NULL;
+    return Z3_mk_ite(c, smt__as_bool(s, cond), a[1], a[2]);
+  }
+
+  case BYTECODE_SHL:
+  case BYTECODE_SHR:
+  case BYTECODE_LSHR:
+    if (count != 2 || is_bool)
+      break;
+    a[0] = smt__term_as(s, irep_sub(ireps, expr, 0), width, flags);
+    // The distance as an unsigned of the same width
+    a[1] = smt__term_as(s, irep_sub(ireps, expr, 1), width, 0);
+    if (!a[0] || !a[1])
+      return NULL;
+    return op == BYTECODE_SHL    ? Z3_mk_bvshl(c, a[0], a[1])
+           : op == BYTECODE_SHR  ? Z3_mk_bvashr(c, a[0], a[1])
+                                 : Z3_mk_bvlshr(c, a[0], a[1]);
+
+  case BYTECODE_NEG:
+  case BYTECODE_BNOT:
+    if (count != 1)
+      break;
+    a[0] = smt__term_as(s, irep_sub(ireps, expr, 0), width, flags);
+    if (!a[0])
+      return NULL;
+    if (is_bool)
+      return op == BYTECODE_BNOT ? Z3_mk_not(c, a[0]) : a[0];
+    return op == BYTECODE_NEG ? Z3_mk_bvneg(c, a[0]) : Z3_mk_bvnot(c, a[0]);
+
+  default: {
+    // Arithmetic and bitwise, folded left over every operand
+    if (count < 2 || ((op == BYTECODE_SUB || op == BYTECODE_DIV ||
+                       op == BYTECODE_MOD) && count != 2))
+      break;
+    if (is_bool && op != BYTECODE_BAND && op != BYTECODE_BOR &&
+        op != BYTECODE_BXOR)
+      break;
+    Z3_ast r = NULL;
+    for (size_t i = 0; i < count; i++) {
+      Z3_ast b = smt__term_as(s, irep_sub(ireps, expr, i), width, flags);
+      if (!b)
+        return NULL;
+      if (!r) {
+        r = b;
+        continue;
+      }
+      Z3_ast both[2] = {r, b};
+      switch (op) {
+      case BYTECODE_ADD:
+        r = Z3_mk_bvadd(c, r, b);
+        break;
+      case BYTECODE_SUB:
+        r = Z3_mk_bvsub(c, r, b);
+        break;
+      case BYTECODE_MUL:
+        r = Z3_mk_bvmul(c, r, b);
+        break;
+      case BYTECODE_DIV:
+        r = is_signed ? Z3_mk_bvsdiv(c, r, b) : Z3_mk_bvudiv(c, r, b);
+        break;
+      case BYTECODE_MOD:
+        r = is_signed ? Z3_mk_bvsrem(c, r, b) : Z3_mk_bvurem(c, r, b);
+        break;
+      case BYTECODE_BAND:
+        r = is_bool ? Z3_mk_and(c, 2, both) : Z3_mk_bvand(c, r, b);
+        break;
+      case BYTECODE_BOR:
+        r = is_bool ? Z3_mk_or(c, 2, both) : Z3_mk_bvor(c, r, b);
+        break;
+      case BYTECODE_BXOR:
+        r = is_bool ? Z3_mk_xor(c, r, b) : Z3_mk_bvxor(c, r, b);
+        break;
+      default:
+        return smt__fail(s, "unsupported expression",
+                         irep_id(ireps, expr)), NULL;
+      }
+    }
+    return r;
+  }
+  }
+  return smt__fail(s, "bad operands of", irep_id(ireps, expr)), NULL;
+}
+
+static Z3_ast smt__term(smt_solver *s, uint64_t expr) {
+  uint64_t *known = u64_map_get(&s->terms, expr);
+  if (known)
+    return s->asts[*known];
+
+  const bytecode_program *bp = s->bp;
+  const irep_store *ireps = bp->program->ireps;
+  uint64_t id = irep_id(ireps, expr);
+  uint8_t width, flags;
+  if (!smt__type(s, expr, &width, &flags))
+    return NULL;
+
+  Z3_ast a = NULL;
+  if (id == bp->names.symbol) {
+    a = smt__symbol(s, expr, width, flags);
+  } else if (id == bp->names.constant) {
+    uint64_t v;
+    if (!bytecode_decode_constant(bp, expr, width, flags, &v))
+      return smt__fail(s, "bad constant", id), NULL;
+    a = smt__is_bool(width, flags)
+            ? (v ? Z3_mk_true(s->ctx) : Z3_mk_false(s->ctx))
+            : Z3_mk_unsigned_int64(
+                  s->ctx, width < 64 ? v & ((UINT64_C(1) << width) - 1) : v,
+                  s->bv_sorts[width]);
+  } else {
+    int op = bytecode_decode_operator(bp, id);
+    if (op < 0)
+      return smt__fail(s, "unsupported expression", id), NULL;
+    a = smt__operator(s, expr, op, width, flags);
+  }
+  if (!a || Z3_get_error_code(s->ctx) != Z3_OK ||
+      !smt__remember(s, &s->terms, expr, a))
+    return NULL;
+  return a;
+}
+
+// The literal standing for cond on paths, encoding cond the first time
+static Z3_ast smt__literal(smt_solver *s, uint64_t cond) {
+  uint64_t *known = u64_map_get(&s->literals, cond);
+  if (known)
+    return s->asts[*known];
+  Z3_ast term = smt__term(s, cond);
+  if (!term)
+    return NULL;
+  Z3_ast literal = Z3_mk_fresh_const(s->ctx, "farol_path", s->bool_sort);
+  Z3_solver_assert(s->ctx, s->solver,
+                   Z3_mk_implies(s->ctx, literal, smt__as_bool(s, term)));
+  if (!smt__remember(s, &s->literals, cond, literal))
+    return NULL;
+  return literal;
+}
+
+static void smt__error_handler(Z3_context ctx, Z3_error_code e) {
+  // Checked through Z3_get_error_code where it matters
+  (void)ctx;
+  (void)e;
+}
+
+smt_solver *smt_solver_create(const bytecode_program *bp, smt_mode mode) {
+  smt_solver *s = (smt_solver *)calloc(1, sizeof(*s));
+  if (!s)
+    return NULL;
+  s->bp = bp;
+  s->mode = mode;
+  Z3_config config = Z3_mk_config();
+  s->ctx = config ? Z3_mk_context(config) : NULL;
+  if (config)
+    Z3_del_config(config);
+  _Bool ok = s->ctx != NULL;
+  ok &= u64_map_init(&s->terms, 0) && u64_map_init(&s->literals, 0) &&
+        u64_map_init(&s->types, 0);
+  if (!ok) {
+    smt_solver_destroy(s);
+    return NULL;
+  }
+  Z3_set_error_handler(s->ctx, smt__error_handler);
+  s->bool_sort = Z3_mk_bool_sort(s->ctx);
+  for (unsigned w = 1; w <= 64; w++)
+    s->bv_sorts[w] = Z3_mk_bv_sort(s->ctx, w);
+  s->solver = Z3_mk_solver(s->ctx);
+  Z3_solver_inc_ref(s->ctx, s->solver);
+  return s;
+}
+
+void smt_solver_destroy(smt_solver *s) {
+  if (s->ctx) {
+    if (s->solver)
+      Z3_solver_dec_ref(s->ctx, s->solver);
+    Z3_del_context(s->ctx);
+  }
+  u64_map_free(&s->terms);
+  u64_map_free(&s->literals);
+  u64_map_free(&s->types);
+  free(s->asts);
+  free(s->path);
+  free(s->assumed);
+  free(s->name);
+  free(s);
+}
+
+void smt_solver_share(smt_solver *s, pthread_mutex_t *lock) { s->lock = lock; }
+
+// Gives the live solver the budget, again whenever it is replaced
+static void smt__budget(smt_solver *s) {
+  Z3_context c = s->ctx;
+  Z3_params params = Z3_mk_params(c);
+  Z3_params_inc_ref(c, params);
+  Z3_params_set_uint(c, params, Z3_mk_string_symbol(c, "timeout"),
+                     s->timeout_ms && s->timeout_ms < UINT32_MAX
+                         ? (unsigned)s->timeout_ms
+                         : UINT32_MAX);
+  Z3_solver_set_params(c, s->solver, params);
+  Z3_params_dec_ref(c, params);
+}
+
+uint64_t smt_solver_timeout(smt_solver *s, uint64_t ms) {
+  uint64_t before = s->timeout_ms;
+  s->timeout_ms = ms;
+  if (ms != before)
+    smt__budget(s);
+  return before;
+}
+
+size_t smt_solver_depth(const smt_solver *s) { return s->path_length; }
+
+_Bool smt_solver_push(smt_solver *s, uint64_t cond) {
+  // Encoded now in both modes, a constraint that can not be is refused
+  // here rather than at the next check
+  _Bool encoded;
+  STATS_PHASE(STATS_ENCODE)
+  encoded = s->mode == SMT_INCREMENTAL ? smt__literal(s, cond) != NULL
+                                       : smt__term(s, cond) != NULL;
+  if (!encoded)
+    return 0;
+  if (!smt__grow((void **)&s->path, &s->path_capacity, s->path_length + 1,
+                 sizeof(uint64_t)))
+    return 0;
+  s->path[s->path_length++] = cond;
+  return 1;
+}
+
+void smt_solver_pop(smt_solver *s, size_t depth) {
+  if (depth < s->path_length)
+    s->path_length = depth;
+}
+
+_Bool smt_solver_sync(smt_solver *s, const symex_state *state) {
+  size_t length = state->guard_length;
+  uint64_t *guard = (uint64_t *)malloc(sizeof(uint64_t) * (length ? length : 1));
+  if (!guard)
+    return 0;
+  symex_state_guard(state, guard, length);
+  // guard is the latest first
+  size_t shared = 0;
+  while (shared < length && shared < s->path_length &&
+         s->path[shared] == guard[length - 1 - shared])
+    shared++;
+  smt_solver_pop(s, shared);
+  _Bool ok = 1;
+  for (size_t i = shared; ok && i < length; i++)
+    ok = smt_solver_push(s, guard[length - 1 - i]);
+  free(guard);
+  return ok;
+}
+
+smt_result smt_solver_check(smt_solver *s, const uint64_t *assumptions,
+                            size_t count) {
+  Z3_context c = s->ctx;
+  s->has_model = 0;
+  size_t total = s->path_length + count;
+  if (!smt__grow((void **)&s->assumed, &s->assumed_capacity, total ? total : 1,
+                 sizeof(Z3_ast)))
+    return SMT_ERROR;
+
+  Z3_lbool r;
+  stats_count(STATS_SOLVER_CALLS, 1);
+  _Bool encoded = 1;
+  uint64_t encoding = stats_begin();
+  if (s->mode == SMT_INCREMENTAL) {
+    for (size_t i = 0; encoded && i < total; i++) {
+      uint64_t cond = i < s->path_length ? s->path[i]
+                                         : assumptions[i - s->path_length];
+      encoded = (s->assumed[i] = smt__literal(s, cond)) != NULL;
+    }
+  } else {
+    Z3_solver_dec_ref(c, s->solver);
+    s->solver = Z3_mk_solver(c);
+    Z3_solver_inc_ref(c, s->solver);
+    if (s->timeout_ms)
+      smt__budget(s);
+    for (size_t i = 0; encoded && i < total; i++) {
+      uint64_t cond = i < s->path_length ? s->path[i]
+                                         : assumptions[i - s->path_length];
+      Z3_ast term = smt__term(s, cond);
+      encoded = term != NULL;
+      if (term)
+        Z3_solver_assert(c, s->solver, smt__as_bool(s, term));
+    }
+  }
+  stats_end(STATS_ENCODE, encoding);
+  if (!encoded)
+    return SMT_ERROR;
+  if (s->lock)
+    pthread_mutex_unlock(s->lock);
+  STATS_PHASE(STATS_SOLVE)
+  r = s->mode == SMT_INCREMENTAL
+          ? Z3_solver_check_assumptions(c, s->solver, total, s->assumed)
+          : Z3_solver_check(c, s->solver);
+  if (s->lock)
+    pthread_mutex_lock(s->lock);
+  if (Z3_get_error_code(c) != Z3_OK)
+    return SMT_ERROR;
+  s->has_model = r == Z3_L_TRUE;
+  return r == Z3_L_TRUE ? SMT_SAT : r == Z3_L_FALSE ? SMT_UNSAT : SMT_UNKNOWN;
+}
+
+char *smt_solver_script(smt_solver *s, const uint64_t *assumptions,
+                        size_t count) {
+  Z3_context c = s->ctx;
+  size_t total = s->path_length + count;
+  if (!smt__grow((void **)&s->assumed, &s->assumed_capacity, total ? total : 1,
+                 sizeof(Z3_ast)))
+    return NULL;
+  for (size_t i = 0; i < total; i++) {
+    uint64_t cond = i < s->path_length ? s->path[i]
+                                       : assumptions[i - s->path_length];
+    Z3_ast term = smt__term(s, cond);
+    if (!term)
+      return NULL;
+    s->assumed[i] = smt__as_bool(s, term);
+  }
+  const char *script = Z3_benchmark_to_smtlib_string(
+      c, "farol", "QF_BV", "unknown", "", (unsigned)total, s->assumed,
+      Z3_mk_true(c));
+  if (!script || Z3_get_error_code(c) != Z3_OK)
+    return NULL;
+  return strdup(script);
+}
+
+_Bool smt_solver_value(smt_solver *s, uint64_t expr, uint64_t *value) {
+  uint8_t width, flags;
+  Z3_ast term = s->has_model ? smt__term(s, expr) : NULL;
+  if (!term || !smt__type(s, expr, &width, &flags))
+    return 0;
+  Z3_context c = s->ctx;
+  Z3_model model = Z3_solver_get_model(c, s->solver);
+  if (!model)
+    return 0;
+  Z3_model_inc_ref(c, model);
+  Z3_ast v = NULL;
+  _Bool ok = Z3_model_eval(c, model, term, 1, &v) && v;
+  uint64_t raw = 0;
+  if (ok && smt__is_bool(width, flags))
+    raw = Z3_get_bool_value(c, v) == Z3_L_TRUE;
+  else if (ok)
+    ok = Z3_get_numeral_uint64(c, v, &raw);
+  Z3_model_dec_ref(c, model);
+  if (!ok)
+    return 0;
+  if ((flags & BYTECODE_SIGNED) && width < 64) {
+    unsigned shift = 64 - width;
+    raw = (uint64_t)((int64_t)(raw << shift) >> shift);
+  }
+  *value = raw;
+  return 1;
+}
+
+// a under an SSA guard, IREP_NIL for none
+static Z3_ast smt__guarded(smt_solver *s, uint64_t guard, Z3_ast a) {
+  if (guard == IREP_NIL || !a)
+    return a;
+  Z3_ast g = smt__term(s, guard);
+  return g ? Z3_mk_implies(s->ctx, smt__as_bool(s, g), a) : NULL;
+}
+
+smt_result smt_solver_check_equation(smt_solver *s, const ssa_equation *eq) {
+  Z3_context c = s->ctx;
+  s->has_model = 0;
+  if (s->mode == SMT_INCREMENTAL) {
+    // Terms stay memoized past the pop, the constraints go
+    Z3_solver_push(c, s->solver);
+  } else {
+    Z3_solver_dec_ref(c, s->solver);
+    s->solver = Z3_mk_solver(c);
+    Z3_solver_inc_ref(c, s->solver);
+    if (s->timeout_ms)
+      smt__budget(s);
+  }
+
+  smt_result result = SMT_ERROR;
+  size_t violations = 0;
+  stats_count(STATS_SOLVER_CALLS, 1);
+  uint64_t encoding = stats_begin();
+  _Bool encoded = 0;
+  for (size_t i = 0; i < eq->length; i++) {
+    uint64_t guard = eq->guards[i];
+    Z3_ast a = NULL;
+    if (eq->kinds[i] == SSA_ASSIGNMENT) {
+      uint8_t width, flags;
+      Z3_ast lhs = smt__type(s, eq->lhs[i], &width, &flags)
+                       ? smt__term(s, eq->lhs[i])
+                       : NULL;
+      Z3_ast rhs = lhs ? smt__term_as(s, eq->rhs[i], width, flags) : NULL;
+      a = rhs ? smt__guarded(s, guard, Z3_mk_eq(c, lhs, rhs)) : NULL;
+    } else {
+      a = smt__term(s, eq->rhs[i]);
+      a = a ? smt__as_bool(s, a) : NULL;
+    }
+    if (!a)
+      goto done;
+    if (eq->kinds[i] == SSA_ASSUME) {
+      a = smt__guarded(s, guard, a);
+    } else if (eq->kinds[i] == SSA_ASSERT) {
+      // Fails when the guard holds and the condition does not
+      Z3_ast g = guard == IREP_NIL ? Z3_mk_true(c) : smt__term(s, guard);
+      if (!g || !smt__grow((void **)&s->assumed, &s->assumed_capacity,
+                           violations + 1, sizeof(Z3_ast)))
+        goto done;
+      Z3_ast both[2] = {smt__as_bool(s, g), Z3_mk_not(c, a)};
+      s->assumed[violations++] = Z3_mk_and(c, 2, both);
+      continue;
+    }
+    if (!a)
+      goto done;
+    Z3_solver_assert(c, s->solver, a);
+  }
+  Z3_solver_assert(c, s->solver,
+                   violations ? Z3_mk_or(c, (unsigned)violations, s->assumed)
+                              : Z3_mk_false(c));
+  stats_end(STATS_ENCODE, encoding);
+  encoded = 1;
+  Z3_lbool r;
+  if (s->lock)
+    pthread_mutex_unlock(s->lock);
+  STATS_PHASE(STATS_SOLVE) r = Z3_solver_check(c, s->solver);
+  if (s->lock)
+    pthread_mutex_lock(s->lock);
+  if (Z3_get_error_code(c) == Z3_OK)
+    result = r == Z3_L_TRUE    ? SMT_SAT
+             : r == Z3_L_FALSE ? SMT_UNSAT
+                               : SMT_UNKNOWN;
+done:
+  if (!encoded)
+    stats_end(STATS_ENCODE, encoding);
+  if (s->mode == SMT_INCREMENTAL)
+    Z3_solver_pop(c, s->solver, 1);
+  return result;
+}
+
+typedef struct {
+  bytecode__test t;
+  bytecode_program *bp;
+  uint64_t int32, boolean;
+  uint64_t x, y;
+} smt__t_exprs;
+
+static uint64_t smt__t_int(smt__t_exprs *e, int32_t v) {
+  char hex[16];
+  snprintf(hex, sizeof(hex), "%08X", (uint32_t)v);
+  return bytecode__t_constant(&e->t, hex, e->int32);
+}
+
+static uint64_t smt__t_cmp(smt__t_exprs *e, const char *op, uint64_t a,
+                           uint64_t b) {
+  return bytecode__t_binary(&e->t, op, e->boolean, a, b);
+}
+
+// The same queries in both modes, returns 0 on the first difference from
+// what they should be
+static _Bool smt__t_queries(smt__t_exprs *e, smt_mode mode) {
+  smt_solver *s = smt_solver_create(e->bp, mode);
+  if (!s)
+    return 0;
+  uint64_t x = e->x, y = e->y, v;
+  uint64_t x_gt_5 = smt__t_cmp(e, ">", x, smt__t_int(e, 5));
+  uint64_t x_lt_7 = smt__t_cmp(e, "<", x, smt__t_int(e, 7));
+  uint64_t x_lt_3 = smt__t_cmp(e, "<", x, smt__t_int(e, 3));
+  uint64_t x_lt_6 = smt__t_cmp(e, "<", x, smt__t_int(e, 6));
+  uint64_t y_lt_0 = smt__t_cmp(e, "<", y, smt__t_int(e, 0));
+  // x + 1 < x only when it wraps around
+  uint64_t wraps = smt__t_cmp(
+      e, "<", bytecode__t_binary(&e->t, "+", e->int32, x, smt__t_int(e, 1)), x);
+
+  _Bool ok = smt_solver_push(s, x_gt_5);
+  ok &= smt_solver_check(s, NULL, 0) == SMT_SAT;
+  ok &= smt_solver_value(s, x, &v) && (int64_t)v > 5;
+  ok &= smt_solver_check(s, &x_lt_3, 1) == SMT_UNSAT;
+  ok &= !smt_solver_value(s, x, &v);
+
+  // Both sides of if (x < 7)
+  size_t depth = smt_solver_depth(s);
+  ok &= smt_solver_push(s, x_lt_7);
+  ok &= smt_solver_check(s, NULL, 0) == SMT_SAT;
+  ok &= smt_solver_value(s, x, &v) && v == 6;
+  ok &= smt_solver_check(s, &x_lt_6, 1) == SMT_UNSAT;
+  smt_solver_pop(s, depth);
+  ok &= smt_solver_depth(s) == 1;
+  ok &= smt_solver_check(s, &x_lt_6, 1) == SMT_UNSAT;
+  ok &= smt_solver_check(s, &wraps, 1) == SMT_SAT;
+  ok &= smt_solver_value(s, x, &v) && v == INT32_MAX;
+
+  // Negative values come back sign extended
+  smt_solver_pop(s, 0);
+  ok &= smt_solver_push(s, y_lt_0) && smt_solver_check(s, NULL, 0) == SMT_SAT;
+  ok &= smt_solver_value(s, y, &v) && (int64_t)v < 0 && (int64_t)v >= INT32_MIN;
+
+  // Paths of forked states
+  symex_state *st = symex_state_create(0);
+  symex_state *other = st ? symex_state_fork(st) : NULL;
+  ok &= other && symex_state_assume(st, x_gt_5) && symex_state_assume(st, x_lt_7);
+  ok &= other && symex_state_assume(other, x_gt_5) &&
+        symex_state_assume(other, x_lt_6);
+  ok &= ok && smt_solver_sync(s, st) && smt_solver_depth(s) == 2 &&
+        smt_solver_check(s, NULL, 0) == SMT_SAT;
+  ok &= ok && smt_solver_sync(s, other) && smt_solver_depth(s) == 2 &&
+        smt_solver_check(s, NULL, 0) == SMT_UNSAT;
+  if (st)
+    symex_state_destroy(st);
+  if (other)
+    symex_state_destroy(other);
+
+  // Pointers are not encoded
+  uint64_t pointer = bytecode__t_type(&e->t, "pointer", "64");
+  uint64_t p = bytecode__t_symbol(&e->t, "p", pointer);
+  uint64_t deref = bytecode__t_node(&e->t, "dereference", e->int32, &p, 1);
+  ok &= !smt_solver_push(s, smt__t_cmp(e, "=", deref, x));
+
+  smt_solver_destroy(s);
+  return ok;
+}
+
+uint64_t smt_tests() {
+  uint64_t errors = 0;
+
+  printf("SMT suite...\n");
+
+  smt__t_exprs e;
+  goto_program *p = bytecode__t_program(&e.t);
+  e.bp = bytecode_program_create(p);
+  e.int32 = bytecode__t_type(&e.t, "signedbv", "32");
+  e.boolean = bytecode__t_node(&e.t, "bool", IREP_NIL, NULL, 0);
+  e.x = bytecode__t_symbol(&e.t, "x", e.int32);
+  e.y = bytecode__t_symbol(&e.t, "y", e.int32);
+
+  {
+    printf("- Incremental path queries... ");
+    _Bool ok = e.bp && smt__t_queries(&e, SMT_INCREMENTAL);
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Full formula path queries... ");
+    _Bool ok = e.bp && smt__t_queries(&e, SMT_FULL);
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Equations... ");
+    ssa_equation eq;
+    _Bool ok = e.bp && ssa_equation_init(&eq, 0);
+    uint64_t yes = bytecode__t_constant(&e.t, "true", e.boolean);
+    // y = x + 1, assume x > 5, assert y > 6 fails when x + 1 wraps around
+    ok = ok &&
+         ssa_equation_append(
+             &eq, SSA_ASSIGNMENT, yes, e.y,
+             bytecode__t_binary(&e.t, "+", e.int32, e.x, smt__t_int(&e, 1)),
+             IREP_NIL) &&
+         ssa_equation_append(&eq, SSA_ASSUME, yes, IREP_NIL,
+                             smt__t_cmp(&e, ">", e.x, smt__t_int(&e, 5)),
+                             IREP_NIL) &&
+         ssa_equation_append(&eq, SSA_ASSERT, yes, IREP_NIL,
+                             smt__t_cmp(&e, ">", e.y, smt__t_int(&e, 6)),
+                             IREP_NIL);
+    for (int mode = SMT_INCREMENTAL; ok && mode <= SMT_FULL; mode++) {
+      smt_solver *s = smt_solver_create(e.bp, (smt_mode)mode);
+      ok = s && smt_solver_check_equation(s, &eq) == SMT_SAT;
+      // Nothing stays asserted after the check
+      ok = ok && smt_solver_push(s, smt__t_cmp(&e, "<", e.x, smt__t_int(&e, 3)));
+      ok = ok && smt_solver_check(s, NULL, 0) == SMT_SAT;
+      if (s)
+        smt_solver_destroy(s);
+    }
+    ok = ok && ssa_equation_append(&eq, SSA_ASSUME, yes, IREP_NIL,
+                                   smt__t_cmp(&e, "<", e.x, smt__t_int(&e, 9)),
+                                   IREP_NIL);
+    // Guarded by x < 7, y == 7 holds only for x == 6
+    uint64_t x_lt_7 = smt__t_cmp(&e, "<", e.x, smt__t_int(&e, 7));
+    ok = ok && ssa_equation_append(&eq, SSA_ASSERT, x_lt_7, IREP_NIL,
+                                   smt__t_cmp(&e, "=", e.y, smt__t_int(&e, 7)),
+                                   IREP_NIL);
+    for (int mode = SMT_INCREMENTAL; ok && mode <= SMT_FULL; mode++) {
+      smt_solver *s = smt_solver_create(e.bp, (smt_mode)mode);
+      ok = s && smt_solver_check_equation(s, &eq) == SMT_UNSAT;
+      eq.rhs[eq.length - 1] = smt__t_cmp(&e, "=", e.y, smt__t_int(&e, 8));
+      ok = ok && smt_solver_check_equation(s, &eq) == SMT_SAT;
+      eq.rhs[eq.length - 1] = smt__t_cmp(&e, "=", e.y, smt__t_int(&e, 7));
+      if (s)
+        smt_solver_destroy(s);
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+    if (e.bp)
+      ssa_equation_free(&eq);
+  }
+
+  if (e.bp)
+    bytecode_program_destroy(e.bp);
+  goto_program_destroy(p);
+  irep_store_destroy(e.t.ireps);
+  interner_destroy(e.t.strings);
+  return errors;
+}
+
+#endif
+#endif
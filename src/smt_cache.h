@@ -0,0 +1,657 @@
+#ifndef SMT_CACHE_H
+#define SMT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bytecode.h"
+#include "simplifier.h"
+#include "smt.h"
+#include "smt_portfolio.h"
+#include "symex_state.h"
+
+// Sits in front of smt_solver and answers what it already knows, the way
+// KLEE does. A query is split into groups of constraints that share no
+// symbol with one another (symbols are hash consed irep nodes, so the node
+// id is the key). Every group is canonical, its constraint ids sorted and
+// without duplicates, and is looked up in a cache of results and models
+// before the solver sees it. Two paths asking about x rarely agree on
+// everything, but often agree on everything that mentions x.
+//
+// With a query, only the part of the path it depends on is solved: the
+// path itself is taken to be satisfiable, as it is for any state symex
+// keeps. Without one (IREP_NIL), every group is.
+//
+// Single threaded like the solver, one per worker. It uses the solver's own
+// path as it pleases, a smt_solver_sync after it puts that back.
+//
+// Groups the solver leaves open (SMT_UNKNOWN, as it says once its
+// smt_solver_timeout runs out) go to a portfolio when there is one. Only
+// what it decides is remembered.
+
+typedef struct {
+  uint64_t queries;
+  uint64_t groups;  // looked up
+  uint64_t hits;    // groups answered from the cache
+  uint64_t sliced;  // path constraints a query did not depend on
+  uint64_t escalated; // groups handed to the portfolio
+} smt_cache_stats;
+
+typedef struct smt_cache smt_cache;
+
+smt_cache *smt_cache_create(const bytecode_program *bp);
+void smt_cache_destroy(smt_cache *c);
+// Simplifies constraints and queries with s before anything else, which
+// decides the constant ones without a lookup and makes equal ones the same
+// key more often. Off (NULL) by default.
+void smt_cache_simplify(smt_cache *c, simplifier *s);
+// Asks p about the groups the solver leaves open. Off (NULL) by default.
+void smt_cache_escalate(smt_cache *c, smt_portfolio *p);
+
+// Is query satisfiable together with constraints
+smt_result smt_cache_check(smt_cache *c, smt_solver *s,
+                           const uint64_t *constraints, size_t count,
+                           uint64_t query);
+// The same with the path of state as the constraints
+smt_result smt_cache_check_state(smt_cache *c, smt_solver *s,
+                                 const symex_state *state, uint64_t query);
+// Value of a symbol in the model of the last SMT_SAT check. 0 for symbols
+// anything goes for (not in the groups that were solved).
+_Bool smt_cache_value(const smt_cache *c, uint64_t symbol, uint64_t *value);
+smt_cache_stats smt_cache_statistics(const smt_cache *c);
+
+uint64_t smt_cache_tests();
+#ifdef SMT_CACHE_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "irep.h"
+#include "stats.h"
+#include "u64_map.h"
+
+#define SMT_CACHE__NONE SIZE_MAX
+
+typedef struct {
+  uint64_t hash;
+  size_t key, key_length;     // in keys
+  size_t model, model_length; // pairs in models
+  smt_result result;
+  size_t next; // with the same hash
+} smt_cache__entry;
+
+struct smt_cache {
+  const bytecode_program *bp;
+  simplifier *simplifier;
+  smt_portfolio *portfolio;
+  // expr -> offset in vars, where its symbol count is followed by them
+  u64_map symbols;
+  uint64_t *vars;
+  size_t var_count, var_capacity;
+  // hash -> first entry
+  u64_map table;
+  smt_cache__entry *entries;
+  size_t entry_count, entry_capacity;
+  uint64_t *keys;
+  size_t key_count, key_capacity;
+  uint64_t *models;
+  size_t model_count, model_capacity;
+  // symbol -> stamp of the group it was last seen in
+  u64_map marks;
+  uint64_t stamp;
+  // Scratch
+  uint64_t *constraints, *group, *guard;
+  size_t constraint_capacity, group_capacity, guard_capacity;
+  _Bool *taken;
+  size_t taken_capacity;
+  // (symbol, value) pairs of the last SMT_SAT
+  uint64_t *last;
+  size_t last_length, last_capacity;
+  smt_cache_stats stats;
+};
+
+static _Bool smt_cache__grow(void **items, size_t *capacity, size_t needed,
+                             size_t size) {
+  if (needed <= *capacity)
+    return 1;
+  size_t grown = *capacity ? *capacity : 16;
+  while (grown < needed)
+    grown *= 2;
+  void *resized = realloc(*items, size * grown);
+  if (!resized)
+    return 0;
+  *items = resized;
+  *capacity = grown;
+  return 1;
+}
+
+static int smt_cache__compare(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Sorts and drops duplicates, returns the new count
+static size_t smt_cache__canonical(uint64_t *ids, size_t count) {
+  qsort(ids, count, sizeof(uint64_t), smt_cache__compare);
+  size_t unique = 0;
+  for (size_t i = 0; i < count; i++)
+    if (!unique || ids[unique - 1] != ids[i])
+      ids[unique++] = ids[i];
+  return unique;
+}
+
+// Offset in c->vars of the symbols expr mentions, SIZE_MAX on failure
+static size_t smt_cache__symbols(smt_cache *c, uint64_t expr) {
+  uint64_t *known = u64_map_get(&c->symbols, expr);
+  if (known)
+    return *known;
+
+  const irep_store *ireps = c->bp->program->ireps;
+  size_t count = irep_sub_count(ireps, expr);
+  size_t total = 0;
+  _Bool symbol = irep_id(ireps, expr) == c->bp->names.symbol;
+  if (symbol)
+    total = 1;
+  for (size_t i = 0; i < count; i++) {
+    size_t sub = smt_cache__symbols(c, irep_sub(ireps, expr, i));
+    if (sub == SMT_CACHE__NONE)
+      return SMT_CACHE__NONE;
+    total += c->vars[sub];
+  }
+
+  // Operands are done, so appending here moves nothing they need
+  size_t at = c->var_count;
+  if (!smt_cache__grow((void **)&c->vars, &c->var_capacity, at + 1 + total,
+                       sizeof(uint64_t)))
+    return SMT_CACHE__NONE;
+  size_t n = 0;
+  if (symbol)
+    c->vars[at + 1 + n++] = expr;
+  for (size_t i = 0; i < count; i++) {
+    size_t sub = *u64_map_get(&c->symbols, irep_sub(ireps, expr, i));
+    memcpy(&c->vars[at + 1 + n], &c->vars[sub + 1],
+           sizeof(uint64_t) * c->vars[sub]);
+    n += c->vars[sub];
+  }
+  n = smt_cache__canonical(&c->vars[at + 1], n);
+  c->vars[at] = n;
+  c->var_count = at + 1 + n;
+  if (!u64_map_put(&c->symbols, expr, at))
+    return SMT_CACHE__NONE;
+  return at;
+}
+
+// Do the symbols at vars meet the group, and if they do (or force) mark them
+// as the group's too
+static _Bool smt_cache__join(smt_cache *c, size_t vars, _Bool force) {
+  const uint64_t *symbols = &c->vars[vars + 1];
+  size_t count = c->vars[vars];
+  _Bool shares = force;
+  for (size_t i = 0; !shares && i < count; i++) {
+    uint64_t *mark = u64_map_get(&c->marks, symbols[i]);
+    shares = mark && *mark == c->stamp;
+  }
+  for (size_t i = 0; shares && i < count; i++)
+    if (!u64_map_put(&c->marks, symbols[i], c->stamp))
+      return 0;
+  return shares;
+}
+
+// Takes into the group every constraint connected to it, returns its size
+static size_t smt_cache__close(smt_cache *c, const size_t *vars, size_t count,
+                               size_t length) {
+  for (_Bool changed = 1; changed;) {
+    changed = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (c->taken[i] || !smt_cache__join(c, vars[i], 0))
+        continue;
+      c->taken[i] = 1;
+      c->group[length++] = c->constraints[i];
+      changed = 1;
+    }
+  }
+  return length;
+}
+
+static uint64_t smt_cache__hash(const uint64_t *ids, size_t count) {
+  uint64_t h = 0xcbf29ce484222325;
+  for (size_t i = 0; i < count; i++) {
+    h ^= ids[i];
+    h *= 0x100000001b3;
+    h ^= h >> 29;
+  }
+  return h == U64_MAP_EMPTY ? 0 : h;
+}
+
+static smt_cache__entry *smt_cache__find(smt_cache *c, uint64_t hash,
+                                         const uint64_t *ids, size_t count) {
+  uint64_t *first = u64_map_get(&c->table, hash);
+  for (size_t e = first ? *first : SMT_CACHE__NONE; e != SMT_CACHE__NONE;
+       e = c->entries[e].next) {
+    smt_cache__entry *entry = &c->entries[e];
+    if (entry->key_length == count &&
+        !memcmp(&c->keys[entry->key], ids, sizeof(uint64_t) * count))
+      return entry;
+  }
+  return NULL;
+}
+
+static _Bool smt_cache__model_add(smt_cache *c, const uint64_t *pairs,
+                                  size_t count) {
+  if (!smt_cache__grow((void **)&c->last, &c->last_capacity,
+                       2 * (c->last_length + count), sizeof(uint64_t)))
+    return 0;
+  memcpy(&c->last[2 * c->last_length], pairs, sizeof(uint64_t) * 2 * count);
+  c->last_length += count;
+  return 1;
+}
+
+// Asks the solver about a canonical group and remembers what it said
+static smt_result smt_cache__solve(smt_cache *c, smt_solver *s, uint64_t hash,
+                                   const uint64_t *ids, size_t count) {
+  smt_solver_pop(s, 0);
+  smt_result r = smt_solver_check(s, ids, count);
+  if (r == SMT_UNKNOWN && c->portfolio) {
+    c->stats.escalated++;
+    r = smt_portfolio_check(c->portfolio, s, ids, count);
+    // It is satisfiable, a model takes the solver as long as it needs
+    if (r == SMT_SAT) {
+      uint64_t budget = smt_solver_timeout(s, 0);
+      r = smt_solver_check(s, ids, count);
+      smt_solver_timeout(s, budget);
+    }
+  }
+  if (r != SMT_SAT && r != SMT_UNSAT)
+    return r;
+
+  // The model is over every symbol of the group
+  size_t model = c->model_count, length = 0;
+  for (size_t i = 0; r == SMT_SAT && i < count; i++) {
+    size_t vars = *u64_map_get(&c->symbols, ids[i]);
+    for (size_t j = 0; j < c->vars[vars]; j++) {
+      uint64_t symbol = c->vars[vars + 1 + j], value;
+      _Bool seen = 0;
+      for (size_t k = 0; !seen && k < length; k++)
+        seen = c->models[2 * (model + k)] == symbol;
+      if (seen)
+        continue;
+      if (!smt_solver_value(s, symbol, &value) ||
+          !smt_cache__grow((void **)&c->models, &c->model_capacity,
+                           2 * (model + length + 1), sizeof(uint64_t)))
+        return SMT_ERROR;
+      c->models[2 * (model + length)] = symbol;
+      c->models[2 * (model + length) + 1] = value;
+      length++;
+    }
+  }
+
+  uint64_t *first = u64_map_get(&c->table, hash);
+  size_t next = first ? *first : SMT_CACHE__NONE;
+  if (!smt_cache__grow((void **)&c->entries, &c->entry_capacity,
+                       c->entry_count + 1, sizeof(smt_cache__entry)) ||
+      !smt_cache__grow((void **)&c->keys, &c->key_capacity,
+                       c->key_count + count, sizeof(uint64_t)) ||
+      !u64_map_put(&c->table, hash, c->entry_count))
+    return SMT_ERROR;
+  memcpy(&c->keys[c->key_count], ids, sizeof(uint64_t) * count);
+  c->entries[c->entry_count++] = (smt_cache__entry){
+      .hash = hash,
+      .key = c->key_count,
+      .key_length = count,
+      .model = model,
+      .model_length = length,
+      .result = r,
+      .next = next,
+  };
+  c->key_count += count;
+  c->model_count += length;
+  if (r == SMT_SAT && !smt_cache__model_add(c, &c->models[2 * model], length))
+    return SMT_ERROR;
+  return r;
+}
+
+static smt_result smt_cache__group(smt_cache *c, smt_solver *s,
+                                   size_t length) {
+  length = smt_cache__canonical(c->group, length);
+  uint64_t hash = smt_cache__hash(c->group, length);
+  c->stats.groups++;
+  smt_cache__entry *entry = smt_cache__find(c, hash, c->group, length);
+  if (!entry)
+    return smt_cache__solve(c, s, hash, c->group, length);
+  c->stats.hits++;
+  stats_count(STATS_CACHE_HITS, 1);
+  if (entry->result == SMT_SAT &&
+      !smt_cache__model_add(c, &c->models[2 * entry->model],
+                            entry->model_length))
+    return SMT_ERROR;
+  return entry->result;
+}
+
+smt_result smt_cache_check(smt_cache *c, smt_solver *s,
+                           const uint64_t *constraints, size_t count,
+                           uint64_t query) {
+  c->stats.queries++;
+  c->last_length = 0;
+  size_t needed = count + 1;
+  size_t *vars = (size_t *)malloc(sizeof(size_t) * needed);
+  if (!vars ||
+      !smt_cache__grow((void **)&c->constraints, &c->constraint_capacity,
+                       needed, sizeof(uint64_t)) ||
+      !smt_cache__grow((void **)&c->group, &c->group_capacity, needed,
+                       sizeof(uint64_t)) ||
+      !smt_cache__grow((void **)&c->taken, &c->taken_capacity, needed,
+                       sizeof(_Bool))) {
+    free(vars);
+    return SMT_ERROR;
+  }
+  memcpy(c->constraints, constraints, sizeof(uint64_t) * count);
+  smt_result r = SMT_SAT;
+  if (c->simplifier) {
+    // Constants are decided here, true ones drop out and a false one is the
+    // answer
+    size_t kept = 0;
+    uint64_t v;
+    for (size_t i = 0; r == SMT_SAT && i < count; i++) {
+      uint64_t simple = simplifier_rewrite(c->simplifier, c->constraints[i]);
+      if (simple == IREP_NIL)
+        r = SMT_ERROR;
+      else if (!simplifier_constant(c->simplifier, simple, &v))
+        c->constraints[kept++] = simple;
+      else if (!v)
+        r = SMT_UNSAT;
+    }
+    count = kept;
+    if (r == SMT_SAT && query != IREP_NIL) {
+      query = simplifier_rewrite(c->simplifier, query);
+      if (query == IREP_NIL)
+        r = SMT_ERROR;
+      else if (simplifier_constant(c->simplifier, query, &v)) {
+        free(vars);
+        return v ? SMT_SAT : SMT_UNSAT;
+      }
+    }
+  }
+  count = smt_cache__canonical(c->constraints, count);
+  memset(c->taken, 0, sizeof(_Bool) * count);
+  for (size_t i = 0; i < count; i++)
+    if ((vars[i] = smt_cache__symbols(c, c->constraints[i])) ==
+        SMT_CACHE__NONE)
+      r = SMT_ERROR;
+
+  if (r == SMT_SAT && query != IREP_NIL) {
+    size_t query_vars = smt_cache__symbols(c, query);
+    c->stamp++;
+    if (query_vars == SMT_CACHE__NONE || !smt_cache__join(c, query_vars, 1)) {
+      r = SMT_ERROR;
+    } else {
+      c->group[0] = query;
+      size_t length = smt_cache__close(c, vars, count, 1);
+      c->stats.sliced += count - (length - 1);
+      r = smt_cache__group(c, s, length);
+    }
+  }
+  for (size_t i = 0; r == SMT_SAT && query == IREP_NIL && i < count; i++) {
+    if (c->taken[i])
+      continue;
+    c->stamp++;
+    c->taken[i] = 1;
+    c->group[0] = c->constraints[i];
+    if (!smt_cache__join(c, vars[i], 1))
+      r = SMT_ERROR;
+    else
+      r = smt_cache__group(c, s, smt_cache__close(c, vars, count, 1));
+  }
+  free(vars);
+  if (r != SMT_SAT)
+    c->last_length = 0;
+  return r;
+}
+
+smt_result smt_cache_check_state(smt_cache *c, smt_solver *s,
+                                 const symex_state *state, uint64_t query) {
+  size_t length = state->guard_length;
+  if (!smt_cache__grow((void **)&c->guard, &c->guard_capacity,
+                       length ? length : 1, sizeof(uint64_t)))
+    return SMT_ERROR;
+  symex_state_guard(state, c->guard, length);
+  return smt_cache_check(c, s, c->guard, length, query);
+}
+
+_Bool smt_cache_value(const smt_cache *c, uint64_t symbol, uint64_t *value) {
+  for (size_t i = 0; i < c->last_length; i++) {
+    if (c->last[2 * i] == symbol) {
+      *value = c->last[2 * i + 1];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+smt_cache_stats smt_cache_statistics(const smt_cache *c) { return c->stats; }
+
+void smt_cache_simplify(smt_cache *c, simplifier *s) { c->simplifier = s; }
+
+void smt_cache_escalate(smt_cache *c, smt_portfolio *p) { c->portfolio = p; }
+
+smt_cache *smt_cache_create(const bytecode_program *bp) {
+  smt_cache *c = (smt_cache *)calloc(1, sizeof(*c));
+  if (!c)
+    return NULL;
+  c->bp = bp;
+  if (!u64_map_init(&c->symbols, 0) || !u64_map_init(&c->table, 0) ||
+      !u64_map_init(&c->marks, 0)) {
+    smt_cache_destroy(c);
+    return NULL;
+  }
+  return c;
+}
+
+void smt_cache_destroy(smt_cache *c) {
+  u64_map_free(&c->symbols);
+  u64_map_free(&c->table);
+  u64_map_free(&c->marks);
+  free(c->vars);
+  free(c->entries);
+  free(c->keys);
+  free(c->models);
+  free(c->constraints);
+  free(c->group);
+  free(c->guard);
+  free(c->taken);
+  free(c->last);
+  free(c);
+}
+
+uint64_t smt_cache_tests() {
+  uint64_t errors = 0;
+
+  printf("SMT cache suite...\n");
+
+  smt__t_exprs e;
+  goto_program *p = bytecode__t_program(&e.t);
+  e.bp = bytecode_program_create(p);
+  e.int32 = bytecode__t_type(&e.t, "signedbv", "32");
+  e.boolean = bytecode__t_node(&e.t, "bool", IREP_NIL, NULL, 0);
+  e.x = bytecode__t_symbol(&e.t, "x", e.int32);
+  e.y = bytecode__t_symbol(&e.t, "y", e.int32);
+  uint64_t z = bytecode__t_symbol(&e.t, "z", e.int32);
+
+  smt_solver *s = e.bp ? smt_solver_create(e.bp, SMT_INCREMENTAL) : NULL;
+  smt_cache *c = e.bp ? smt_cache_create(e.bp) : NULL;
+
+  {
+    printf("- Queries see the constraints they depend on... ");
+    _Bool ok = s && c;
+    uint64_t x_gt_5 = smt__t_cmp(&e, ">", e.x, smt__t_int(&e, 5));
+    uint64_t y_lt_0 = smt__t_cmp(&e, "<", e.y, smt__t_int(&e, 0));
+    uint64_t x_lt_7 = smt__t_cmp(&e, "<", e.x, smt__t_int(&e, 7));
+    uint64_t path[] = {x_gt_5, y_lt_0};
+    uint64_t v;
+    ok &= ok && smt_cache_check(c, s, path, 2, x_lt_7) == SMT_SAT;
+    ok &= ok && smt_cache_value(c, e.x, &v) && v == 6 &&
+          !smt_cache_value(c, e.y, &v);
+    smt_cache_stats st = ok ? smt_cache_statistics(c) : (smt_cache_stats){0};
+    ok &= st.queries == 1 && st.groups == 1 && st.hits == 0 && st.sliced == 1;
+
+    // Every group of the path on its own
+    ok &= ok && smt_cache_check(c, s, path, 2, IREP_NIL) == SMT_SAT;
+    ok &= ok && smt_cache_value(c, e.x, &v) && (int64_t)v > 5 &&
+          smt_cache_value(c, e.y, &v) && (int64_t)v < 0;
+    st = ok ? smt_cache_statistics(c) : (smt_cache_stats){0};
+    ok &= st.groups == 3 && st.hits == 0;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Equal groups are solved once... ");
+    _Bool ok = s && c;
+    uint64_t x_gt_5 = smt__t_cmp(&e, ">", e.x, smt__t_int(&e, 5));
+    uint64_t x_lt_7 = smt__t_cmp(&e, "<", e.x, smt__t_int(&e, 7));
+    uint64_t x_lt_3 = smt__t_cmp(&e, "<", e.x, smt__t_int(&e, 3));
+    uint64_t z_eq_3 = smt__t_cmp(&e, "=", z, smt__t_int(&e, 3));
+    uint64_t x_gt_y = smt__t_cmp(&e, ">", e.x, e.y);
+    uint64_t y_gt_5 = smt__t_cmp(&e, ">", e.y, smt__t_int(&e, 5));
+    smt_cache_stats before = ok ? smt_cache_statistics(c) : (smt_cache_stats){0};
+
+    // Another path, but the same about x, in another order and repeated
+    uint64_t path[] = {z_eq_3, x_gt_5, z_eq_3};
+    uint64_t v;
+    ok &= ok && smt_cache_check(c, s, path, 3, x_lt_7) == SMT_SAT;
+    ok &= ok && smt_cache_value(c, e.x, &v) && v == 6;
+    ok &= ok && smt_cache_check(c, s, path, 3, x_lt_3) == SMT_UNSAT;
+    ok &= ok && !smt_cache_value(c, e.x, &v);
+    ok &= ok && smt_cache_check(c, s, &x_gt_5, 1, x_lt_3) == SMT_UNSAT;
+    smt_cache_stats st = ok ? smt_cache_statistics(c) : (smt_cache_stats){0};
+    ok &= st.groups - before.groups == 3 && st.hits - before.hits == 2;
+
+    // x < 3 reaches y > 5 through x > y
+    uint64_t chain[] = {y_gt_5, z_eq_3, x_gt_y};
+    ok &= ok && smt_cache_check(c, s, chain, 3, x_lt_3) == SMT_UNSAT;
+    ok &= ok && smt_cache_check(c, s, chain, 3, x_lt_7) == SMT_UNSAT;
+    st = ok ? smt_cache_statistics(c) : (smt_cache_stats){0};
+    ok &= st.sliced - before.sliced == 1 + 1 + 0 + 1 + 1;
+
+    // The path of a state
+    symex_state *state = symex_state_create(0);
+    ok &= state && symex_state_assume(state, z_eq_3) &&
+          symex_state_assume(state, x_gt_5);
+    ok &= ok && smt_cache_check_state(c, s, state, x_lt_7) == SMT_SAT;
+    ok &= ok && smt_cache_statistics(c).hits - st.hits == 1;
+    if (state)
+      symex_state_destroy(state);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Simplified queries... ");
+    simplifier *simple = e.bp ? simplifier_create(e.bp) : NULL;
+    _Bool ok = s && c && simple;
+    uint64_t x_gt_5 = smt__t_cmp(&e, ">", e.x, smt__t_int(&e, 5));
+    uint64_t yes = smt__t_cmp(&e, "<", smt__t_int(&e, 1), smt__t_int(&e, 2));
+    uint64_t no = smt__t_cmp(&e, "<", smt__t_int(&e, 2), smt__t_int(&e, 1));
+    // x + 0 < 7 is x < 7, asked before
+    uint64_t x_lt_7 = smt__t_cmp(
+        &e, "<",
+        bytecode__t_binary(&e.t, "+", e.int32, e.x, smt__t_int(&e, 0)),
+        smt__t_int(&e, 7));
+    uint64_t path[] = {x_gt_5, yes};
+    smt_cache_stats before = ok ? smt_cache_statistics(c) : (smt_cache_stats){0};
+    if (ok)
+      smt_cache_simplify(c, simple);
+    ok &= ok && smt_cache_check(c, s, path, 2, x_lt_7) == SMT_SAT;
+    ok &= ok && smt_cache_check(c, s, path, 2, no) == SMT_UNSAT;
+    uint64_t unsat[] = {x_gt_5, no};
+    ok &= ok && smt_cache_check(c, s, unsat, 2, IREP_NIL) == SMT_UNSAT;
+    smt_cache_stats st = ok ? smt_cache_statistics(c) : (smt_cache_stats){0};
+    ok &= st.groups - before.groups == 1 && st.hits - before.hits == 1 &&
+          st.sliced == before.sliced;
+    if (c)
+      smt_cache_simplify(c, NULL);
+    if (simple)
+      simplifier_destroy(simple);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Open groups go to the portfolio... ");
+    // Stands in for a solver that is faster at factoring
+    static const char *const decides[] = {"sh", "-c", "echo unsat", "sh",
+                                          NULL};
+    smt_portfolio *portfolio = smt_portfolio_create(NULL);
+    _Bool ok = s && c && portfolio;
+    ok &= ok && smt_portfolio_add(portfolio, "decides", decides);
+    uint64_t word = bytecode__t_type(&e.t, "unsignedbv", "64");
+    uint64_t a = bytecode__t_symbol(&e.t, "a", word);
+    uint64_t b = bytecode__t_symbol(&e.t, "b", word);
+    uint64_t one = bytecode__t_constant(&e.t, "0000000000000001", word);
+    uint64_t most = bytecode__t_constant(&e.t, "00000000FFFFFFFF", word);
+    // The product of two primes just under 2^32
+    uint64_t n = bytecode__t_constant(&e.t, "FFFFFFEA00000055", word);
+    uint64_t factors[] = {
+        smt__t_cmp(&e, ">", a, one),
+        smt__t_cmp(&e, ">", b, one),
+        smt__t_cmp(&e, "<=", a, most),
+        smt__t_cmp(&e, "<=", b, most),
+    };
+    uint64_t product = smt__t_cmp(
+        &e, "=", bytecode__t_binary(&e.t, "*", word, a, b), n);
+    smt_cache_stats before = ok ? smt_cache_statistics(c) : (smt_cache_stats){0};
+    if (ok) {
+      smt_cache_escalate(c, portfolio);
+      smt_solver_timeout(s, 1);
+    }
+    ok &= ok && smt_cache_check(c, s, factors, 4, product) == SMT_UNSAT;
+    // Decided, so not asked again
+    ok &= ok && smt_cache_check(c, s, factors, 4, product) == SMT_UNSAT;
+    smt_cache_stats st = ok ? smt_cache_statistics(c) : (smt_cache_stats){0};
+    ok &= st.escalated - before.escalated == 1 &&
+          st.hits - before.hits == 1 &&
+          smt_portfolio_statistics(portfolio).queries == 1;
+    if (c)
+      smt_cache_escalate(c, NULL);
+    if (s)
+      smt_solver_timeout(s, 0);
+    if (portfolio)
+      smt_portfolio_destroy(portfolio);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  if (c)
+    smt_cache_destroy(c);
+  if (s)
+    smt_solver_destroy(s);
+  if (e.bp)
+    bytecode_program_destroy(e.bp);
+  goto_program_destroy(p);
+  irep_store_destroy(e.t.ireps);
+  interner_destroy(e.t.strings);
+  return errors;
+}
+
+#endif
+#endif
@@ -0,0 +1,472 @@
+#ifndef SMT_PORTFOLIO_H
+#define SMT_PORTFOLIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "smt.h"
+
+// Races several solvers on one query, for the hard ones where which solver
+// is fast varies the most. Backends are commands (z3, bitwuzla, cvc5...)
+// reading the query as an SMT-LIB 2 script, started with posix_spawnp so
+// that nothing is logged per launch. The first sat or unsat wins and the
+// rest are killed.
+//
+// Wins are counted per query shape, the operators the script uses and its
+// size. When fewer backends race than are configured, the ones that won
+// that shape most go first, and the others only get a turn when those had
+// no answer.
+
+#define SMT_PORTFOLIO_BACKENDS 8
+
+typedef struct {
+  size_t parallel;       // backends racing at once, 0 for all
+  uint64_t timeout_ms;   // of a whole check, 0 for none
+  const char *directory; // of the scripts, $TMPDIR or /tmp when NULL
+} smt_portfolio_options;
+
+typedef struct {
+  uint64_t queries;
+  uint64_t launched;
+  uint64_t cancelled; // killed after another one won
+  uint64_t timeouts;  // checks nobody decided in time, every backend killed
+} smt_portfolio_stats;
+
+typedef struct smt_portfolio smt_portfolio;
+
+smt_portfolio *smt_portfolio_create(const smt_portfolio_options *options);
+void smt_portfolio_destroy(smt_portfolio *p);
+// argv is the command, NULL terminated, the path of the script is appended
+// to it. Both must outlive p. 0 when there are SMT_PORTFOLIO_BACKENDS.
+_Bool smt_portfolio_add(smt_portfolio *p, const char *name,
+                        const char *const *argv);
+// Held by the caller of smt_portfolio_check, which lets go of it while the
+// backends race, as smt_solver_share. NULL for none (the default).
+void smt_portfolio_share(smt_portfolio *p, pthread_mutex_t *lock);
+
+// Decides what smt_solver_check(s, assumptions, count) would. There is no
+// model, s can be asked for one once it is known to be SMT_SAT.
+smt_result smt_portfolio_check(smt_portfolio *p, smt_solver *s,
+                               const uint64_t *assumptions, size_t count);
+// The same on a script
+smt_result smt_portfolio_run(smt_portfolio *p, const char *script);
+// Name of the backend that decided the last check, NULL if none did
+const char *smt_portfolio_winner(const smt_portfolio *p);
+// Checks backend i (in the order they were added) won so far
+uint64_t smt_portfolio_wins(const smt_portfolio *p, size_t i);
+smt_portfolio_stats smt_portfolio_statistics(const smt_portfolio *p);
+
+uint64_t smt_portfolio_tests();
+#ifdef SMT_PORTFOLIO_IMPL
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "u64_map.h"
+
+typedef struct {
+  const char *name;
+  const char *const *argv;
+  uint64_t wins;
+} smt_portfolio__backend;
+
+struct smt_portfolio {
+  smt_portfolio_options options;
+  smt_portfolio__backend backends[SMT_PORTFOLIO_BACKENDS];
+  size_t backend_count;
+  // shape -> row of wins, one per backend
+  u64_map shapes;
+  uint64_t (*rows)[SMT_PORTFOLIO_BACKENDS];
+  size_t row_count, row_capacity;
+  const char *winner;
+  smt_portfolio_stats stats;
+  pthread_mutex_t *lock;
+};
+
+smt_portfolio *smt_portfolio_create(const smt_portfolio_options *options) {
+  smt_portfolio *p = (smt_portfolio *)calloc(1, sizeof(*p));
+  if (!p)
+    return NULL;
+  if (options)
+    p->options = *options;
+  if (!p->options.directory)
+    p->options.directory = getenv("TMPDIR");
+  if (!p->options.directory)
+    p->options.directory = "/tmp";
+  if (!u64_map_init(&p->shapes, 0)) {
+    free(p);
+    return NULL;
+  }
+  return p;
+}
+
+void smt_portfolio_destroy(smt_portfolio *p) {
+  u64_map_free(&p->shapes);
+  free(p->rows);
+  free(p);
+}
+
+_Bool smt_portfolio_add(smt_portfolio *p, const char *name,
+                        const char *const *argv) {
+  if (p->backend_count == SMT_PORTFOLIO_BACKENDS) {
+    fprintf(stderr, "smt portfolio: more than %d backends\n",
+            SMT_PORTFOLIO_BACKENDS);
+    return 0;
+  }
+  p->backends[p->backend_count++] = (smt_portfolio__backend){name, argv, 0};
+  return 1;
+}
+
+void smt_portfolio_share(smt_portfolio *p, pthread_mutex_t *lock) {
+  p->lock = lock;
+}
+
+// Which operators the script applies, hashed into a mask, and the order of
+// magnitude of its length
+static uint64_t smt_portfolio__shape(const char *script) {
+  uint64_t mask = 0;
+  size_t length = 0;
+  for (const char *c = script; *c; c++, length++) {
+    if (*c != '(')
+      continue;
+    uint64_t h = 0xcbf29ce484222325;
+    const char *op = c + 1;
+    while (*op && *op != ' ' && *op != '(' && *op != ')' && *op != '\n')
+      h = (h ^ (unsigned char)*op++) * 0x100000001b3;
+    if (op > c + 1)
+      mask |= UINT64_C(1) << (h % 56);
+  }
+  uint64_t magnitude = 0;
+  while (length >>= 1)
+    magnitude++;
+  return mask | magnitude << 56;
+}
+
+static uint64_t *smt_portfolio__row(smt_portfolio *p, uint64_t shape) {
+  uint64_t *known = u64_map_get(&p->shapes, shape);
+  if (known)
+    return p->rows[*known];
+  if (p->row_count == p->row_capacity) {
+    size_t capacity = p->row_capacity ? 2 * p->row_capacity : 16;
+    void *rows = realloc(p->rows, sizeof(*p->rows) * capacity);
+    if (!rows)
+      return NULL;
+    p->rows = (uint64_t(*)[SMT_PORTFOLIO_BACKENDS])rows;
+    p->row_capacity = capacity;
+  }
+  if (!u64_map_put(&p->shapes, shape, p->row_count))
+    return NULL;
+  memset(p->rows[p->row_count], 0, sizeof(*p->rows));
+  return p->rows[p->row_count++];
+}
+
+// First word of what the backend printed
+static smt_result smt_portfolio__answer(const char *path) {
+  char line[16] = {0};
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return SMT_ERROR;
+  size_t n = fread(line, 1, sizeof(line) - 1, f);
+  fclose(f);
+  line[n] = 0;
+  size_t word = strcspn(line, " \t\r\n");
+  if (word == 5 && !strncmp(line, "unsat", 5))
+    return SMT_UNSAT;
+  if (word == 3 && !strncmp(line, "sat", 3))
+    return SMT_SAT;
+  return SMT_UNKNOWN;
+}
+
+typedef struct {
+  pid_t proc;
+  size_t backend;
+  _Bool running;
+} smt_portfolio__race;
+
+extern char **environ;
+
+// Starts the backend on script with its output going to output
+static _Bool smt_portfolio__launch(smt_portfolio *p, size_t backend,
+                                   const char *script, const char *output,
+                                   pid_t *proc) {
+  Nob_Cmd cmd = {0};
+  for (const char *const *arg = p->backends[backend].argv; *arg; arg++)
+    nob_cmd_append(&cmd, *arg);
+  nob_cmd_append(&cmd, script, NULL);
+  posix_spawn_file_actions_t actions;
+  int error = posix_spawn_file_actions_init(&actions);
+  if (!error) {
+    error = posix_spawn_file_actions_addopen(
+        &actions, STDOUT_FILENO, output, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (!error)
+      error = posix_spawnp(proc, cmd.items[0], &actions, NULL,
+                           (char *const *)cmd.items, environ);
+    posix_spawn_file_actions_destroy(&actions);
+  }
+  if (error)
+    fprintf(stderr, "smt portfolio: could not start %s: %s\n",
+            p->backends[backend].name, strerror(error));
+  nob_cmd_free(cmd);
+  p->stats.launched += !error;
+  return !error;
+}
+
+static void smt_portfolio__cancel(smt_portfolio__race *race) {
+  kill(race->proc, SIGKILL);
+  while (waitpid(race->proc, NULL, 0) < 0 && errno == EINTR)
+    ;
+  race->running = 0;
+}
+
+static smt_result smt_portfolio__run(smt_portfolio *p, const char *script) {
+  p->winner = NULL;
+  p->stats.queries++;
+  size_t count = p->backend_count;
+  if (!count)
+    return SMT_UNKNOWN;
+
+  // Best first: wins on this shape, then overall, then as added
+  uint64_t *row = smt_portfolio__row(p, smt_portfolio__shape(script));
+  if (!row)
+    return SMT_ERROR;
+  size_t order[SMT_PORTFOLIO_BACKENDS];
+  for (size_t i = 0; i < count; i++) {
+    size_t j = i;
+    for (; j > 0; j--) {
+      size_t o = order[j - 1];
+      if (row[o] > row[i] ||
+          (row[o] == row[i] && p->backends[o].wins >= p->backends[i].wins))
+        break;
+      order[j] = o;
+    }
+    order[j] = i;
+  }
+
+  char path[4096];
+  int length = snprintf(path, sizeof(path), "%s/farol-XXXXXX.smt2",
+                        p->options.directory);
+  if (length < 0 || (size_t)length + 16 > sizeof(path))
+    return SMT_ERROR;
+  int fd = mkstemps(path, 5);
+  if (fd < 0) {
+    fprintf(stderr, "smt portfolio: could not create %s: %s\n", path,
+            strerror(errno));
+    return SMT_ERROR;
+  }
+  size_t size = strlen(script);
+  _Bool written = (size_t)write(fd, script, size) == size;
+  close(fd);
+  char outputs[SMT_PORTFOLIO_BACKENDS][4096 + 32];
+  for (size_t i = 0; i < count; i++)
+    snprintf(outputs[i], sizeof(outputs[i]), "%s.%zu", path, i);
+
+  size_t parallel = p->options.parallel ? p->options.parallel : count;
+  uint64_t start = nob_nanos_since_unspecified_epoch();
+  uint64_t timeout = p->options.timeout_ms * 1000 * 1000;
+  smt_portfolio__race races[SMT_PORTFOLIO_BACKENDS] = {0};
+  size_t launched = 0, running = 0;
+  smt_result r = written ? SMT_UNKNOWN : SMT_ERROR;
+  while (written && p->winner == NULL) {
+    // A new round when every racer gave up
+    while (running == 0 && launched < count) {
+      for (size_t n = 0; n < parallel && launched < count; n++, launched++) {
+        smt_portfolio__race *race = &races[launched];
+        race->backend = order[launched];
+        race->running = smt_portfolio__launch(
+            p, race->backend, path, outputs[race->backend], &race->proc);
+        running += race->running;
+      }
+    }
+    if (running == 0)
+      break;
+
+    for (size_t i = 0; i < launched && !p->winner; i++) {
+      smt_portfolio__race *race = &races[i];
+      if (!race->running || waitpid(race->proc, NULL, WNOHANG) != race->proc)
+        continue;
+      race->running = 0;
+      running--;
+      smt_result answer = smt_portfolio__answer(outputs[race->backend]);
+      if (answer == SMT_SAT || answer == SMT_UNSAT) {
+        r = answer;
+        p->winner = p->backends[race->backend].name;
+        p->backends[race->backend].wins++;
+        row[race->backend]++;
+      }
+    }
+    if (!p->winner && timeout &&
+        nob_nanos_since_unspecified_epoch() - start >= timeout) {
+      p->stats.timeouts++;
+      break;
+    }
+    if (!p->winner && running) {
+      struct timespec poll = {0, 1000 * 1000};
+      nanosleep(&poll, NULL);
+    }
+  }
+
+  for (size_t i = 0; i < launched; i++) {
+    if (races[i].running) {
+      smt_portfolio__cancel(&races[i]);
+      p->stats.cancelled += p->winner != NULL;
+    }
+    remove(outputs[races[i].backend]);
+  }
+  remove(path);
+  return r;
+}
+
+smt_result smt_portfolio_run(smt_portfolio *p, const char *script) {
+  smt_result r;
+  stats_count(STATS_SOLVER_CALLS, 1);
+  STATS_PHASE(STATS_SOLVE) r = smt_portfolio__run(p, script);
+  return r;
+}
+
+smt_result smt_portfolio_check(smt_portfolio *p, smt_solver *s,
+                               const uint64_t *assumptions, size_t count) {
+  char *script = smt_solver_script(s, assumptions, count);
+  if (!script)
+    return SMT_ERROR;
+  if (p->lock)
+    pthread_mutex_unlock(p->lock);
+  smt_result r = smt_portfolio_run(p, script);
+  if (p->lock)
+    pthread_mutex_lock(p->lock);
+  free(script);
+  return r;
+}
+
+const char *smt_portfolio_winner(const smt_portfolio *p) { return p->winner; }
+
+uint64_t smt_portfolio_wins(const smt_portfolio *p, size_t i) {
+  return i < p->backend_count ? p->backends[i].wins : 0;
+}
+
+smt_portfolio_stats smt_portfolio_statistics(const smt_portfolio *p) {
+  return p->stats;
+}
+
+uint64_t smt_portfolio_tests() {
+  uint64_t errors = 0;
+
+  printf("SMT portfolio suite...\n");
+
+  smt__t_exprs e;
+  goto_program *prog = bytecode__t_program(&e.t);
+  e.bp = bytecode_program_create(prog);
+  e.int32 = bytecode__t_type(&e.t, "signedbv", "32");
+  e.boolean = bytecode__t_node(&e.t, "bool", IREP_NIL, NULL, 0);
+  e.x = bytecode__t_symbol(&e.t, "x", e.int32);
+  smt_solver *s = e.bp ? smt_solver_create(e.bp, SMT_INCREMENTAL) : NULL;
+  uint64_t x_gt_5 = smt__t_cmp(&e, ">", e.x, smt__t_int(&e, 5));
+  uint64_t x_lt_3 = smt__t_cmp(&e, "<", e.x, smt__t_int(&e, 3));
+
+  // Stand ins for solvers: one that reads the script, one that never
+  // answers, one that gives up and one that takes a while
+  static const char *const reader[] = {
+      "sh", "-c",
+      "grep -q '(check-sat)' \"$1\" && grep -q bvslt \"$1\" && echo unsat",
+      "sh", NULL};
+  static const char *const hangs[] = {"sh", "-c", "exec sleep 30", "sh", NULL};
+  static const char *const gives_up[] = {"sh", "-c", "echo unknown", "sh",
+                                         NULL};
+  static const char *const slow[] = {"sh", "-c", "sleep 0.05; echo sat", "sh",
+                                     NULL};
+
+  {
+    printf("- The first answer wins... ");
+    smt_portfolio *p = smt_portfolio_create(NULL);
+    _Bool ok = s && p;
+    ok &= ok && smt_portfolio_add(p, "hangs", hangs) &&
+          smt_portfolio_add(p, "reader", reader);
+    ok &= ok && smt_solver_push(s, x_gt_5);
+    uint64_t start = nob_nanos_since_unspecified_epoch();
+    ok &= ok && smt_portfolio_check(p, s, &x_lt_3, 1) == SMT_UNSAT;
+    ok &= nob_nanos_since_unspecified_epoch() - start < 10ull * NOB_NANOS_PER_SEC;
+    ok &= ok && smt_portfolio_winner(p) &&
+          !strcmp(smt_portfolio_winner(p), "reader");
+    smt_portfolio_stats st = ok ? smt_portfolio_statistics(p)
+                                : (smt_portfolio_stats){0};
+    ok &= st.launched == 2 && st.cancelled == 1 && smt_portfolio_wins(p, 1) == 1;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+    if (p)
+      smt_portfolio_destroy(p);
+  }
+
+  {
+    printf("- Winners of a shape go first... ");
+    smt_portfolio_options options = {.parallel = 1};
+    smt_portfolio *p = smt_portfolio_create(&options);
+    _Bool ok = s && p;
+    ok &= ok && smt_portfolio_add(p, "gives up", gives_up) &&
+          smt_portfolio_add(p, "slow", slow);
+    const char *script = "(declare-fun x () Bool)\n(assert x)\n(check-sat)\n";
+    ok &= ok && smt_portfolio_run(p, script) == SMT_SAT;
+    ok &= ok && smt_portfolio_statistics(p).launched == 2;
+    ok &= ok && smt_portfolio_run(p, script) == SMT_SAT;
+    ok &= ok && smt_portfolio_statistics(p).launched == 3 &&
+          smt_portfolio_wins(p, 1) == 2;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+    if (p)
+      smt_portfolio_destroy(p);
+  }
+
+  {
+    printf("- Timeouts kill every backend... ");
+    smt_portfolio_options options = {.timeout_ms = 50};
+    smt_portfolio *p = smt_portfolio_create(&options);
+    _Bool ok = s && p;
+    ok &= ok && smt_portfolio_add(p, "hangs", hangs) &&
+          smt_portfolio_add(p, "also hangs", hangs);
+    ok &= ok && smt_portfolio_check(p, s, NULL, 0) == SMT_UNKNOWN;
+    smt_portfolio_stats st = ok ? smt_portfolio_statistics(p)
+                                : (smt_portfolio_stats){0};
+    // Both were killed, but not for losing
+    ok &= st.timeouts == 1 && st.launched == 2 && st.cancelled == 0 &&
+          !smt_portfolio_winner(p);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+    if (p)
+      smt_portfolio_destroy(p);
+  }
+
+  if (s)
+    smt_solver_destroy(s);
+  if (e.bp)
+    bytecode_program_destroy(e.bp);
+  goto_program_destroy(prog);
+  irep_store_destroy(e.t.ireps);
+  interner_destroy(e.t.strings);
+  return errors;
+}
+
+#endif
+#endif
@@ -0,0 +1,292 @@
+#ifndef SSA_EQUATION_H
+#define SSA_EQUATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bytecode.h"
+
+// The equation symex writes out: SSA steps, each an assignment, assumption
+// or assertion under a guard, in program order.
+//
+// Steps are stored struct of arrays, one dense array per field, every entry
+// an id: expressions and source locations are ireps, hash consed into the
+// program's store. A step costs 33 bytes and no allocation of its own, and
+// what goes over every step (encoding, slicing) reads only the columns it
+// needs, front to back. Equations of tens of millions of steps are the
+// expected size.
+
+typedef enum {
+  SSA_ASSIGNMENT, // lhs = rhs, lhs an SSA symbol
+  SSA_ASSUME,     // guard => rhs, lhs IREP_NIL
+  SSA_ASSERT,     // guard => rhs should hold, lhs IREP_NIL
+} ssa_step_kind;
+
+typedef struct {
+  uint8_t *kinds;
+  uint64_t *guards, *lhs, *rhs, *locations;
+  size_t length, capacity;
+} ssa_equation;
+
+_Bool ssa_equation_init(ssa_equation *eq, size_t expected);
+void ssa_equation_free(ssa_equation *eq);
+void ssa_equation_clear(ssa_equation *eq);
+// 0 on allocation failure, the equation is unchanged
+_Bool ssa_equation_append(ssa_equation *eq, ssa_step_kind kind, uint64_t guard,
+                          uint64_t lhs, uint64_t rhs, uint64_t location);
+
+// Drops the assignments no assumption or assertion depends on, through
+// rhs and guards, keeping the order of the rest. One backward pass, every
+// expression node is visited once. Returns the number of steps dropped,
+// SIZE_MAX (with the equation unchanged) on allocation failure.
+size_t ssa_equation_slice(ssa_equation *eq, const bytecode_program *bp);
+
+uint64_t ssa_equation_tests();
+#ifdef SSA_EQUATION_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "irep.h"
+#include "stats.h"
+#include "u64_map.h"
+
+static _Bool ssa__reserve(ssa_equation *eq, size_t needed) {
+  if (needed <= eq->capacity)
+    return 1;
+  size_t grown = eq->capacity ? eq->capacity : 64;
+  while (grown < needed)
+    grown *= 2;
+  // A column grown before a failure is only longer than it needs to be
+  uint8_t *kinds = (uint8_t *)realloc(eq->kinds, grown);
+  if (!kinds)
+    return 0;
+  eq->kinds = kinds;
+  uint64_t **columns[] = {&eq->guards, &eq->lhs, &eq->rhs, &eq->locations};
+  for (size_t i = 0; i < sizeof(columns) / sizeof(*columns); i++) {
+    uint64_t *column = (uint64_t *)realloc(*columns[i], sizeof(uint64_t) * grown);
+    if (!column)
+      return 0;
+    *columns[i] = column;
+  }
+  eq->capacity = grown;
+  return 1;
+}
+
+_Bool ssa_equation_init(ssa_equation *eq, size_t expected) {
+  memset(eq, 0, sizeof(*eq));
+  return ssa__reserve(eq, expected ? expected : 1);
+}
+
+void ssa_equation_free(ssa_equation *eq) {
+  free(eq->kinds);
+  free(eq->guards);
+  free(eq->lhs);
+  free(eq->rhs);
+  free(eq->locations);
+  memset(eq, 0, sizeof(*eq));
+}
+
+void ssa_equation_clear(ssa_equation *eq) { eq->length = 0; }
+
+_Bool ssa_equation_append(ssa_equation *eq, ssa_step_kind kind, uint64_t guard,
+                          uint64_t lhs, uint64_t rhs, uint64_t location) {
+  if (!ssa__reserve(eq, eq->length + 1))
+    return 0;
+  size_t i = eq->length++;
+  eq->kinds[i] = (uint8_t)kind;
+  eq->guards[i] = guard;
+  eq->lhs[i] = lhs;
+  eq->rhs[i] = rhs;
+  eq->locations[i] = location;
+  return 1;
+}
+
+typedef struct {
+  const bytecode_program *bp;
+  u64_map seen;     // expression nodes already walked
+  u64_map relevant; // symbols something kept reads
+  uint64_t *stack;
+  size_t stack_length, stack_capacity;
+} ssa__slicer;
+
+// A node seen once has had its symbols marked, which stay marked, so the
+// whole pass walks every node at most once
+static _Bool ssa__mark(ssa__slicer *sl, uint64_t expr) {
+  const irep_store *ireps = sl->bp->program->ireps;
+  sl->stack_length = 0;
+  if (expr == IREP_NIL)
+    return 1;
+  if (!goto__grow((void **)&sl->stack, &sl->stack_capacity, 1,
+                  sizeof(uint64_t), 0))
+    return 0;
+  sl->stack[sl->stack_length++] = expr;
+  while (sl->stack_length) {
+    uint64_t node = sl->stack[--sl->stack_length];
+    if (u64_map_get(&sl->seen, node))
+      continue;
+    if (!u64_map_put(&sl->seen, node, 1))
+      return 0;
+    if (irep_id(ireps, node) == sl->bp->names.symbol) {
+      if (!u64_map_put(&sl->relevant, node, 1))
+        return 0;
+      continue;
+    }
+    size_t count = irep_sub_count(ireps, node);
+    if (!goto__grow((void **)&sl->stack, &sl->stack_capacity,
+                    sl->stack_length + count, sizeof(uint64_t), 0))
+      return 0;
+    for (size_t i = 0; i < count; i++)
+      sl->stack[sl->stack_length++] = irep_sub(ireps, node, i);
+  }
+  return 1;
+}
+
+size_t ssa_equation_slice(ssa_equation *eq, const bytecode_program *bp) {
+  uint64_t begin = stats_begin();
+  ssa__slicer sl = {.bp = bp};
+  uint8_t *kept = (uint8_t *)malloc(eq->length ? eq->length : 1);
+  _Bool ok = kept && u64_map_init(&sl.seen, 0) && u64_map_init(&sl.relevant, 0);
+  for (size_t i = eq->length; ok && i-- > 0;) {
+    kept[i] = eq->kinds[i] != SSA_ASSIGNMENT ||
+              u64_map_get(&sl.relevant, eq->lhs[i]) != NULL;
+    if (kept[i])
+      ok = ssa__mark(&sl, eq->guards[i]) && ssa__mark(&sl, eq->rhs[i]);
+  }
+  size_t length = 0;
+  for (size_t i = 0; ok && i < eq->length; i++) {
+    if (!kept[i])
+      continue;
+    eq->kinds[length] = eq->kinds[i];
+    eq->guards[length] = eq->guards[i];
+    eq->lhs[length] = eq->lhs[i];
+    eq->rhs[length] = eq->rhs[i];
+    eq->locations[length] = eq->locations[i];
+    length++;
+  }
+  size_t dropped = ok ? eq->length - length : SIZE_MAX;
+  if (ok)
+    eq->length = length;
+  else
+    fprintf(stderr, "ssa equation: out of memory\n");
+  free(kept);
+  free(sl.stack);
+  u64_map_free(&sl.seen);
+  u64_map_free(&sl.relevant);
+  stats_end(STATS_SLICE, begin);
+  return dropped;
+}
+
+uint64_t ssa_equation_tests() {
+  uint64_t errors = 0;
+
+  printf("SSA equation suite...\n");
+
+  bytecode__test t;
+  goto_program *p = bytecode__t_program(&t);
+  bytecode_program *bp = bytecode_program_create(p);
+  uint64_t int32 = bytecode__t_type(&t, "signedbv", "32");
+  uint64_t boolean = bytecode__t_leaf(&t, "bool");
+  uint64_t yes = bytecode__t_constant(&t, "true", boolean);
+  uint64_t x = bytecode__t_symbol(&t, "x#1", int32);
+  uint64_t y = bytecode__t_symbol(&t, "y#1", int32);
+  uint64_t z = bytecode__t_symbol(&t, "z#1", int32);
+  uint64_t w = bytecode__t_symbol(&t, "w#1", int32);
+  uint64_t c = bytecode__t_symbol(&t, "c#0", boolean);
+
+  {
+    printf("- Slicing keeps what assertions read... ");
+    ssa_equation eq;
+    _Bool ok = bp && ssa_equation_init(&eq, 0);
+    // 0: x#1 = 5
+    // 1: z#1 = 7
+    // 2: y#1 = x#1 + 1
+    // 3: w#1 = z#1
+    // 4: assume c#0
+    // 5: c#0 => assert y#1 == 6
+    ok = ok &&
+         ssa_equation_append(&eq, SSA_ASSIGNMENT, yes, x,
+                             bytecode__t_constant(&t, "5", int32), 10) &&
+         ssa_equation_append(&eq, SSA_ASSIGNMENT, yes, z,
+                             bytecode__t_constant(&t, "7", int32), 11) &&
+         ssa_equation_append(
+             &eq, SSA_ASSIGNMENT, yes, y,
+             bytecode__t_binary(&t, "+", int32, x,
+                                bytecode__t_constant(&t, "1", int32)),
+             12) &&
+         ssa_equation_append(&eq, SSA_ASSIGNMENT, yes, w, z, 13) &&
+         ssa_equation_append(&eq, SSA_ASSUME, yes, IREP_NIL, c, 14) &&
+         ssa_equation_append(
+             &eq, SSA_ASSERT, c, IREP_NIL,
+             bytecode__t_binary(&t, "=", boolean, y,
+                                bytecode__t_constant(&t, "6", int32)),
+             15);
+    ok = ok && eq.length == 6 && ssa_equation_slice(&eq, bp) == 2;
+    ok = ok && eq.length == 4 && eq.lhs[0] == x && eq.lhs[1] == y &&
+         eq.kinds[2] == SSA_ASSUME && eq.kinds[3] == SSA_ASSERT &&
+         eq.guards[3] == c && eq.locations[0] == 10 && eq.locations[1] == 12 &&
+         eq.locations[3] == 15;
+    // Nothing left to drop
+    ok = ok && ssa_equation_slice(&eq, bp) == 0 && eq.length == 4;
+    ssa_equation_clear(&eq);
+    ok = ok && eq.length == 0 && ssa_equation_slice(&eq, bp) == 0;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+    if (bp)
+      ssa_equation_free(&eq);
+  }
+
+  {
+    printf("- Slicing a long chain... ");
+    // v#i = v#(i - 1) + 1, and an assertion on the middle of the chain
+    enum { STEPS = 100000 };
+    ssa_equation eq;
+    _Bool ok = bp && ssa_equation_init(&eq, STEPS);
+    uint64_t one = bytecode__t_constant(&t, "1", int32);
+    uint64_t previous = bytecode__t_constant(&t, "0", int32), middle = 0;
+    char name[32];
+    for (size_t i = 1; ok && i <= STEPS; i++) {
+      snprintf(name, sizeof(name), "v#%zu", i);
+      uint64_t v = bytecode__t_symbol(&t, name, int32);
+      ok = ssa_equation_append(&eq, SSA_ASSIGNMENT, yes, v,
+                               bytecode__t_binary(&t, "+", int32, previous, one),
+                               IREP_NIL);
+      if (i == STEPS / 2)
+        middle = v;
+      previous = v;
+    }
+    ok = ok && ssa_equation_append(&eq, SSA_ASSERT, yes, IREP_NIL,
+                                   bytecode__t_binary(&t, "<", boolean, middle,
+                                                      previous),
+                                   IREP_NIL);
+    ok = ok && ssa_equation_slice(&eq, bp) == 0;
+    // Without the last step the second half goes
+    eq.rhs[eq.length - 1] = bytecode__t_binary(&t, "<", boolean, one, middle);
+    ok = ok && ssa_equation_slice(&eq, bp) == STEPS / 2 &&
+         eq.length == STEPS / 2 + 1 && eq.lhs[STEPS / 2 - 1] == middle;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+    if (bp)
+      ssa_equation_free(&eq);
+  }
+
+  bytecode_program_destroy(bp);
+  goto_program_destroy(p);
+  irep_store_destroy(t.ireps);
+  interner_destroy(t.strings);
+  return errors;
+}
+
+#endif
+#endif
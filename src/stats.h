@@ -0,0 +1,264 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Process wide phase timers and event counters, cheap enough to stay
+// compiled in everywhere.
+//
+// Every thread adds to a slot of its own, claimed the first time it counts
+// anything, so counting is an uncontended relaxed add and never a shared
+// cache line. Readers sum the slots. A phase is timed with one monotonic
+// clock read at each end, around coarse units of work (a file, a function
+// body, a solver call), never per string or node: intern is the time spent
+// interning a file's symbol table and hash consing linked files into one
+// store, the lookups themselves are counted. Phases nest, a body decoded while slicing
+// counts in both parse and slice, and threads in the same phase add up.
+
+#define STATS_PHASES(X)                                                      \
+  X(PARSE, "parse") X(INTERN, "intern") X(LOWER, "lower") X(SLICE, "slice")  \
+  X(SYMEX, "symex") X(ENCODE, "encode") X(SOLVE, "solve")
+#define STATS_COUNTERS(X)                                                    \
+  X(INTERN_HITS, "intern_hits") X(INTERN_MISSES, "intern_misses")            \
+  X(STATES_FORKED, "states_forked") X(SOLVER_CALLS, "solver_calls")          \
+  X(CACHE_HITS, "cache_hits")
+
+typedef enum {
+#define STATS__ENUM(name, string) STATS_##name,
+  STATS_PHASES(STATS__ENUM)
+  STATS_PHASE_COUNT
+} stats_phase;
+
+typedef enum {
+  STATS_COUNTERS(STATS__ENUM)
+  STATS_COUNTER_COUNT
+#undef STATS__ENUM
+} stats_counter;
+
+// Threads past the last slot share it, still exactly
+#define STATS_SLOTS 64
+
+typedef struct {
+  _Alignas(64) _Atomic uint64_t counters[STATS_COUNTER_COUNT];
+  _Atomic uint64_t nanos[STATS_PHASE_COUNT];
+  _Atomic uint64_t entries[STATS_PHASE_COUNT];
+} stats__slot;
+
+extern stats__slot stats__slots[STATS_SLOTS];
+extern _Thread_local stats__slot *stats__mine;
+stats__slot *stats__claim(void);
+
+static inline stats__slot *stats__slot_of_thread(void) {
+  return stats__mine ? stats__mine : stats__claim();
+}
+
+static inline void stats_count(stats_counter counter, uint64_t n) {
+  atomic_fetch_add_explicit(&stats__slot_of_thread()->counters[counter], n,
+                            memory_order_relaxed);
+}
+
+static inline uint64_t stats_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Start of a phase, to hand to stats_end
+static inline uint64_t stats_begin(void) { return stats_now(); }
+
+static inline void stats_end(stats_phase phase, uint64_t begin) {
+  stats__slot *slot = stats__slot_of_thread();
+  atomic_fetch_add_explicit(&slot->nanos[phase], stats_now() - begin,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&slot->entries[phase], 1, memory_order_relaxed);
+}
+
+// Times the statement or block that follows, which must not leave it with
+// return, break or goto
+#define STATS_PHASE(phase)                                                   \
+  for (uint64_t stats__begin = stats_begin(), stats__once = 1; stats__once;  \
+       stats_end(phase, stats__begin), stats__once = 0)
+
+typedef struct {
+  uint64_t counters[STATS_COUNTER_COUNT];
+  uint64_t nanos[STATS_PHASE_COUNT];
+  uint64_t entries[STATS_PHASE_COUNT];
+} stats_snapshot;
+
+// Sums of every thread so far
+stats_snapshot stats_read(void);
+void stats_reset(void);
+// One JSON object, {"phases": {"parse": {"seconds": s, "entries": n}, ...},
+// "counters": {"intern_hits": n, ...}}, and a newline. 0 on a write error.
+_Bool stats_write_json(FILE *out);
+
+uint64_t stats_tests();
+#ifdef STATS_IMPL
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const stats__phase_names[] = {
+#define STATS__NAME(name, string) string,
+    STATS_PHASES(STATS__NAME)};
+static const char *const stats__counter_names[] = {
+    STATS_COUNTERS(STATS__NAME)
+#undef STATS__NAME
+};
+
+stats__slot stats__slots[STATS_SLOTS];
+_Thread_local stats__slot *stats__mine;
+static atomic_size_t stats__claimed;
+
+stats__slot *stats__claim(void) {
+  size_t i = atomic_fetch_add_explicit(&stats__claimed, 1, memory_order_relaxed);
+  stats__mine = &stats__slots[i < STATS_SLOTS ? i : STATS_SLOTS - 1];
+  return stats__mine;
+}
+
+stats_snapshot stats_read(void) {
+  stats_snapshot s;
+  memset(&s, 0, sizeof(s));
+  for (size_t i = 0; i < STATS_SLOTS; i++) {
+    stats__slot *slot = &stats__slots[i];
+    for (size_t c = 0; c < STATS_COUNTER_COUNT; c++)
+      s.counters[c] +=
+          atomic_load_explicit(&slot->counters[c], memory_order_relaxed);
+    for (size_t p = 0; p < STATS_PHASE_COUNT; p++) {
+      s.nanos[p] += atomic_load_explicit(&slot->nanos[p], memory_order_relaxed);
+      s.entries[p] +=
+          atomic_load_explicit(&slot->entries[p], memory_order_relaxed);
+    }
+  }
+  return s;
+}
+
+void stats_reset(void) {
+  for (size_t i = 0; i < STATS_SLOTS; i++) {
+    stats__slot *slot = &stats__slots[i];
+    for (size_t c = 0; c < STATS_COUNTER_COUNT; c++)
+      atomic_store_explicit(&slot->counters[c], 0, memory_order_relaxed);
+    for (size_t p = 0; p < STATS_PHASE_COUNT; p++) {
+      atomic_store_explicit(&slot->nanos[p], 0, memory_order_relaxed);
+      atomic_store_explicit(&slot->entries[p], 0, memory_order_relaxed);
+    }
+  }
+}
+
+_Bool stats_write_json(FILE *out) {
+  stats_snapshot s = stats_read();
+  int failed = fprintf(out, "{\"phases\": {") < 0;
+  for (size_t p = 0; p < STATS_PHASE_COUNT; p++)
+    failed |= fprintf(out, "%s\"%s\": {\"seconds\": %.9f, \"entries\": %llu}",
+                      p ? ", " : "", stats__phase_names[p], s.nanos[p] / 1e9,
+                      (unsigned long long)s.entries[p]) < 0;
+  failed |= fprintf(out, "}, \"counters\": {") < 0;
+  for (size_t c = 0; c < STATS_COUNTER_COUNT; c++)
+    failed |= fprintf(out, "%s\"%s\": %llu", c ? ", " : "",
+                      stats__counter_names[c],
+                      (unsigned long long)s.counters[c]) < 0;
+  failed |= fprintf(out, "}}\n") < 0;
+  return !failed && fflush(out) == 0;
+}
+
+static void *stats__t_count(void *arg) {
+  (void)arg;
+  for (int i = 0; i < 1000; i++)
+    stats_count(STATS_STATES_FORKED, 1);
+  STATS_PHASE(STATS_SYMEX) stats_count(STATS_SOLVER_CALLS, 2);
+  return NULL;
+}
+
+uint64_t stats_tests() {
+  uint64_t errors = 0;
+
+  printf("Stats suite...\n");
+
+  // The counts of the other suites are not ours to lose
+  stats_snapshot before = stats_read();
+
+  {
+    printf("- Counting from several threads... ");
+    enum { THREADS = 4 };
+    pthread_t threads[THREADS];
+    size_t started = 0;
+    for (; started < THREADS; started++)
+      if (pthread_create(&threads[started], NULL, stats__t_count, NULL))
+        break;
+    for (size_t i = 0; i < started; i++)
+      pthread_join(threads[i], NULL);
+    stats_snapshot after = stats_read();
+    _Bool ok =
+        started == THREADS &&
+        after.counters[STATS_STATES_FORKED] -
+                before.counters[STATS_STATES_FORKED] ==
+            1000 * THREADS &&
+        after.counters[STATS_SOLVER_CALLS] -
+                before.counters[STATS_SOLVER_CALLS] ==
+            2 * THREADS &&
+        after.entries[STATS_SYMEX] - before.entries[STATS_SYMEX] == THREADS &&
+        after.counters[STATS_CACHE_HITS] == before.counters[STATS_CACHE_HITS];
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- JSON output... ");
+    stats_snapshot saved = stats_read();
+    stats_reset();
+    stats_count(STATS_INTERN_HITS, 41);
+    stats_count(STATS_INTERN_HITS, 1);
+    uint64_t begin = stats_begin();
+    stats_end(STATS_PARSE, begin - 1500000000u);
+    char text[1024] = {0};
+    FILE *f = tmpfile();
+    _Bool ok = f && stats_write_json(f);
+    if (f) {
+      rewind(f);
+      size_t length = fread(text, 1, sizeof(text) - 1, f);
+      text[length] = 0;
+      fclose(f);
+    }
+    ok &= strncmp(text, "{\"phases\": {\"parse\": {\"seconds\": 1.5", 36) == 0;
+    ok &= strstr(text, "\"entries\": 1}, \"intern\": {\"seconds\": "
+                       "0.000000000, \"entries\": 0}") != NULL;
+    ok &= strstr(text, "\"counters\": {\"intern_hits\": 42, "
+                       "\"intern_misses\": 0,") != NULL;
+    ok &= strstr(text, "\"cache_hits\": 0}}\n") != NULL;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    // Back to what the other suites counted, on this thread's slot
+    stats_reset();
+    stats__slot *slot = stats__slot_of_thread();
+    for (size_t c = 0; c < STATS_COUNTER_COUNT; c++)
+      atomic_store_explicit(&slot->counters[c], saved.counters[c],
+                            memory_order_relaxed);
+    for (size_t p = 0; p < STATS_PHASE_COUNT; p++) {
+      atomic_store_explicit(&slot->nanos[p], saved.nanos[p],
+                            memory_order_relaxed);
+      atomic_store_explicit(&slot->entries[p], saved.entries[p],
+                            memory_order_relaxed);
+    }
+  }
+
+  return errors;
+}
+
+#endif
+#endif
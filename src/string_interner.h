@@ -4,66 +4,522 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "bench.h"
+
 typedef struct {
   char *str;
   size_t length;
+  uint64_t hash;
 } intern_entry;
 
+// Bump allocated block of string bytes, used when the interner is created
+// with a non zero arena_chunk_size.
+typedef struct intern_chunk {
+  struct intern_chunk *next;
+  size_t used;
+  size_t capacity;
+  char data[];
+} intern_chunk;
+
+// Entry of a saved symbol pool, offset points into the string blob.
+typedef struct {
+  uint64_t hash;
+  uint32_t offset;
+  uint32_t length;
+} intern_pool_entry;
+
+// Symbol pool file layout, in native byte order:
+//   intern_pool_header
+//   intern_pool_entry entries[count]
+//   uint32_t index[index_capacity]
+//   char blob[blob_size], NUL terminated strings
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t count;
+  uint64_t index_capacity;
+  uint64_t blob_size;
+} intern_pool_header;
+
+#define INTERN_POOL_MAGIC "FSP\x01"
+#define INTERN_POOL_VERSION 1
+
 typedef struct {
   intern_entry *entries;
   size_t capacity;
   size_t length;
+  // Open addressing index over entries. Each slot holds id + 1 (0 is empty),
+  // index_capacity is always a power of two.
+  uint32_t *index;
+  size_t index_capacity;
+  // Arena mode: strings live in chunks and are released all at once.
+  intern_chunk *chunks;
+  size_t chunk_size;
+  // Optional blocked bloom filter in front of the index: two bits in one
+  // word per string, 4 bits per index slot. NULL when disabled.
+  uint64_t *bloom;
+  size_t max_strings; // 0 for no limit
+  // Read only base mapped by interner_load. Ids below base_length resolve to
+  // the pool, entries[i] has id base_length + i.
+  void *map;
+  size_t map_size;
+  size_t base_length;
+  const intern_pool_entry *base_entries;
+  const uint32_t *base_index;
+  size_t base_index_capacity;
+  const char *base_blob;
 } string_interner;
 
-
-string_interner *interner_create(void);
+typedef struct {
+  // 0 allocates every string on its own, anything else is the size of the
+  // chunks strings are bump allocated from.
+  size_t arena_chunk_size;
+  // Reject most new strings before probing the index.
+  _Bool bloom_filter;
+  // Interning a new string fails once this many are held, 0 for no limit
+  size_t max_strings;
+} string_interner_opt;
+
+#define INTERNER_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+// interner_create() or interner_create(.arena_chunk_size = ...)
+#define interner_create(...)                                                 \
+  interner_create_opt((string_interner_opt){__VA_ARGS__})
+
+string_interner *interner_create_opt(string_interner_opt opt);
 void interner_destroy(string_interner *it);
+// Ids of the interner_intern functions when they run out of memory
+#define INTERNER_ERROR UINT64_MAX
+
 uint64_t interner_intern(string_interner *it, const char *key);
+// Interns the first len bytes of data, which does not need to be NUL
+// terminated. Bytes are only copied when the string is new.
+uint64_t interner_intern_n(string_interner *it, const char *data, size_t len);
+// Same as interner_intern_n for callers that already computed interner_hash.
+uint64_t interner_intern_hashed(string_interner *it, const char *data,
+                                size_t len, uint64_t hash);
+uint64_t interner_hash(const char *data, size_t len);
+// Number of ids handed out so far, including the mapped base.
+size_t interner_count(const string_interner *it);
+const char *interner_get(const string_interner *it, uint64_t id,
+                         size_t *length);
+
+// Writes every string of it as a symbol pool, ids are preserved.
+_Bool interner_save(const string_interner *it, const char *path);
+// Maps a symbol pool without copying its strings. The pool is read only, new
+// strings go to the regular entries of the returned interner.
+string_interner *interner_load_opt(const char *path, string_interner_opt opt);
+#define interner_load(path, ...)                                             \
+  interner_load_opt((path), (string_interner_opt){__VA_ARGS__})
+
+#ifdef NOB_H_
+static inline uint64_t interner_intern_sv(string_interner *it,
+                                          Nob_String_View sv) {
+  return interner_intern_n(it, sv.data, sv.count);
+}
+#endif
 
 
 uint64_t string_interner_tests();
+// Misses, hits and a Zipf distributed mix over count names, with and
+// without the bloom filter
+void string_interner_bench(bench *b, size_t count);
 #ifdef STRING_INTERNER_IMPL
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-string_interner *interner_create(void) {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+// FNV-1a, good enough for identifiers and cheap to compute.
+uint64_t interner_hash(const char *data, size_t length) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < length; i++) {
+    h ^= (unsigned char)data[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static void interner__index_insert(uint32_t *index, size_t capacity,
+                                   uint64_t hash, uint32_t slot_value) {
+  size_t mask = capacity - 1;
+  size_t i = hash & mask;
+  while (index[i])
+    i = (i + 1) & mask;
+  index[i] = slot_value;
+}
+
+#define INTERNER__BLOOM_WORDS(index_capacity) ((index_capacity) / 16)
+
+// The index uses the low bits of the hash, the filter uses the high ones.
+static inline uint64_t interner__bloom_mask(uint64_t hash) {
+  return (1ULL << (hash >> 58)) | (1ULL << ((hash >> 52) & 63));
+}
+
+static inline uint64_t *interner__bloom_word(uint64_t *bloom,
+                                             size_t index_capacity,
+                                             uint64_t hash) {
+  return &bloom[(hash >> 24) & (INTERNER__BLOOM_WORDS(index_capacity) - 1)];
+}
+
+// Keeps the index at most half full. Rehashing only needs the cached hashes.
+static int interner__index_grow(string_interner *it) {
+  size_t capacity = it->index_capacity * 2;
+  uint32_t *index = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+  uint64_t *bloom = NULL;
+  if (it->bloom)
+    bloom = (uint64_t *)calloc(INTERNER__BLOOM_WORDS(capacity), sizeof(uint64_t));
+  if (!index || (it->bloom && !bloom)) {
+    free(index);
+    free(bloom);
+    return 0;
+  }
+  for (size_t i = 0; i < it->length; i++) {
+    uint64_t hash = it->entries[i].hash;
+    interner__index_insert(index, capacity, hash, i + 1);
+    if (bloom)
+      *interner__bloom_word(bloom, capacity, hash) |= interner__bloom_mask(hash);
+  }
+  free(it->index);
+  free(it->bloom);
+  it->index = index;
+  it->index_capacity = capacity;
+  it->bloom = bloom;
+  return 1;
+}
+
+static char *interner__alloc(string_interner *it, size_t size) {
+  if (!it->chunk_size)
+    return (char *)malloc(size);
+
+  intern_chunk *c = it->chunks;
+  if (!c || c->capacity - c->used < size) {
+    size_t capacity = size > it->chunk_size ? size : it->chunk_size;
+    intern_chunk *fresh = (intern_chunk *)malloc(sizeof(intern_chunk) + capacity);
+    if (!fresh)
+      return NULL;
+    fresh->used = 0;
+    fresh->capacity = capacity;
+    if (c && size > it->chunk_size) {
+      // Oversized strings get a chunk of their own, keep bumping the current one
+      fresh->next = c->next;
+      c->next = fresh;
+    } else {
+      fresh->next = c;
+      it->chunks = fresh;
+    }
+    c = fresh;
+  }
+
+  char *ptr = c->data + c->used;
+  c->used += size;
+  return ptr;
+}
+
+string_interner *interner_create_opt(string_interner_opt opt) {
   string_interner *it = (string_interner *)malloc(sizeof(*it));
   if (!it)
     return NULL;
+  it->chunks = NULL;
+  it->chunk_size = opt.arena_chunk_size;
+  it->max_strings = opt.max_strings;
+  it->map = NULL;
+  it->map_size = 0;
+  it->base_length = 0;
+  it->base_entries = NULL;
+  it->base_index = NULL;
+  it->base_index_capacity = 0;
+  it->base_blob = NULL;
   it->capacity = 128;
   it->length = 0;
   it->entries = (intern_entry *)calloc(it->capacity, sizeof(intern_entry));
-  return it->entries ? it : (free(it), (string_interner *)NULL);
+  it->index_capacity = 256;
+  it->index = (uint32_t *)calloc(it->index_capacity, sizeof(uint32_t));
+  it->bloom = NULL;
+  if (opt.bloom_filter)
+    it->bloom = (uint64_t *)calloc(INTERNER__BLOOM_WORDS(it->index_capacity),
+                                   sizeof(uint64_t));
+  if (!it->entries || !it->index || (opt.bloom_filter && !it->bloom)) {
+    free(it->entries);
+    free(it->index);
+    free(it->bloom);
+    free(it);
+    return NULL;
+  }
+  return it;
 }
 
 void interner_destroy(string_interner *it) {
-  for (size_t i = 0; i < it->capacity; ++i)
-    free((char *)it->entries[i].str);
+  if (it->chunk_size) {
+    while (it->chunks) {
+      intern_chunk *next = it->chunks->next;
+      free(it->chunks);
+      it->chunks = next;
+    }
+  } else {
+    for (size_t i = 0; i < it->length; ++i)
+      free(it->entries[i].str);
+  }
   free(it->entries);
+  free(it->index);
+  free(it->bloom);
+  if (it->map)
+    munmap(it->map, it->map_size);
   free(it);
 }
 
 uint64_t interner_intern(string_interner *it, const char *key) {
-  // Do we have this string? Maybe this is a good place for a bloom filter
-  for (int i = 0; i < it->length; i++) {
-    if (strcmp(key, it->entries[i].str) == 0)
-      return i;
+  return interner_intern_n(it, key, strlen(key));
+}
+
+uint64_t interner_intern_n(string_interner *it, const char *key, size_t length) {
+  return interner_intern_hashed(it, key, length, interner_hash(key, length));
+}
+
+uint64_t interner_intern_hashed(string_interner *it, const char *key,
+                                size_t length, uint64_t hash) {
+  if (it->base_index) {
+    size_t mask = it->base_index_capacity - 1;
+    for (size_t slot = hash & mask; it->base_index[slot];
+         slot = (slot + 1) & mask) {
+      const intern_pool_entry *e = &it->base_entries[it->base_index[slot] - 1];
+      if (e->hash == hash && e->length == length &&
+          memcmp(it->base_blob + e->offset, key, length) == 0) {
+        stats_count(STATS_INTERN_HITS, 1);
+        return it->base_index[slot] - 1;
+      }
+    }
+  }
+
+  // Do we have this string? The filter answers "definitely new" without
+  // touching the index or the entries.
+  _Bool maybe_present = 1;
+  if (it->bloom) {
+    uint64_t bits = interner__bloom_mask(hash);
+    uint64_t *word = interner__bloom_word(it->bloom, it->index_capacity, hash);
+    maybe_present = (*word & bits) == bits;
+    *word |= bits;
   }
 
+  if (maybe_present) {
+    size_t mask = it->index_capacity - 1;
+    for (size_t slot = hash & mask; it->index[slot]; slot = (slot + 1) & mask) {
+      intern_entry *e = &it->entries[it->index[slot] - 1];
+      if (e->hash == hash && e->length == length &&
+          memcmp(e->str, key, length) == 0) {
+        stats_count(STATS_INTERN_HITS, 1);
+        return it->base_length + it->index[slot] - 1;
+      }
+    }
+  }
+  stats_count(STATS_INTERN_MISSES, 1);
+
+  if (it->max_strings && interner_count(it) >= it->max_strings) {
+    fprintf(stderr, "string interner: full at %zu strings\n", it->max_strings);
+    return INTERNER_ERROR;
+  }
   if (it->capacity == it->length) {
+    intern_entry *entries = (intern_entry *)realloc(
+        it->entries, sizeof(intern_entry) * it->capacity * 2);
+    if (!entries) {
+      fprintf(stderr, "string interner: out of memory\n");
+      return INTERNER_ERROR;
+    }
+    it->entries = entries;
     it->capacity *= 2;
-    it->entries = (intern_entry *)realloc(it->entries,
-                                          sizeof(intern_entry) * it->capacity);
   }
+  char *str = interner__alloc(it, length + 1);
+  if (!str) {
+    fprintf(stderr, "string interner: out of memory\n");
+    return INTERNER_ERROR;
+  }
+
+  intern_entry *e = &it->entries[it->length];
+  e->str = str;
+  e->length = length;
+  e->hash = hash;
+  memcpy(e->str, key, length);
+  e->str[length] = 0;
+
+  uint64_t id = it->length++;
+  // A grown index has the new entry. When the index can not grow the entry
+  // goes to the old one while it keeps a free slot for probes to stop at.
+  if (it->length * 2 > it->index_capacity && interner__index_grow(it))
+    return it->base_length + id;
+  if (it->length == it->index_capacity) {
+    it->length--;
+    if (!it->chunk_size)
+      free(str);
+    fprintf(stderr, "string interner: out of memory\n");
+    return INTERNER_ERROR;
+  }
+  interner__index_insert(it->index, it->index_capacity, hash, id + 1);
+  return it->base_length + id;
+}
+
+size_t interner_count(const string_interner *it) {
+  return it->base_length + it->length;
+}
+
+const char *interner_get(const string_interner *it, uint64_t id,
+                         size_t *length) {
+  if (id < it->base_length) {
+    const intern_pool_entry *e = &it->base_entries[id];
+    if (length)
+      *length = e->length;
+    return it->base_blob + e->offset;
+  }
+  const intern_entry *e = &it->entries[id - it->base_length];
+  if (length)
+    *length = e->length;
+  return e->str;
+}
+
+_Bool interner_save(const string_interner *it, const char *path) {
+  _Bool result = 1;
+  size_t count = interner_count(it);
+  intern_pool_header header = {0};
+  memcpy(header.magic, INTERN_POOL_MAGIC, 4);
+  header.version = INTERN_POOL_VERSION;
+  header.count = count;
+  header.index_capacity = 256;
+  while (header.index_capacity < count * 2)
+    header.index_capacity *= 2;
+
+  intern_pool_entry *entries =
+      (intern_pool_entry *)malloc(sizeof(intern_pool_entry) * (count ? count : 1));
+  uint32_t *index = (uint32_t *)calloc(header.index_capacity, sizeof(uint32_t));
+  // Write next to the destination and rename, path may be the pool it maps
+  char *tmp_path = (char *)malloc(strlen(path) + 5);
+  FILE *f = NULL;
+  if (tmp_path) {
+    sprintf(tmp_path, "%s.tmp", path);
+    f = fopen(tmp_path, "wb");
+  }
+  if (!entries || !index || !f) {
+    result = 0;
+    goto defer;
+  }
+
+  for (size_t id = 0; id < count; id++) {
+    size_t length;
+    interner_get(it, id, &length);
+    if (header.blob_size + length + 1 > UINT32_MAX) {
+      result = 0;
+      goto defer;
+    }
+    entries[id].hash = id < it->base_length
+                           ? it->base_entries[id].hash
+                           : it->entries[id - it->base_length].hash;
+    entries[id].offset = header.blob_size;
+    entries[id].length = length;
+    header.blob_size += length + 1;
+    interner__index_insert(index, header.index_capacity, entries[id].hash,
+                           id + 1);
+  }
+
+  result &= fwrite(&header, sizeof(header), 1, f) == 1;
+  result &= fwrite(entries, sizeof(intern_pool_entry), count, f) == count;
+  result &= fwrite(index, sizeof(uint32_t), header.index_capacity, f) ==
+            header.index_capacity;
+  for (size_t id = 0; id < count && result; id++) {
+    size_t length;
+    const char *str = interner_get(it, id, &length);
+    result &= fwrite(str, 1, length + 1, f) == length + 1;
+  }
+
+defer:
+  if (f && fclose(f) != 0)
+    result = 0;
+  if (f && result)
+    result = rename(tmp_path, path) == 0;
+  if (f && !result)
+    remove(tmp_path);
+  free(tmp_path);
+  free(entries);
+  free(index);
+  return result;
+}
+
+// Lookups trust the pool once it is mapped, so everything they follow is
+// checked once here: sizes without overflow, strings inside the blob and
+// index slots naming entries, with a free slot left for probes to stop at
+static _Bool interner__pool_valid(const intern_pool_header *header,
+                                  size_t size) {
+  size_t left = size - sizeof(*header);
+  uint64_t count = header->count, capacity = header->index_capacity;
+  if (memcmp(header->magic, INTERN_POOL_MAGIC, 4) != 0 ||
+      header->version != INTERN_POOL_VERSION || count >= UINT32_MAX ||
+      count > left / sizeof(intern_pool_entry) || !capacity ||
+      (capacity & (capacity - 1)) != 0 || capacity / 2 < count)
+    return 0;
+  left -= sizeof(intern_pool_entry) * count;
+  if (capacity > left / sizeof(uint32_t) ||
+      header->blob_size != left - sizeof(uint32_t) * capacity)
+    return 0;
+
+  const char *base = (const char *)header + sizeof(*header);
+  const intern_pool_entry *entries = (const intern_pool_entry *)base;
+  const uint32_t *index = (const uint32_t *)(base + sizeof(*entries) * count);
+  const char *blob = (const char *)(index + capacity);
+  for (size_t i = 0; i < count; i++)
+    if ((uint64_t)entries[i].offset + entries[i].length >= header->blob_size ||
+        blob[entries[i].offset + entries[i].length] != 0)
+      return 0;
+  size_t used = 0;
+  for (size_t slot = 0; slot < capacity; slot++) {
+    if (index[slot] > count)
+      return 0;
+    used += index[slot] != 0;
+  }
+  return used <= count;
+}
+
+string_interner *interner_load_opt(const char *path, string_interner_opt opt) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(intern_pool_header)) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return NULL;
 
-  size_t length = strlen(key);
-  it->entries[it->length].str = (char *)malloc(length + 1);
-  it->entries[it->length].length = length;
-  memcpy(it->entries[it->length].str, key, length + 1);
+  if (!interner__pool_valid((const intern_pool_header *)map, size)) {
+    fprintf(stderr, "string interner: %s is not a valid symbol pool\n", path);
+    munmap(map, size);
+    return NULL;
+  }
+  const intern_pool_header *header = (const intern_pool_header *)map;
+  size_t entries_size = sizeof(intern_pool_entry) * header->count;
+  size_t index_size = sizeof(uint32_t) * header->index_capacity;
 
-  return it->length++;
+  string_interner *it = interner_create_opt(opt);
+  if (!it) {
+    munmap(map, size);
+    return NULL;
+  }
+  const char *base = (const char *)map + sizeof(*header);
+  it->map = map;
+  it->map_size = size;
+  it->base_length = header->count;
+  it->base_entries = (const intern_pool_entry *)base;
+  it->base_index = (const uint32_t *)(base + entries_size);
+  it->base_index_capacity = header->index_capacity;
+  it->base_blob = base + entries_size + index_size;
+  return it;
 }
 
 uint64_t string_interner_tests() {
@@ -139,8 +595,371 @@ uint64_t string_interner_tests() {
     interner_destroy(test);
   }
 
+  {
+    printf("- Many strings keep dense ids... ");
+    string_interner *test = interner_create();
+
+    char str[32];
+    _Bool ok = 1;
+    for (int i = 0; i < 10000; i++) {
+      snprintf(str, sizeof(str), "c::main::1::x%d", i);
+      ok &= interner_intern(test, str) == (uint64_t)i;
+    }
+    for (int i = 0; i < 10000; i++) {
+      snprintf(str, sizeof(str), "c::main::1::x%d", i);
+      ok &= interner_intern(test, str) == (uint64_t)i;
+    }
+    ok &= test->length == 10000;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    interner_destroy(test);
+  }
+
+  {
+    printf("- Arena storage... ");
+    string_interner *test = interner_create(.arena_chunk_size = 64);
+
+    char str[32];
+    _Bool ok = 1;
+    for (int i = 0; i < 1000; i++) {
+      snprintf(str, sizeof(str), "__CPROVER_tmp%d", i);
+      ok &= interner_intern(test, str) == (uint64_t)i;
+    }
+    // Bigger than a chunk
+    char big[200];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = 0;
+    uint64_t big_id = interner_intern(test, big);
+    ok &= big_id == 1000 && interner_intern(test, big) == big_id;
+    ok &= strcmp(test->entries[big_id].str, big) == 0;
+    ok &= strcmp(test->entries[42].str, "__CPROVER_tmp42") == 0;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    interner_destroy(test);
+  }
+
+  {
+    printf("- Interning slices... ");
+    string_interner *test = interner_create(.arena_chunk_size = 1024);
+
+    const char *dotted = "c::main::1::x";
+    uint64_t c = interner_intern_n(test, dotted, 1);
+    uint64_t main_ = interner_intern_n(test, dotted + 3, 4);
+    uint64_t full = interner_intern(test, dotted);
+
+    _Bool ok = c == 0 && main_ == 1 && full == 2;
+    ok &= interner_intern(test, "c") == c;
+    ok &= interner_intern(test, "main") == main_;
+    ok &= strcmp(test->entries[main_].str, "main") == 0;
+    // Embedded NUL bytes are part of the key
+    ok &= interner_intern_n(test, "a\0b", 3) != interner_intern_n(test, "a", 1);
+    ok &= interner_intern_n(test, "", 0) == interner_intern(test, "");
+#ifdef NOB_H_
+    ok &= interner_intern_sv(test, nob_sv_from_parts(dotted + 3, 4)) == main_;
+#endif
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    interner_destroy(test);
+  }
+
+  {
+    printf("- A full interner... ");
+    string_interner *test = interner_create(.max_strings = 2);
+
+    uint64_t a = interner_intern(test, "a");
+    uint64_t b = interner_intern(test, "b");
+    _Bool ok = interner_intern(test, "c") == INTERNER_ERROR;
+    // What it holds still interns
+    ok &= interner_intern(test, "a") == a && interner_intern(test, "b") == b;
+    ok &= interner_count(test) == 2;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    interner_destroy(test);
+  }
+
+  {
+    printf("- Bloom filter... ");
+    string_interner *test = interner_create(.bloom_filter = 1);
+
+    char str[32];
+    _Bool ok = 1;
+    for (int i = 0; i < 5000; i++) {
+      snprintf(str, sizeof(str), "tag-struct-s%d", i);
+      ok &= interner_intern(test, str) == (uint64_t)i;
+    }
+    // No false negatives, also across the rebuilds done while growing
+    for (int i = 0; i < 5000; i++) {
+      snprintf(str, sizeof(str), "tag-struct-s%d", i);
+      ok &= interner_intern(test, str) == (uint64_t)i;
+    }
+    ok &= test->length == 5000;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    interner_destroy(test);
+  }
+
+  {
+    printf("- Save and load a symbol pool... ");
+    char path[] = "/tmp/farol-interner-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0)
+      close(fd);
+    string_interner *test = interner_create(.arena_chunk_size = 1024);
+
+    char str[32];
+    for (int i = 0; i < 300; i++) {
+      snprintf(str, sizeof(str), "c::f::%d", i);
+      interner_intern(test, str);
+    }
+    _Bool ok = interner_save(test, path);
+    interner_destroy(test);
+
+    ok &= fd >= 0;
+    string_interner *loaded = ok ? interner_load(path) : NULL;
+    ok &= loaded && interner_count(loaded) == 300 && loaded->length == 0;
+    for (int i = 0; ok && i < 300; i++) {
+      snprintf(str, sizeof(str), "c::f::%d", i);
+      ok &= interner_intern(loaded, str) == (uint64_t)i;
+      ok &= strcmp(interner_get(loaded, i, NULL), str) == 0;
+    }
+    // New strings land in the overflow region after the pool
+    ok &= loaded && interner_intern(loaded, "fresh") == 300;
+    ok &= loaded && interner_intern(loaded, "fresh") == 300;
+    ok &= loaded && strcmp(interner_get(loaded, 300, NULL), "fresh") == 0;
+
+    // A pool saved from a loaded interner keeps both regions
+    ok &= loaded && interner_save(loaded, path);
+    if (loaded)
+      interner_destroy(loaded);
+    loaded = ok ? interner_load(path) : NULL;
+    ok &= loaded && interner_count(loaded) == 301;
+    ok &= loaded && interner_intern(loaded, "fresh") == 300;
+    ok &= loaded && interner_intern(loaded, "c::f::7") == 7;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (loaded)
+      interner_destroy(loaded);
+    remove(path);
+  }
+
+  {
+    printf("- Corrupted symbol pools... ");
+    char path[] = "/tmp/farol-interner-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0)
+      close(fd);
+    string_interner *test = interner_create();
+    interner_intern(test, "a");
+    interner_intern(test, "bc");
+    _Bool ok = fd >= 0 && interner_save(test, path);
+    interner_destroy(test);
+    size_t entries = sizeof(intern_pool_header);
+    size_t index = entries + 2 * sizeof(intern_pool_entry);
+    size_t blob = index + 256 * sizeof(uint32_t);
+    char pool[sizeof(intern_pool_header) + 2 * sizeof(intern_pool_entry) +
+              256 * sizeof(uint32_t) + 5];
+    FILE *f = ok ? fopen(path, "rb") : NULL;
+    ok &= f && fread(pool, 1, sizeof(pool), f) == sizeof(pool) &&
+          fgetc(f) == EOF;
+    if (f)
+      fclose(f);
+
+    // Each a copy of the good pool with one thing broken
+    uint64_t huge = UINT64_MAX / sizeof(intern_pool_entry) + 2;
+    uint32_t past = 5, unnamed = 3;
+    struct {
+      size_t at;
+      const void *bytes;
+      size_t length;
+    } corruptions[] = {
+        {offsetof(intern_pool_header, count), &huge, sizeof(huge)},
+        {entries + sizeof(intern_pool_entry) +
+             offsetof(intern_pool_entry, offset),
+         &past, sizeof(past)},
+        {blob + 4, "x", 1},
+        {index, &unnamed, sizeof(unnamed)},
+        {sizeof(pool) - 1, NULL, 0}, // truncated
+    };
+    f = NULL;
+    for (size_t i = 0; ok && i < sizeof(corruptions) / sizeof(*corruptions);
+         i++) {
+      char broken[sizeof(pool)];
+      memcpy(broken, pool, sizeof(pool));
+      size_t length = sizeof(pool);
+      if (corruptions[i].bytes)
+        memcpy(broken + corruptions[i].at, corruptions[i].bytes,
+               corruptions[i].length);
+      else
+        length = corruptions[i].at;
+      f = fopen(path, "wb");
+      ok &= f && fwrite(broken, 1, length, f) == length;
+      ok &= f && fclose(f) == 0;
+      string_interner *loaded = ok ? interner_load(path) : NULL;
+      ok &= !loaded;
+      if (loaded)
+        interner_destroy(loaded);
+    }
+    // and the good one still loads
+    f = ok ? fopen(path, "wb") : NULL;
+    ok &= f && fwrite(pool, 1, sizeof(pool), f) == sizeof(pool);
+    ok &= f && fclose(f) == 0;
+    string_interner *loaded = ok ? interner_load(path) : NULL;
+    ok &= loaded && interner_intern(loaded, "bc") == 1;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (loaded)
+      interner_destroy(loaded);
+    remove(path);
+  }
+
   return errors;
 }
 
+// Identifiers as CBMC writes them: locals, parameters, temporaries and
+// globals of a few thousand functions
+static void interner__bench_name(char *out, size_t size, size_t i) {
+  size_t f = i % 2741;
+  switch (i % 4) {
+  case 0:
+    snprintf(out, size, "c::f%zu::1::x%zu", f, i);
+    break;
+  case 1:
+    snprintf(out, size, "c::f%zu::p%zu", f, i);
+    break;
+  case 2:
+    snprintf(out, size, "c::f%zu::$tmp::return_value_g%zu", f, i);
+    break;
+  default:
+    snprintf(out, size, "c::global_%zu", i);
+  }
+}
+
+void string_interner_bench(bench *b, size_t count) {
+  printf("String interner benchmark (%zu strings)...\n", count);
+
+  // Every name is first interned as a miss and then looked up again. The
+  // longest, a return value with i of 20 digits, takes 51 bytes.
+  enum { NAME = 64 };
+  char *names = (char *)malloc(count * NAME);
+  uint32_t *draws = (uint32_t *)malloc(sizeof(uint32_t) * 4 * count);
+  double *cdf = (double *)malloc(sizeof(double) * count);
+  if (!names || !draws || !cdf) {
+    fprintf(stderr, "string interner: out of memory\n");
+    free(names);
+    free(draws);
+    free(cdf);
+    return;
+  }
+  for (size_t i = 0; i < count; i++)
+    interner__bench_name(names + i * NAME, NAME, i);
+
+  for (int bloom = 0; bloom < 2; bloom++) {
+    string_interner *it = interner_create(.arena_chunk_size =
+                                              INTERNER_DEFAULT_CHUNK_SIZE,
+                                          .bloom_filter = bloom);
+    if (bench_begin(b, bloom ? "interner/miss/bloom" : "interner/miss")) {
+      for (size_t i = 0; i < count; i++)
+        interner_intern(it, names + i * NAME);
+      bench_end(b, count);
+    } else {
+      for (size_t i = 0; i < count; i++)
+        interner_intern(it, names + i * NAME);
+    }
+    if (bench_begin(b, bloom ? "interner/hit/bloom" : "interner/hit")) {
+      for (size_t i = 0; i < count; i++)
+        interner_intern(it, names + i * NAME);
+      bench_end(b, count);
+    }
+    interner_destroy(it);
+  }
+
+  // Lookups the way a parse does them: Zipf distributed (s = 1) over the
+  // names, so a few (the irep keywords, main's locals) dominate, and most
+  // are seen once or never. Starts empty, the first draw of a name misses.
+  double total = 0;
+  for (size_t i = 0; i < count; i++)
+    cdf[i] = total += 1.0 / (double)(i + 1);
+  uint64_t x = 0x9E3779B97F4A7C15ull;
+  for (size_t i = 0; i < 4 * count; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    double u = (double)(x >> 11) / 9007199254740992.0 * total;
+    size_t lo = 0, hi = count - 1;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (cdf[mid] < u)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    draws[i] = (uint32_t)lo;
+  }
+  static const char *const keywords[] = {
+      "id", "sub", "type", "symbol", "identifier", "constant", "value",
+      "signedbv", "unsignedbv", "width", "bool", "code", "assign",
+      "#source_location", "file", "line", "function", "+", "=", "<"};
+  enum { KEYWORDS = sizeof(keywords) / sizeof(*keywords) };
+  for (size_t i = 0; i < KEYWORDS && i < count; i++)
+    snprintf(names + i * NAME, NAME, "%s", keywords[i]);
+  for (int bloom = 0; bloom < 2; bloom++) {
+    string_interner *it = interner_create(.arena_chunk_size =
+                                              INTERNER_DEFAULT_CHUNK_SIZE,
+                                          .bloom_filter = bloom);
+    if (bench_begin(b, bloom ? "interner/zipf/bloom" : "interner/zipf")) {
+      for (size_t i = 0; i < 4 * count; i++)
+        interner_intern(it, names + (size_t)draws[i] * NAME);
+      bench_end(b, 4 * count);
+    }
+    interner_destroy(it);
+  }
+
+  free(names);
+  free(draws);
+  free(cdf);
+}
+
 #endif
 #endif
@@ -0,0 +1,336 @@
+#ifndef SYMEX_LUA_H
+#define SYMEX_LUA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shared_interner.h"
+#include "symex_scheduler.h"
+
+// Search strategies written in Lua, as the rank hook of SYMEX_CUSTOM. The
+// script defines a global rank(batch), called once per batch of states.
+// batch is the same userdata on every call, a handle onto the native
+// states: nothing is copied into Lua tables and a call allocates nothing.
+//
+//   #batch              number of states
+//   batch:pc(i)         where state i is, 1 <= i <= #batch
+//   batch:func(i)
+//   batch:depth(i)      frames below the current one
+//   batch:guard(i)      number of conditions on its path
+//   batch:value(i, s)   irep id of symbol s on its path, nil if unassigned
+//   batch:generation(i, s)
+//   batch:set(i, p)     priority of state i, higher runs first (0 if unset)
+//   intern(name)        symbol id of name
+//
+// Lua states are single threaded, every worker gets one of its own, each
+// running the script once at creation.
+
+typedef struct symex_lua symex_lua;
+
+// NULL and a diagnostic if the script does not load or has no rank
+symex_lua *symex_lua_create(const char *script, shared_interner *strings,
+                            size_t workers);
+void symex_lua_destroy(symex_lua *l);
+// Makes options explore with l ranking, on as many workers as l has states
+void symex_lua_attach(symex_lua *l, symex_scheduler_options *options);
+
+uint64_t symex_lua_tests();
+#ifdef SYMEX_LUA_IMPL
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+
+#include "irep.h"
+
+#define SYMEX_LUA__BATCH "farol.batch"
+
+typedef struct {
+  symex_state *const *states;
+  double *priorities;
+  size_t count;
+} symex_lua__batch;
+
+typedef struct {
+  lua_State *L;
+  int rank;  // registry refs
+  int batch; // of the userdata, which points at view
+  symex_lua__batch view;
+} symex_lua__worker;
+
+struct symex_lua {
+  shared_interner *strings;
+  symex_lua__worker *workers;
+  size_t worker_count;
+};
+
+static symex_lua__batch *symex_lua__check(lua_State *L) {
+  return *(symex_lua__batch **)luaL_checkudata(L, 1, SYMEX_LUA__BATCH);
+}
+
+static size_t symex_lua__index(lua_State *L, symex_lua__batch *b) {
+  lua_Integer i = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, i >= 1 && (size_t)i <= b->count, 2, "no such state");
+  return (size_t)i - 1;
+}
+
+static int symex_lua__len(lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)symex_lua__check(L)->count);
+  return 1;
+}
+
+static int symex_lua__pc(lua_State *L) {
+  symex_lua__batch *b = symex_lua__check(L);
+  lua_pushinteger(L, b->states[symex_lua__index(L, b)]->pc);
+  return 1;
+}
+
+static int symex_lua__func(lua_State *L) {
+  symex_lua__batch *b = symex_lua__check(L);
+  lua_pushinteger(L, (lua_Integer)b->states[symex_lua__index(L, b)]->function);
+  return 1;
+}
+
+static int symex_lua__depth(lua_State *L) {
+  symex_lua__batch *b = symex_lua__check(L);
+  lua_pushinteger(L, b->states[symex_lua__index(L, b)]->depth);
+  return 1;
+}
+
+static int symex_lua__guard(lua_State *L) {
+  symex_lua__batch *b = symex_lua__check(L);
+  lua_pushinteger(L,
+                  (lua_Integer)b->states[symex_lua__index(L, b)]->guard_length);
+  return 1;
+}
+
+static int symex_lua__value(lua_State *L) {
+  symex_lua__batch *b = symex_lua__check(L);
+  const symex_state *s = b->states[symex_lua__index(L, b)];
+  uint64_t v = symex_state_value(s, (uint64_t)luaL_checkinteger(L, 3));
+  if (v == IREP_NIL)
+    lua_pushnil(L);
+  else
+    lua_pushinteger(L, (lua_Integer)v);
+  return 1;
+}
+
+static int symex_lua__generation(lua_State *L) {
+  symex_lua__batch *b = symex_lua__check(L);
+  const symex_state *s = b->states[symex_lua__index(L, b)];
+  lua_pushinteger(L, (lua_Integer)symex_state_generation(
+                         s, (uint64_t)luaL_checkinteger(L, 3)));
+  return 1;
+}
+
+static int symex_lua__set(lua_State *L) {
+  symex_lua__batch *b = symex_lua__check(L);
+  b->priorities[symex_lua__index(L, b)] = luaL_checknumber(L, 3);
+  return 0;
+}
+
+static int symex_lua__intern(lua_State *L) {
+  shared_interner *strings =
+      (shared_interner *)lua_touserdata(L, lua_upvalueindex(1));
+  size_t length;
+  const char *name = luaL_checklstring(L, 1, &length);
+  lua_pushinteger(L,
+                  (lua_Integer)shared_interner_intern_n(strings, name, length));
+  return 1;
+}
+
+static const luaL_Reg symex_lua__methods[] = {
+    {"pc", symex_lua__pc},
+    {"func", symex_lua__func},
+    {"depth", symex_lua__depth},
+    {"guard", symex_lua__guard},
+    {"value", symex_lua__value},
+    {"generation", symex_lua__generation},
+    {"set", symex_lua__set},
+    {NULL, NULL},
+};
+
+static _Bool symex_lua__open(symex_lua *l, symex_lua__worker *w,
+                             const char *script) {
+  lua_State *L = w->L = luaL_newstate();
+  if (!L)
+    return 0;
+  luaL_openlibs(L);
+
+  luaL_newmetatable(L, SYMEX_LUA__BATCH);
+  lua_newtable(L);
+  luaL_setfuncs(L, symex_lua__methods, 0);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, symex_lua__len);
+  lua_setfield(L, -2, "__len");
+  lua_pop(L, 1);
+
+  symex_lua__batch **handle =
+      (symex_lua__batch **)lua_newuserdata(L, sizeof(symex_lua__batch *));
+  *handle = &w->view;
+  luaL_setmetatable(L, SYMEX_LUA__BATCH);
+  w->batch = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  if (l->strings) {
+    lua_pushlightuserdata(L, l->strings);
+    lua_pushcclosure(L, symex_lua__intern, 1);
+    lua_setglobal(L, "intern");
+  }
+
+  if (luaL_dostring(L, script)) {
+    fprintf(stderr, "symex lua: %s\n", lua_tostring(L, -1));
+    return 0;
+  }
+  if (lua_getglobal(L, "rank") != LUA_TFUNCTION) {
+    fprintf(stderr, "symex lua: the script defines no rank function\n");
+    return 0;
+  }
+  w->rank = luaL_ref(L, LUA_REGISTRYINDEX);
+  return 1;
+}
+
+void symex_lua_destroy(symex_lua *l) {
+  for (size_t i = 0; i < l->worker_count; i++)
+    if (l->workers[i].L)
+      lua_close(l->workers[i].L);
+  free(l->workers);
+  free(l);
+}
+
+symex_lua *symex_lua_create(const char *script, shared_interner *strings,
+                            size_t workers) {
+  if (!workers)
+    workers = 1;
+  symex_lua *l = (symex_lua *)calloc(1, sizeof(*l));
+  if (!l)
+    return NULL;
+  l->strings = strings;
+  l->workers = (symex_lua__worker *)calloc(workers, sizeof(symex_lua__worker));
+  if (!l->workers) {
+    free(l);
+    return NULL;
+  }
+  l->worker_count = workers;
+  for (size_t i = 0; i < workers; i++) {
+    if (!symex_lua__open(l, &l->workers[i], script)) {
+      symex_lua_destroy(l);
+      return NULL;
+    }
+  }
+  return l;
+}
+
+static void symex_lua__rank(void *ctx, symex_worker *w,
+                            symex_state *const *states, size_t count,
+                            double *priorities) {
+  symex_lua *l = (symex_lua *)ctx;
+  symex_lua__worker *lw = &l->workers[symex_worker_id(w)];
+  lua_State *L = lw->L;
+  lw->view.states = states;
+  lw->view.priorities = priorities;
+  lw->view.count = count;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, lw->rank);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, lw->batch);
+  // A failing script leaves the batch in DFS order
+  if (lua_pcall(L, 1, 0, 0)) {
+    fprintf(stderr, "symex lua: %s\n", lua_tostring(L, -1));
+    lua_pop(L, 1);
+  }
+  lw->view.count = 0;
+}
+
+void symex_lua_attach(symex_lua *l, symex_scheduler_options *options) {
+  options->strategy = SYMEX_CUSTOM;
+  options->workers = l->worker_count;
+  options->rank = symex_lua__rank;
+  options->rank_ctx = l;
+}
+
+typedef struct {
+  atomic_uint_fast64_t leaves, explored;
+  // Symbol 1 in the second state explored
+  atomic_uint_fast64_t second;
+} symex_lua__t_tree;
+
+#define SYMEX_LUA__T_DEPTH 8
+
+// Branches on symbol (level + 1) until SYMEX_LUA__T_DEPTH
+static void symex_lua__t_step(void *ctx, symex_worker *w, symex_state *s) {
+  symex_lua__t_tree *t = (symex_lua__t_tree *)ctx;
+  if (atomic_fetch_add(&t->explored, 1) == 1)
+    atomic_store(&t->second, symex_state_value(s, 1));
+  if (s->pc == SYMEX_LUA__T_DEPTH) {
+    atomic_fetch_add(&t->leaves, 1);
+    symex_state_destroy(s);
+    return;
+  }
+  symex_state *other = symex_state_fork(s);
+  _Bool ok = other && symex_state_assign(s, s->pc + 1, 0) &&
+             symex_state_assign(other, s->pc + 1, 1);
+  s->pc++;
+  if (other)
+    other->pc++;
+  if (!ok || !symex_worker_push(w, s))
+    symex_state_destroy(s);
+  if (other && (!ok || !symex_worker_push(w, other)))
+    symex_state_destroy(other);
+}
+
+uint64_t symex_lua_tests() {
+  uint64_t errors = 0;
+
+  printf("Symex Lua suite...\n");
+
+  {
+    printf("- Lua ranks the batches... ");
+    // The branch that took 0 first, DFS would take the newest (1)
+    const char *script = "calls, seen = 0, 0\n"
+                         "function rank(batch)\n"
+                         "  calls = calls + 1\n"
+                         "  seen = seen + #batch\n"
+                         "  for i = 1, #batch do\n"
+                         "    if batch:value(i, batch:pc(i)) == 0 then\n"
+                         "      batch:set(i, 1)\n"
+                         "    end\n"
+                         "  end\n"
+                         "end\n";
+    symex_lua *l = symex_lua_create(script, NULL, 1);
+    _Bool ok = l != NULL;
+    symex_lua__t_tree t = {0};
+    symex_scheduler_options options = {.step = symex_lua__t_step, .ctx = &t};
+    if (ok) {
+      symex_lua_attach(l, &options);
+      symex_scheduler_result r = symex_schedule(symex_state_create(0), &options);
+      ok &= r.finished && atomic_load(&t.leaves) == 1 << SYMEX_LUA__T_DEPTH;
+      ok &= atomic_load(&t.second) == 0;
+      lua_State *L = l->workers[0].L;
+      lua_getglobal(L, "calls");
+      lua_getglobal(L, "seen");
+      lua_Integer calls = lua_tointeger(L, -2), seen = lua_tointeger(L, -1);
+      lua_pop(L, 2);
+      ok &= calls > 0 && (uint64_t)calls < r.explored &&
+            (uint64_t)seen == r.explored;
+    }
+    ok &= symex_lua_create("x = 1", NULL, 1) == NULL;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (l)
+      symex_lua_destroy(l);
+  }
+
+  return errors;
+}
+
+#endif
+#endif
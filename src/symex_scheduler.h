@@ -0,0 +1,600 @@
+#ifndef SYMEX_SCHEDULER_H
+#define SYMEX_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "symex_state.h"
+
+// Explores symex states on a pool of threads. Every worker has a deque of
+// pending states of its own and picks the next one by the strategy. When it
+// runs out it steals half of another worker's deque, from the end its owner
+// would get to last: the states closest to the root of its exploration,
+// which have the most work under them. Forks are O(1) and share everything
+// (see symex_state.h), so moving them between threads costs nothing, and
+// strings go through the shared_interner.
+//
+// The step callback owns the state it gets. It runs it up to the next
+// branch and pushes what comes out of it, or destroys it when the path
+// ends. Exploration is over when no state is pending or running, or after
+// a worker calls symex_worker_stop.
+
+typedef enum {
+  SYMEX_DFS,
+  SYMEX_BFS,
+  // The state at the least visited location goes first, visits are counted
+  // over all workers
+  SYMEX_COVERAGE,
+  // Ranked by the rank hook, a batch of states per call
+  SYMEX_CUSTOM,
+} symex_strategy;
+
+typedef struct symex_worker symex_worker;
+
+typedef struct {
+  symex_strategy strategy;
+  // 0 is one per processor
+  size_t workers;
+  void (*step)(void *ctx, symex_worker *w, symex_state *s);
+  void *ctx;
+  // SYMEX_CUSTOM: the worker takes the newest batch states of its deque, in
+  // the order they were pushed, and rank gives each a priority (all 0 on
+  // entry). They then run highest first, ties newest first, before rank is
+  // called again. Neither array is allocated per call, and the states stay
+  // the worker's: rank only looks at them.
+  void (*rank)(void *ctx, symex_worker *w, symex_state *const *states,
+               size_t count, double *priorities);
+  void *rank_ctx;
+  // 0 is SYMEX_SCHEDULER_BATCH
+  size_t batch;
+} symex_scheduler_options;
+
+#define SYMEX_SCHEDULER_BATCH 32
+
+typedef struct {
+  // Every state was explored, nobody stopped
+  _Bool finished;
+  uint64_t explored;
+  uint64_t steals;
+  // Pending when the exploration stopped
+  uint64_t dropped;
+} symex_scheduler_result;
+
+// Explores from initial, which it takes over. Blocks until it is done.
+symex_scheduler_result symex_schedule(symex_state *initial,
+                                      const symex_scheduler_options *options);
+// For step to queue s. 0 on allocation failure, s is still the caller's then.
+_Bool symex_worker_push(symex_worker *w, symex_state *s);
+// Ends the exploration, states still pending are destroyed
+void symex_worker_stop(symex_worker *w);
+size_t symex_worker_id(const symex_worker *w);
+
+uint64_t symex_scheduler_tests();
+#ifdef SYMEX_SCHEDULER_IMPL
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+#define SYMEX_SCHEDULER__STEAL_MAX 64
+// How far from the top of the deque SYMEX_COVERAGE looks
+#define SYMEX_SCHEDULER__WINDOW 32
+#define SYMEX_SCHEDULER__COVERAGE_BITS 12
+
+typedef struct symex_scheduler symex_scheduler;
+
+// Ring buffer, front is the oldest
+typedef struct {
+  pthread_mutex_t lock;
+  symex_state **items;
+  size_t capacity; // power of two
+  size_t head, count;
+} symex_scheduler__deque;
+
+struct symex_worker {
+  symex_scheduler *sch;
+  size_t id;
+  symex_scheduler__deque deque;
+  uint64_t explored, steals;
+  unsigned seed;
+  // SYMEX_CUSTOM: ranked states, the next one last. Other workers can not
+  // steal them.
+  symex_state **ready;
+  double *priorities;
+  size_t ready_count;
+};
+
+struct symex_scheduler {
+  const symex_scheduler_options *options;
+  symex_worker **workers;
+  size_t worker_count;
+  // Pending or running, and just pending
+  atomic_size_t pending, queued;
+  atomic_bool stopped;
+  // Idle workers wait for states to steal
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle_wake;
+  atomic_size_t idle;
+  // Hashed (function, pc) -> visits
+  atomic_uint coverage[1 << SYMEX_SCHEDULER__COVERAGE_BITS];
+};
+
+static symex_state **symex_scheduler__at(symex_scheduler__deque *d, size_t i) {
+  return &d->items[(d->head + i) & (d->capacity - 1)];
+}
+
+static _Bool symex_scheduler__push_back(symex_scheduler__deque *d,
+                                        symex_state *s) {
+  if (d->count == d->capacity) {
+    size_t capacity = d->capacity ? d->capacity * 2 : 64;
+    symex_state **items =
+        (symex_state **)malloc(sizeof(symex_state *) * capacity);
+    if (!items)
+      return 0;
+    for (size_t i = 0; i < d->count; i++)
+      items[i] = *symex_scheduler__at(d, i);
+    free(d->items);
+    d->items = items;
+    d->capacity = capacity;
+    d->head = 0;
+  }
+  *symex_scheduler__at(d, d->count++) = s;
+  return 1;
+}
+
+static symex_state *symex_scheduler__pop_front(symex_scheduler__deque *d) {
+  symex_state *s = d->items[d->head];
+  d->head = (d->head + 1) & (d->capacity - 1);
+  d->count--;
+  return s;
+}
+
+static symex_state *symex_scheduler__pop_back(symex_scheduler__deque *d) {
+  return *symex_scheduler__at(d, --d->count);
+}
+
+static atomic_uint *symex_scheduler__visits(symex_scheduler *sch,
+                                            const symex_state *s) {
+  uint64_t h = ((uint64_t)s->function << 32 | s->pc) * 0x9e3779b97f4a7c15ULL;
+  return &sch->coverage[h >> (64 - SYMEX_SCHEDULER__COVERAGE_BITS)];
+}
+
+static symex_state *symex_scheduler__least_visited(symex_scheduler *sch,
+                                                   symex_scheduler__deque *d) {
+  size_t window = d->count < SYMEX_SCHEDULER__WINDOW ? d->count
+                                                     : SYMEX_SCHEDULER__WINDOW;
+  size_t best = d->count - 1;
+  unsigned best_visits = UINT32_MAX;
+  for (size_t i = d->count - window; i < d->count; i++) {
+    unsigned visits = atomic_load_explicit(
+        symex_scheduler__visits(sch, *symex_scheduler__at(d, i)),
+        memory_order_relaxed);
+    // Ties go to the newest, as in DFS
+    if (visits <= best_visits) {
+      best = i;
+      best_visits = visits;
+    }
+  }
+  symex_state **slot = symex_scheduler__at(d, best);
+  symex_state *s = *slot;
+  *slot = symex_scheduler__pop_back(d);
+  return s;
+}
+
+static symex_state *symex_scheduler__ranked(symex_worker *w) {
+  const symex_scheduler_options *o = w->sch->options;
+  if (w->ready_count)
+    return w->ready[--w->ready_count];
+
+  symex_scheduler__deque *d = &w->deque;
+  size_t n = 0;
+  pthread_mutex_lock(&d->lock);
+  n = d->count < o->batch ? d->count : o->batch;
+  for (size_t i = n; i-- > 0;)
+    w->ready[i] = symex_scheduler__pop_back(d);
+  pthread_mutex_unlock(&d->lock);
+  if (!n)
+    return NULL;
+  atomic_fetch_sub(&w->sch->queued, n);
+
+  for (size_t i = 0; i < n; i++)
+    w->priorities[i] = 0;
+  o->rank(o->rank_ctx, w, w->ready, n, w->priorities);
+  // Stable insertion sort, batches are small
+  for (size_t i = 1; i < n; i++) {
+    symex_state *s = w->ready[i];
+    double p = w->priorities[i];
+    size_t k = i;
+    for (; k > 0 && w->priorities[k - 1] > p; k--) {
+      w->ready[k] = w->ready[k - 1];
+      w->priorities[k] = w->priorities[k - 1];
+    }
+    w->ready[k] = s;
+    w->priorities[k] = p;
+  }
+  w->ready_count = n - 1;
+  return w->ready[n - 1];
+}
+
+static symex_state *symex_scheduler__take(symex_worker *w) {
+  if (w->sch->options->strategy == SYMEX_CUSTOM)
+    return symex_scheduler__ranked(w);
+  symex_scheduler__deque *d = &w->deque;
+  symex_state *s = NULL;
+  pthread_mutex_lock(&d->lock);
+  if (d->count) {
+    switch (w->sch->options->strategy) {
+    case SYMEX_DFS:
+      s = symex_scheduler__pop_back(d);
+      break;
+    case SYMEX_BFS:
+      s = symex_scheduler__pop_front(d);
+      break;
+    default:
+      s = symex_scheduler__least_visited(w->sch, d);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&d->lock);
+  if (s)
+    atomic_fetch_sub(&w->sch->queued, 1);
+  return s;
+}
+
+// Half of some other worker's states go to w, returns one of them
+static symex_state *symex_scheduler__steal(symex_worker *w) {
+  symex_scheduler *sch = w->sch;
+  symex_state *stolen[SYMEX_SCHEDULER__STEAL_MAX];
+  size_t start = rand_r(&w->seed) % sch->worker_count;
+  for (size_t k = 0; k < sch->worker_count; k++) {
+    symex_worker *victim = sch->workers[(start + k) % sch->worker_count];
+    if (victim == w)
+      continue;
+    symex_scheduler__deque *d = &victim->deque;
+    size_t n = 0;
+    pthread_mutex_lock(&d->lock);
+    size_t half = (d->count + 1) / 2;
+    if (half > SYMEX_SCHEDULER__STEAL_MAX)
+      half = SYMEX_SCHEDULER__STEAL_MAX;
+    for (; n < half; n++)
+      stolen[n] = sch->options->strategy == SYMEX_BFS
+                      ? symex_scheduler__pop_back(d)
+                      : symex_scheduler__pop_front(d);
+    pthread_mutex_unlock(&d->lock);
+    if (!n)
+      continue;
+
+    w->steals++;
+    // stolen[0] runs now, the rest keeps its order in w's deque
+    size_t kept = 1;
+    pthread_mutex_lock(&w->deque.lock);
+    while (kept < n && symex_scheduler__push_back(&w->deque, stolen[kept]))
+      kept++;
+    pthread_mutex_unlock(&w->deque.lock);
+    if (kept < n) {
+      pthread_mutex_lock(&d->lock);
+      for (size_t i = kept; i < n; i++) {
+        if (symex_scheduler__push_back(d, stolen[i]))
+          continue;
+        symex_state_destroy(stolen[i]);
+        atomic_fetch_sub(&sch->queued, 1);
+        atomic_fetch_sub(&sch->pending, 1);
+      }
+      pthread_mutex_unlock(&d->lock);
+    }
+    atomic_fetch_sub(&sch->queued, 1);
+    return stolen[0];
+  }
+  return NULL;
+}
+
+static void symex_scheduler__wake(symex_scheduler *sch, _Bool all) {
+  pthread_mutex_lock(&sch->idle_lock);
+  if (all)
+    pthread_cond_broadcast(&sch->idle_wake);
+  else
+    pthread_cond_signal(&sch->idle_wake);
+  pthread_mutex_unlock(&sch->idle_lock);
+}
+
+static void *symex_scheduler__worker(void *arg) {
+  symex_worker *w = (symex_worker *)arg;
+  symex_scheduler *sch = w->sch;
+  while (!atomic_load(&sch->stopped)) {
+    symex_state *s = symex_scheduler__take(w);
+    if (!s)
+      s = symex_scheduler__steal(w);
+    if (s) {
+      atomic_fetch_add_explicit(symex_scheduler__visits(sch, s), 1,
+                                memory_order_relaxed);
+      w->explored++;
+      STATS_PHASE(STATS_SYMEX) sch->options->step(sch->options->ctx, w, s);
+      if (atomic_fetch_sub(&sch->pending, 1) == 1)
+        symex_scheduler__wake(sch, 1);
+      continue;
+    }
+
+    pthread_mutex_lock(&sch->idle_lock);
+    atomic_fetch_add(&sch->idle, 1);
+    while (!atomic_load(&sch->queued) && atomic_load(&sch->pending) &&
+           !atomic_load(&sch->stopped))
+      pthread_cond_wait(&sch->idle_wake, &sch->idle_lock);
+    atomic_fetch_sub(&sch->idle, 1);
+    _Bool done = !atomic_load(&sch->pending);
+    pthread_mutex_unlock(&sch->idle_lock);
+    if (done)
+      break;
+  }
+  return NULL;
+}
+
+_Bool symex_worker_push(symex_worker *w, symex_state *s) {
+  symex_scheduler *sch = w->sch;
+  pthread_mutex_lock(&w->deque.lock);
+  _Bool ok = symex_scheduler__push_back(&w->deque, s);
+  pthread_mutex_unlock(&w->deque.lock);
+  if (!ok)
+    return 0;
+  atomic_fetch_add(&sch->pending, 1);
+  atomic_fetch_add(&sch->queued, 1);
+  if (atomic_load(&sch->idle))
+    symex_scheduler__wake(sch, 0);
+  return 1;
+}
+
+void symex_worker_stop(symex_worker *w) {
+  atomic_store(&w->sch->stopped, 1);
+  symex_scheduler__wake(w->sch, 1);
+}
+
+size_t symex_worker_id(const symex_worker *w) { return w->id; }
+
+symex_scheduler_result symex_schedule(symex_state *initial,
+                                      const symex_scheduler_options *given) {
+  symex_scheduler_result result = {0};
+  symex_scheduler_options options_copy = *given;
+  const symex_scheduler_options *options = &options_copy;
+  if (!options_copy.batch)
+    options_copy.batch = SYMEX_SCHEDULER_BATCH;
+  _Bool ranked = options->strategy == SYMEX_CUSTOM;
+  size_t count = options->workers;
+  if (!count)
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+  if (!count)
+    count = 1;
+
+  symex_scheduler *sch = (symex_scheduler *)calloc(1, sizeof(*sch));
+  symex_worker **workers =
+      (symex_worker **)calloc(count, sizeof(symex_worker *));
+  pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * count);
+  size_t created = 0;
+  if (sch && workers && threads) {
+    for (; created < count; created++) {
+      symex_worker *w = (symex_worker *)calloc(1, sizeof(*w));
+      if (w && ranked) {
+        w->ready = (symex_state **)malloc(sizeof(symex_state *) * options->batch);
+        w->priorities = (double *)malloc(sizeof(double) * options->batch);
+      }
+      if (w && ranked && (!w->ready || !w->priorities)) {
+        free(w->ready);
+        free(w->priorities);
+        free(w);
+        w = NULL;
+      }
+      if (!w)
+        break;
+      w->sch = sch;
+      w->id = created;
+      w->seed = 0x5eed + created;
+      pthread_mutex_init(&w->deque.lock, NULL);
+      workers[created] = w;
+    }
+  }
+  if (!created) {
+    fprintf(stderr, "symex scheduler: out of memory\n");
+    free(sch);
+    free(workers);
+    free(threads);
+    symex_state_destroy(initial);
+    result.dropped = 1;
+    return result;
+  }
+
+  sch->options = options;
+  sch->workers = workers;
+  sch->worker_count = created;
+  atomic_init(&sch->pending, 0);
+  atomic_init(&sch->queued, 0);
+  atomic_init(&sch->stopped, 0);
+  atomic_init(&sch->idle, 0);
+  for (size_t i = 0; i < (1 << SYMEX_SCHEDULER__COVERAGE_BITS); i++)
+    atomic_init(&sch->coverage[i], 0);
+  pthread_mutex_init(&sch->idle_lock, NULL);
+  pthread_cond_init(&sch->idle_wake, NULL);
+
+  if (!symex_worker_push(workers[0], initial)) {
+    symex_state_destroy(initial);
+    result.dropped = 1;
+  } else {
+    // The calling thread is worker 0
+    size_t started = 1;
+    for (; started < created; started++)
+      if (pthread_create(&threads[started], NULL, symex_scheduler__worker,
+                         workers[started]))
+        break;
+    symex_scheduler__worker(workers[0]);
+    for (size_t i = 1; i < started; i++)
+      pthread_join(threads[i], NULL);
+  }
+
+  result.finished = !atomic_load(&sch->stopped) && !result.dropped;
+  for (size_t i = 0; i < created; i++) {
+    symex_worker *w = workers[i];
+    result.explored += w->explored;
+    result.steals += w->steals;
+    result.dropped += w->deque.count + w->ready_count;
+    while (w->deque.count)
+      symex_state_destroy(symex_scheduler__pop_front(&w->deque));
+    while (w->ready_count)
+      symex_state_destroy(w->ready[--w->ready_count]);
+    free(w->deque.items);
+    free(w->ready);
+    free(w->priorities);
+    pthread_mutex_destroy(&w->deque.lock);
+    free(w);
+  }
+  pthread_mutex_destroy(&sch->idle_lock);
+  pthread_cond_destroy(&sch->idle_wake);
+  free(sch);
+  free(workers);
+  free(threads);
+  return result;
+}
+
+// A binary tree of paths: every state branches on a fresh symbol until
+// SYMEX_SCHEDULER__T_DEPTH, leaves add up the branches they took
+#define SYMEX_SCHEDULER__T_DEPTH 12
+
+typedef struct {
+  atomic_uint_fast64_t leaves, sum;
+  uint64_t stop_after;
+  atomic_uint_fast64_t seen;
+} symex_scheduler__t_tree;
+
+static void symex_scheduler__t_step(void *ctx, symex_worker *w,
+                                    symex_state *s) {
+  symex_scheduler__t_tree *t = (symex_scheduler__t_tree *)ctx;
+  if (t->stop_after && atomic_fetch_add(&t->seen, 1) + 1 == t->stop_after)
+    symex_worker_stop(w);
+  if (s->pc == SYMEX_SCHEDULER__T_DEPTH) {
+    uint64_t path = 0;
+    for (uint64_t level = 0; level < SYMEX_SCHEDULER__T_DEPTH; level++)
+      path |= symex_state_value(s, level) << level;
+    atomic_fetch_add(&t->leaves, 1);
+    atomic_fetch_add(&t->sum, path);
+    symex_state_destroy(s);
+    return;
+  }
+  symex_state *other = symex_state_fork(s);
+  _Bool ok = other && symex_state_assign(s, s->pc, 0) &&
+             symex_state_assign(other, s->pc, 1);
+  s->pc++;
+  if (other)
+    other->pc++;
+  if (!ok || !symex_worker_push(w, s))
+    symex_state_destroy(s);
+  if (other && (!ok || !symex_worker_push(w, other)))
+    symex_state_destroy(other);
+}
+
+typedef struct {
+  atomic_uint_fast64_t calls, ranked, batch_max;
+} symex_scheduler__t_ranks;
+
+// Deepest first, paths that took branch 1 at the top before the others
+static void symex_scheduler__t_rank(void *ctx, symex_worker *w,
+                                    symex_state *const *states, size_t count,
+                                    double *priorities) {
+  (void)w;
+  symex_scheduler__t_ranks *r = (symex_scheduler__t_ranks *)ctx;
+  atomic_fetch_add(&r->calls, 1);
+  atomic_fetch_add(&r->ranked, count);
+  if (count > atomic_load(&r->batch_max))
+    atomic_store(&r->batch_max, count);
+  for (size_t i = 0; i < count; i++)
+    priorities[i] = states[i]->pc + (symex_state_value(states[i], 0) == 1) * 0.5;
+}
+
+uint64_t symex_scheduler_tests() {
+  uint64_t errors = 0;
+
+  printf("Symex scheduler suite...\n");
+
+  {
+    printf("- Every strategy explores every path... ");
+    _Bool ok = 1;
+    uint64_t leaves = 1 << SYMEX_SCHEDULER__T_DEPTH;
+    symex_strategy strategies[] = {SYMEX_DFS, SYMEX_BFS, SYMEX_COVERAGE};
+    for (size_t i = 0; i < 3; i++) {
+      symex_scheduler__t_tree t = {0};
+      symex_scheduler_options options = {.strategy = strategies[i],
+                                         .workers = 4,
+                                         .step = symex_scheduler__t_step,
+                                         .ctx = &t};
+      symex_state *initial = symex_state_create(0);
+      symex_scheduler_result r = symex_schedule(initial, &options);
+      ok &= r.finished && r.dropped == 0 && r.explored == 2 * leaves - 1;
+      ok &= atomic_load(&t.leaves) == leaves &&
+            atomic_load(&t.sum) == leaves * (leaves - 1) / 2;
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Custom ranks come in batches... ");
+    _Bool ok = 1;
+    uint64_t leaves = 1 << SYMEX_SCHEDULER__T_DEPTH;
+    for (size_t workers = 1; workers <= 4; workers += 3) {
+      symex_scheduler__t_tree t = {0};
+      symex_scheduler__t_ranks ranks = {0};
+      symex_scheduler_options options = {.strategy = SYMEX_CUSTOM,
+                                         .workers = workers,
+                                         .step = symex_scheduler__t_step,
+                                         .ctx = &t,
+                                         .rank = symex_scheduler__t_rank,
+                                         .rank_ctx = &ranks,
+                                         .batch = 8};
+      symex_scheduler_result r = symex_schedule(symex_state_create(0), &options);
+      ok &= r.finished && r.explored == 2 * leaves - 1 &&
+            atomic_load(&t.leaves) == leaves;
+      // Stolen states are not ranked, those that stayed are once
+      ok &= atomic_load(&ranks.batch_max) <= 8;
+      ok &= atomic_load(&ranks.ranked) + r.steals <= r.explored;
+      if (workers == 1)
+        ok &= atomic_load(&ranks.ranked) == r.explored &&
+              atomic_load(&ranks.calls) < r.explored;
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- Stopping drops what is pending... ");
+    symex_scheduler__t_tree t = {.stop_after = 100};
+    symex_scheduler_options options = {.strategy = SYMEX_BFS,
+                                       .workers = 3,
+                                       .step = symex_scheduler__t_step,
+                                       .ctx = &t};
+    symex_scheduler_result r = symex_schedule(symex_state_create(0), &options);
+    _Bool ok = !r.finished && r.explored >= 100 && r.dropped > 0 &&
+               r.explored < 2 * (1 << SYMEX_SCHEDULER__T_DEPTH) - 1;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  return errors;
+}
+
+#endif
+#endif
@@ -0,0 +1,368 @@
+#ifndef SYMEX_STATE_H
+#define SYMEX_STATE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "hamt.h"
+#include "memory.h"
+
+// One path of the symbolic execution: where it is, what every symbol holds
+// and what it has assumed. All of it is persistent, the symbol maps are
+// HAMTs and the path condition and call stack are lists that share their
+// tails, so forking at a branch is O(1) and the two paths then only pay for
+// what they write. Objects reached through pointers live in a memory (see
+// memory.h), shared the same way down to pages.
+//
+// Symbols are interned ids and values are irep nodes, hash consing makes
+// equal expressions the same id. Every assignment bumps the symbol's SSA
+// generation, the name symbol#generation is unique along the path.
+
+typedef struct symex_list symex_list;
+
+typedef struct {
+  size_t function;
+  uint32_t pc;
+  // Number of frames below this one
+  uint32_t depth;
+  hamt values;      // symbol -> irep, missing for unassigned symbols
+  hamt generations; // symbol -> last SSA generation, 0 (missing) at start
+  symex_list *guard;  // conditions assumed so far, the latest first
+  symex_list *frames; // return points, the innermost first
+  size_t guard_length;
+  memory memory;      // objects reached through pointers, byte by byte
+} symex_state;
+
+symex_state *symex_state_create(size_t function);
+void symex_state_destroy(symex_state *s);
+// O(1), the fork starts where s is and both can then go their own way
+symex_state *symex_state_fork(const symex_state *s);
+
+// IREP_NIL when symbol was never assigned on this path
+uint64_t symex_state_value(const symex_state *s, uint64_t symbol);
+uint64_t symex_state_generation(const symex_state *s, uint64_t symbol);
+// Returns the new generation of symbol, 0 on allocation failure
+uint64_t symex_state_assign(symex_state *s, uint64_t symbol, uint64_t value);
+// Forgets the value, the generation stays (the symbol left its scope)
+_Bool symex_state_kill(symex_state *s, uint64_t symbol);
+
+// Adds cond to the path condition
+_Bool symex_state_assume(symex_state *s, uint64_t cond);
+// Path condition, at most capacity of it, the latest first. Returns the
+// length of the whole of it.
+size_t symex_state_guard(const symex_state *s, uint64_t *conds,
+                         size_t capacity);
+
+// Enters function, to come back to return_pc of the current one
+_Bool symex_state_call(symex_state *s, size_t function, uint32_t return_pc);
+// Back where the innermost call was made, 0 when there is no caller
+_Bool symex_state_return(symex_state *s);
+
+uint64_t symex_state_tests();
+// Assignments, lookups and forks of a state holding that many symbols
+void symex_state_bench(bench *b, size_t symbols);
+#ifdef SYMEX_STATE_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "irep.h"
+#include "stats.h"
+
+struct symex_list {
+  atomic_uint refs;
+  uint64_t head[2];
+  symex_list *tail;
+};
+
+static symex_list *symex__cons(uint64_t a, uint64_t b, symex_list *tail) {
+  symex_list *l = (symex_list *)malloc(sizeof(*l));
+  if (!l)
+    return NULL;
+  atomic_init(&l->refs, 1);
+  l->head[0] = a;
+  l->head[1] = b;
+  // The new cell holds the caller's reference to tail from now on
+  l->tail = tail;
+  return l;
+}
+
+static symex_list *symex__list_copy(symex_list *l) {
+  if (l)
+    atomic_fetch_add_explicit(&l->refs, 1, memory_order_relaxed);
+  return l;
+}
+
+static void symex__list_release(symex_list *l) {
+  // Iterative, paths can be long
+  while (l &&
+         atomic_fetch_sub_explicit(&l->refs, 1, memory_order_acq_rel) == 1) {
+    symex_list *tail = l->tail;
+    free(l);
+    l = tail;
+  }
+}
+
+symex_state *symex_state_create(size_t function) {
+  symex_state *s = (symex_state *)calloc(1, sizeof(*s));
+  if (!s)
+    return NULL;
+  s->function = function;
+  s->values = HAMT_EMPTY;
+  s->generations = HAMT_EMPTY;
+  s->memory = MEMORY_EMPTY;
+  return s;
+}
+
+void symex_state_destroy(symex_state *s) {
+  hamt_release(s->values);
+  hamt_release(s->generations);
+  memory_release(s->memory);
+  symex__list_release(s->guard);
+  symex__list_release(s->frames);
+  free(s);
+}
+
+symex_state *symex_state_fork(const symex_state *s) {
+  symex_state *f = (symex_state *)malloc(sizeof(*f));
+  if (!f)
+    return NULL;
+  *f = *s;
+  f->values = hamt_copy(s->values);
+  f->generations = hamt_copy(s->generations);
+  f->memory = memory_copy(s->memory);
+  f->guard = symex__list_copy(s->guard);
+  f->frames = symex__list_copy(s->frames);
+  stats_count(STATS_STATES_FORKED, 1);
+  return f;
+}
+
+uint64_t symex_state_value(const symex_state *s, uint64_t symbol) {
+  const uint64_t *v = hamt_get(s->values, symbol);
+  return v ? *v : IREP_NIL;
+}
+
+uint64_t symex_state_generation(const symex_state *s, uint64_t symbol) {
+  const uint64_t *g = hamt_get(s->generations, symbol);
+  return g ? *g : 0;
+}
+
+uint64_t symex_state_assign(symex_state *s, uint64_t symbol, uint64_t value) {
+  uint64_t generation = symex_state_generation(s, symbol) + 1;
+  if (!hamt_set(&s->generations, symbol, generation))
+    return 0;
+  if (!hamt_set(&s->values, symbol, value)) {
+    hamt_set(&s->generations, symbol, generation - 1);
+    return 0;
+  }
+  return generation;
+}
+
+_Bool symex_state_kill(symex_state *s, uint64_t symbol) {
+  return hamt_remove(&s->values, symbol);
+}
+
+_Bool symex_state_assume(symex_state *s, uint64_t cond) {
+  symex_list *l = symex__cons(cond, 0, s->guard);
+  if (!l)
+    return 0;
+  s->guard = l;
+  s->guard_length++;
+  return 1;
+}
+
+size_t symex_state_guard(const symex_state *s, uint64_t *conds,
+                         size_t capacity) {
+  size_t i = 0;
+  for (symex_list *l = s->guard; l && i < capacity; l = l->tail)
+    conds[i++] = l->head[0];
+  return s->guard_length;
+}
+
+_Bool symex_state_call(symex_state *s, size_t function, uint32_t return_pc) {
+  symex_list *l = symex__cons(s->function, return_pc, s->frames);
+  if (!l)
+    return 0;
+  s->frames = l;
+  s->function = function;
+  s->pc = 0;
+  s->depth++;
+  return 1;
+}
+
+_Bool symex_state_return(symex_state *s) {
+  symex_list *frame = s->frames;
+  if (!frame)
+    return 0;
+  s->function = frame->head[0];
+  s->pc = (uint32_t)frame->head[1];
+  s->depth--;
+  s->frames = symex__list_copy(frame->tail);
+  symex__list_release(frame);
+  return 1;
+}
+
+uint64_t symex_state_tests() {
+  uint64_t errors = 0;
+
+  printf("Symex state suite...\n");
+
+  {
+    printf("- Forks are independent... ");
+    symex_state *s = symex_state_create(0);
+    _Bool ok = s != NULL;
+    for (uint64_t sym = 0; ok && sym < 1000; sym++)
+      ok &= symex_state_assign(s, sym, sym * 10) == 1;
+    ok &= ok && symex_state_assign(s, 5, 7) == 2;
+    ok &= ok && symex_state_assume(s, 100);
+
+    symex_state *f = ok ? symex_state_fork(s) : NULL;
+    ok &= f != NULL;
+    // if (c) on s, if (!c) on f
+    ok &= ok && symex_state_assume(s, 200) && symex_state_assume(f, 201);
+    ok &= ok && symex_state_assign(f, 5, 8) == 3 &&
+          symex_state_assign(f, 2000, 1) == 1;
+    ok &= ok && symex_state_kill(s, 6) && !symex_state_kill(s, 6);
+
+    ok &= ok && symex_state_value(s, 5) == 7 && symex_state_value(f, 5) == 8;
+    ok &= ok && symex_state_generation(s, 5) == 2 &&
+          symex_state_generation(f, 5) == 3;
+    ok &= ok && symex_state_value(s, 2000) == IREP_NIL &&
+          symex_state_value(f, 2000) == 1;
+    ok &= ok && symex_state_value(s, 6) == IREP_NIL &&
+          symex_state_value(f, 6) == 60 && symex_state_generation(s, 6) == 1;
+    ok &= ok && symex_state_value(s, 999) == 9990 &&
+          symex_state_value(f, 999) == 9990;
+
+    uint64_t conds[4];
+    ok &= ok && symex_state_guard(s, conds, 4) == 2 && conds[0] == 200 &&
+          conds[1] == 100;
+    ok &= ok && symex_state_guard(f, conds, 1) == 2 && conds[0] == 201;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (s)
+      symex_state_destroy(s);
+    if (f)
+      symex_state_destroy(f);
+  }
+
+  {
+    printf("- Calls and returns... ");
+    symex_state *s = symex_state_create(0);
+    _Bool ok = s != NULL;
+    s->pc = 4;
+    ok &= ok && symex_state_call(s, 1, 5);
+    s->pc = 2;
+    ok &= ok && symex_state_call(s, 2, 3);
+    symex_state *f = ok ? symex_state_fork(s) : NULL;
+    ok &= f != NULL;
+
+    ok &= ok && s->function == 2 && s->pc == 0 && s->depth == 2;
+    ok &= ok && symex_state_return(s) && s->function == 1 && s->pc == 3;
+    ok &= ok && symex_state_return(s) && s->function == 0 && s->pc == 5;
+    ok &= ok && !symex_state_return(s) && s->depth == 0;
+    // The fork still has both frames, its returns go the same way
+    ok &= ok && f->depth == 2 && symex_state_return(f) && f->function == 1 &&
+          symex_state_return(f) && f->pc == 5;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (s)
+      symex_state_destroy(s);
+    if (f)
+      symex_state_destroy(f);
+  }
+
+  {
+    printf("- Memory follows forks... ");
+    symex_state *s = symex_state_create(0);
+    _Bool ok = s != NULL;
+    uint64_t buffer = ok ? memory_allocate(&s->memory, 1500) : 0;
+    uint8_t in[4] = {1, 2, 3, 4}, out[4] = {0};
+    ok &= buffer && memory_write(&s->memory, buffer, 100, 4, in);
+    symex_state *f = ok ? symex_state_fork(s) : NULL;
+    ok &= f && f->memory.table == s->memory.table;
+    uint64_t symbol = 77;
+    ok &= ok && memory_write_symbolic(&f->memory, buffer, 101, 1, &symbol);
+    ok &= ok && memory_read_concrete(s->memory, buffer, 100, 4, out) &&
+          out[1] == 2;
+    ok &= ok && memory_read(f->memory, buffer, 100, 4, out, NULL) == 1;
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    if (s)
+      symex_state_destroy(s);
+    if (f)
+      symex_state_destroy(f);
+  }
+
+  return errors;
+}
+
+void symex_state_bench(bench *b, size_t symbols) {
+  printf("Symex state benchmark (%zu symbols)...\n", symbols);
+
+  // Interned ids are small and dense, values any irep
+  symex_state *s = symex_state_create(0);
+  _Bool ok = s != NULL;
+  if (ok && bench_begin(b, "symex/assign")) {
+    for (size_t i = 0; ok && i < symbols; i++)
+      ok = symex_state_assign(s, i + 1, 2 * i) != 0;
+    bench_end(b, symbols);
+  } else {
+    for (size_t i = 0; ok && i < symbols; i++)
+      ok = symex_state_assign(s, i + 1, 2 * i) != 0;
+  }
+
+  if (ok && bench_begin(b, "symex/lookup")) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < 4 * symbols; i++)
+      sum += symex_state_value(s, (i * 7919) % symbols + 1);
+    bench_end(b, 4 * symbols);
+    // Keeps the loop
+    if (sum == 1)
+      printf("\n");
+  }
+
+  // A branch: both sides fork, write a little and assume their condition,
+  // then one of them is dropped
+  if (ok && bench_begin(b, "symex/fork")) {
+    for (size_t i = 0; ok && i < symbols; i++) {
+      symex_state *f = symex_state_fork(s);
+      ok = f != NULL;
+      for (size_t j = 0; ok && j < 4; j++)
+        ok = symex_state_assign(f, (i + j * 7919) % symbols + 1, i) != 0;
+      ok = ok && symex_state_assume(f, i);
+      if (f)
+        symex_state_destroy(f);
+    }
+    bench_end(b, symbols);
+  }
+  if (!ok)
+    fprintf(stderr, "symex state: out of memory\n");
+
+  if (s)
+    symex_state_destroy(s);
+}
+
+#endif
+#endif
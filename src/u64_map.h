@@ -0,0 +1,149 @@
+#ifndef U64_MAP_H
+#define U64_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Open addressing map from uint64_t to uint64_t, for the id keyed side
+// tables (symbol -> slot, node -> memoized result...). U64_MAP_EMPTY can not
+// be used as a key.
+
+#define U64_MAP_EMPTY UINT64_MAX
+
+typedef struct {
+  uint64_t key;
+  uint64_t value;
+} u64_map_slot;
+
+typedef struct {
+  u64_map_slot *slots;
+  size_t capacity; // power of two
+  size_t length;
+} u64_map;
+
+_Bool u64_map_init(u64_map *m, size_t expected);
+void u64_map_free(u64_map *m);
+void u64_map_clear(u64_map *m);
+// NULL when key is not there
+uint64_t *u64_map_get(const u64_map *m, uint64_t key);
+// Inserts or overwrites, 0 on allocation failure
+_Bool u64_map_put(u64_map *m, uint64_t key, uint64_t value);
+
+uint64_t u64_map_tests();
+#ifdef U64_MAP_IMPL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline size_t u64_map__slot(uint64_t key, size_t capacity) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return key & (capacity - 1);
+}
+
+static _Bool u64_map__alloc(u64_map *m, size_t capacity) {
+  m->slots = (u64_map_slot *)malloc(sizeof(u64_map_slot) * capacity);
+  if (!m->slots)
+    return 0;
+  memset(m->slots, 0xff, sizeof(u64_map_slot) * capacity);
+  m->capacity = capacity;
+  m->length = 0;
+  return 1;
+}
+
+_Bool u64_map_init(u64_map *m, size_t expected) {
+  size_t capacity = 16;
+  while (capacity < 2 * expected)
+    capacity *= 2;
+  return u64_map__alloc(m, capacity);
+}
+
+void u64_map_free(u64_map *m) {
+  free(m->slots);
+  m->slots = NULL;
+  m->capacity = m->length = 0;
+}
+
+void u64_map_clear(u64_map *m) {
+  memset(m->slots, 0xff, sizeof(u64_map_slot) * m->capacity);
+  m->length = 0;
+}
+
+uint64_t *u64_map_get(const u64_map *m, uint64_t key) {
+  size_t mask = m->capacity - 1;
+  for (size_t i = u64_map__slot(key, m->capacity);
+       m->slots[i].key != U64_MAP_EMPTY; i = (i + 1) & mask)
+    if (m->slots[i].key == key)
+      return &m->slots[i].value;
+  return NULL;
+}
+
+_Bool u64_map_put(u64_map *m, uint64_t key, uint64_t value) {
+  uint64_t *existing = u64_map_get(m, key);
+  if (existing) {
+    *existing = value;
+    return 1;
+  }
+
+  if ((m->length + 1) * 2 > m->capacity) {
+    u64_map old = *m;
+    if (!u64_map__alloc(m, old.capacity * 2)) {
+      *m = old;
+      return 0;
+    }
+    for (size_t i = 0; i < old.capacity; i++)
+      if (old.slots[i].key != U64_MAP_EMPTY)
+        u64_map_put(m, old.slots[i].key, old.slots[i].value);
+    free(old.slots);
+  }
+
+  size_t mask = m->capacity - 1;
+  size_t i = u64_map__slot(key, m->capacity);
+  while (m->slots[i].key != U64_MAP_EMPTY)
+    i = (i + 1) & mask;
+  m->slots[i].key = key;
+  m->slots[i].value = value;
+  m->length++;
+  return 1;
+}
+
+uint64_t u64_map_tests() {
+  uint64_t errors = 0;
+
+  printf("u64 map suite...\n");
+
+  {
+    printf("- Put, get and overwrite... ");
+    u64_map m;
+    _Bool ok = u64_map_init(&m, 0);
+    for (uint64_t i = 0; ok && i < 1000; i++)
+      ok &= u64_map_put(&m, i * 64, i);
+    for (uint64_t i = 0; ok && i < 1000; i++) {
+      uint64_t *v = u64_map_get(&m, i * 64);
+      ok &= v && *v == i;
+    }
+    ok &= ok && u64_map_get(&m, 1) == NULL;
+    ok &= ok && u64_map_put(&m, 64, 7) && *u64_map_get(&m, 64) == 7;
+    ok &= m.length == 1000;
+    if (ok) {
+      u64_map_clear(&m);
+      ok &= m.length == 0 && u64_map_get(&m, 64) == NULL;
+    }
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+
+    u64_map_free(&m);
+  }
+
+  return errors;
+}
+
+#endif
+#endif
@@ -0,0 +1,579 @@
+#ifndef WITNESS_H
+#define WITNESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "goto_binary.h"
+
+// Counterexamples, written out step by step while they are read from a
+// model: the inputs the path draws, in order, then the assertion it fails.
+// Nothing is kept but the number of steps so far, traces of millions of
+// inputs cost no memory. Two formats:
+//
+//  - JSON, {"steps": [{"kind": "input", ...}, ..., {"kind": "violation",
+//    ...}], "length": n}, every step with its function, pc and, when the
+//    instruction has one, file and line. Inputs have the symbol they set
+//    (no SSA suffix, "farol::nondet" for the result of a nondet side effect)
+//    and its value.
+//  - GraphML, a violation witness in the SV-COMP format: a chain of nodes
+//    from the entry to the violation, one edge per input with its line and
+//    an assumption ("x == 5;", "\result == 5;"). The result of a nondet
+//    side effect is that of the function it is drawn in, which the edge
+//    names as assumption.resultfunction. The graph says which program it
+//    is for (witness_program) and when it was written.
+
+typedef enum {
+  WITNESS_JSON,
+  WITNESS_GRAPHML,
+} witness_format;
+
+// The program a GraphML witness is for, NULL fields are left out
+typedef struct {
+  const char *file; // the source file verified
+  const char *hash; // SHA-256 of it in hex, see witness_hash_file
+  // NULL for unreach-call, CHECK( init(main()), LTL(G ! call(reach_error())) )
+  const char *specification;
+  const char *architecture; // "32bit" or "64bit", NULL for the host's
+} witness_program;
+
+typedef struct {
+  FILE *out;
+  witness_format format;
+  goto_program *p;
+  witness_program program;
+  uint64_t file, line; // names of source location fields
+  uint64_t nondet;     // "farol::nondet"
+  size_t steps;
+  _Bool failed; // some write did
+} witness;
+
+// Writes the header to out, which the witness does not own. program may be
+// NULL, JSON has no use for it.
+void witness_begin(witness *w, FILE *out, witness_format format,
+                   goto_program *p, const witness_program *program);
+// The input drawn at function/pc into the SSA symbol whose identifier is
+// identifier (a string id, "c::main::1::x#3"), value canonical as in
+// bytecode with the symbol's width and BYTECODE_ flags
+void witness_input(witness *w, size_t function, size_t pc, uint64_t identifier,
+                   uint64_t value, uint8_t width, uint8_t flags);
+void witness_violation(witness *w, size_t function, size_t pc);
+// Closes the document and flushes, 0 if any write failed
+_Bool witness_end(witness *w);
+
+// SHA-256 of the file at path as 64 hex digits and a NUL, 0 and a diagnostic
+// if it can not be read
+_Bool witness_hash_file(const char *path, char hex[65]);
+
+uint64_t witness_tests();
+#ifdef WITNESS_IMPL
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bytecode.h"
+#include "irep.h"
+
+static void witness__printf(witness *w, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void witness__printf(witness *w, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  w->failed |= vfprintf(w->out, format, args) < 0;
+  va_end(args);
+}
+
+// string escaped for the format, a JSON string or XML text
+static void witness__text(witness *w, const char *s, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    unsigned char c = (unsigned char)s[i];
+    if (w->format == WITNESS_JSON && (c == '"' || c == '\\'))
+      witness__printf(w, "\\%c", c);
+    else if (w->format == WITNESS_JSON && c < 0x20)
+      witness__printf(w, "\\u%04x", c);
+    else if (w->format == WITNESS_GRAPHML && c == '<')
+      witness__printf(w, "&lt;");
+    else if (w->format == WITNESS_GRAPHML && c == '>')
+      witness__printf(w, "&gt;");
+    else if (w->format == WITNESS_GRAPHML && c == '&')
+      witness__printf(w, "&amp;");
+    else
+      w->failed |= fputc(c, w->out) == EOF;
+  }
+}
+
+static void witness__string(witness *w, uint64_t id) {
+  size_t length = 0;
+  const char *s = goto_program_string(w->p, id, &length);
+  witness__text(w, s ? s : "", s ? length : 0);
+}
+
+static _Bool witness__location(witness *w, size_t function, size_t pc,
+                               uint64_t *file, uint64_t *line) {
+  const goto_function *f =
+      function < w->p->function_count ? &w->p->functions[function] : NULL;
+  if (!f || !f->loaded || pc >= f->count)
+    return 0;
+  uint64_t location = f->instructions[pc].source_location;
+  if (location == IREP_NIL)
+    return 0;
+  uint64_t l = irep_find(w->p->ireps, location, w->line);
+  uint64_t s = irep_find(w->p->ireps, location, w->file);
+  *line = l == IREP_NIL ? IREP_NIL : irep_id(w->p->ireps, l);
+  *file = s == IREP_NIL ? IREP_NIL : irep_id(w->p->ireps, s);
+  return *line != IREP_NIL || *file != IREP_NIL;
+}
+
+static void witness__value(witness *w, uint64_t value, uint8_t width,
+                           uint8_t flags) {
+  if ((flags & BYTECODE_SIGNED) && width && width < 64 &&
+      (value >> (width - 1)) & 1)
+    value |= ~0ull << width;
+  if (flags & BYTECODE_SIGNED)
+    witness__printf(w, "%lld", (long long)value);
+  else
+    witness__printf(w, "%llu", (unsigned long long)value);
+}
+
+// Fields every JSON step has
+static void witness__json_step(witness *w, const char *kind, size_t function,
+                               size_t pc) {
+  witness__printf(w, "%s\n{\"kind\": \"%s\", \"function\": \"",
+                  w->steps ? "," : "", kind);
+  if (function < w->p->function_count)
+    witness__string(w, w->p->functions[function].name);
+  witness__printf(w, "\", \"pc\": %zu", pc);
+  uint64_t file, line;
+  if (witness__location(w, function, pc, &file, &line)) {
+    if (file != IREP_NIL) {
+      witness__printf(w, ", \"file\": \"");
+      witness__string(w, file);
+      witness__printf(w, "\"");
+    }
+    if (line != IREP_NIL) {
+      witness__printf(w, ", \"line\": ");
+      witness__string(w, line);
+    }
+  }
+}
+
+// The next node of the chain and the edge to it
+static void witness__edge(witness *w, size_t function, size_t pc) {
+  witness__printf(w, "<node id=\"N%zu\"/>\n", w->steps + 1);
+  witness__printf(w, "<edge source=\"N%zu\" target=\"N%zu\">\n", w->steps,
+                  w->steps + 1);
+  uint64_t file, line;
+  if (witness__location(w, function, pc, &file, &line) && line != IREP_NIL) {
+    witness__printf(w, "<data key=\"startline\">");
+    witness__string(w, line);
+    witness__printf(w, "</data>\n");
+  }
+  if (function < w->p->function_count) {
+    witness__printf(w, "<data key=\"assumption.scope\">");
+    witness__string(w, w->p->functions[function].name);
+    witness__printf(w, "</data>\n");
+  }
+}
+
+// Graph data, left out when value is NULL
+static void witness__data(witness *w, const char *key, const char *value) {
+  if (!value)
+    return;
+  witness__printf(w, "<data key=\"%s\">", key);
+  witness__text(w, value, strlen(value));
+  witness__printf(w, "</data>\n");
+}
+
+void witness_begin(witness *w, FILE *out, witness_format format,
+                   goto_program *p, const witness_program *program) {
+  *w = (witness){.out = out, .format = format, .p = p};
+  if (program)
+    w->program = *program;
+  w->file = goto_program_intern(p, "file");
+  w->line = goto_program_intern(p, "line");
+  w->nondet = goto_program_intern(p, "farol::nondet");
+  if (format == WITNESS_JSON) {
+    witness__printf(w, "{\"steps\": [");
+    return;
+  }
+  witness__printf(
+      w,
+      "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n"
+      "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\" "
+      "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\">\n"
+      "<key attr.name=\"witness-type\" attr.type=\"string\" for=\"graph\" "
+      "id=\"witness-type\"/>\n"
+      "<key attr.name=\"sourcecodelang\" attr.type=\"string\" for=\"graph\" "
+      "id=\"sourcecodelang\"/>\n"
+      "<key attr.name=\"producer\" attr.type=\"string\" for=\"graph\" "
+      "id=\"producer\"/>\n"
+      "<key attr.name=\"specification\" attr.type=\"string\" "
+      "for=\"graph\" id=\"specification\"/>\n"
+      "<key attr.name=\"programfile\" attr.type=\"string\" for=\"graph\" "
+      "id=\"programfile\"/>\n"
+      "<key attr.name=\"programhash\" attr.type=\"string\" for=\"graph\" "
+      "id=\"programhash\"/>\n"
+      "<key attr.name=\"architecture\" attr.type=\"string\" "
+      "for=\"graph\" id=\"architecture\"/>\n"
+      "<key attr.name=\"creationtime\" attr.type=\"string\" "
+      "for=\"graph\" id=\"creationtime\"/>\n"
+      "<key attr.name=\"entry\" attr.type=\"boolean\" for=\"node\" "
+      "id=\"entry\"><default>false</default></key>\n"
+      "<key attr.name=\"violation\" attr.type=\"boolean\" for=\"node\" "
+      "id=\"violation\"><default>false</default></key>\n"
+      "<key attr.name=\"startline\" attr.type=\"int\" for=\"edge\" "
+      "id=\"startline\"/>\n"
+      "<key attr.name=\"assumption\" attr.type=\"string\" for=\"edge\" "
+      "id=\"assumption\"/>\n"
+      "<key attr.name=\"assumption.scope\" attr.type=\"string\" for=\"edge\" "
+      "id=\"assumption.scope\"/>\n"
+      "<key attr.name=\"assumption.resultfunction\" attr.type=\"string\" "
+      "for=\"edge\" id=\"assumption.resultfunction\"/>\n"
+      "<graph edgedefault=\"directed\">\n"
+      "<data key=\"witness-type\">violation_witness</data>\n"
+      "<data key=\"sourcecodelang\">C</data>\n"
+      "<data key=\"producer\">Farol</data>\n");
+  witness__data(w, "specification",
+                w->program.specification
+                    ? w->program.specification
+                    : "CHECK( init(main()), LTL(G ! call(reach_error())) )");
+  witness__data(w, "programfile", w->program.file);
+  witness__data(w, "programhash", w->program.hash);
+  witness__data(w, "architecture",
+                w->program.architecture ? w->program.architecture
+                : sizeof(void *) == 8   ? "64bit"
+                                        : "32bit");
+  // ISO 8601, in UTC
+  char now[32];
+  time_t t = time(NULL);
+  struct tm utc;
+  if (gmtime_r(&t, &utc) &&
+      strftime(now, sizeof(now), "%Y-%m-%dT%H:%M:%SZ", &utc))
+    witness__data(w, "creationtime", now);
+  witness__printf(w, "<node id=\"N0\"><data key=\"entry\">true</data>"
+                     "</node>\n");
+}
+
+void witness_input(witness *w, size_t function, size_t pc, uint64_t identifier,
+                   uint64_t value, uint8_t width, uint8_t flags) {
+  size_t length = 0;
+  const char *name = goto_program_string(w->p, identifier, &length);
+  if (!name)
+    name = "", length = 0;
+  // Without the SSA generation
+  size_t symbol = length;
+  while (symbol > 0 && name[symbol - 1] != '#')
+    symbol--;
+  symbol = symbol ? symbol - 1 : length;
+  size_t nondet_length = 0;
+  const char *nondet = goto_program_string(w->p, w->nondet, &nondet_length);
+  _Bool result = nondet && symbol == nondet_length &&
+                 !memcmp(name, nondet, nondet_length);
+
+  if (w->format == WITNESS_JSON) {
+    witness__json_step(w, "input", function, pc);
+    witness__printf(w, ", \"symbol\": \"");
+    witness__text(w, name, symbol);
+    witness__printf(w, "\", \"value\": ");
+    witness__value(w, value, width, flags);
+    witness__printf(w, "}");
+  } else {
+    witness__edge(w, function, pc);
+    if (result && function < w->p->function_count) {
+      witness__printf(w, "<data key=\"assumption.resultfunction\">");
+      witness__string(w, w->p->functions[function].name);
+      witness__printf(w, "</data>\n");
+    }
+    witness__printf(w, "<data key=\"assumption\">");
+    if (result) {
+      witness__printf(w, "\\result");
+    } else {
+      // The C name, after the last scope
+      size_t base = symbol;
+      while (base > 1 && !(name[base - 1] == ':' && name[base - 2] == ':'))
+        base--;
+      if (base <= 1)
+        base = 0;
+      witness__text(w, name + base, symbol - base);
+    }
+    witness__printf(w, " == ");
+    witness__value(w, value, width, flags);
+    witness__printf(w, ";</data>\n</edge>\n");
+  }
+  w->steps++;
+}
+
+void witness_violation(witness *w, size_t function, size_t pc) {
+  if (w->format == WITNESS_JSON) {
+    witness__json_step(w, "violation", function, pc);
+    witness__printf(w, "}");
+  } else {
+    witness__printf(w, "<node id=\"N%zu\"><data key=\"violation\">true</data>"
+                       "</node>\n",
+                    w->steps + 1);
+    witness__printf(w, "<edge source=\"N%zu\" target=\"N%zu\">\n", w->steps,
+                    w->steps + 1);
+    uint64_t file, line;
+    if (witness__location(w, function, pc, &file, &line) && line != IREP_NIL) {
+      witness__printf(w, "<data key=\"startline\">");
+      witness__string(w, line);
+      witness__printf(w, "</data>\n");
+    }
+    witness__printf(w, "</edge>\n");
+  }
+  w->steps++;
+}
+
+_Bool witness_end(witness *w) {
+  if (w->format == WITNESS_JSON)
+    witness__printf(w, "\n], \"length\": %zu}\n", w->steps);
+  else
+    witness__printf(w, "</graph>\n</graphml>\n");
+  w->failed |= fflush(w->out) != 0;
+  return !w->failed;
+}
+
+// FIPS 180-4
+static const uint32_t witness__k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define WITNESS__ROTR(x, n) ((x) >> (n) | (x) << (32 - (n)))
+
+static void witness__sha256_block(uint32_t h[8], const uint8_t block[64]) {
+  uint32_t m[64];
+  for (int i = 0; i < 16; i++)
+    m[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 |
+           (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = WITNESS__ROTR(m[i - 15], 7) ^ WITNESS__ROTR(m[i - 15], 18) ^
+                  m[i - 15] >> 3;
+    uint32_t s1 = WITNESS__ROTR(m[i - 2], 17) ^ WITNESS__ROTR(m[i - 2], 19) ^
+                  m[i - 2] >> 10;
+    m[i] = m[i - 16] + s0 + m[i - 7] + s1;
+  }
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5],
+           g = h[6], k = h[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = k +
+                  (WITNESS__ROTR(e, 6) ^ WITNESS__ROTR(e, 11) ^
+                   WITNESS__ROTR(e, 25)) +
+                  ((e & f) ^ (~e & g)) + witness__k[i] + m[i];
+    uint32_t t2 =
+        (WITNESS__ROTR(a, 2) ^ WITNESS__ROTR(a, 13) ^ WITNESS__ROTR(a, 22)) +
+        ((a & b) ^ (a & c) ^ (b & c));
+    k = g, g = f, f = e, e = d + t1;
+    d = c, c = b, b = a, a = t1 + t2;
+  }
+  h[0] += a, h[1] += b, h[2] += c, h[3] += d;
+  h[4] += e, h[5] += f, h[6] += g, h[7] += k;
+}
+
+// Of the bytes read from f until its end
+static _Bool witness__sha256(FILE *f, char hex[65]) {
+  uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  uint8_t block[64];
+  uint64_t length = 0;
+  size_t n;
+  while ((n = fread(block, 1, sizeof(block), f)) == sizeof(block)) {
+    witness__sha256_block(h, block);
+    length += n;
+  }
+  if (ferror(f))
+    return 0;
+  length += n;
+  // A 1 bit, zeros to 56 bytes into a block and the length in bits
+  block[n++] = 0x80;
+  if (n > 56) {
+    memset(block + n, 0, 64 - n);
+    witness__sha256_block(h, block);
+    n = 0;
+  }
+  memset(block + n, 0, 56 - n);
+  for (int i = 0; i < 8; i++)
+    block[56 + i] = (uint8_t)(length * 8 >> (56 - 8 * i));
+  witness__sha256_block(h, block);
+  for (int i = 0; i < 8; i++)
+    snprintf(hex + 8 * i, 9, "%08x", h[i]);
+  return 1;
+}
+
+_Bool witness_hash_file(const char *path, char hex[65]) {
+  FILE *f = fopen(path, "rb");
+  _Bool ok = f && witness__sha256(f, hex);
+  if (f)
+    fclose(f);
+  if (!ok)
+    fprintf(stderr, "witness: could not read %s\n", path);
+  return ok;
+}
+
+// What was written to f, NUL terminated, NULL if it can not be read
+static char *witness__t_contents(FILE *f) {
+  long size = ftell(f);
+  char *text = size >= 0 ? (char *)malloc((size_t)size + 1) : NULL;
+  if (!text)
+    return NULL;
+  rewind(f);
+  size_t length = fread(text, 1, (size_t)size, f);
+  text[length] = 0;
+  return text;
+}
+
+uint64_t witness_tests() {
+  uint64_t errors = 0;
+
+  printf("Witness suite...\n");
+
+  bytecode__test t;
+  goto_program *p = bytecode__t_program(&t);
+  // main's assertion x == 91 (pc 7) at line 12 of "a<b>.c"
+  irep_named location[] = {
+      {interner_intern(t.strings, "file"), bytecode__t_leaf(&t, "a<b>.c")},
+      {interner_intern(t.strings, "line"), bytecode__t_leaf(&t, "12")},
+  };
+  p->functions[0].instructions[7].source_location =
+      irep_make(t.ireps, interner_intern(t.strings, "source_location"), NULL,
+                0, location, 2);
+  uint64_t x = interner_intern(t.strings, "main::x#3");
+  uint64_t nondet = interner_intern(t.strings, "farol::nondet#12");
+  uint8_t byte = 0;
+
+  {
+    printf("- JSON... ");
+    FILE *f = tmpfile();
+    witness w;
+    _Bool ok = f != NULL;
+    if (ok) {
+      witness_begin(&w, f, WITNESS_JSON, p, NULL);
+      witness_input(&w, 0, 3, x, 0xfffffffb, 32, BYTECODE_SIGNED);
+      witness_input(&w, 1, 0, nondet, 200, 8, byte);
+      witness_violation(&w, 0, 7);
+      ok = witness_end(&w) && w.steps == 3;
+    }
+    char *text = ok ? witness__t_contents(f) : NULL;
+    ok &= text &&
+          !strcmp(text,
+                  "{\"steps\": [\n"
+                  "{\"kind\": \"input\", \"function\": \"main\", \"pc\": 3, "
+                  "\"symbol\": \"main::x\", \"value\": -5},\n"
+                  "{\"kind\": \"input\", \"function\": \"inc\", \"pc\": 0, "
+                  "\"symbol\": \"farol::nondet\", \"value\": 200},\n"
+                  "{\"kind\": \"violation\", \"function\": \"main\", \"pc\": "
+                  "7, \"file\": \"a<b>.c\", \"line\": 12}\n"
+                  "], \"length\": 3}\n");
+    free(text);
+    if (f)
+      fclose(f);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- GraphML... ");
+    FILE *f = tmpfile();
+    witness w;
+    _Bool ok = f != NULL;
+    if (ok) {
+      witness_begin(&w, f, WITNESS_GRAPHML, p,
+                    &(witness_program){.file = "a<b>.c",
+                                       .hash = "ba7816bf",
+                                       .architecture = "32bit"});
+      witness_input(&w, 0, 3, x, 5, 32, BYTECODE_SIGNED);
+      witness_input(&w, 1, 0, nondet, 1, 1, BYTECODE_BOOL);
+      witness_violation(&w, 0, 7);
+      ok = witness_end(&w);
+    }
+    char *text = ok ? witness__t_contents(f) : NULL;
+    ok &= text && strstr(text, "<node id=\"N0\"><data key=\"entry\">true"
+                               "</data></node>\n<node id=\"N1\"/>\n"
+                               "<edge source=\"N0\" target=\"N1\">\n"
+                               "<data key=\"assumption.scope\">main</data>\n"
+                               "<data key=\"assumption\">x == 5;</data>\n"
+                               "</edge>\n") != NULL;
+    ok &= text && strstr(text, "<data key=\"assumption.resultfunction\">inc"
+                               "</data>\n<data key=\"assumption\">\\result "
+                               "== 1;</data>\n") != NULL;
+    ok &= text && strstr(text, "<data key=\"specification\">CHECK( "
+                               "init(main()), LTL(G ! call(reach_error())) )"
+                               "</data>\n<data key=\"programfile\">a&lt;b&gt;"
+                               ".c</data>\n<data key=\"programhash\">"
+                               "ba7816bf</data>\n<data key=\"architecture\">"
+                               "32bit</data>\n<data key=\"creationtime\">") !=
+                      NULL;
+    ok &= text && strstr(text, "<node id=\"N3\"><data key=\"violation\">true"
+                               "</data></node>\n<edge source=\"N2\" "
+                               "target=\"N3\">\n<data key=\"startline\">12"
+                               "</data>\n</edge>\n</graph>\n</graphml>\n") !=
+                      NULL;
+    free(text);
+    if (f)
+      fclose(f);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  {
+    printf("- SHA-256... ");
+    // The examples of FIPS 180-4, the second one pads into a block of its own
+    const char *inputs[] = {
+        "", "abc", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"};
+    const char *hashes[] = {
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"};
+    _Bool ok = 1;
+    for (int i = 0; i < 3; i++) {
+      FILE *f = tmpfile();
+      char hex[65] = {0};
+      ok &= f && fputs(inputs[i], f) >= 0;
+      if (f)
+        rewind(f);
+      ok = ok && witness__sha256(f, hex) && !strcmp(hex, hashes[i]);
+      if (f)
+        fclose(f);
+    }
+    char hex[65];
+    ok &= !witness_hash_file("/nonexistent/farol.c", hex);
+
+    if (!ok) {
+      printf("FAIL\n");
+      errors++;
+    } else {
+      printf("OK\n");
+    }
+  }
+
+  goto_program_destroy(p);
+  irep_store_destroy(t.ireps);
+  interner_destroy(t.strings);
+  return errors;
+}
+
+#endif
+#endif